@@ -0,0 +1,27 @@
+// Only valid when the device supports descriptor indexing, see BindlessDescriptors.
+// Bound after the frame, lighting and draw sets. Including shaders enable
+// GL_EXT_nonuniform_qualifier before any declaration.
+
+const int MaxMaterialDataMembers = 12;
+const int MaxMaterialTextures = 8;
+const uint NoTexture = 0xFFFFFFFFu;
+
+// data members each use one vec4 slot, reinterpret with uintBitsToFloat for float members
+struct MaterialData
+{
+	uvec4 data[MaxMaterialDataMembers];
+	uint textures[MaxMaterialTextures];
+};
+
+layout (set = 3, binding = 0) uniform sampler2D bindless_textures[];
+
+layout (std430, set = 3, binding = 1) readonly buffer MaterialBuffer
+{
+	MaterialData materials[];
+};
+
+vec4 sample_material_texture (uint material, uint slot, vec2 uv)
+{
+	if (materials[material].textures[slot] == NoTexture) return vec4 (1.0);
+	return texture (bindless_textures[nonuniformEXT (materials[material].textures[slot])], uv);
+}
@@ -1,9 +1,17 @@
+// needs GL_EXT_multiview for gl_ViewIndex, which has to be enabled at the top of the shader before
+// anything else
 
-layout (set = 0, binding = 1) uniform CameraData
+struct CameraData
 {
 	mat4 proj_view;
 	mat4 view;
 	vec3 camera_dir;
 	vec3 camera_pos;
-}
-cam;
\ No newline at end of file
+	vec4 padding[6];
+};
+
+// bound at the camera being drawn from, in multiview passes the other views' cameras follow it
+layout (set = 0, binding = 1) uniform CameraBuffer { CameraData views[2]; }
+cameras;
+
+#define cam cameras.views[gl_ViewIndex]
@@ -0,0 +1,11 @@
+
+// Matches DrawData in MeshRenderer.h
+struct DrawData
+{
+	mat4 transform;
+	vec4 bounds; // object space sphere, w is the radius
+	uint index_count;
+	uint first_index;
+	int vertex_offset;
+	uint material_index;
+};
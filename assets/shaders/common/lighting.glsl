@@ -2,43 +2,227 @@
 
 #include "pbr_func.glsl"
 
-const int DirectionalLightCount = 5;
-const int PointLightCount = 10;
-const int SpotLightCount = 10;
+// Needs camera.glsl included first. Lights are binned into a froxel grid on the CPU each frame,
+// a fragment finds its cluster from gl_FragCoord and its view depth and only shades the lights
+// listed there. The first directional light is shadowed by cascaded shadow maps. The layouts
+// match Lighting.h, LightClusters.h, ShadowCascades.h, Atmosphere.h and IBL.h.
 
 struct DirectionalLight
 {
 	vec3 direction;
-	vec3 color;
 	float intensity;
+	vec3 color;
+	float padding;
 };
 
 struct PointLight
 {
 	vec3 position;
+	float range;
 	vec3 color;
 	float intensity;
-	float cutOff;
 };
 
 struct SpotLight
 {
 	vec3 position;
+	float range;
+	vec3 direction;
+	float cos_inner;
 	vec3 color;
-	float attenuation;
-	float cutoff;
-	float outerCutOff;
+	float intensity;
+	float cos_outer;
+	float padding_0;
+	float padding_1;
+	float padding_2;
 };
 
-layout (set = 1, binding = 0) uniform DirectionalLightData { DirectionalLight lights[1]; }
+struct ClusterParams
+{
+	uint tiles_x;
+	uint tiles_y;
+	uint slices;
+	uint directional_count;
+	float viewport_width;
+	float viewport_height;
+	float depth_scale;
+	float depth_bias;
+	float depth_sign;
+	uint point_count;
+	uint spot_count;
+	uint padding;
+};
+
+// point light indices start at offset, followed by the spot light indices
+struct Cluster
+{
+	uint offset;
+	uint point_count;
+	uint spot_count;
+	uint padding;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer DirectionalLightData { DirectionalLight lights[]; }
 directional;
 
-layout (set = 1, binding = 1) uniform PointLightData { PointLight lights[PointLightCount]; }
+layout (std430, set = 1, binding = 1) readonly buffer PointLightData { PointLight lights[]; }
 point;
 
-layout (set = 1, binding = 2) uniform SpotLightData { SpotLight lights[SpotLightCount]; }
+layout (std430, set = 1, binding = 2) readonly buffer SpotLightData { SpotLight lights[]; }
 spot;
 
+layout (std430, set = 1, binding = 3) readonly buffer ClusterData
+{
+	ClusterParams params;
+	Cluster clusters[];
+}
+cluster_grid;
+
+layout (std430, set = 1, binding = 4) readonly buffer LightIndexData { uint indices[]; }
+light_indices;
+
+#define MAX_SHADOW_CASCADES 4
+
+struct ShadowData
+{
+	mat4 proj_view[MAX_SHADOW_CASCADES];
+	vec4 split_depths; // far view depth of each cascade
+	vec4 texel_sizes; // world size of a texel in each cascade
+	uint cascade_count;
+	float depth_bias;
+	float normal_bias; // in texels
+	uint padding;
+};
+
+layout (std430, set = 1, binding = 5) readonly buffer ShadowBuffer { ShadowData data; }
+shadows;
+
+// reversed depth, the comparison passes when the fragment is at least as close to the light
+layout (set = 1, binding = 6) uniform sampler2DShadow shadow_maps[MAX_SHADOW_CASCADES];
+
+// irradiance as cosine convolved L1 spherical harmonics, the w components are unused
+struct AmbientProbe
+{
+	vec4 constant;
+	vec4 x;
+	vec4 y;
+	vec4 z;
+};
+
+layout (std430, set = 1, binding = 7) readonly buffer AmbientBuffer { AmbientProbe probe; }
+ambient;
+
+// irradiance arriving at a surface facing N from the sky and ground around it
+vec3 AmbientIrradiance (vec3 N)
+{
+	AmbientProbe probe = ambient.probe;
+	vec3 irradiance = probe.constant.rgb + probe.x.rgb * N.x + probe.y.rgb * N.y + probe.z.rgb * N.z;
+	return max (irradiance, vec3 (0.0));
+}
+
+// Irradiance as cosine convolved L2 spherical harmonics with the basis constants folded in, the w
+// components are unused. The specular cube has one mip per roughness step.
+struct EnvironmentData
+{
+	vec4 sh[9];
+	float specular_mips;
+	float intensity;
+	uint enabled;
+	float padding;
+};
+
+layout (std430, set = 1, binding = 8) readonly buffer EnvironmentBuffer { EnvironmentData data; }
+environment;
+
+layout (set = 1, binding = 9) uniform samplerCube environment_specular;
+
+// split sum scale and bias of F0, u is N dot V and v the roughness
+layout (set = 1, binding = 10) uniform sampler2D environment_brdf;
+
+vec3 EnvironmentIrradiance (vec3 N)
+{
+	EnvironmentData env = environment.data;
+	vec3 irradiance = env.sh[0].rgb;
+	irradiance += env.sh[1].rgb * N.y + env.sh[2].rgb * N.z + env.sh[3].rgb * N.x;
+	irradiance += env.sh[4].rgb * (N.x * N.y) + env.sh[5].rgb * (N.y * N.z) + env.sh[7].rgb * (N.x * N.z);
+	irradiance += env.sh[6].rgb * (3.0 * N.z * N.z - 1.0) + env.sh[8].rgb * (N.x * N.x - N.y * N.y);
+	return max (irradiance, vec3 (0.0)) * env.intensity;
+}
+
+// Light from everything around the surface: diffuse and specular from the environment maps when
+// they are set, diffuse from the ambient probe otherwise
+vec3 AmbientLighting (vec3 N, vec3 V, vec3 F0, vec3 albedo, float roughness, float metalness)
+{
+	vec3 diffuse = albedo / PI * (1.0 - metalness);
+	if (environment.data.enabled == 0) return AmbientIrradiance (N) * diffuse;
+
+	float NdotV = max (dot (N, V), 0.0);
+	vec2 split_sum = texture (environment_brdf, vec2 (NdotV, roughness)).rg;
+	vec3 specular_albedo = F0 * split_sum.x + split_sum.y;
+
+	vec3 R = reflect (-V, N);
+	float lod = roughness * (environment.data.specular_mips - 1.0);
+	vec3 prefiltered = textureLod (environment_specular, R, lod).rgb * environment.data.intensity;
+
+	// what the specular lobe reflects doesn't reach the diffuse layer
+	return EnvironmentIrradiance (N) * diffuse * (vec3 (1.0) - specular_albedo) + prefiltered * specular_albedo;
+}
+
+Cluster FindCluster (vec3 Pos)
+{
+	ClusterParams params = cluster_grid.params;
+	float depth = max (params.depth_sign * (cam.view * vec4 (Pos, 1.0)).z, 1e-6);
+	uint slice = uint (clamp (floor (log (depth) * params.depth_scale + params.depth_bias), 0.0, float (params.slices - 1)));
+	uvec2 tile = uvec2 (gl_FragCoord.xy / vec2 (params.viewport_width, params.viewport_height) *
+	                    vec2 (params.tiles_x, params.tiles_y));
+	tile = min (tile, uvec2 (params.tiles_x - 1, params.tiles_y - 1));
+	return cluster_grid.clusters[(slice * params.tiles_y + tile.y) * params.tiles_x + tile.x];
+}
+
+// neighbouring fragments can pick different cascades, so only constant indices are used
+float SampleShadowMap (uint cascade, vec3 coord)
+{
+	if (cascade == 0) return texture (shadow_maps[0], coord);
+	if (cascade == 1) return texture (shadow_maps[1], coord);
+	if (cascade == 2) return texture (shadow_maps[2], coord);
+	return texture (shadow_maps[3], coord);
+}
+
+// 1 is fully lit
+float ShadowFactor (vec3 N, vec3 L, vec3 Pos)
+{
+	uint count = shadows.data.cascade_count;
+	if (count == 0) return 1.0;
+
+	float depth = cluster_grid.params.depth_sign * (cam.view * vec4 (Pos, 1.0)).z;
+	uint cascade = 0;
+	while (cascade < count && depth > shadows.data.split_depths[cascade])
+		cascade++;
+	if (cascade == count) return 1.0;
+
+	// pushing the position out along the normal hides acne on surfaces facing away from the light
+	float NdotL = clamp (dot (N, L), 0.0, 1.0);
+	float offset = shadows.data.texel_sizes[cascade] * shadows.data.normal_bias * sqrt (1.0 - NdotL * NdotL);
+	vec4 clip = shadows.data.proj_view[cascade] * vec4 (Pos + N * offset, 1.0);
+	vec3 coord = vec3 (clip.xy * 0.5 + 0.5, clip.z + shadows.data.depth_bias);
+
+	// four bilinear compares cover a 3x3 texel footprint
+	vec2 texel = 1.0 / vec2 (textureSize (shadow_maps[0], 0));
+	float lit = 0.0;
+	lit += SampleShadowMap (cascade, vec3 (coord.xy + vec2 (-0.5, -0.5) * texel, coord.z));
+	lit += SampleShadowMap (cascade, vec3 (coord.xy + vec2 (0.5, -0.5) * texel, coord.z));
+	lit += SampleShadowMap (cascade, vec3 (coord.xy + vec2 (-0.5, 0.5) * texel, coord.z));
+	lit += SampleShadowMap (cascade, vec3 (coord.xy + vec2 (0.5, 0.5) * texel, coord.z));
+	return lit * 0.25;
+}
+
+// inverse square falloff, smoothly windowed to reach zero at range
+float RangeAttenuation (float separation, float range)
+{
+	float ratio = separation / range;
+	float window = clamp (1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+	return window * window / max (separation * separation, 1e-4);
+}
 
 vec3 DirectionalLightingCalc (
     DirectionalLight dl, vec3 N, vec3 V, vec3 F0, vec3 albedo, float roughness, float metalness)
@@ -55,24 +239,44 @@ vec3 PointLightingCalc (PointLight pl, vec3 N, vec3 V, vec3 F0, vec3 Pos, vec3 a
 	// calculate per-light radiance
 	vec3 L = normalize (pl.position - Pos);
 	vec3 H = normalize (V + L);
-	float separation = distance (pl.position, Pos);
-	float attenuation = 1.0 / (separation * separation);
+	float attenuation = RangeAttenuation (distance (pl.position, Pos), pl.range);
 	vec3 radiance = pl.color * pl.intensity * attenuation;
 	return PBR_Calc (N, V, F0, L, H, radiance, albedo, roughness, metalness);
 }
 
+vec3 SpotLightingCalc (SpotLight sl, vec3 N, vec3 V, vec3 F0, vec3 Pos, vec3 albedo, float roughness, float metalness)
+{
+	vec3 L = normalize (sl.position - Pos);
+	vec3 H = normalize (V + L);
+	float cone = smoothstep (sl.cos_outer, sl.cos_inner, dot (-L, normalize (sl.direction)));
+	float attenuation = RangeAttenuation (distance (sl.position, Pos), sl.range) * cone;
+	vec3 radiance = sl.color * sl.intensity * attenuation;
+	return PBR_Calc (N, V, F0, L, H, radiance, albedo, roughness, metalness);
+}
+
 vec3 LightingContribution (vec3 N, vec3 V, vec3 F0, vec3 Pos, vec3 albedo, float roughness, float metalness)
 {
 	vec3 Lo = vec3 (0.0);
-	for (int i = 0; i < DirectionalLightCount; ++i)
+	for (uint i = 0; i < cluster_grid.params.directional_count; ++i)
 	{
-		Lo += DirectionalLightingCalc (directional.lights[i], N, V, F0, albedo, roughness, metalness);
+		vec3 contribution = DirectionalLightingCalc (directional.lights[i], N, V, F0, albedo, roughness, metalness);
+		if (i == 0) contribution *= ShadowFactor (N, normalize (directional.lights[0].direction), Pos);
+		Lo += contribution;
 	}
 
-	for (int i = 0; i < PointLightCount; ++i)
+	Cluster cluster = FindCluster (Pos);
+	for (uint i = 0; i < cluster.point_count; ++i)
 	{
-		Lo += PointLightingCalc (point.lights[i], N, V, F0, Pos, albedo, roughness, metalness);
+		uint index = light_indices.indices[cluster.offset + i];
+		Lo += PointLightingCalc (point.lights[index], N, V, F0, Pos, albedo, roughness, metalness);
+	}
+
+	uint spot_offset = cluster.offset + cluster.point_count;
+	for (uint i = 0; i < cluster.spot_count; ++i)
+	{
+		uint index = light_indices.indices[spot_offset + i];
+		Lo += SpotLightingCalc (spot.lights[index], N, V, F0, Pos, albedo, roughness, metalness);
 	}
 
 	return Lo;
-}
\ No newline at end of file
+}
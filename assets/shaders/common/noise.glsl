@@ -0,0 +1,245 @@
+// GLSL versions of the FastNoiseSIMD generators the terrain node graph uses, so graphs compiled by
+// GraphCodegen give the same values as InternalGraph on the CPU. Every function takes the
+// coordinate already multiplied by the frequency and returns roughly -1 to 1.
+
+const int NoisePrimeX = 1619;
+const int NoisePrimeY = 31337;
+const int NoisePrimeZ = 6971;
+const ivec3 NoisePrimes = ivec3 (NoisePrimeX, NoisePrimeY, NoisePrimeZ);
+
+// NoiseKind values, match the order GraphCodegen writes
+const int NoiseValue = 0;
+const int NoisePerlin = 1;
+const int NoiseSimplex = 2;
+const int NoiseCubic = 3;
+
+// FractalType, same numbering as the graph's fractal input
+const int FractalFBM = 0;
+const int FractalBillow = 1;
+const int FractalRigidMulti = 2;
+
+// CellularReturnType, same numbering as the graph's cellular return input
+const int CellValue = 0;
+const int CellDistance = 1;
+const int CellDistance2 = 2;
+const int CellDistance2Add = 3;
+const int CellDistance2Sub = 4;
+const int CellDistance2Mul = 5;
+const int CellDistance2Div = 6;
+const int CellDistance2Cave = 7;
+
+// integer math wraps like the SIMD lanes do, shifts are logical like _mm_srli_epi32
+int NoiseHash (int seed, ivec3 p)
+{
+	int hash = seed ^ p.x ^ p.y ^ p.z;
+	hash = hash * hash * 60493 * hash;
+	return int (uint (hash) >> 13) ^ hash;
+}
+
+float NoiseValCoord (int seed, ivec3 p)
+{
+	int hash = seed ^ p.x ^ p.y ^ p.z;
+	hash = hash * hash * 60493 * hash;
+	return float (hash) * (1.0 / 2147483648.0);
+}
+
+float NoiseGradCoord (int seed, ivec3 p, vec3 f)
+{
+	int hash = NoiseHash (seed, p);
+	int h = hash & 13;
+	float u = h < 8 ? f.x : f.y;
+	float v = h < 2 ? f.y : (h == 12 ? f.x : f.z);
+	u = (hash & 1) != 0 ? -u : u;
+	v = (hash & 2) != 0 ? -v : v;
+	return u + v;
+}
+
+vec3 NoiseQuintic (vec3 t) { return t * t * t * (t * (t * 6.0 - 15.0) + 10.0); }
+
+float NoiseCubicLerp (float a, float b, float c, float d, float t)
+{
+	float p = (d - c) - (a - b);
+	return t * t * t * p + t * t * ((a - b) - p) + t * (c - a) + b;
+}
+
+float ValueSingle (int seed, vec3 pos)
+{
+	vec3 fl = floor (pos);
+	ivec3 p0 = ivec3 (fl) * NoisePrimes;
+	ivec3 p1 = p0 + NoisePrimes;
+	vec3 s = NoiseQuintic (pos - fl);
+
+	float x00 = mix (NoiseValCoord (seed, ivec3 (p0.x, p0.y, p0.z)), NoiseValCoord (seed, ivec3 (p1.x, p0.y, p0.z)), s.x);
+	float x10 = mix (NoiseValCoord (seed, ivec3 (p0.x, p1.y, p0.z)), NoiseValCoord (seed, ivec3 (p1.x, p1.y, p0.z)), s.x);
+	float x01 = mix (NoiseValCoord (seed, ivec3 (p0.x, p0.y, p1.z)), NoiseValCoord (seed, ivec3 (p1.x, p0.y, p1.z)), s.x);
+	float x11 = mix (NoiseValCoord (seed, ivec3 (p0.x, p1.y, p1.z)), NoiseValCoord (seed, ivec3 (p1.x, p1.y, p1.z)), s.x);
+	return mix (mix (x00, x10, s.y), mix (x01, x11, s.y), s.z);
+}
+
+float PerlinSingle (int seed, vec3 pos)
+{
+	vec3 fl = floor (pos);
+	ivec3 p0 = ivec3 (fl) * NoisePrimes;
+	ivec3 p1 = p0 + NoisePrimes;
+	vec3 f0 = pos - fl;
+	vec3 f1 = f0 - 1.0;
+	vec3 s = NoiseQuintic (f0);
+
+	float x00 = mix (NoiseGradCoord (seed, ivec3 (p0.x, p0.y, p0.z), vec3 (f0.x, f0.y, f0.z)),
+	    NoiseGradCoord (seed, ivec3 (p1.x, p0.y, p0.z), vec3 (f1.x, f0.y, f0.z)),
+	    s.x);
+	float x10 = mix (NoiseGradCoord (seed, ivec3 (p0.x, p1.y, p0.z), vec3 (f0.x, f1.y, f0.z)),
+	    NoiseGradCoord (seed, ivec3 (p1.x, p1.y, p0.z), vec3 (f1.x, f1.y, f0.z)),
+	    s.x);
+	float x01 = mix (NoiseGradCoord (seed, ivec3 (p0.x, p0.y, p1.z), vec3 (f0.x, f0.y, f1.z)),
+	    NoiseGradCoord (seed, ivec3 (p1.x, p0.y, p1.z), vec3 (f1.x, f0.y, f1.z)),
+	    s.x);
+	float x11 = mix (NoiseGradCoord (seed, ivec3 (p0.x, p1.y, p1.z), vec3 (f0.x, f1.y, f1.z)),
+	    NoiseGradCoord (seed, ivec3 (p1.x, p1.y, p1.z), vec3 (f1.x, f1.y, f1.z)),
+	    s.x);
+	return mix (mix (x00, x10, s.y), mix (x01, x11, s.y), s.z);
+}
+
+float SimplexCorner (int seed, ivec3 p, vec3 f)
+{
+	float t = 0.6 - dot (f, f);
+	if (t <= 0.0) return 0.0;
+	t *= t;
+	return t * t * NoiseGradCoord (seed, p, f);
+}
+
+float SimplexSingle (int seed, vec3 pos)
+{
+	const float F3 = 1.0 / 3.0;
+	const float G3 = 1.0 / 6.0;
+
+	vec3 cell = floor (pos + (pos.x + pos.y + pos.z) * F3);
+	vec3 f0 = pos - (cell - (cell.x + cell.y + cell.z) * G3);
+
+	// which of the six tetrahedra the point is in
+	vec3 g = step (f0.yzx, f0.xyz);
+	vec3 l = 1.0 - g;
+	vec3 i1 = min (g, l.zxy);
+	vec3 i2 = max (g, l.zxy);
+
+	vec3 f1 = f0 - i1 + G3;
+	vec3 f2 = f0 - i2 + 2.0 * G3;
+	vec3 f3 = f0 - 1.0 + 3.0 * G3;
+
+	ivec3 p0 = ivec3 (cell) * NoisePrimes;
+	return 32.0 * (SimplexCorner (seed, p0, f0) + SimplexCorner (seed, p0 + ivec3 (i1) * NoisePrimes, f1) +
+	                  SimplexCorner (seed, p0 + ivec3 (i2) * NoisePrimes, f2) + SimplexCorner (seed, p0 + NoisePrimes, f3));
+}
+
+float CubicSingle (int seed, vec3 pos)
+{
+	const float CubicBounding = 1.0 / (1.5 * 1.5 * 1.5);
+	vec3 fl = floor (pos);
+	ivec3 p1 = ivec3 (fl) * NoisePrimes;
+	vec3 s = pos - fl;
+
+	float zs[4];
+	for (int z = 0; z < 4; z++)
+	{
+		float ys[4];
+		for (int y = 0; y < 4; y++)
+		{
+			int py = p1.y + (y - 1) * NoisePrimeY;
+			int pz = p1.z + (z - 1) * NoisePrimeZ;
+			ys[y] = NoiseCubicLerp (NoiseValCoord (seed, ivec3 (p1.x - NoisePrimeX, py, pz)),
+			    NoiseValCoord (seed, ivec3 (p1.x, py, pz)),
+			    NoiseValCoord (seed, ivec3 (p1.x + NoisePrimeX, py, pz)),
+			    NoiseValCoord (seed, ivec3 (p1.x + 2 * NoisePrimeX, py, pz)),
+			    s.x);
+		}
+		zs[z] = NoiseCubicLerp (ys[0], ys[1], ys[2], ys[3], s.y);
+	}
+	return NoiseCubicLerp (zs[0], zs[1], zs[2], zs[3], s.z) * CubicBounding;
+}
+
+float NoiseSingle (int kind, int seed, vec3 pos)
+{
+	switch (kind)
+	{
+		case NoiseValue: return ValueSingle (seed, pos);
+		case NoisePerlin: return PerlinSingle (seed, pos);
+		case NoiseSimplex: return SimplexSingle (seed, pos);
+		case NoiseCubic: return CubicSingle (seed, pos);
+	}
+	return 0.0;
+}
+
+// lacunarity is FastNoiseSIMD's default of 2, every octave uses the next seed
+float NoiseFractal (int kind, int seed, vec3 pos, int octaves, float gain, int fractal_type)
+{
+	float amp = gain;
+	float amp_total = 1.0;
+	for (int i = 1; i < octaves; i++)
+	{
+		amp_total += amp;
+		amp *= gain;
+	}
+	float bounding = 1.0 / amp_total;
+
+	float n = NoiseSingle (kind, seed, pos);
+	float result = fractal_type == FractalFBM ? n : (fractal_type == FractalBillow ? abs (n) * 2.0 - 1.0 : 1.0 - abs (n));
+	amp = 1.0;
+	for (int i = 1; i < octaves; i++)
+	{
+		pos *= 2.0;
+		seed++;
+		amp *= gain;
+		n = NoiseSingle (kind, seed, pos);
+		if (fractal_type == FractalFBM)
+			result += n * amp;
+		else if (fractal_type == FractalBillow)
+			result += (abs (n) * 2.0 - 1.0) * amp;
+		else
+			result -= (1.0 - abs (n)) * amp;
+	}
+	return fractal_type == FractalRigidMulti ? result : result * bounding;
+}
+
+float WhiteNoise (int seed, vec3 pos)
+{
+	ivec3 bits = floatBitsToInt (pos);
+	bits ^= ivec3 (uvec3 (bits) >> 16);
+	return NoiseValCoord (seed, bits * NoisePrimes);
+}
+
+// euclidean distances are squared, as FastNoiseSIMD does
+float CellularNoise (int seed, vec3 pos, float jitter, int return_type)
+{
+	ivec3 center = ivec3 (round (pos));
+	float distance = 999999.0;
+	float distance2 = 999999.0;
+	float cell_value = 0.0;
+
+	for (int x = -1; x <= 1; x++)
+		for (int y = -1; y <= 1; y++)
+			for (int z = -1; z <= 1; z++)
+			{
+				ivec3 cell = center + ivec3 (x, y, z);
+				int hash = NoiseHash (seed, cell * NoisePrimes);
+				vec3 offset = vec3 (float (hash & 1023), float ((hash >> 10) & 1023), float ((hash >> 20) & 1023)) - 511.5;
+				vec3 d = offset * (jitter * inversesqrt (dot (offset, offset))) + (vec3 (cell) - pos);
+				float new_distance = dot (d, d);
+
+				if (new_distance < distance) cell_value = NoiseValCoord (seed, cell * NoisePrimes);
+				distance2 = max (min (distance2, new_distance), distance);
+				distance = min (distance, new_distance);
+			}
+
+	switch (return_type)
+	{
+		case CellValue: return cell_value;
+		case CellDistance: return distance - 1.0;
+		case CellDistance2: return distance2 - 1.0;
+		case CellDistance2Add: return distance2 + distance - 1.0;
+		case CellDistance2Sub: return distance2 - distance - 1.0;
+		case CellDistance2Mul: return distance2 * distance - 1.0;
+		case CellDistance2Div: return distance / distance2 - 1.0;
+		case CellDistance2Cave: return clamp (distance / distance2 * 2.0 - 1.0, -1.0, 1.0);
+	}
+	return 0.0;
+}
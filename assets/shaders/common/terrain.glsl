@@ -0,0 +1,68 @@
+// Vertex side of the terrain, shared by terrain.vert and terrain_shadow.vert so the shadow casters
+// match the drawn surface
+
+// Matches TerrainPatch in TerrainLOD.h
+struct TerrainPatch
+{
+	vec4 offset_size; // x and z of the corner, world size, lod
+	vec4 morph; // morph start and end distance
+};
+
+// every tile's samples, tile after tile, each in x major order
+layout (std430, set = 2, binding = 0) readonly buffer HeightData { float heights[]; };
+
+// firstInstance of each quadrant's draw is its first patch in this array
+layout (std430, set = 2, binding = 1) readonly buffer PatchData { TerrainPatch patches[]; };
+
+// Matches TerrainPushConstants in TerrainRenderer.cpp
+layout (push_constant) uniform TerrainParams
+{
+	mat4 shadow_proj_view; // the cascade being rendered, unused by the main pass
+	vec3 lod_origin; // the camera the patches were selected and morph for
+	float grid_resolution;
+	vec2 origin;
+	float world_size;
+	float height_scale;
+	uint tile_count;
+	uint tile_samples;
+}
+terrain;
+
+float Sample (uvec2 pos)
+{
+	uint edge = terrain.tile_samples - 1;
+	uvec2 tile = min (pos / edge, uvec2 (terrain.tile_count - 1));
+	uvec2 local = pos - tile * edge;
+	uint tile_index = tile.y * terrain.tile_count + tile.x;
+	return heights[(tile_index * terrain.tile_samples + local.x) * terrain.tile_samples + local.y];
+}
+
+// bilinear like TerrainQuadtree::get_height
+float Height (vec2 world_xz)
+{
+	float last_sample = float (terrain.tile_count * (terrain.tile_samples - 1));
+	vec2 pos = clamp ((world_xz - terrain.origin) / terrain.world_size * last_sample, vec2 (0.0), vec2 (last_sample));
+	uvec2 base = min (uvec2 (pos), uvec2 (last_sample - 1.0));
+	vec2 t = pos - vec2 (base);
+
+	float h0 = mix (Sample (base), Sample (base + uvec2 (1, 0)), t.x);
+	float h1 = mix (Sample (base + uvec2 (0, 1)), Sample (base + uvec2 (1, 1)), t.x);
+	return mix (h0, h1, t.y) * terrain.height_scale;
+}
+
+// World position of a grid vertex of the instance's patch. Odd grid vertices slide onto their even
+// neighbours as the morph goes to 1, which gives the grid of the next coarser level.
+vec3 TerrainPosition (vec2 grid)
+{
+	TerrainPatch patch_data = patches[gl_InstanceIndex];
+	float size = patch_data.offset_size.z;
+
+	vec2 world_xz = patch_data.offset_size.xy + grid * size;
+	float dist = distance (terrain.lod_origin, vec3 (world_xz.x, Height (world_xz), world_xz.y));
+	float morph = clamp ((dist - patch_data.morph.x) / (patch_data.morph.y - patch_data.morph.x), 0.0, 1.0);
+
+	vec2 odd = fract (grid * terrain.grid_resolution * 0.5) * 2.0 / terrain.grid_resolution;
+	grid -= odd * morph;
+	world_xz = patch_data.offset_size.xy + grid * size;
+	return vec3 (world_xz.x, Height (world_xz), world_xz.y);
+}
@@ -0,0 +1,103 @@
+// Shared part of the compute shaders GraphCodegen writes. The generated code defines
+// GraphEvaluate, this runs it once per terrain sample and writes the results straight into
+// TerrainRenderer's height buffer and splat map.
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// every tile's samples, tile after tile, each in x major order
+layout (std430, set = 0, binding = 0) writeonly buffer HeightData { float heights[]; };
+layout (set = 0, binding = 1, rgba8) uniform writeonly image2D splat_map;
+// min and max scaled height of every leaf node, in z then x order, as order preserving uints
+layout (std430, set = 0, binding = 2) buffer LeafBounds { uint leaf_bounds[]; };
+
+// Matches GraphPushConstants in TerrainRenderer.cpp
+layout (push_constant) uniform GraphParams
+{
+	uint tile_count;
+	uint tile_samples;
+	uint leaf_count; // leaf nodes along each side
+	float scale; // noise coordinate of a sample is its index times scale
+	float height_scale;
+	float padding[3];
+}
+graph;
+
+void GraphEvaluate (ivec2 cell, out float height, out vec4 splat);
+
+// Selector node, the same branches as InternalGraph's
+float GraphSelect (float value, float a, float b, float lower, float upper, float smooth_width)
+{
+	float half_width = smooth_width / 2.0;
+	if (smooth_width == 0.0) return value < lower && value > upper ? a : b;
+	if (value < lower - half_width) return a;
+	if (value < lower + half_width)
+	{
+		float t = (value - (lower - half_width)) / smooth_width;
+		return t * b + (1.0 - t) * a;
+	}
+	if (value <= upper - half_width) return b;
+	if (value <= upper + half_width)
+	{
+		float t = ((upper + half_width) - value) / smooth_width;
+		return t * b + (1.0 - t) * a;
+	}
+	return a;
+}
+
+uint OrderedBits (float value)
+{
+	uint bits = floatBitsToUint (value);
+	return (bits & 0x80000000u) != 0u ? ~bits : bits | 0x80000000u;
+}
+
+// the tiles along one axis whose samples include index, edge samples belong to two
+uvec2 TileRange (uint index)
+{
+	uint edge = graph.tile_samples - 1;
+	uint last = min (index / edge, graph.tile_count - 1);
+	uint first = index > 0 && index % edge == 0 ? index / edge - 1 : last;
+	return uvec2 (first, last);
+}
+
+void main ()
+{
+	uint last_sample = graph.tile_count * (graph.tile_samples - 1);
+	uvec2 cell = gl_GlobalInvocationID.xy;
+	if (cell.x > last_sample || cell.y > last_sample) return;
+
+	float height;
+	vec4 splat;
+	GraphEvaluate (ivec2 (cell), height, splat);
+	imageStore (splat_map, ivec2 (cell), splat);
+
+	uvec2 tiles_x = TileRange (cell.x);
+	uvec2 tiles_z = TileRange (cell.y);
+	uint edge = graph.tile_samples - 1;
+	for (uint tz = tiles_z.x; tz <= tiles_z.y; tz++)
+		for (uint tx = tiles_x.x; tx <= tiles_x.y; tx++)
+		{
+			uvec2 local = cell - uvec2 (tx, tz) * edge;
+			uint tile_index = tz * graph.tile_count + tx;
+			heights[(tile_index * graph.tile_samples + local.x) * graph.tile_samples + local.y] = height;
+		}
+
+	// a leaf covers the samples from floor of its start to ceil of its end, like
+	// TerrainQuadtree::update_bounds scans them
+	float leaf_samples = float (last_sample) / float (graph.leaf_count);
+	uint bits = OrderedBits (height * graph.height_scale);
+	int center_x = int (float (cell.x) / leaf_samples);
+	int center_z = int (float (cell.y) / leaf_samples);
+	for (int lz = max (center_z - 1, 0); lz <= min (center_z + 1, int (graph.leaf_count) - 1); lz++)
+	{
+		if (float (cell.y) < floor (float (lz) * leaf_samples) || float (cell.y) > ceil (float (lz + 1) * leaf_samples))
+			continue;
+		for (int lx = max (center_x - 1, 0); lx <= min (center_x + 1, int (graph.leaf_count) - 1); lx++)
+		{
+			if (float (cell.x) < floor (float (lx) * leaf_samples) || float (cell.x) > ceil (float (lx + 1) * leaf_samples))
+				continue;
+			uint index = (uint (lz) * graph.leaf_count + uint (lx)) * 2;
+			atomicMin (leaf_bounds[index], bits);
+			atomicMax (leaf_bounds[index + 1], bits);
+		}
+	}
+}
@@ -0,0 +1,16 @@
+// Blends the terrain layers, grass, rock, snow and dirt, by the weights of a splat map texel.
+// terrain.frag blends per pixel, terrain_vt_composite.comp once per virtual texture page texel.
+void TerrainMaterial (vec4 splat, out vec3 albedo, out float roughness)
+{
+	const vec3 layer_albedo[4] = vec3[4] (
+	    vec3 (0.16, 0.28, 0.08), vec3 (0.32, 0.29, 0.26), vec3 (0.85, 0.87, 0.9), vec3 (0.24, 0.18, 0.12));
+	const vec4 layer_roughness = vec4 (0.9, 0.8, 0.6, 0.95);
+
+	// an empty texel is grass
+	float total = dot (splat, vec4 (1.0));
+	vec4 weights = total > 0.0 ? splat / total : vec4 (1.0, 0.0, 0.0, 0.0);
+
+	albedo = layer_albedo[0] * weights.r + layer_albedo[1] * weights.g + layer_albedo[2] * weights.b +
+	         layer_albedo[3] * weights.a;
+	roughness = dot (layer_roughness, weights);
+}
@@ -1,6 +1,7 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_multiview : enable
 
 #include "globals.glsl"
 
@@ -27,7 +28,7 @@ layout (location = 2) in vec2 inTexCoord;
 
 layout (location = 0) out vec4 outColor;
 
-vec3 DirPhongLighting (vec3 view, vec3 normal, int i)
+vec3 DirPhongLighting (vec3 view, vec3 normal, uint i)
 {
 
 	vec3 light = normalize (directional.lights[i].direction);
@@ -50,24 +51,22 @@ void main ()
 	vec3 normalVec = normalize (inNormal);
 
 	vec3 pointLightContrib = vec3 (0.0f);
-	for (int i = 0; i < PointLightCount; i++)
+	Cluster cluster = FindCluster (inFragPos);
+	for (uint i = 0; i < cluster.point_count; i++)
 	{
-		vec3 lightVec = normalize (point.lights[i].position - inFragPos).xyz;
+		PointLight pl = point.lights[light_indices.indices[cluster.offset + i]];
+		vec3 lightVec = normalize (pl.position - inFragPos).xyz;
 		vec3 reflectVec = reflect (-lightVec, normalVec);
-		vec3 halfwayVec = normalize (viewVec + point.lights[i].position);
 
-		float separation = distance (point.lights[i].position, inFragPos);
-		float attenuation = 1.0f / (separation * separation);
+		float attenuation = RangeAttenuation (distance (pl.position, inFragPos), pl.range) * pl.intensity;
 
-		vec3 diffuse =
-		    max (dot (normalVec, lightVec), 0.0) * vec3 (1.0f) * attenuation * point.lights[i].color;
-		vec3 specular = pow (max (dot (viewVec, reflectVec), 0.0), 16.0) * vec3 (0.75f) *
-		                attenuation * point.lights[i].color;
+		vec3 diffuse = max (dot (normalVec, lightVec), 0.0) * vec3 (1.0f) * attenuation * pl.color;
+		vec3 specular = pow (max (dot (viewVec, reflectVec), 0.0), 16.0) * vec3 (0.75f) * attenuation * pl.color;
 		pointLightContrib += (diffuse + specular);
 	}
 
 	vec3 spotLightContrib = vec3 (0.0f);
-	for (int i = 0; i < DirectionalLightCount; i++)
+	for (uint i = 0; i < cluster_grid.params.directional_count; i++)
 	{
 		spotLightContrib += DirPhongLighting (viewVec, normalVec, i);
 	}
@@ -0,0 +1,35 @@
+#version 450 core
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_multiview : enable
+
+#include "globals.glsl"
+
+#include "camera.glsl"
+
+#include "lighting.glsl"
+
+layout (location = 0) in vec3 inFragPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inTexCoord;
+layout (location = 3) flat in uint inMaterialIndex;
+
+layout (location = 0) out vec4 outColor;
+
+void main ()
+{
+	vec3 N = normalize (inNormal);
+	vec3 V = normalize (cam.camera_pos - inFragPos);
+
+	vec3 albedo = vec3 (0.8);
+	float roughness = 0.5;
+	float metallic = 0.0;
+
+	vec3 F0 = mix (vec3 (0.04), albedo, metallic);
+	vec3 color = LightingContribution (N, V, F0, inFragPos, albedo, roughness, metallic);
+
+	color = color / (color + vec3 (1.0));
+	color = pow (color, vec3 (1.0 / 2.2));
+
+	outColor = vec4 (color, 1.0);
+}
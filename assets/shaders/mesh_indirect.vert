@@ -0,0 +1,37 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_multiview : enable
+
+#include "globals.glsl"
+
+#include "camera.glsl"
+
+#include "draw_data.glsl"
+
+// firstInstance of each indirect command is its index in this array
+layout (std430, set = 2, binding = 0) readonly buffer DrawBuffer { DrawData draws[]; };
+
+layout (location = 0) in vec3 inPosition;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inTexCoord;
+
+layout (location = 0) out vec3 outFragPos;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec2 outTexCoord;
+layout (location = 3) flat out uint outMaterialIndex;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main ()
+{
+	DrawData draw = draws[gl_InstanceIndex];
+
+	vec4 world_pos = draw.transform * vec4 (inPosition, 1.0);
+	gl_Position = cam.proj_view * world_pos;
+
+	outFragPos = world_pos.xyz;
+	outNormal = mat3 (transpose (inverse (draw.transform))) * inNormal;
+	outTexCoord = inTexCoord;
+	outMaterialIndex = draw.material_index;
+}
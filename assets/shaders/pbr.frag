@@ -1,6 +1,7 @@
 #version 450 core
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_multiview : enable
 
 #include "globals.glsl"
 
@@ -51,7 +52,7 @@ void main ()
 	vec3 F0 = vec3 (0.04);
 	F0 = mix (F0, pbr_mat.albedo, pbr_mat.metallic);
 
-	vec3 ambient = vec3 (0.0) * pbr_mat.albedo * pbr_mat.ao;
+	vec3 ambient = AmbientLighting (N, V, F0, pbr_mat.albedo, pbr_mat.roughness, pbr_mat.metallic) * pbr_mat.ao;
 	vec3 color = ambient + LightingContribution (
 	                           N, V, F0, inFragPos, pbr_mat.albedo, pbr_mat.roughness, pbr_mat.metallic);
 
@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#include "draw_data.glsl"
+
+// firstInstance of each draw is its index in this array
+layout (std430, set = 2, binding = 0) readonly buffer DrawBuffer { DrawData draws[]; };
+
+layout (push_constant) uniform ShadowPush { mat4 proj_view; }
+shadow;
+
+layout (location = 0) in vec3 inPosition;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main ()
+{
+	DrawData draw = draws[gl_InstanceIndex];
+	gl_Position = shadow.proj_view * draw.transform * vec4 (inPosition, 1.0);
+}
@@ -0,0 +1,52 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_ARB_separate_shader_objects : enable
+
+#include "globals.glsl"
+
+// Matches SkyPushConstants in AtmosphereRenderer.cpp
+layout (push_constant) uniform SkyParams
+{
+	vec4 sun_direction; // towards the sun, w is the cosine of the disk's angular radius
+	vec4 sun_illuminance; // at the top of the atmosphere
+	vec4 sun_disk; // radiance of the disk after the atmosphere
+}
+sky;
+
+// radiance per unit of sun illuminance, by azimuth from the sun and elevation, see Atmosphere.h
+layout (set = 2, binding = 0) uniform sampler2D sky_view;
+
+layout (location = 0) in vec3 inViewRay;
+
+layout (location = 0) out vec4 outColor;
+
+vec2 SkyViewUV (vec3 dir)
+{
+	vec2 sun_horizontal = sky.sun_direction.xz;
+	float sun_length = length (sun_horizontal);
+	float view_length = length (dir.xz);
+	float cos_azimuth = 1.0;
+	if (sun_length > 1e-5 && view_length > 1e-5) cos_azimuth = dot (dir.xz / view_length, sun_horizontal / sun_length);
+	float azimuth = acos (clamp (cos_azimuth, -1.0, 1.0));
+
+	// rows squeeze towards the horizon, matching sky_view_v in Atmosphere.cpp
+	float elevation = asin (clamp (dir.y, -1.0, 1.0));
+	float v = 0.5 + 0.5 * sign (elevation) * sqrt (abs (elevation) / (0.5 * PI));
+
+	// the table was baked with its first and last texels on the edges
+	vec2 size = vec2 (textureSize (sky_view, 0));
+	return (vec2 (azimuth / PI, v) * (size - 1.0) + 0.5) / size;
+}
+
+void main ()
+{
+	vec3 dir = normalize (inViewRay);
+	vec3 radiance = texture (sky_view, SkyViewUV (dir)).rgb * sky.sun_illuminance.rgb;
+
+	float cos_sun = dot (dir, normalize (sky.sun_direction.xyz));
+	float cos_disk = sky.sun_direction.w;
+	radiance += sky.sun_disk.rgb * smoothstep (cos_disk - 2e-6, cos_disk + 2e-6, cos_sun);
+
+	vec3 color = radiance / (radiance + vec3 (1.0));
+	outColor = vec4 (pow (color, vec3 (1.0 / 2.2)), 1.0f);
+}
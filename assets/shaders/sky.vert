@@ -0,0 +1,24 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_multiview : enable
+
+#include "globals.glsl"
+
+#include "camera.glsl"
+
+layout (location = 0) out vec3 outViewRay;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+// A triangle covering the screen at the far plane, so the depth test only lets the sky through
+// where nothing was drawn. The view ray points from the camera through the near plane.
+void main ()
+{
+	vec2 uv = vec2 ((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	vec2 ndc = uv * 2.0 - 1.0;
+	// reversed depth, the near plane is at 1
+	vec4 near_point = inverse (cam.proj_view) * vec4 (ndc, 1.0, 1.0);
+	outViewRay = near_point.xyz / near_point.w - cam.camera_pos;
+	gl_Position = vec4 (ndc, 0.0, 1.0);
+}
@@ -1,6 +1,7 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_multiview : enable
 
 #include "globals.glsl"
 
@@ -8,14 +9,30 @@
 
 #include "lighting.glsl"
 
-// texture sampling
-layout (set = 2, binding = 1) uniform sampler2D texHeightMap;
-layout (set = 2, binding = 2) uniform sampler2D texNormalMap;
-layout (set = 2, binding = 3) uniform sampler2D texSplatMap;
-layout (set = 2, binding = 4) uniform sampler2DArray texArrayAlbedo;
-layout (set = 2, binding = 5) uniform sampler2DArray texArrayRoughness;
-layout (set = 2, binding = 6) uniform sampler2DArray texArrayMetalness;
-layout (set = 2, binding = 7) uniform sampler2DArray texArrayNormal;
+#include "terrain_material.glsl"
+
+// Matches VirtualTextureGPUHeader in TerrainVirtualTexture.h
+layout (std430, set = 2, binding = 2) readonly buffer PageTable
+{
+	uint level_count;
+	uint atlas_pages; // along each side
+	uint page_texels; // along each side, with a one texel border
+	float near_distance;
+	uint entries[]; // physical slot plus one of every virtual page, 0 when it isn't resident
+}
+page_table;
+
+// one flag per virtual page, read back by TerrainVirtualTexture::update
+layout (std430, set = 2, binding = 3) writeonly buffer Feedback { uint requested[]; };
+
+// the feedback write would otherwise turn off early depth testing, and hidden terrain would ask
+// for pages
+layout (early_fragment_tests) in;
+
+layout (set = 2, binding = 4) uniform sampler2D page_atlas;
+
+// layer weights, one texel per height sample, see terrain_material.glsl
+layout (set = 2, binding = 5) uniform sampler2D splat_map;
 
 layout (location = 0) in vec3 inFragPos;
 layout (location = 1) in vec3 inNormal;
@@ -23,114 +40,75 @@ layout (location = 2) in vec2 inTexCoord;
 
 layout (location = 0) out vec4 outColor;
 
-vec3 perturbNormal (vec3 texNormal)
-{
-	vec3 tangentNormal = texNormal * 2.0 - 1.0;
+uint PagesPerSide (uint level) { return 1u << (page_table.level_count - 1u - level); }
 
-	vec3 q1 = dFdx (inFragPos);
-	vec3 q2 = dFdy (inFragPos);
-	vec2 st1 = dFdx (inTexCoord);
-	vec2 st2 = dFdy (inTexCoord);
-
-	vec3 N = normalize (inNormal);
-	vec3 T = normalize (q1 * st2.t - q2 * st1.t);
-	vec3 B = -normalize (cross (N, T));
-	mat3 TBN = mat3 (T, B, N);
+// pages are stored level after level, finest first, each level in z then x order
+uint PageIndex (uint level, uvec2 page)
+{
+	uint level_offset = ((1u << (2u * page_table.level_count)) - (1u << (2u * (page_table.level_count - level)))) / 3u;
+	return level_offset + page.y * PagesPerSide (level) + page.x;
+}
 
-	return normalize (TBN * tangentNormal);
+// Looks uv up in the finest resident page of the level its footprint needs or a coarser one.
+// Fragments closer than near_distance, or without any resident page, blend per pixel instead.
+bool VirtualTextureFetch (vec2 uv, float dist, out vec4 texel)
+{
+	texel = vec4 (0.0);
+	uint interior = page_table.page_texels - 2u;
+	vec2 coord = uv * float (PagesPerSide (0u) * interior);
+	float lod = log2 (max (length (dFdx (coord)), length (dFdy (coord))));
+	uint level = uint (clamp (lod, 0.0, float (page_table.level_count - 1u)));
+	if (dist < page_table.near_distance) return false;
+
+	// a sixteenth of the pixels is plenty to find the visible pages
+	if ((uint (gl_FragCoord.x) & 3u) == 0u && (uint (gl_FragCoord.y) & 3u) == 0u)
+	{
+		uint pages = PagesPerSide (level);
+		requested[PageIndex (level, min (uvec2 (uv * float (pages)), uvec2 (pages - 1u)))] = 1u;
+	}
+
+	for (uint l = level; l < page_table.level_count; l++)
+	{
+		uint pages = PagesPerSide (l);
+		uvec2 page = min (uvec2 (uv * float (pages)), uvec2 (pages - 1u));
+		uint entry = page_table.entries[PageIndex (l, page)];
+		if (entry == 0u) continue;
+
+		uint slot = entry - 1u;
+		vec2 local = (uv * float (pages) - vec2 (page)) * float (interior) + 1.0;
+		vec2 atlas_texel = vec2 (slot % page_table.atlas_pages, slot / page_table.atlas_pages) * float (page_table.page_texels) + local;
+		texel = textureLod (page_atlas, atlas_texel / float (page_table.atlas_pages * page_table.page_texels), 0.0);
+		return true;
+	}
+	return false;
 }
 
 void main ()
 {
-	// vec4 texColor = inColor; //splatmap not in yet, so just use vertex colors until then
-	vec4 texColor = texture (texSplatMap, inTexCoord);
-	float texSampleDensity = 500.0f;
-
-	vec4 albedo1 = texture (
-	    texArrayAlbedo, vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 0));
-	vec4 albedo2 = texture (
-	    texArrayAlbedo, vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 1));
-	vec4 albedo3 = texture (
-	    texArrayAlbedo, vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 2));
-	vec4 albedo4 = texture (
-	    texArrayAlbedo, vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 3));
-	vec3 albedo = vec3 (
-	    albedo1 * texColor.x + albedo2 * texColor.y + albedo3 * texColor.z + albedo4 * texColor.w);
-	albedo = pow (albedo, vec3 (2.2));
-
-	float roughness1 = float(texture (texArrayRoughness,
-	    vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 0)));
-	float roughness2 = float(texture (texArrayRoughness,
-	    vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 1)));
-	float roughness3 = float(texture (texArrayRoughness,
-	    vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 2)));
-	float roughness4 = float(texture (texArrayRoughness,
-	    vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 3)));
-	float roughness = (roughness1 * texColor.x + roughness2 * texColor.y + roughness3 * texColor.z +
-	                   roughness4 * texColor.w);
-
-	float metalness1 = float(texture (texArrayMetalness,
-	    vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 0)));
-	float metalness2 = float(texture (texArrayMetalness,
-	    vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 1)));
-	float metalness3 = float(texture (texArrayMetalness,
-	    vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 2)));
-	float metalness4 = float(texture (texArrayMetalness,
-	    vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 3)));
-	float metalness = (metalness1 * texColor.x + metalness2 * texColor.y + metalness3 * texColor.z +
-	                   metalness4 * texColor.w);
-
-	vec3 normal1 = vec3 (texture (
-	    texArrayNormal, vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 0)));
-	vec3 normal2 = vec3 (texture (
-	    texArrayNormal, vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 1)));
-	vec3 normal3 = vec3 (texture (
-	    texArrayNormal, vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 2)));
-	vec3 normal4 = vec3 (texture (
-	    texArrayNormal, vec3 (inTexCoord.x * texSampleDensity, inTexCoord.y * texSampleDensity, 3)));
-	vec3 normal = normalize (
-	    normal1 * texColor.x + normal2 * texColor.y + normal3 * texColor.z + normal4 * texColor.w);
-
-	vec3 viewVec = normalize (-cam.camera_dir);
-
-	// vec3 normalVec = normalize(inNormal);
-
-	// vec3 pointLightContrib = vec3(0.0f);
-	// for(int i = 0; i < PointLightCount; i++){
-	//	vec3 lightVec = normalize(point.lights[i].position - inFragPos).xyz;
-	//	vec3 reflectVec = reflect(-lightVec, normalVec);
-	//	vec3 halfwayVec = normalize(viewVec + point.lights[i].position);
-
-	//	float separation = distance(point.lights[i].position, inFragPos);
-	//	float attenuation = 1.0f/(separation*separation);
-
-	//	vec3 diffuse = max(dot(normalVec, lightVec), 0.0) * vec3(1.0f) * attenuation *
-	// point.lights[i].color; 	vec3 specular = pow(max(dot(viewVec, reflectVec), 0.0), 16.0) *
-	// vec3(0.75f)* attenuation * point.lights[i].color; 	pointLightContrib += (diffuse + specular);
-	//}
-
-	// vec3 dirContrib = DirPhongLighting(viewVec, sun.light[0].direction, normalVec,
-	// sun.light[0].color, sun.light[0].intensity); vec3 N = normalize(inNormal);
-	vec3 N = perturbNormal (normal);
-	vec3 V = normalize (cam.camera_pos - inFragPos);
-	vec3 F0 = vec3 (0.04);
-	F0 = mix (F0, albedo, metalness);
-	vec3 ambient = vec3 (0.002);
-	vec3 lighting = ambient + LightingContribution (N, V, F0, inFragPos, albedo, roughness, metalness);
+	vec3 N = normalize (inNormal);
 
-	float belowWaterLevelDarkening = -1 * (((-clamp (inFragPos.y, -7, -0.5) - 0.5) / 5) - 1);
+	vec3 albedo;
+	float roughness;
+	vec4 page_texel;
+	if (VirtualTextureFetch (clamp (inTexCoord, 0.0, 1.0), distance (cam.camera_pos, inFragPos), page_texel))
+	{
+		albedo = page_texel.rgb;
+		roughness = page_texel.a;
+	}
+	else
+	{
+		// texel centers sit on the height samples
+		vec2 samples = vec2 (textureSize (splat_map, 0));
+		vec2 splat_uv = (clamp (inTexCoord, 0.0, 1.0) * (samples - 1.0) + 0.5) / samples;
+		TerrainMaterial (texture (splat_map, splat_uv), albedo, roughness);
+	}
 
+	vec3 V = normalize (cam.camera_pos - inFragPos);
+	float metalness = 0.0;
+	vec3 F0 = mix (vec3 (0.04), albedo, metalness);
+	vec3 ambient = AmbientLighting (N, V, F0, albedo, roughness, metalness);
+	vec3 lighting = ambient + LightingContribution (N, V, F0, inFragPos, albedo, roughness, metalness);
 
-	// outColor = (vec4(0,0,0,0) + inColor) * vec4((pointLightContrib + dirContrib), 1.0f);
-	// outColor = vec4(lighting, 1.0f);
-	// outColor = vec4(pointLightContrib * inColor, 1.0f);
 	vec3 color = lighting / (lighting + vec3 (1.0));
 	outColor = vec4 (pow (color, vec3 (1.0 / 2.2)), 1.0f);
-
-	// float r = outColor.r * belowWaterLevelDarkening;
-	// float g = outColor.g * belowWaterLevelDarkening;
-	// float b = outColor.b * clamp (belowWaterLevelDarkening * 0.8, 0, 1);
-	//
-	//
-	// outColor = vec4 (r, g, b, 1.0f);
 }
@@ -1,33 +1,15 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_multiview : enable
 
 #include "globals.glsl"
 
 #include "camera.glsl"
 
-// per model information
-layout (set = 2, binding = 0) uniform ModelMatrixData
-{
-	mat4 model;
-	mat4 normal;
-}
-mnd;
-
-// height and normal map
-layout (set = 2, binding = 1) uniform sampler2D texHeightMap;
-layout (set = 2, binding = 2) uniform sampler2D texNormalMap;
-
-
-layout (location = 0) in vec3 inPosition;
-layout (location = 1) in vec3 inNormal;
-layout (location = 2) in vec2 inTexCoord;
+#include "terrain.glsl"
 
-// Instanced attributes
-layout (location = 3) in vec4 pos;
-layout (location = 4) in vec4 uv;
-layout (location = 5) in vec4 h_w_pp;
-layout (location = 6) in vec4 dumb;
+layout (location = 0) in vec3 inPosition; // 0 to 1 across the patch in x and z
 
 layout (location = 0) out vec3 outFragPos;
 layout (location = 1) out vec3 outNormal;
@@ -37,20 +19,15 @@ out gl_PerVertex { vec4 gl_Position; };
 
 void main ()
 {
-	vec3 new_pos = inPosition;
+	vec3 world_pos = TerrainPosition (inPosition.xz);
+	gl_Position = cam.proj_view * vec4 (world_pos, 1.0);
 
-	new_pos.x = mix (pos.x, pos.z, inPosition.x);
-	new_pos.z = mix (pos.y, pos.w, inPosition.z);
+	vec2 world_xz = world_pos.xz;
+	float spacing = terrain.world_size / float (terrain.tile_count * (terrain.tile_samples - 1));
+	float dx = Height (world_xz + vec2 (spacing, 0.0)) - Height (world_xz - vec2 (spacing, 0.0));
+	float dz = Height (world_xz + vec2 (0.0, spacing)) - Height (world_xz - vec2 (0.0, spacing));
 
-	vec2 new_uv = mix (uv.xy, uv.zw, vec2 (inPosition.x, inPosition.z));
-	float height = texture (texHeightMap, new_uv.yx).r;
-
-	new_pos.y = height * h_w_pp.x;
-	gl_Position = cam.proj_view * vec4 (new_pos, 1.0);
-
-	vec3 new_norm = texture (texNormalMap, new_uv.yx).rgb;
-
-	outTexCoord = new_uv;
-	outNormal = new_norm;
-	outFragPos = (vec4 (new_pos, 1.0)).xyz;
-}
\ No newline at end of file
+	outFragPos = world_pos;
+	outNormal = normalize (vec3 (-dx, 2.0 * spacing, -dz));
+	outTexCoord = (world_xz - terrain.origin) / terrain.world_size;
+}
@@ -0,0 +1,11 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
+
+#include "terrain.glsl"
+
+layout (location = 0) in vec3 inPosition; // 0 to 1 across the patch in x and z
+
+out gl_PerVertex { vec4 gl_Position; };
+
+void main () { gl_Position = terrain.shadow_proj_view * vec4 (TerrainPosition (inPosition.xz), 1.0); }
@@ -0,0 +1,60 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_multiview : enable
+
+// Matches UpscalePushConstants in UpscaleRenderer.cpp
+layout (push_constant) uniform UpscaleParams
+{
+	vec2 uv_scale; // the rendered area over the size of the scene image
+	vec2 texel_size; // one over the size of the scene image
+}
+params;
+
+// each view's scene in its own layer, only the top left uv_scale of it was rendered this frame
+layout (set = 0, binding = 0) uniform sampler2DArray scene;
+
+layout (location = 0) in vec2 inUV;
+
+layout (location = 0) out vec4 outColor;
+
+// taps stay half a texel inside the rendered area, past it are last frame's texels
+vec3 Tap (vec2 uv)
+{
+	vec2 uv_min = 0.5 * params.texel_size;
+	vec2 uv_max = params.uv_scale - 0.5 * params.texel_size;
+	return textureLod (scene, vec3 (clamp (uv, uv_min, uv_max), gl_ViewIndex), 0.0).rgb;
+}
+
+// Catmull-Rom from 9 bilinear taps. The middle two texels of each axis have positive weights, so
+// one tap between them at the ratio of their weights reads both through the linear filter. At a
+// scale of 1 every pixel lands on a texel center and this is a copy.
+void main ()
+{
+	vec2 texel_pos = inUV * params.uv_scale / params.texel_size;
+	vec2 center = floor (texel_pos - 0.5) + 0.5;
+	vec2 f = texel_pos - center;
+
+	vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+	vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+	vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+	vec2 w3 = f * f * (-0.5 + 0.5 * f);
+	vec2 w12 = w1 + w2;
+
+	vec2 uv0 = (center - 1.0) * params.texel_size;
+	vec2 uv12 = (center + w2 / w12) * params.texel_size;
+	vec2 uv3 = (center + 2.0) * params.texel_size;
+
+	vec3 color = Tap (vec2 (uv0.x, uv0.y)) * w0.x * w0.y;
+	color += Tap (vec2 (uv12.x, uv0.y)) * w12.x * w0.y;
+	color += Tap (vec2 (uv3.x, uv0.y)) * w3.x * w0.y;
+	color += Tap (vec2 (uv0.x, uv12.y)) * w0.x * w12.y;
+	color += Tap (vec2 (uv12.x, uv12.y)) * w12.x * w12.y;
+	color += Tap (vec2 (uv3.x, uv12.y)) * w3.x * w12.y;
+	color += Tap (vec2 (uv0.x, uv3.y)) * w0.x * w3.y;
+	color += Tap (vec2 (uv12.x, uv3.y)) * w12.x * w3.y;
+	color += Tap (vec2 (uv3.x, uv3.y)) * w3.x * w3.y;
+
+	// the negative lobes can undershoot next to hard edges
+	outColor = vec4 (max (color, vec3 (0.0)), 1.0);
+}
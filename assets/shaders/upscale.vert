@@ -0,0 +1,14 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_ARB_separate_shader_objects : enable
+
+layout (location = 0) out vec2 outUV;
+
+out gl_PerVertex { vec4 gl_Position; };
+
+// A triangle covering the screen, the uv is 0 to 1 across the output
+void main ()
+{
+	outUV = vec2 ((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4 (outUV * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -1,47 +1,59 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_multiview : enable
 
 #include "globals.glsl"
 
 #include "camera.glsl"
 
-// per model information
-layout (set = 2, binding = 0) uniform ModelMatrixData
+const int MaxCascades = 3; // OceanSettings::MaxCascades
+
+// the mesh follows the camera in steps of this many metres, so vertices don't slide over the waves
+const float SnapSize = 2.0;
+
+// Matches OceanPushConstants in OceanRenderer.cpp
+layout (push_constant) uniform OceanParams
 {
-	mat4 model;
-	mat4 normal;
+	vec4 patch_sizes; // world size each cascade's maps repeat over
+	vec4 fade_distances; // where each cascade has faded out
+	float sea_level;
+	uint cascade_count;
+	float padding[2];
 }
-mnd;
+ocean;
 
-layout (location = 0) in vec3 inPosition;
+// x, height, z displacement of every cascade
+layout (set = 2, binding = 0) uniform sampler2D displacement_maps[MaxCascades];
+
+layout (location = 0) in vec3 inPosition; // around the origin, gets coarser away from it
 
 layout (location = 0) out vec3 outFragPos;
-layout (location = 1) out vec3 outNormal;
+layout (location = 1) out vec2 outSurfaceXZ; // undisplaced, where the maps are sampled
 
 out gl_PerVertex { vec4 gl_Position; };
 
-float height (vec3 pos)
+float CascadeWeight (int cascade, float dist)
 {
-	float t = global.time / 3;
-	return sin (t + pos.x / 8) * cos (t + pos.z / 7) + sin (1.4 * t + pos.x / 5) * cos (0.7 * t + pos.z / 6);
+	float fade = ocean.fade_distances[cascade];
+	return 1.0 - smoothstep (0.5 * fade, fade, dist);
 }
 
 void main ()
 {
-	vec3 vert_pos = inPosition;
-	outFragPos = vert_pos;
-	vec3 static_pos = inPosition + cam.camera_pos; // for y value comp
-
-	float disp = height (static_pos);
-
-	float xDiff = (height (static_pos + vec3 (0.1, 0, 0)) - height (static_pos + vec3 (-0.1, 0, 0)));
-	float zDiff = (height (static_pos + vec3 (0, 0, 0.1)) - height (static_pos + vec3 (0, 0, -0.1)));
-
-	vec3 out_norm = vec3 (xDiff, 0.5, zDiff);
-
-	vert_pos += vec3 (xDiff, disp * 1, zDiff);
-
-	gl_Position = cam.proj_view * mnd.model * vec4 (vert_pos, 1.0);
-	outNormal = normalize (out_norm);
+	vec2 surface_xz = inPosition.xz + floor (cam.camera_pos.xz / SnapSize) * SnapSize;
+	float dist = distance (cam.camera_pos, vec3 (surface_xz.x, ocean.sea_level, surface_xz.y));
+
+	vec3 displacement = vec3 (0.0);
+	for (int i = 0; i < MaxCascades; i++)
+	{
+		if (uint (i) >= ocean.cascade_count) break;
+		vec2 uv = surface_xz / ocean.patch_sizes[i];
+		displacement += textureLod (displacement_maps[i], uv, 0.0).xyz * CascadeWeight (i, dist);
+	}
+
+	vec3 world_pos = vec3 (surface_xz.x, ocean.sea_level, surface_xz.y) + displacement;
+	gl_Position = cam.proj_view * vec4 (world_pos, 1.0);
+	outFragPos = world_pos;
+	outSurfaceXZ = surface_xz;
 }
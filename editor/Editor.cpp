@@ -1,7 +1,85 @@
 #include "Editor.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <string_view>
+
+#include "core/Benchmark.h"
+
+#include "GraphCodegen.h"
+
+namespace
+{
+// The optional count following the flag at argv[i]. Returns fallback when nothing or another flag
+// follows, nullopt when the argument isn't a positive whole number.
+std::optional<uint64_t> parse_count_arg (int argc, char* argv[], int i, uint64_t fallback)
+{
+	if (i + 1 >= argc || std::string_view (argv[i + 1]).substr (0, 2) == "--") return fallback;
+
+	char const* str = argv[i + 1];
+	char* end = nullptr;
+	errno = 0;
+	uint64_t count = std::strtoull (str, &end, 10);
+	if (str[0] == '-' || end == str || *end != '\0' || errno == ERANGE || count == 0) return {};
+	return count;
+}
+
+uint32_t to_iterations (uint64_t count)
+{
+	return static_cast<uint32_t> (std::min<uint64_t> (count, std::numeric_limits<uint32_t>::max ()));
+}
+
+struct CountBenchmark
+{
+	std::string_view flag;
+	uint64_t default_count;
+	int (*run) (uint64_t count);
+};
+
+const CountBenchmark CountBenchmarks[] = {
+	{ "--ecs-benchmark", 1000000, [] (uint64_t count) { return run_ecs_benchmark (count); } },
+	{ "--culling-benchmark", 1000000, [] (uint64_t count) { return run_culling_benchmark (count); } },
+	{ "--bvh-benchmark", 1000000, [] (uint64_t count) { return run_bvh_benchmark (count); } },
+	{ "--light-benchmark", 10000, [] (uint64_t count) { return run_light_cluster_benchmark (count); } },
+	{ "--terrain-benchmark", 1000, [] (uint64_t count) { return run_terrain_lod_benchmark (to_iterations (count)); } },
+	{ "--ocean-benchmark", 100, [] (uint64_t count) { return run_ocean_benchmark (to_iterations (count)); } },
+};
+} // namespace
+
 int main (int argc, char* argv[])
 {
+	Log.install_crash_handlers ();
+
+	// --benchmark <settings.json> renders headless and exits without opening a window
+	// --ecs-benchmark [entity count] only exercises the ECS, defaulting to a million entities
+	// --culling-benchmark [object count] only exercises frustum culling, defaulting to a million objects
+	// --bvh-benchmark [object count] compares BVH culling against brute force, defaulting to a million objects
+	// --light-benchmark [light count] only exercises light clustering, defaulting to ten thousand lights
+	// --terrain-benchmark [iterations] only exercises terrain LOD selection, defaulting to a thousand
+	// --ocean-benchmark [iterations] only exercises the ocean simulation, defaulting to a hundred
+	for (int i = 1; i < argc; i++)
+	{
+		std::string_view arg = argv[i];
+		if (arg == "--benchmark" && i + 1 < argc) return run_benchmark (argv[i + 1]);
+
+		for (auto& benchmark : CountBenchmarks)
+		{
+			if (arg != benchmark.flag) continue;
+			auto count = parse_count_arg (argc, argv, i, benchmark.default_count);
+			if (!count)
+			{
+				Log.error ("{} expects a positive whole number, got {}", arg, argv[i + 1]);
+				return EXIT_FAILURE;
+			}
+			return benchmark.run (count.value ());
+		}
+	}
+
 	std::unique_ptr<Engine> vkApp;
 	try
 	{
@@ -9,7 +87,7 @@ int main (int argc, char* argv[])
 	}
 	catch (const std::runtime_error& e)
 	{
-		Log.debug (fmt::format ("Engine failed to initialize{}", e.what ()));
+		Log.debug ("Engine failed to initialize{}", e.what ());
 		return EXIT_FAILURE;
 	}
 	Editor editor (*vkApp.get ());
@@ -22,7 +100,7 @@ int main (int argc, char* argv[])
 	}
 	catch (const std::runtime_error& e)
 	{
-		Log.error (fmt::format ("Engine quite in main loop{}", e.what ()));
+		Log.error ("Engine quite in main loop{}", e.what ());
 		return EXIT_FAILURE;
 	}
 	vkApp.reset ();
@@ -30,7 +108,11 @@ int main (int argc, char* argv[])
 	return EXIT_SUCCESS;
 }
 
-Editor::Editor (Engine& engine) : engine (engine), imgui_nodeGraph_terrain (engine.input) {}
+Editor::Editor (Engine& engine) : engine (engine), imgui_nodeGraph_terrain (engine.input)
+{
+	// the default graph, so there is terrain before anyone touches the buttons
+	engine.vulkan_renderer.terrain_renderer.generate (engine.thread_pool, graph_height_source ());
+}
 
 void Editor::update_inputs ()
 {
@@ -54,6 +136,10 @@ void Editor::draw_imgui ()
 		imgui_nodeGraph_terrain.Draw ();
 
 		controller_window (&panels.controller_list);
+
+		if (panels.profiler) profiler_window (&panels.profiler);
+		if (panels.memory) memory_window (&panels.memory);
+		if (panels.terrain) terrain_window (&panels.terrain);
 	}
 }
 
@@ -164,3 +250,289 @@ void Editor::controller_window (bool* show_controller_window)
 	}
 	ImGui::End ();
 }
+
+// Flame view of the last complete frame, one lane per thread and one row per scope depth
+void Editor::profiler_window (bool* show_profiler)
+{
+	if (!ImGui::Begin ("Profiler", show_profiler))
+	{
+		ImGui::End ();
+		return;
+	}
+	bool enabled = Prof.is_enabled ();
+	if (ImGui::Checkbox ("Enabled", &enabled)) Prof.set_enabled (enabled);
+	ImGui::SameLine ();
+	if (ImGui::Button ("Save Trace")) Prof.write_chrome_trace ("profile.json");
+
+	ImGui::Text ("GPU");
+	for (auto& timing : engine.vulkan_renderer.get_gpu_timings ())
+	{
+		ImGui::Text ("%*s%s %.3f ms", static_cast<int> (timing.depth * 2), "", timing.name.c_str (), timing.ms);
+		if (timing.statistics && ImGui::IsItemHovered ())
+		{
+			auto& stats = timing.statistics.value ();
+			ImGui::SetTooltip ("IA vertices %llu\nIA primitives %llu\nVS invocations %llu\nClipped primitives "
+			                   "%llu\nFS invocations %llu\nCS invocations %llu",
+			    (unsigned long long)stats.input_assembly_vertices,
+			    (unsigned long long)stats.input_assembly_primitives,
+			    (unsigned long long)stats.vertex_shader_invocations,
+			    (unsigned long long)stats.clipping_primitives,
+			    (unsigned long long)stats.fragment_shader_invocations,
+			    (unsigned long long)stats.compute_shader_invocations);
+		}
+	}
+	bool dynamic_resolution = engine.vulkan_renderer.is_dynamic_resolution_enabled ();
+	if (ImGui::Checkbox ("Dynamic Resolution", &dynamic_resolution))
+		engine.vulkan_renderer.set_dynamic_resolution (dynamic_resolution);
+	auto render_extent = engine.vulkan_renderer.get_render_extent ();
+	ImGui::Text ("Render scale %.2f (%ux%u)",
+	    engine.vulkan_renderer.get_render_scale (),
+	    render_extent.width,
+	    render_extent.height);
+	ImGui::Separator ();
+
+	uint64_t frame_start = Prof.last_frame_start ();
+	uint64_t frame_end = Prof.last_frame_end ();
+	if (!enabled || frame_start == 0 || frame_end <= frame_start)
+	{
+		ImGui::Text ("No frame captured");
+		ImGui::End ();
+		return;
+	}
+	double frame_ns = static_cast<double> (frame_end - frame_start);
+	ImGui::Text ("CPU, last frame %.3f ms", frame_ns / 1e6);
+
+	float row_height = ImGui::GetTextLineHeightWithSpacing ();
+	float width = ImGui::GetContentRegionAvail ().x;
+	ImDrawList* draw_list = ImGui::GetWindowDrawList ();
+
+	for (auto& thread : Prof.collect ())
+	{
+		ImGui::Text ("%s", thread.thread_name.c_str ());
+		ImVec2 origin = ImGui::GetCursorScreenPos ();
+		uint32_t row_count = 1;
+		for (auto& event : thread.events)
+		{
+			if (event.end_ns < frame_start || event.start_ns > frame_end) continue;
+
+			uint64_t start = std::max (event.start_ns, frame_start);
+			uint64_t end = std::min (event.end_ns, frame_end);
+			float x0 = origin.x + width * static_cast<float> ((start - frame_start) / frame_ns);
+			float x1 = origin.x + width * static_cast<float> ((end - frame_start) / frame_ns);
+			x1 = std::max (x1, x0 + 1.0f);
+			float y0 = origin.y + event.depth * row_height;
+			ImVec2 rect_min (x0, y0);
+			ImVec2 rect_max (x1, y0 + row_height - 1.0f);
+
+			float hue = static_cast<float> (std::hash<std::string_view>{}(event.name) % 360) / 360.0f;
+			draw_list->AddRectFilled (rect_min, rect_max, ImColor::HSV (hue, 0.5f, 0.7f));
+			if (x1 - x0 > ImGui::CalcTextSize (event.name).x)
+				draw_list->AddText (rect_min, IM_COL32 (255, 255, 255, 255), event.name);
+			if (ImGui::IsMouseHoveringRect (rect_min, rect_max))
+				ImGui::SetTooltip ("%s %.3f ms", event.name, (event.end_ns - event.start_ns) / 1e6);
+
+			row_count = std::max (row_count, event.depth + 1);
+		}
+		ImGui::Dummy (ImVec2 (width, row_count * row_height));
+	}
+
+	ImGui::End ();
+}
+
+void Editor::memory_window (bool* show_memory)
+{
+	if (!ImGui::Begin ("Memory", show_memory))
+	{
+		ImGui::End ();
+		return;
+	}
+	if (ImGui::Button ("Save Report")) MemTracker.write_json ("memory_report.json");
+
+	auto to_mb = [] (double bytes) { return bytes / (1024.0 * 1024.0); };
+
+	ImGui::Columns (5, "memory_tags");
+	ImGui::Text ("Tag");
+	ImGui::NextColumn ();
+	ImGui::Text ("Current MB");
+	ImGui::NextColumn ();
+	ImGui::Text ("Peak MB");
+	ImGui::NextColumn ();
+	ImGui::Text ("Budget MB");
+	ImGui::NextColumn ();
+	ImGui::Text ("Allocs/Frame");
+	ImGui::NextColumn ();
+	ImGui::Separator ();
+	for (size_t i = 0; i < MemoryTagCount; i++)
+	{
+		auto tag = static_cast<MemoryTag> (i);
+		auto stats = MemTracker.get_stats (tag);
+		bool over = stats.budget_bytes > 0 && stats.current_bytes > static_cast<int64_t> (stats.budget_bytes);
+
+		if (over)
+			ImGui::TextColored (ImVec4 (1.f, 0.3f, 0.3f, 1.f), "%s", memory_tag_name (tag));
+		else
+			ImGui::Text ("%s%s", memory_tag_name (tag), is_gpu_memory_tag (tag) ? " (gpu)" : "");
+		ImGui::NextColumn ();
+		ImGui::Text ("%.2f", to_mb (static_cast<double> (stats.current_bytes)));
+		ImGui::NextColumn ();
+		ImGui::Text ("%.2f", to_mb (static_cast<double> (stats.peak_bytes)));
+		ImGui::NextColumn ();
+		if (stats.budget_bytes > 0)
+			ImGui::Text ("%.2f", to_mb (static_cast<double> (stats.budget_bytes)));
+		else
+			ImGui::Text ("-");
+		ImGui::NextColumn ();
+		ImGui::Text ("%llu", (unsigned long long)stats.frame_allocations);
+		ImGui::NextColumn ();
+	}
+	ImGui::Columns (1);
+	ImGui::Separator ();
+
+	auto heaps = MemTracker.get_heap_stats ();
+	for (size_t i = 0; i < heaps.size (); i++)
+	{
+		ImGui::Text ("Heap %d%s: %.1f / %.1f MB (%.1f MB in use)",
+		    static_cast<int> (i),
+		    heaps[i].device_local ? " (device local)" : "",
+		    to_mb (static_cast<double> (heaps[i].block_bytes)),
+		    to_mb (static_cast<double> (heaps[i].budget_bytes)),
+		    to_mb (static_cast<double> (heaps[i].allocation_bytes)));
+	}
+	if (MemTracker.get_device_budget () > 0)
+	{
+		ImGui::Text ("Device budget: %.1f / %.1f MB",
+		    to_mb (static_cast<double> (MemTracker.device_local_usage ())),
+		    to_mb (static_cast<double> (MemTracker.get_device_budget ())));
+	}
+	ImGui::End ();
+}
+
+TerrainHeightSource Editor::graph_height_source ()
+{
+	auto& graph = imgui_nodeGraph_terrain.GetGraph ();
+	return [&graph] (uint32_t tile_x, uint32_t tile_z, uint32_t samples) {
+		// neighbouring tiles start on each other's last sample so their edges match
+		int32_t step = static_cast<int32_t> (samples - 1);
+		InternalGraph::GraphUser user (graph,
+		    1337,
+		    static_cast<int> (samples),
+		    cml::vec2<int32_t> (static_cast<int32_t> (tile_x) * step, static_cast<int32_t> (tile_z) * step),
+		    1.0f,
+		    1.0f);
+		return user.get_heightMap ();
+	};
+}
+
+void Editor::compare_terrain_graph ()
+{
+	auto& terrain = engine.vulkan_renderer.terrain_renderer;
+	auto shader = InternalGraph::generate_compute_shader (imgui_nodeGraph_terrain.GetGraph ());
+	if (!shader || !terrain.generate_on_gpu (shader.value ())) return;
+	auto gpu_heights = terrain.read_back_heights ();
+
+	// GraphUser is the reference, tiles are laid out like TerrainQuadtree::get_heights
+	auto const& settings = terrain.get_quadtree ().get_settings ();
+	uint32_t tile_size = settings.tile_samples * settings.tile_samples;
+	uint32_t tile_count = settings.tile_count * settings.tile_count;
+	std::vector<double> tile_max (tile_count, 0.0);
+	std::vector<double> tile_sum (tile_count, 0.0);
+	auto source = graph_height_source ();
+	job::parallel_for (engine.thread_pool, tile_count, 1, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			auto cpu_heights = source (static_cast<uint32_t> (i % settings.tile_count),
+			    static_cast<uint32_t> (i / settings.tile_count),
+			    settings.tile_samples);
+			for (uint32_t s = 0; s < tile_size; s++)
+			{
+				double error = std::abs (static_cast<double> (cpu_heights[s]) - gpu_heights[i * tile_size + s]);
+				tile_max[i] = std::max (tile_max[i], error);
+				tile_sum[i] += error;
+			}
+		}
+	});
+
+	graph_max_error = *std::max_element (std::begin (tile_max), std::end (tile_max));
+	graph_mean_error = std::accumulate (std::begin (tile_sum), std::end (tile_sum), 0.0) /
+	                   (static_cast<double> (tile_size) * tile_count);
+	Log.debug ("Terrain graph GPU against CPU: max error {:.6f}, mean error {:.6f}", graph_max_error, graph_mean_error);
+}
+
+void Editor::terrain_window (bool* show_terrain)
+{
+	if (!ImGui::Begin ("Terrain", show_terrain))
+	{
+		ImGui::End ();
+		return;
+	}
+	auto& terrain = engine.vulkan_renderer.terrain_renderer;
+	if (ImGui::Button ("Generate From Graph")) terrain.generate (engine.thread_pool, graph_height_source ());
+	ImGui::SameLine ();
+	if (ImGui::Button ("Generate On GPU"))
+	{
+		auto shader = InternalGraph::generate_compute_shader (imgui_nodeGraph_terrain.GetGraph ());
+		if (shader) terrain.generate_on_gpu (shader.value ());
+	}
+	ImGui::SameLine ();
+	if (ImGui::Button ("Compare GPU With CPU")) compare_terrain_graph ();
+	if (graph_max_error >= 0.0)
+		ImGui::Text ("GPU graph error: max %.6f, mean %.6f", graph_max_error, graph_mean_error);
+
+	auto const& stats = terrain.get_stats ();
+	ImGui::Text ("Visited %u, culled %u, selected %u nodes", stats.visited_nodes, stats.culled_nodes, stats.selected_nodes);
+	ImGui::Text ("Patches drawn: %u", stats.patch_count);
+	for (uint32_t lod = 0; lod < terrain.get_quadtree ().get_settings ().lod_count; lod++)
+		ImGui::Text ("LOD %u: %u nodes, range %.0f", lod, stats.nodes_per_lod[lod], terrain.get_quadtree ().get_range (lod));
+
+	bool virtual_texture = terrain.get_virtual_texture ().is_enabled ();
+	if (ImGui::Checkbox ("Virtual Texture", &virtual_texture)) terrain.set_virtual_texture_enabled (virtual_texture);
+	if (virtual_texture)
+	{
+		auto const& vt_stats = terrain.get_virtual_texture ().get_stats ();
+		ImGui::Text ("Virtual texture: %u resident, %u requested", vt_stats.resident_pages, vt_stats.requested_pages);
+		ImGui::Text ("Pages composited %u, evicted %u", vt_stats.composited_pages, vt_stats.evicted_pages);
+	}
+
+	auto& ocean = engine.vulkan_renderer.ocean_renderer;
+	bool draw_ocean = ocean.is_enabled ();
+	if (ImGui::Checkbox ("Draw Ocean", &draw_ocean)) ocean.set_enabled (draw_ocean);
+	if (draw_ocean)
+	{
+		float sea_level = ocean.get_sea_level ();
+		if (ImGui::DragFloat ("Sea Level", &sea_level, 0.5f)) ocean.set_sea_level (sea_level);
+		ImGui::Text ("Ocean simulation: %.3f ms", ocean.get_simulate_ms ());
+	}
+
+	auto& atmosphere = engine.vulkan_renderer.atmosphere_renderer;
+	bool draw_sky = atmosphere.is_enabled ();
+	if (ImGui::Checkbox ("Draw Sky", &draw_sky)) atmosphere.set_enabled (draw_sky);
+	if (draw_sky)
+	{
+		cml::vec3f sun = atmosphere.get_sun_direction ();
+		float elevation = std::asin (std::clamp (sun.y, -1.f, 1.f)) * 180.f / 3.14159265f;
+		float azimuth = std::atan2 (sun.z, sun.x) * 180.f / 3.14159265f;
+		float illuminance = atmosphere.get_sun_illuminance ();
+		bool changed = ImGui::SliderFloat ("Sun Elevation", &elevation, -10.f, 90.f);
+		changed |= ImGui::SliderFloat ("Sun Azimuth", &azimuth, -180.f, 180.f);
+		changed |= ImGui::DragFloat ("Sun Illuminance", &illuminance, 0.1f, 0.f, 100.f);
+		if (changed)
+		{
+			float e = elevation * 3.14159265f / 180.f;
+			float a = azimuth * 3.14159265f / 180.f;
+			atmosphere.set_sun (cml::vec3f (std::cos (e) * std::cos (a), std::sin (e), std::cos (e) * std::sin (a)),
+			    atmosphere.get_sun_color (),
+			    illuminance);
+		}
+		ImGui::Text ("Last sky view bake: %.3f ms", atmosphere.get_bake_ms ());
+	}
+
+	auto& lighting = engine.vulkan_renderer.lighting;
+	if (lighting.has_environment ())
+	{
+		float intensity = lighting.get_environment_intensity ();
+		if (ImGui::DragFloat ("Environment Intensity", &intensity, 0.01f, 0.f, 100.f))
+			lighting.set_environment_intensity (intensity);
+	}
+
+	ImGui::End ();
+}
@@ -18,6 +18,9 @@ struct ImGUI_PanelSettings
 	bool debug_overlay = true;
 	bool controls_list = true;
 	bool controller_list = true;
+	bool profiler = true;
+	bool memory = true;
+	bool terrain = true;
 };
 
 class Editor
@@ -34,6 +37,15 @@ class Editor
 	void player_controller (bool* show_player_controller);
 	void controls_window (bool* show_controls_window);
 	void controller_window (bool* show_controller_window);
+	void profiler_window (bool* show_profiler);
+	void memory_window (bool* show_memory);
+	void terrain_window (bool* show_terrain);
+
+	TerrainHeightSource graph_height_source ();
+	// runs the graph on the GPU and checks every height against GraphUser
+	void compare_terrain_graph ();
+	double graph_max_error = -1.0; // negative until the first comparison
+	double graph_mean_error = 0.0;
 
 	ImGUI_PanelSettings panels;
 
@@ -0,0 +1,328 @@
+#include "GraphCodegen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "core/Logger.h"
+
+namespace InternalGraph
+{
+namespace
+{
+std::string float_literal (float value)
+{
+	if (!std::isfinite (value)) return "0.0";
+	std::string text = fmt::format ("{}", value);
+	if (text.find_first_of (".e") == std::string::npos) text += ".0";
+	return text;
+}
+
+char const* glsl_type (LinkType type)
+{
+	switch (type)
+	{
+		case LinkType::Int: return "int";
+		case LinkType::Vec2: return "vec2";
+		case LinkType::Vec3: return "vec3";
+		case LinkType::Vec4: return "vec4";
+		default: return "float";
+	}
+}
+
+// noise parameters are read from the link's stored value, like Node::SetupNodeForComputation does
+int int_parameter (Node const& node, int index)
+{
+	auto value = node.inputLinks.at (index).GetValue ();
+	if (auto i = std::get_if<int> (&value)) return *i;
+	if (auto f = std::get_if<float> (&value)) return static_cast<int> (*f);
+	return 0;
+}
+
+float float_parameter (Node const& node, int index)
+{
+	auto value = node.inputLinks.at (index).GetValue ();
+	if (auto f = std::get_if<float> (&value)) return *f;
+	if (auto i = std::get_if<int> (&value)) return static_cast<float> (*i);
+	return 0.f;
+}
+
+struct Expression
+{
+	std::string text;
+	LinkType type;
+};
+
+// Writes one local per node reached from a root, in dependency order
+class Emitter
+{
+	public:
+	explicit Emitter (NodeMap const& nodes) : nodes (nodes) {}
+
+	std::optional<std::string> input (Node const& node, int index, LinkType want);
+	std::string const& get_body () const { return body; }
+
+	private:
+	NodeMap const& nodes;
+	std::string body;
+	std::map<NodeID, Expression> emitted;
+	std::set<NodeID> visiting;
+
+	std::optional<Expression> emit (NodeID id);
+	std::optional<Expression> node_expression (Node const& node);
+	std::optional<std::string> noise_expression (Node const& node);
+};
+
+std::optional<std::string> convert (Expression const& expr, LinkType want)
+{
+	if (expr.type == want) return expr.text;
+	if (want == LinkType::Float && expr.type == LinkType::Int) return "float (" + expr.text + ")";
+	if (want == LinkType::Int && expr.type == LinkType::Float) return "int (" + expr.text + ")";
+	Log.error ("Graph codegen can't use a {} where a {} is expected", glsl_type (expr.type), glsl_type (want));
+	return std::nullopt;
+}
+
+std::optional<std::string> Emitter::input (Node const& node, int index, LinkType want)
+{
+	auto const& link = node.inputLinks.at (index);
+	if (link.HasInputNode ())
+	{
+		auto expr = emit (link.GetInputNode ());
+		if (!expr) return std::nullopt;
+		return convert (expr.value (), want);
+	}
+
+	auto value = link.GetValue ();
+	Expression literal;
+	if (auto i = std::get_if<int> (&value))
+		literal = { std::to_string (*i), LinkType::Int };
+	else if (auto f = std::get_if<float> (&value))
+		literal = { float_literal (*f), LinkType::Float };
+	else if (auto v2 = std::get_if<cml::vec2f> (&value))
+		literal = { fmt::format ("vec2 ({}, {})", float_literal (v2->x), float_literal (v2->y)), LinkType::Vec2 };
+	else if (auto v3 = std::get_if<cml::vec3f> (&value))
+		literal = { fmt::format ("vec3 ({}, {}, {})", float_literal (v3->x), float_literal (v3->y), float_literal (v3->z)),
+			LinkType::Vec3 };
+	else if (auto v4 = std::get_if<cml::vec4f> (&value))
+		literal = { fmt::format ("vec4 ({}, {}, {}, {})",
+			            float_literal (v4->x),
+			            float_literal (v4->y),
+			            float_literal (v4->z),
+			            float_literal (v4->w)),
+			LinkType::Vec4 };
+	return convert (literal, want);
+}
+
+std::optional<Expression> Emitter::emit (NodeID id)
+{
+	auto found = emitted.find (id);
+	if (found != emitted.end ()) return found->second;
+
+	auto node = nodes.find (id);
+	if (node == nodes.end ())
+	{
+		Log.error ("Graph codegen found a link to missing node {}", id);
+		return std::nullopt;
+	}
+	if (!visiting.insert (id).second)
+	{
+		Log.error ("Graph codegen found a cycle through node {}", id);
+		return std::nullopt;
+	}
+
+	auto expr = node_expression (node->second);
+	visiting.erase (id);
+	if (!expr) return std::nullopt;
+
+	std::string name = fmt::format ("n{}", id);
+	body += fmt::format ("\t{} {} = {};\n", glsl_type (expr->type), name, expr->text);
+	Expression local{ name, expr->type };
+	emitted.emplace (id, local);
+	return local;
+}
+
+std::optional<std::string> Emitter::noise_expression (Node const& node)
+{
+	int seed = int_parameter (node, 0);
+	std::string pos = "pos * " + float_literal (float_parameter (node, 1));
+
+	auto fractal = [&] (char const* kind) {
+		int octaves = std::max (int_parameter (node, 2), 1);
+		int type = int_parameter (node, 4);
+		char const* fractal_type = type == 2 ? "FractalRigidMulti" : (type == 1 ? "FractalBillow" : "FractalFBM");
+		return fmt::format ("NoiseFractal ({}, {}, {}, {}, {}, {})",
+		    kind,
+		    seed,
+		    pos,
+		    octaves,
+		    float_literal (float_parameter (node, 3)),
+		    fractal_type);
+	};
+
+	switch (node.GetNodeType ())
+	{
+		case NodeType::ValueNoise: return fractal ("NoiseValue");
+		case NodeType::PerlinNoise: return fractal ("NoisePerlin");
+		case NodeType::SimplexNoise: return fractal ("NoiseSimplex");
+		case NodeType::CubicNoise: return fractal ("NoiseCubic");
+		case NodeType::WhiteNoise: return fmt::format ("WhiteNoise ({}, {})", seed, pos);
+		case NodeType::CellNoise:
+		{
+			int return_type = int_parameter (node, 3);
+			if (return_type < 0 || return_type > 7) return_type = 0;
+			return fmt::format (
+			    "CellularNoise ({}, {}, {}, {})", seed, pos, float_literal (float_parameter (node, 2)), return_type);
+		}
+		case NodeType::VoronoiNoise:
+			return fmt::format (
+			    "CellularNoise ({}, {}, {}, CellValue)", seed, pos, float_literal (float_parameter (node, 2)));
+		default: return std::nullopt;
+	}
+}
+
+std::optional<Expression> Emitter::node_expression (Node const& node)
+{
+	// the CPU evaluator works on floats for every arithmetic node
+	auto binary = [&] (char const* op) -> std::optional<Expression> {
+		auto a = input (node, 0, LinkType::Float);
+		auto b = input (node, 1, LinkType::Float);
+		if (!a || !b) return std::nullopt;
+		return Expression{ fmt::format ("{} {} {}", a.value (), op, b.value ()), LinkType::Float };
+	};
+	auto call = [&] (char const* function) -> std::optional<Expression> {
+		auto a = input (node, 0, LinkType::Float);
+		auto b = input (node, 1, LinkType::Float);
+		if (!a || !b) return std::nullopt;
+		return Expression{ fmt::format ("{} ({}, {})", function, a.value (), b.value ()), LinkType::Float };
+	};
+	auto pass_through = [&] (LinkType type) -> std::optional<Expression> {
+		auto a = input (node, 0, type);
+		if (!a) return std::nullopt;
+		return Expression{ a.value (), type };
+	};
+
+	switch (node.GetNodeType ())
+	{
+		case NodeType::Addition: return binary ("+");
+		case NodeType::Subtraction: return binary ("-");
+		case NodeType::Multiplication: return binary ("*");
+		case NodeType::Division: return binary ("/");
+		case NodeType::Power: return call ("pow");
+		case NodeType::Max: return call ("max");
+		case NodeType::Min: return call ("min");
+
+		case NodeType::Blend:
+		{
+			auto a = input (node, 0, LinkType::Float);
+			auto b = input (node, 1, LinkType::Float);
+			auto alpha = input (node, 2, LinkType::Float);
+			if (!a || !b || !alpha) return std::nullopt;
+			return Expression{ fmt::format ("mix ({}, {}, {})", a.value (), b.value (), alpha.value ()), LinkType::Float };
+		}
+		case NodeType::Clamp:
+		{
+			auto value = input (node, 0, LinkType::Float);
+			auto lower = input (node, 1, LinkType::Float);
+			auto upper = input (node, 2, LinkType::Float);
+			if (!value || !lower || !upper) return std::nullopt;
+			return Expression{ fmt::format ("min (max ({}, {}), {})", value.value (), lower.value (), upper.value ()),
+				LinkType::Float };
+		}
+		case NodeType::Selector:
+		{
+			std::vector<std::string> args;
+			for (int i = 0; i < 6; i++)
+			{
+				auto arg = input (node, i, LinkType::Float);
+				if (!arg) return std::nullopt;
+				args.push_back (arg.value ());
+			}
+			return Expression{
+				fmt::format ("GraphSelect ({}, {}, {}, {}, {}, {})", args[0], args[1], args[2], args[3], args[4], args[5]),
+				LinkType::Float
+			};
+		}
+		case NodeType::Invert:
+		{
+			auto value = input (node, 0, LinkType::Float);
+			if (!value) return std::nullopt;
+			return Expression{ "1.0 - " + value.value (), LinkType::Float };
+		}
+		case NodeType::MonoGradient:
+		{
+			auto value = input (node, 0, LinkType::Float);
+			auto lower = input (node, 1, LinkType::Float);
+			auto upper = input (node, 2, LinkType::Float);
+			if (!value || !lower || !upper) return std::nullopt;
+			return Expression{ fmt::format ("{1} + {0} * ({2} - {1})", value.value (), lower.value (), upper.value ()),
+				LinkType::Float };
+		}
+		case NodeType::ColorCreator:
+		{
+			std::vector<std::string> args;
+			for (int i = 0; i < 4; i++)
+			{
+				auto arg = input (node, i, LinkType::Float);
+				if (!arg) return std::nullopt;
+				args.push_back (arg.value ());
+			}
+			return Expression{ fmt::format ("vec4 ({}, {}, {}, {})", args[0], args[1], args[2], args[3]), LinkType::Vec4 };
+		}
+
+		case NodeType::ConstantFloat: return pass_through (LinkType::Float);
+		case NodeType::ConstantInt:
+		case NodeType::TextureIndex:
+		case NodeType::FractalReturnType:
+		case NodeType::CellularReturnType: return pass_through (LinkType::Int);
+
+		case NodeType::ValueNoise:
+		case NodeType::SimplexNoise:
+		case NodeType::PerlinNoise:
+		case NodeType::CubicNoise:
+		case NodeType::WhiteNoise:
+		case NodeType::CellNoise:
+		case NodeType::VoronoiNoise:
+		{
+			auto noise = noise_expression (node);
+			if (!noise) return std::nullopt;
+			return Expression{ "(" + noise.value () + " + 1.0) * 0.5", LinkType::Float };
+		}
+
+		default:
+			Log.error ("Graph codegen doesn't support node type {}", static_cast<int> (node.GetNodeType ()));
+			return std::nullopt;
+	}
+}
+
+} // namespace
+
+std::optional<std::string> generate_compute_shader (GraphPrototype const& graph)
+{
+	NodeMap nodes = graph.GetNodeMap ();
+	auto output = nodes.find (graph.GetOutputNodeID ());
+	if (output == nodes.end () || output->second.GetNodeType () != NodeType::Output)
+	{
+		Log.error ("Graph codegen needs an output node");
+		return std::nullopt;
+	}
+
+	// both outputs share one body so nodes they have in common are evaluated once
+	Emitter emitter (nodes);
+	auto height = emitter.input (output->second, 0, LinkType::Float);
+	auto splat = emitter.input (output->second, 1, LinkType::Vec4);
+	if (!height || !splat) return std::nullopt;
+
+	std::string shader = "#version 450\n#extension GL_GOOGLE_include_directive : enable\n\n";
+	shader += "#include \"noise.glsl\"\n\n#include \"terrain_graph.glsl\"\n\n";
+	shader += "void GraphEvaluate (ivec2 cell, out float height, out vec4 splat)\n{\n";
+	shader += "\tvec3 pos = vec3 (float (cell.x), 0.0, float (cell.y)) * graph.scale;\n";
+	shader += emitter.get_body ();
+	// the output node maps the height from 0 to 1 into -1 to 1, see Node::get_heightMapValue
+	shader += "\theight = (" + height.value () + ") * 2.0 - 1.0;\n";
+	shader += "\tsplat = " + splat.value () + ";\n}\n";
+	return shader;
+}
+
+} // namespace InternalGraph
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "InternalGraph.h"
+
+namespace InternalGraph
+{
+
+// Translates graph into a GLSL compute shader that evaluates it for every terrain sample on the
+// GPU. Math nodes are inlined, noise nodes call the generators in common/noise.glsl and the
+// bindings come from common/terrain_graph.glsl. GraphUser stays the reference the output is
+// checked against. Logs and returns nothing when the graph can't be translated.
+std::optional<std::string> generate_compute_shader (GraphPrototype const& graph);
+
+} // namespace InternalGraph
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
 #include <map>
 #include <memory>
@@ -11,6 +12,8 @@
 
 #include <cml/cml.h>
 
+#include "core/MemoryTracker.h"
+
 namespace InternalGraph
 {
 
@@ -33,17 +36,18 @@ template <typename T> class NoiseImage2D
 	public:
 	NoiseImage2D (){};
 
-	~NoiseImage2D ()
-	{
-		if (image != nullptr) FastNoiseSIMD::FreeNoiseSet (image);
-	}
+	~NoiseImage2D () { FreeImage (); }
 
-	NoiseImage2D (NoiseImage2D const& node) : width (node.width), image (node.image) {}
+	// copies own their own noise set, the tracker counts each one
+	NoiseImage2D (NoiseImage2D const& node) { CopyImage (node); }
 
 	NoiseImage2D& operator= (NoiseImage2D const& node)
 	{
-		width = node.width;
-		image = node.image;
+		if (this != &node)
+		{
+			FreeImage ();
+			CopyImage (node);
+		}
 		return *this;
 	}
 
@@ -54,16 +58,22 @@ template <typename T> class NoiseImage2D
 
 	NoiseImage2D& operator= (NoiseImage2D&& node)
 	{
-		width = node.width;
-		image = node.image;
-		node.image = nullptr;
+		if (this != &node)
+		{
+			FreeImage ();
+			width = node.width;
+			image = node.image;
+			node.image = nullptr;
+		}
 		return *this;
 	}
 
 	void SetImage (int width, T* image)
 	{
+		FreeImage ();
 		this->width = width;
 		this->image = image;
+		if (image != nullptr) MemTracker.allocate (MemoryTag::noise_image, width * width * sizeof (T));
 	}
 
 	// No error look
@@ -86,6 +96,23 @@ template <typename T> class NoiseImage2D
 	private:
 	int width = 0;
 	T* image = nullptr;
+
+	void FreeImage ()
+	{
+		if (image == nullptr) return;
+		MemTracker.free (MemoryTag::noise_image, width * width * sizeof (T));
+		FastNoiseSIMD::FreeNoiseSet (image);
+		image = nullptr;
+	}
+
+	void CopyImage (NoiseImage2D const& node)
+	{
+		width = node.width;
+		if (node.image == nullptr) return;
+		image = FastNoiseSIMD::GetEmptySet (width * width);
+		std::copy_n (node.image, width * width, image);
+		MemTracker.allocate (MemoryTag::noise_image, width * width * sizeof (T));
+	}
 };
 
 template <typename T> float NoiseImage2D<T>::BilinearImageSample2D (const float x, const float z)
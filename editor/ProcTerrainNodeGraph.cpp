@@ -676,7 +676,7 @@ ConnectionType PossibleConnection::GetActiveSlotType (HoveredSlotInfo info, std:
 
 void ProcTerrainNodeGraph::SaveGraphFromFile ()
 {
-	Log.debug (fmt::format ("PWD = {}", std::filesystem::current_path ().string ()));
+	Log.debug ("PWD = {}", std::filesystem::current_path ().string ());
 	const char* filename = noc_file_dialog_open (
 	    NOC_FILE_DIALOG_SAVE, NULL, std::filesystem::current_path ().string ().c_str (), NULL);
 	if (filename != NULL)
@@ -794,7 +794,7 @@ void ProcTerrainNodeGraph::LoadGraphFromFile (std::string file_name)
 	}
 	catch (nlohmann::json::parse_error& e)
 	{
-		Log.error (fmt::format ("{}", e.what ()));
+		Log.error ("{}", e.what ());
 	}
 	inFile.close ();
 
@@ -891,7 +891,7 @@ void ProcTerrainNodeGraph::LoadGraphFromFile (std::string file_name)
 	}
 	catch (nlohmann::json::parse_error& e)
 	{
-		Log.error (fmt::format ("{}", e.what ()));
+		Log.error ("{}", e.what ());
 	}
 }
 
@@ -0,0 +1,771 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "rendering/Culling.h"
+#include "rendering/LightClusters.h"
+#include "rendering/Ocean.h"
+#include "rendering/OcclusionCulling.h"
+#include "rendering/TerrainLOD.h"
+#include "rendering/Renderer.h"
+#include "resources/Resource.h"
+#include "scene/BVH.h"
+#include "scene/Component.h"
+#include "scene/ECS.h"
+#include "scene/PlayerController.h"
+#include "scene/SystemScheduler.h"
+
+#include "JobSystem.h"
+#include "Logger.h"
+#include "MemoryTracker.h"
+#include "Profiler.h"
+
+BenchmarkSettings::BenchmarkSettings (std::filesystem::path file_name) : file_name (file_name)
+{
+	camera_path = { { cml::vec3f (0, 2, -10), 0.f, 0.f }, { cml::vec3f (0, 2, 10), 3.14159f, 0.f } };
+	load ();
+}
+
+void BenchmarkSettings::load ()
+{
+	if (std::filesystem::exists (file_name))
+	{
+		// missing keys keep their defaults, a malformed file leaves the rest at the defaults
+		try
+		{
+			std::ifstream input{ file_name.string () };
+			nlohmann::json j;
+			input >> j;
+
+			width = j.value ("width", width);
+			height = j.value ("height", height);
+			use_validation_layers = j.value ("use-validation-layers", use_validation_layers);
+			view_count = j.value ("view-count", view_count);
+			warmup_frames = j.value ("warmup-frames", warmup_frames);
+			frame_count = j.value ("frame-count", frame_count);
+
+			if (j.contains ("camera-path"))
+			{
+				std::vector<BenchmarkCameraKey> path;
+				for (auto& key : j["camera-path"])
+				{
+					auto position = key.value ("position", std::vector<float>{ 0.f, 0.f, 0.f });
+					position.resize (3, 0.f);
+					path.push_back (BenchmarkCameraKey{ cml::vec3f (position[0], position[1], position[2]),
+					    key.value ("yaw", 0.f),
+					    key.value ("pitch", 0.f) });
+				}
+				camera_path = std::move (path);
+			}
+
+			capture_dir = j.value ("capture-dir", capture_dir.string ());
+			capture_interval = j.value ("capture-interval", capture_interval);
+			report_file = j.value ("report-file", report_file.string ());
+		}
+		catch (nlohmann::json::exception& e)
+		{
+			Log.error ("Benchmark settings {} are malformed: {}", file_name.string (), e.what ());
+		}
+	}
+	else
+	{
+		Log.debug ("Benchmark settings file didn't exist, creating one");
+		save ();
+	}
+}
+
+void BenchmarkSettings::save ()
+{
+	nlohmann::json j;
+
+	j["width"] = width;
+	j["height"] = height;
+	j["use-validation-layers"] = use_validation_layers;
+	j["view-count"] = view_count;
+	j["warmup-frames"] = warmup_frames;
+	j["frame-count"] = frame_count;
+
+	j["camera-path"] = nlohmann::json::array ();
+	for (auto& key : camera_path)
+	{
+		j["camera-path"].push_back ({ { "position", { key.position.x, key.position.y, key.position.z } },
+		    { "yaw", key.yaw },
+		    { "pitch", key.pitch } });
+	}
+
+	j["capture-dir"] = capture_dir.string ();
+	j["capture-interval"] = capture_interval;
+	j["report-file"] = report_file.string ();
+
+	std::ofstream outFile (file_name);
+	outFile << std::setw (4) << j;
+	outFile.close ();
+}
+
+namespace
+{
+BenchmarkCameraKey sample_camera_path (std::vector<BenchmarkCameraKey> const& path, uint32_t frame, uint32_t frame_count)
+{
+	if (path.empty ()) return BenchmarkCameraKey{ cml::vec3f::zero };
+	if (path.size () == 1 || frame_count <= 1) return path.front ();
+
+	float t = static_cast<float> (frame) / static_cast<float> (frame_count - 1) * static_cast<float> (path.size () - 1);
+	size_t key = std::min (static_cast<size_t> (t), path.size () - 2);
+	float frac = t - static_cast<float> (key);
+
+	auto& a = path[key];
+	auto& b = path[key + 1];
+	return BenchmarkCameraKey{ cml::lerp (a.position, b.position, frac),
+		a.yaw + (b.yaw - a.yaw) * frac,
+		a.pitch + (b.pitch - a.pitch) * frac };
+}
+
+// nearest rank, frame_ms must be sorted
+double percentile (std::vector<double> const& frame_ms, double p)
+{
+	if (frame_ms.empty ()) return 0.0;
+	size_t index = static_cast<size_t> (p * static_cast<double> (frame_ms.size () - 1) + 0.5);
+	return frame_ms[std::min (index, frame_ms.size () - 1)];
+}
+
+double ms_since (uint64_t start) { return static_cast<double> (Profiler::now () - start) / 1000000.0; }
+
+// what every run starts with, count is the number of frames or iterations asked for
+bool begin_benchmark (char const* count_name, uint32_t count)
+{
+	if (count == 0)
+	{
+		Log.error ("{} must be greater than zero", count_name);
+		return false;
+	}
+	Prof.set_thread_name ("Main");
+	return true;
+}
+
+// fixed seed, so every run scatters the same scene
+std::mt19937 benchmark_rng () { return std::mt19937 (1234); }
+
+struct Timings
+{
+	double mean = 0.0;
+	double p50 = 0.0;
+	double p90 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+Timings summarize (std::vector<double> ms)
+{
+	Timings timings;
+	if (ms.empty ()) return timings;
+	std::sort (std::begin (ms), std::end (ms));
+	timings.mean = std::accumulate (std::begin (ms), std::end (ms), 0.0) / static_cast<double> (ms.size ());
+	timings.p50 = percentile (ms, 0.50);
+	timings.p90 = percentile (ms, 0.90);
+	timings.p99 = percentile (ms, 0.99);
+	timings.max = ms.back ();
+	return timings;
+}
+
+std::string format_timings (Timings const& timings)
+{
+	return fmt::format ("mean {:.3f} ms, p50 {:.3f} ms, p99 {:.3f} ms, max {:.3f} ms",
+	    timings.mean,
+	    timings.p50,
+	    timings.p99,
+	    timings.max);
+}
+} // namespace
+
+int run_benchmark (std::filesystem::path settings_file)
+{
+	BenchmarkSettings settings (settings_file);
+	if (!begin_benchmark ("Benchmark frame count", settings.frame_count)) return EXIT_FAILURE;
+
+	job::ThreadPool thread_pool;
+	Resource::Resources resources (thread_pool);
+
+	std::vector<double> frame_ms;
+	frame_ms.reserve (settings.frame_count);
+
+	struct GPUScopeTotal
+	{
+		double total_ms = 0.0;
+		uint32_t samples = 0;
+	};
+	std::map<std::string, GPUScopeTotal> gpu_totals;
+	VkDeviceSize peak_allocated_bytes = 0;
+	uint32_t view_count = 1; // what the renderer ended up drawing
+	bool terrain_virtual_texture = false; // from render_settings.json, to compare runs with and without
+	double render_scale_total = 0.0; // dynamic resolution, over the measured frames
+
+	try
+	{
+		VulkanRenderer renderer (settings.use_validation_layers,
+		    thread_pool,
+		    VkExtent2D{ settings.width, settings.height },
+		    resources,
+		    settings.view_count);
+		view_count = renderer.get_view_count ();
+		terrain_virtual_texture = renderer.terrain_renderer.get_virtual_texture ().is_enabled ();
+
+		auto camera = renderer.render_cameras.create (CameraType::perspective, cml::vec3f::zero, cml::quatf::identity);
+
+		if (settings.capture_interval > 0 && !settings.capture_dir.empty ())
+			std::filesystem::create_directories (settings.capture_dir);
+
+		uint32_t total_frames = settings.warmup_frames + settings.frame_count;
+		for (uint32_t i = 0; i < total_frames; i++)
+		{
+			bool measured = i >= settings.warmup_frames;
+			uint32_t frame = measured ? i - settings.warmup_frames : 0;
+
+			Prof.new_frame ();
+			MemTracker.new_frame ();
+			uint64_t frame_start = Profiler::now ();
+			{
+				PROFILE_SCOPE ("Frame");
+
+				auto key = sample_camera_path (settings.camera_path, frame, settings.frame_count);
+				auto cam = renderer.render_cameras.get_camera_data (camera);
+				cam.set_position (key.position);
+				cam.set_rotation (to_quaternion (key.yaw, key.pitch, 0.f));
+				cam.set_aspect_ratio (static_cast<float> (settings.width) / static_cast<float> (settings.height));
+				renderer.render_cameras.set_camera_data (camera, cam);
+
+				renderer.render_frame ();
+			}
+			uint64_t frame_end = Profiler::now ();
+
+			if (!measured) continue;
+
+			frame_ms.push_back (static_cast<double> (frame_end - frame_start) / 1000000.0);
+
+			// results lag a couple of frames behind, which evens out over the run
+			for (auto& scope : renderer.get_gpu_timings ())
+			{
+				auto& total = gpu_totals[scope.name];
+				total.total_ms += scope.ms;
+				total.samples++;
+			}
+			peak_allocated_bytes = std::max (peak_allocated_bytes, renderer.get_allocated_bytes ());
+			render_scale_total += renderer.get_render_scale ();
+
+			// captures stall the device, so they're taken after the frame time was recorded
+			if (settings.capture_interval > 0 && !settings.capture_dir.empty () && frame % settings.capture_interval == 0)
+			{
+				renderer.save_frame (settings.capture_dir / fmt::format ("frame_{:05}.png", frame));
+			}
+		}
+		renderer.device_wait ();
+		thread_pool.stop ();
+	}
+	catch (std::runtime_error const& e)
+	{
+		Log.error ("Benchmark failed: {}", e.what ());
+		return EXIT_FAILURE;
+	}
+
+	Timings timings = summarize (frame_ms);
+
+	nlohmann::json report;
+	report["width"] = settings.width;
+	report["height"] = settings.height;
+	report["frame-count"] = settings.frame_count;
+	report["view-count"] = view_count;
+	report["terrain-virtual-texture"] = terrain_virtual_texture;
+	report["cpu-frame-ms"] = { { "mean", timings.mean },
+		{ "p50", timings.p50 },
+		{ "p90", timings.p90 },
+		{ "p99", timings.p99 },
+		{ "max", timings.max } };
+	report["frames-ms"] = frame_ms;
+
+	report["gpu-scope-ms"] = nlohmann::json::object ();
+	for (auto& [name, total] : gpu_totals)
+	{
+		report["gpu-scope-ms"][name] = total.total_ms / static_cast<double> (total.samples);
+	}
+	report["peak-device-memory-bytes"] = peak_allocated_bytes;
+	report["mean-render-scale"] = render_scale_total / static_cast<double> (frame_ms.size ());
+
+	Log.debug ("Benchmark: {} frames, {}", settings.frame_count, format_timings (timings));
+	for (auto& [name, total] : gpu_totals)
+	{
+		Log.debug ("  gpu {}: {:.3f} ms", name, total.total_ms / static_cast<double> (total.samples));
+	}
+	Log.debug ("  device memory: {:.1f} MB", static_cast<double> (peak_allocated_bytes) / (1024.0 * 1024.0));
+
+	std::ofstream out_file (settings.report_file);
+	if (!out_file)
+	{
+		Log.error ("Couldn't open {} to write the benchmark report", settings.report_file.string ());
+		return EXIT_FAILURE;
+	}
+	out_file << std::setw (4) << report;
+	out_file.close ();
+	return EXIT_SUCCESS;
+}
+
+int run_ecs_benchmark (size_t entity_count, uint32_t frame_count)
+{
+	if (!begin_benchmark ("ECS benchmark frame count", frame_count)) return EXIT_FAILURE;
+	job::ThreadPool thread_pool;
+
+	ecs::World world;
+	uint64_t create_start = Profiler::now ();
+	for (size_t i = 0; i < entity_count; i++)
+	{
+		Transform transform;
+		transform.position = cml::vec3f (static_cast<float> (i % 1000), 0.f, static_cast<float> (i / 1000));
+		// every eighth entity is a light, so the systems see more than one archetype
+		if (i % 8 == 0)
+			world.create (transform, Bounds{ cml::vec3f::zero, 1.f }, LightComponent{});
+		else
+			world.create (transform, Bounds{ cml::vec3f::zero, 1.f }, MeshRendererComponent{});
+	}
+	double create_ms = ms_since (create_start);
+
+	// move and spin touch Transform so they are serialized, flicker only touches lights and runs alongside
+	const float dt = 1.f / 60.f;
+	const cml::quatf spin = to_quaternion (dt, 0.f, 0.f);
+	ecs::SystemScheduler systems;
+	systems.add_system ("move", {}, ecs::SystemScheduler::access<Transform> (), [dt] (ecs::World& w, job::ThreadPool& pool) {
+		w.par_each_chunk<Transform> (pool, [dt] (size_t count, ecs::Entity const*, Transform* transforms) {
+			for (size_t i = 0; i < count; i++)
+				transforms[i].position.y += dt;
+		});
+	});
+	systems.add_system ("spin",
+	    ecs::SystemScheduler::access<Bounds> (),
+	    ecs::SystemScheduler::access<Transform> (),
+	    [spin] (ecs::World& w, job::ThreadPool& pool) {
+		    w.par_each_chunk<Transform, Bounds> (pool, [spin] (size_t count, ecs::Entity const*, Transform* transforms, Bounds* bounds) {
+			    for (size_t i = 0; i < count; i++)
+				    if (bounds[i].radius > 0.f) transforms[i].rotation = spin * transforms[i].rotation;
+		    });
+	    });
+	systems.add_system ("flicker", {}, ecs::SystemScheduler::access<LightComponent> (), [dt] (ecs::World& w, job::ThreadPool& pool) {
+		w.par_each_chunk<LightComponent> (pool, [dt] (size_t count, ecs::Entity const*, LightComponent* lights) {
+			for (size_t i = 0; i < count; i++)
+				lights[i].intensity = cml::max (0.f, lights[i].intensity - dt);
+		});
+	});
+
+	std::vector<double> frame_ms;
+	frame_ms.reserve (frame_count);
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		Prof.new_frame ();
+		uint64_t frame_start = Profiler::now ();
+		systems.run (world, thread_pool);
+		frame_ms.push_back (ms_since (frame_start));
+	}
+	thread_pool.stop ();
+
+	Log.debug ("ECS benchmark: {} entities created in {:.3f} ms, {} stages, {} workers",
+	    world.entity_count (),
+	    create_ms,
+	    systems.get_stages ().size (),
+	    thread_pool.worker_count ());
+	Log.debug ("  update: {} frames, {}", frame_count, format_timings (summarize (frame_ms)));
+	return EXIT_SUCCESS;
+}
+
+int run_culling_benchmark (size_t object_count, uint32_t iterations)
+{
+	if (!begin_benchmark ("Culling benchmark iteration count", iterations)) return EXIT_FAILURE;
+	job::ThreadPool thread_pool;
+
+	// objects scattered over a 2km square, half spheres and half boxes
+	auto rng = benchmark_rng ();
+	std::uniform_real_distribution<float> position (-1000.f, 1000.f);
+	std::uniform_real_distribution<float> height (0.f, 100.f);
+	std::uniform_real_distribution<float> size (0.5f, 10.f);
+	CullingBounds bounds;
+	for (size_t i = 0; i < object_count; i++)
+	{
+		cml::vec3f center (position (rng), height (rng), position (rng));
+		float s = size (rng);
+		if (i % 2 == 0)
+			bounds.add_sphere (center, s);
+		else
+			bounds.add_aabb (center - cml::vec3f (s, s * 0.5f, s), center + cml::vec3f (s, s * 0.5f, s));
+	}
+
+	// a main view, two stereo eyes and four shadow cascade style orthographic views
+	std::vector<Frustum> frustums;
+	cml::mat4f main_proj_view;
+	for (int i = 0; i < 7; i++)
+	{
+		ViewCameraData cam;
+		cam.Setup (i < 3 ? CameraType::perspective : CameraType::orthographic,
+		    cml::vec3f (static_cast<float> (i) * 0.1f, 20.f, 0.f),
+		    to_quaternion (static_cast<float> (i) * 0.5f, 0.f, 0.f));
+		cam.set_aspect_ratio (16.f / 9.f);
+		cam.set_clip_far (1000.f);
+		if (i >= 3) cam.set_view_size (50.f * static_cast<float> (i - 2));
+		if (i == 0) main_proj_view = cam.get_proj_view_mat ();
+		frustums.push_back (extract_frustum (cam.get_proj_view_mat ()));
+	}
+
+	FrustumCuller culler;
+	std::vector<double> iteration_ms;
+	iteration_ms.reserve (iterations);
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		Prof.new_frame ();
+		uint64_t start = Profiler::now ();
+		culler.cull (thread_pool, bounds, frustums);
+		iteration_ms.push_back (ms_since (start));
+	}
+
+	// occlusion stage for the main view, rolling hills stand in for coarse terrain
+	const uint32_t terrain_resolution = 64;
+	std::vector<float> terrain_heights (terrain_resolution * terrain_resolution);
+	for (uint32_t z = 0; z < terrain_resolution; z++)
+		for (uint32_t x = 0; x < terrain_resolution; x++)
+			terrain_heights[z * terrain_resolution + x] =
+			    40.f + 60.f * std::sin (static_cast<float> (x) * 0.3f) * std::cos (static_cast<float> (z) * 0.3f);
+
+	OcclusionCuller occlusion;
+	std::vector<uint32_t> main_visible = culler.get_visible (0);
+	size_t frustum_visible = main_visible.size ();
+	uint64_t occlusion_start = Profiler::now ();
+	occlusion.begin_frame (main_proj_view);
+	occlusion.add_heightfield_occluder (terrain_heights, terrain_resolution, cml::vec3f (-1000.f, 0.f, -1000.f), 2000.f);
+	occlusion.render (thread_pool);
+	double occlusion_render_ms = ms_since (occlusion_start);
+	occlusion.filter (thread_pool, bounds, main_visible);
+	double occlusion_ms = ms_since (occlusion_start);
+	thread_pool.stop ();
+
+	Log.debug ("Culling benchmark: {} objects, {} frustums, {} iterations", bounds.size (), frustums.size (), iterations);
+	Log.debug ("  {}", format_timings (summarize (iteration_ms)));
+	for (uint32_t f = 0; f < frustums.size (); f++)
+	{
+		Log.debug ("  frustum {}: {} visible", f, culler.get_visible (f).size ());
+	}
+	Log.debug ("  occlusion: {} of {} main view objects left, {:.3f} ms ({:.3f} ms rasterizing)",
+	    main_visible.size (),
+	    frustum_visible,
+	    occlusion_ms,
+	    occlusion_render_ms);
+	return EXIT_SUCCESS;
+}
+
+int run_bvh_benchmark (size_t object_count, uint32_t iterations)
+{
+	if (!begin_benchmark ("BVH benchmark iteration count", iterations)) return EXIT_FAILURE;
+	job::ThreadPool thread_pool;
+
+	auto rng = benchmark_rng ();
+	std::uniform_real_distribution<float> position (-1000.f, 1000.f);
+	std::uniform_real_distribution<float> height (0.f, 100.f);
+	std::uniform_real_distribution<float> size (0.5f, 10.f);
+	std::vector<AABB> boxes (object_count);
+	CullingBounds brute_bounds;
+	for (auto& box : boxes)
+	{
+		cml::vec3f center (position (rng), height (rng), position (rng));
+		cml::vec3f extent (size (rng), size (rng), size (rng));
+		box = AABB{ center - extent, center + extent };
+		brute_bounds.add_aabb (box.min, box.max);
+	}
+
+	BVH bvh;
+	uint64_t build_start = Profiler::now ();
+	bvh.build (thread_pool, boxes);
+	double build_ms = ms_since (build_start);
+
+	uint64_t refit_start = Profiler::now ();
+	bvh.refit (boxes);
+	double refit_ms = ms_since (refit_start);
+
+	ViewCameraData cam;
+	cam.Setup (CameraType::perspective, cml::vec3f (0.f, 50.f, 0.f), cml::quatf::identity);
+	cam.set_aspect_ratio (16.f / 9.f);
+	cam.set_clip_far (1000.f);
+	std::vector<Frustum> frustums = { extract_frustum (cam.get_proj_view_mat ()) };
+
+	// both sides run on one thread, the BVH query is single threaded by design
+	std::vector<uint32_t> bvh_visible;
+	double bvh_ms = 0.0;
+	double brute_ms = 0.0;
+	size_t brute_visible = 0;
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		bvh_visible.clear ();
+		uint64_t start = Profiler::now ();
+		bvh.cull (frustums[0], bvh_visible);
+		bvh_ms += ms_since (start);
+
+		start = Profiler::now ();
+		brute_visible = 0;
+		auto frustum = frustums[0];
+		for (auto& box : boxes)
+		{
+			cml::vec3f c = box.center ();
+			cml::vec3f e = (box.max - box.min) * 0.5f;
+			bool inside = true;
+			for (auto& p : frustum.planes)
+			{
+				float dist = c.x * p.x + c.y * p.y + c.z * p.z + p.w;
+				float reach = e.x * std::abs (p.x) + e.y * std::abs (p.y) + e.z * std::abs (p.z);
+				inside = inside && dist >= -reach;
+			}
+			if (inside) brute_visible++;
+		}
+		brute_ms += ms_since (start);
+	}
+
+	// the SIMD brute force path uses the thread pool, reported for reference
+	FrustumCuller culler;
+	uint64_t simd_start = Profiler::now ();
+	for (uint32_t i = 0; i < iterations; i++)
+		culler.cull (thread_pool, brute_bounds, frustums);
+	double simd_ms = ms_since (simd_start);
+
+	const uint32_t ray_count = 10000;
+	uint32_t ray_hits = 0;
+	uint64_t ray_start = Profiler::now ();
+	for (uint32_t i = 0; i < ray_count; i++)
+	{
+		if (bvh.height_at (position (rng), position (rng))) ray_hits++;
+	}
+	double ray_ms = ms_since (ray_start);
+	thread_pool.stop ();
+
+	Log.debug ("BVH benchmark: {} objects, {} nodes, build {:.3f} ms, refit {:.3f} ms",
+	    bvh.primitive_count (),
+	    bvh.node_count (),
+	    build_ms,
+	    refit_ms);
+	Log.debug ("  cull: bvh {:.3f} ms ({} visible), brute force {:.3f} ms ({} visible), simd brute force {:.3f} ms",
+	    bvh_ms / iterations,
+	    bvh_visible.size (),
+	    brute_ms / iterations,
+	    brute_visible,
+	    simd_ms / iterations);
+	Log.debug ("  height queries: {} in {:.3f} ms, {} hits", ray_count, ray_ms, ray_hits);
+	return EXIT_SUCCESS;
+}
+
+int run_light_cluster_benchmark (size_t light_count, uint32_t iterations)
+{
+	if (!begin_benchmark ("Light cluster benchmark iteration count", iterations)) return EXIT_FAILURE;
+	job::ThreadPool thread_pool;
+
+	// lights scattered around the camera, four point lights to every spot light
+	auto rng = benchmark_rng ();
+	std::uniform_real_distribution<float> position (-200.f, 200.f);
+	std::uniform_real_distribution<float> height (0.f, 20.f);
+	std::uniform_real_distribution<float> range (2.f, 15.f);
+	std::vector<LightSphere> points;
+	std::vector<LightSphere> spots;
+	for (size_t i = 0; i < light_count; i++)
+	{
+		LightSphere light{ cml::vec3f (position (rng), height (rng), position (rng)), range (rng) };
+		if (i % 5 == 4)
+			spots.push_back (light);
+		else
+			points.push_back (light);
+	}
+	if (points.size () > LightClusterGrid::MaxLightCount || spots.size () > LightClusterGrid::MaxLightCount)
+	{
+		Log.error ("Light cluster benchmark supports at most {} lights of each kind", LightClusterGrid::MaxLightCount);
+		return EXIT_FAILURE;
+	}
+
+	ViewCameraData cam;
+	cam.Setup (CameraType::perspective, cml::vec3f (0.f, 10.f, 0.f), cml::quatf::identity);
+	cam.set_aspect_ratio (16.f / 9.f);
+	cam.set_clip_near (0.1f);
+	cam.set_clip_far (1000.f);
+
+	LightClusterGrid grid;
+	std::vector<double> iteration_ms;
+	iteration_ms.reserve (iterations);
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		// turn the camera a little every iteration so the lights move through the grid
+		cam.set_rotation (to_quaternion (static_cast<float> (i) * 0.05f, 0.f, 0.f));
+		uint64_t start = Profiler::now ();
+		grid.build (thread_pool,
+		    cam.get_view_mat (),
+		    cam.get_proj_mat (),
+		    cam.get_clip_near (),
+		    cam.get_clip_far (),
+		    1920.f,
+		    1080.f,
+		    points,
+		    spots);
+		iteration_ms.push_back (ms_since (start));
+	}
+	thread_pool.stop ();
+
+	size_t occupied = 0;
+	uint32_t most_lights = 0;
+	for (auto& cluster : grid.get_clusters ())
+	{
+		uint32_t count = cluster.point_count + cluster.spot_count;
+		if (count > 0) occupied++;
+		most_lights = std::max (most_lights, count);
+	}
+
+	Log.debug ("Light cluster benchmark: {} point lights, {} spot lights, {} clusters, {} iterations",
+	    points.size (),
+	    spots.size (),
+	    LightClusterGrid::ClusterCount,
+	    iterations);
+	Log.debug ("  {}", format_timings (summarize (iteration_ms)));
+	Log.debug ("  last build: {} indices, {} occupied clusters, at most {} lights in a cluster{}",
+	    grid.get_indices ().size (),
+	    occupied,
+	    most_lights,
+	    grid.overflowed () ? ", index list overflowed" : "");
+	return EXIT_SUCCESS;
+}
+
+int run_terrain_lod_benchmark (uint32_t iterations)
+{
+	if (!begin_benchmark ("Terrain LOD benchmark iteration count", iterations)) return EXIT_FAILURE;
+
+	// rolling hills from a few sine waves, sampled on the same grid the graph would fill
+	TerrainQuadtree terrain;
+	auto const& settings = terrain.get_settings ();
+	uint32_t samples = settings.tile_samples;
+	uint32_t step = samples - 1;
+	for (uint32_t tile_z = 0; tile_z < settings.tile_count; tile_z++)
+		for (uint32_t tile_x = 0; tile_x < settings.tile_count; tile_x++)
+		{
+			std::vector<float> heights;
+			heights.reserve (samples * samples);
+			for (uint32_t x = 0; x < samples; x++)
+				for (uint32_t z = 0; z < samples; z++)
+				{
+					float gx = static_cast<float> (tile_x * step + x);
+					float gz = static_cast<float> (tile_z * step + z);
+					heights.push_back (0.5f + 0.3f * std::sin (gx * 0.004f) * std::cos (gz * 0.005f) +
+					                   0.15f * std::sin (gx * 0.031f + gz * 0.017f));
+				}
+			terrain.set_tile (tile_x, tile_z, heights);
+		}
+	terrain.update_bounds ();
+
+	ViewCameraData cam;
+	cam.Setup (CameraType::perspective, cml::vec3f (0.f, 0.f, 0.f), cml::quatf::identity);
+	cam.set_aspect_ratio (16.f / 9.f);
+	cam.set_clip_near (0.1f);
+	cam.set_clip_far (10000.f);
+
+	std::vector<TerrainPatch> patches;
+	std::array<uint32_t, 4> quadrant_counts;
+	TerrainSelectionStats stats;
+	std::array<uint64_t, TerrainSelectionStats::MaxLods> lod_totals = {};
+	uint64_t patch_total = 0;
+
+	std::vector<double> iteration_ms;
+	iteration_ms.reserve (iterations);
+	for (uint32_t i = 0; i < iterations; i++)
+	{
+		// fly a circle over the terrain, a little above the ground, looking along the path
+		float angle = static_cast<float> (i) / static_cast<float> (iterations) * 6.28318f;
+		float x = std::cos (angle) * settings.world_size * 0.3f;
+		float z = std::sin (angle) * settings.world_size * 0.3f;
+		cam.set_position (cml::vec3f (x, terrain.get_height (x, z) + 20.f, z));
+		cam.set_rotation (to_quaternion (-angle, -0.2f, 0.f));
+
+		uint64_t start = Profiler::now ();
+		stats = terrain.select (cam.get_position (), extract_frustum (cam.get_proj_view_mat ()), patches, quadrant_counts);
+		iteration_ms.push_back (ms_since (start));
+
+		patch_total += stats.patch_count;
+		for (uint32_t lod = 0; lod < settings.lod_count; lod++)
+			lod_totals[lod] += stats.nodes_per_lod[lod];
+	}
+
+	Log.debug ("Terrain LOD benchmark: {} samples per side, {} levels, {} iterations",
+	    terrain.samples_per_side (),
+	    settings.lod_count,
+	    iterations);
+	Log.debug ("  {}", format_timings (summarize (iteration_ms)));
+	Log.debug ("  mean {:.1f} patches, {} triangles each",
+	    static_cast<double> (patch_total) / iterations,
+	    settings.grid_resolution * settings.grid_resolution / 2);
+	for (uint32_t lod = 0; lod < settings.lod_count; lod++)
+		Log.debug ("  lod {}: range {:.0f}, mean {:.1f} nodes",
+		    lod,
+		    terrain.get_range (lod),
+		    static_cast<double> (lod_totals[lod]) / iterations);
+	return EXIT_SUCCESS;
+}
+
+int run_ocean_benchmark (uint32_t iterations)
+{
+	if (!begin_benchmark ("Ocean benchmark iteration count", iterations)) return EXIT_FAILURE;
+	job::ThreadPool thread_pool;
+
+	// the full cascade set, then one cascade alone to compare against the 1 ms per 256x256 target
+	OceanSettings settings;
+	OceanSettings single = settings;
+	single.cascade_count = 1;
+	OceanSimulation ocean (settings);
+	OceanSimulation single_ocean (single);
+
+	auto time_simulation = [&] (OceanSimulation& simulation) {
+		std::vector<double> iteration_ms;
+		iteration_ms.reserve (iterations);
+		for (uint32_t i = 0; i < iterations; i++)
+		{
+			uint64_t start = Profiler::now ();
+			simulation.simulate (thread_pool, static_cast<float> (i) / 60.f);
+			iteration_ms.push_back (ms_since (start));
+		}
+		return summarize (iteration_ms);
+	};
+
+	Log.debug ("Ocean benchmark: {}x{} FFT, {} cascades, {} threads, {} iterations",
+	    settings.resolution,
+	    settings.resolution,
+	    settings.cascade_count,
+	    thread_pool.worker_count () + 1,
+	    iterations);
+	for (auto* simulation : { &single_ocean, &ocean })
+	{
+		Timings timings = time_simulation (*simulation);
+		uint32_t cascades = simulation->get_settings ().cascade_count;
+		Log.debug ("  {} cascade{}: {}, {:.3f} ms per cascade",
+		    cascades,
+		    cascades == 1 ? "" : "s",
+		    format_timings (timings),
+		    timings.mean / cascades);
+	}
+
+	for (uint32_t cascade = 0; cascade < settings.cascade_count; cascade++)
+	{
+		double squares = 0.0;
+		float highest = 0.f;
+		for (auto const& texel : ocean.get_texels (cascade))
+		{
+			squares += static_cast<double> (texel.displacement[1]) * texel.displacement[1];
+			highest = std::max (highest, std::abs (texel.displacement[1]));
+		}
+		Log.debug ("  cascade {}: {:.1f} m tile, rms height {:.3f} m, max {:.3f} m",
+		    cascade,
+		    settings.patch_sizes[cascade],
+		    std::sqrt (squares / static_cast<double> (ocean.get_texels (cascade).size ())),
+		    highest);
+	}
+	return EXIT_SUCCESS;
+}
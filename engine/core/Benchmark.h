@@ -0,0 +1,72 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "cml/cml.h"
+
+struct BenchmarkCameraKey
+{
+	cml::vec3f position;
+	float yaw = 0.f; // radians
+	float pitch = 0.f;
+};
+
+class BenchmarkSettings
+{
+	public:
+	BenchmarkSettings (std::filesystem::path file_name);
+	void load ();
+	void save ();
+
+	uint32_t width = 1280;
+	uint32_t height = 720;
+	bool use_validation_layers = false;
+	// 2 renders a stereo pair in one multiview pass, captures show the eyes side by side
+	uint32_t view_count = 1;
+
+	uint32_t warmup_frames = 60;
+	uint32_t frame_count = 1000;
+
+	// keys are spread evenly over frame_count and linearly interpolated
+	std::vector<BenchmarkCameraKey> camera_path;
+
+	// every capture_interval'th measured frame is written to capture_dir, 0 disables captures
+	std::filesystem::path capture_dir;
+	uint32_t capture_interval = 0;
+
+	std::filesystem::path report_file = "benchmark_report.json";
+
+	private:
+	std::filesystem::path file_name;
+};
+
+// Renders a fixed number of frames headless along the scripted camera path and writes a report
+// of CPU frame time percentiles, average GPU pass times and device memory use.
+// Returns a process exit code.
+int run_benchmark (std::filesystem::path settings_file);
+
+// Creates entity_count entities in an ecs::World and times frame_count scheduler runs of a few
+// systems touching them, logging per frame percentiles. Returns a process exit code.
+int run_ecs_benchmark (size_t entity_count, uint32_t frame_count = 100);
+
+// Frustum culls object_count random bounds against a set of cameras with FrustumCuller and logs
+// per iteration percentiles. Returns a process exit code.
+int run_culling_benchmark (size_t object_count, uint32_t iterations = 100);
+
+// Builds a BVH over object_count random boxes and compares culling through it against brute force
+// culling of the same boxes, then times ray and height queries. Returns a process exit code.
+int run_bvh_benchmark (size_t object_count, uint32_t iterations = 100);
+
+// Bins light_count random point and spot lights into a LightClusterGrid from a turning camera and
+// logs per iteration percentiles. Returns a process exit code.
+int run_light_cluster_benchmark (size_t light_count, uint32_t iterations = 100);
+
+// Selects CDLOD terrain patches over a synthetic heightfield from a camera flying across it and
+// logs per iteration percentiles and the nodes picked per level. Returns a process exit code.
+int run_terrain_lod_benchmark (uint32_t iterations = 1000);
+
+// Simulates the FFT ocean on the job system, once with a single cascade and once with all of them,
+// and logs per iteration percentiles and the wave heights of every cascade. Returns a process exit code.
+int run_ocean_benchmark (uint32_t iterations = 100);
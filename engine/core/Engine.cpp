@@ -91,7 +91,7 @@ Engine::Engine ()
 {
 	input.set_mouse_control_status (false);
 
-	Log.debug (fmt::format ("Hardware Threads Available = {}", HardwareThreadCount ()));
+	Log.debug ("Hardware Threads Available = {}", HardwareThreadCount ());
 
 	openxr = create_openxr (vulkan_renderer.get_openxr_init ());
 
@@ -115,9 +115,14 @@ Engine::~Engine ()
 
 void Engine::run ()
 {
+	Prof.set_thread_name ("Main");
 
 	while (!window.should_window_close ())
 	{
+		Prof.new_frame ();
+		MemTracker.new_frame ();
+		PROFILE_SCOPE ("Frame");
+
 		if (window.should_window_resize ())
 		{
 			if (!window.is_window_iconified ())
@@ -140,6 +145,7 @@ void Engine::run ()
 		{
 			if (time.exact_time_since_frame_start () < 1.0 / settings.MaxFPS)
 			{
+				PROFILE_SCOPE ("Frame Limiter");
 				std::this_thread::sleep_for (std::chrono::duration<double> (
 				    1.0 / settings.MaxFPS - time.exact_time_since_frame_start () - (1.0 / settings.MaxFPS) / 10.0));
 			}
@@ -155,6 +161,7 @@ void Engine::run ()
 void Engine::build_imgui ()
 {
 
+	PROFILE_SCOPE ("Engine::build_imgui");
 	imGuiTimer.start_timer ();
 
 	vulkan_renderer.imgui_new_frame ();
@@ -187,11 +194,11 @@ void Engine::process_inputs ()
 		// 	Log.debug ("Wireframe toggle");
 		// }
 
-		// if (input.get_key_down (Input::KeyCode::F))
-		// {
-		// 	scene.walkOnGround = !scene.walkOnGround;
-		// 	Log.debug ("flight mode toggled");
-		// }
+		if (input.get_key_down (Input::KeyCode::F))
+		{
+			scene.walk_on_ground = !scene.walk_on_ground;
+			Log.debug ("flight mode toggled");
+		}
 	}
 	else
 	{
@@ -14,7 +14,9 @@
 #include "Input.h"
 #include "JobSystem.h"
 #include "Logger.h"
+#include "MemoryTracker.h"
 #include "OpenXR.h"
+#include "Profiler.h"
 #include "Time.h"
 #include "Window.h"
 
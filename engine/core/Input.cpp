@@ -117,7 +117,7 @@ bool InputDirector::get_mouse_control_status () const { return mouseControlStatu
 void InputDirector::set_mouse_control_status (bool value)
 {
 	mouseControlStatus = value;
-	Log.debug (fmt::format ("Mouse control status {}", value));
+	Log.debug ("Mouse control status {}", value);
 	if (mouseControlStatus)
 	{
 		glfwSetInputMode (window.get_window_context (), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -1,6 +1,9 @@
 #include "JobSystem.h"
 
+#include <algorithm>
+
 #include "Logger.h"
+#include "Profiler.h"
 
 unsigned int HardwareThreadCount ()
 {
@@ -64,6 +67,7 @@ void Task::run ()
 	{
 		if (!sbp->is_cancelled ())
 		{
+			PROFILE_SCOPE ("Task");
 			m_job ();
 		}
 		sbp->signal ();
@@ -91,7 +95,8 @@ ThreadPool::ThreadPool ()
 	int thread_count = static_cast<int> (HardwareThreadCount ());
 	for (int i = 0; i < thread_count; i++)
 	{
-		worker_threads.emplace_back (std::thread ([this] {
+		worker_threads.emplace_back (std::thread ([this, i] {
+			Prof.set_thread_name (fmt::format ("Worker {}", i));
 			while (continue_working)
 			{
 				{
@@ -154,7 +159,7 @@ void ThreadPool::submit (std::vector<Task> in_tasks)
 std::optional<Task> ThreadPool::get_task ()
 {
 	std::lock_guard lg (queue_lock);
-	// Log.debug (fmt::format ("queue size {}", task_queue.size ()));
+	// Log.debug ("queue size {}", task_queue.size ());
 	while (!task_queue.empty ())
 	{
 		auto val = task_queue.front ();
@@ -166,6 +171,87 @@ std::optional<Task> ThreadPool::get_task ()
 	return {};
 }
 
+void parallel_for (
+    ThreadPool& pool, size_t count, size_t grain_size, std::function<void (size_t begin, size_t end)> const& fn)
+{
+	if (count == 0) return;
+	grain_size = std::max<size_t> (grain_size, 1);
+	size_t range_count = (count + grain_size - 1) / grain_size;
+	if (range_count == 1)
+	{
+		fn (0, count);
+		return;
+	}
+
+	// shared so helpers that only get scheduled after we returned find nothing left to do
+	struct State
+	{
+		std::atomic<size_t> next_range = 0;
+		std::atomic<size_t> finished_ranges = 0;
+		size_t count;
+		size_t grain_size;
+		size_t range_count;
+		std::function<void (size_t, size_t)> fn;
+	};
+	auto state = std::make_shared<State> ();
+	state->count = count;
+	state->grain_size = grain_size;
+	state->range_count = range_count;
+	state->fn = fn;
+
+	auto work = [state] {
+		size_t range;
+		while ((range = state->next_range++) < state->range_count)
+		{
+			size_t begin = range * state->grain_size;
+			state->fn (begin, std::min (begin + state->grain_size, state->count));
+			state->finished_ranges++;
+		}
+	};
+
+	auto signal = std::make_shared<TaskSignal> ();
+	size_t helper_count = std::min (range_count - 1, pool.worker_count ());
+	std::vector<Task> tasks;
+	for (size_t i = 0; i < helper_count; i++)
+		tasks.emplace_back (WorkFuncSig (work), signal);
+	pool.submit (tasks);
+
+	work ();
+	while (state->finished_ranges.load () < range_count)
+		std::this_thread::yield ();
+}
+
+// BackgroundJob
+
+BackgroundJob::~BackgroundJob () { wait (); }
+
+void BackgroundJob::start (ThreadPool& pool, WorkFuncSig&& work)
+{
+	wait ();
+	state = std::make_shared<State> ();
+	state->work = std::move (work);
+	// tasks only run while their signal is alive
+	state->signal = std::make_shared<TaskSignal> ();
+	pool.submit ([state = state] { run (*state); }, state->signal);
+}
+
+void BackgroundJob::wait ()
+{
+	if (!state) return;
+	run (*state);
+	while (!state->done.load ())
+		std::this_thread::yield ();
+}
+
+bool BackgroundJob::is_done () const { return !state || state->done.load (); }
+
+void BackgroundJob::run (State& state)
+{
+	if (state.claimed.exchange (true)) return;
+	state.work ();
+	state.done = true;
+}
+
 std::vector<std::thread::id> ThreadPool::get_thread_ids ()
 {
 	std::vector<std::thread::id> ids;
@@ -188,7 +274,7 @@ class JobTesterClass
 	{
 		for (auto& n : nums)
 		{
-			Log.debug (fmt::format ("{} ", n));
+			Log.debug ("{} ", n);
 		}
 	}
 
@@ -222,7 +308,7 @@ void JobTesterClass::MulNumAddNum (int num1, int num2)
 
 bool JobTester ()
 {
-	Log.debug (fmt::format ("Job system test: start"));
+	Log.debug ("Job system test: start");
 
 	ThreadPool tMan;
 
@@ -250,7 +336,7 @@ bool JobTester ()
 
 	signal2->wait ();
 	jtc.Print ();
-	Log.debug (fmt::format ("Job system test: done"));
+	Log.debug ("Job system test: done");
 	return true;
 }
 } // namespace job
\ No newline at end of file
@@ -79,6 +79,7 @@ class ThreadPool
 	std::optional<Task> get_task ();
 
 	std::vector<std::thread::id> get_thread_ids ();
+	size_t worker_count () const { return worker_threads.size (); }
 
 	private:
 	std::mutex queue_lock;
@@ -90,6 +91,42 @@ class ThreadPool
 	std::mutex workSubmittedLock;
 	std::condition_variable workSubmittedCondVar;
 };
+
+// One piece of work running on the pool in the background, for work a frame starts and a later
+// point waits on. If no worker picked it up by the time wait is called, the caller runs it itself,
+// so it finishes even with every worker busy.
+class BackgroundJob
+{
+	public:
+	BackgroundJob () = default;
+	~BackgroundJob ();
+	BackgroundJob (BackgroundJob const& other) = delete;
+	BackgroundJob& operator= (BackgroundJob const& other) = delete;
+
+	// waits for the previous work first
+	void start (ThreadPool& pool, WorkFuncSig&& work);
+	void wait ();
+	// also true when nothing was started
+	bool is_done () const;
+
+	private:
+	struct State
+	{
+		std::atomic_bool claimed = false;
+		std::atomic_bool done = false;
+		WorkFuncSig work;
+		std::shared_ptr<TaskSignal> signal;
+	};
+	std::shared_ptr<State> state;
+
+	static void run (State& state);
+};
+
+// Splits [0, count) into ranges of grain_size and runs them across the pool. The calling thread
+// works through ranges too and only returns once all of them are done, so it's safe to call from
+// inside another task.
+void parallel_for (
+    ThreadPool& pool, size_t count, size_t grain_size, std::function<void (size_t begin, size_t end)> const& fn);
 } // namespace job
 
 namespace
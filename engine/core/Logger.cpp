@@ -1,12 +1,59 @@
 #include "Logger.h"
 
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <cstdio>
-#include <iostream>
-#include <mutex>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 Logger Log;
-std::mutex log_lock;
 
+thread_local Logger::LocalBuffer Logger::local_buffer;
+
+namespace
+{
+uint64_t log_time_ns ()
+{
+	return static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (
+	    std::chrono::steady_clock::now ().time_since_epoch ())
+	                                  .count ());
+}
+
+const int CrashSignals[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL };
+const size_t CrashSignalCount = sizeof (CrashSignals) / sizeof (CrashSignals[0]);
+
+#if defined(_WIN32)
+using CrashAction = void (*) (int);
+#else
+using CrashAction = struct sigaction;
+#endif
+CrashAction previous_actions[CrashSignalCount];
+bool crash_handlers_installed = false;
+
+// preallocated, the crash handler can't allocate
+char crash_line[Logger::RecordTextSize + 1];
+
+void crash_write (int fd, char const* data, size_t size)
+{
+	if (fd < 0) return;
+#if defined(_WIN32)
+	_write (fd, data, static_cast<unsigned int> (size));
+#else
+	while (size > 0)
+	{
+		ssize_t written = ::write (fd, data, size);
+		if (written <= 0) return;
+		data += written;
+		size -= static_cast<size_t> (written);
+	}
+#endif
+}
+} // namespace
 
 Logger::OutputFileHandle::OutputFileHandle (std::string file_name)
 {
@@ -14,29 +61,275 @@ Logger::OutputFileHandle::OutputFileHandle (std::string file_name)
 	if (!fp)
 	{
 		fmt::print ("File opening failed");
+		return;
 	}
+#if defined(_WIN32)
+	fd = _fileno (fp);
+#else
+	fd = fileno (fp);
+#endif
 }
 
-Logger::OutputFileHandle::~OutputFileHandle () { std::fclose (fp); }
+Logger::OutputFileHandle::~OutputFileHandle ()
+{
+	if (fp) std::fclose (fp);
+}
 
-Logger::Logger () : fp_debug ("output.txt"), fp_error ("error.txt") {}
+Logger::LocalBuffer::~LocalBuffer ()
+{
+	if (buffer) buffer->retired.store (true, std::memory_order_release);
+}
 
-void Logger::debug (std::string_view str_v)
+Logger::Logger () : fp_debug ("output.txt"), fp_error ("error.txt")
 {
-	std::lock_guard<std::mutex> lock (log_lock);
-	fmt::print (str_v);
-	fmt::print ("\n");
-	fmt::print (fp_debug.fp, str_v);
-	fmt::print (fp_debug.fp, "\n");
+	flusher = std::thread ([this] { flusher_main (); });
 }
 
-void Logger::error (std::string_view str_v)
+Logger::~Logger ()
 {
-	std::lock_guard<std::mutex> lock (log_lock);
-	fmt::print (stderr, str_v);
-	fmt::print (stderr, "\n");
-	fmt::print (fp_debug.fp, str_v);
-	fmt::print (fp_debug.fp, "\n");
-	fmt::print (fp_error.fp, str_v);
-	fmt::print (fp_error.fp, "\n");
-}
\ No newline at end of file
+	running = false;
+	{
+		std::lock_guard lg (wake_lock);
+		wake_requested = true;
+	}
+	wake_cond.notify_one ();
+	if (flusher.joinable ()) flusher.join ();
+
+	remove_crash_handlers ();
+	flush ();
+
+	ThreadBuffer* buffer = first_buffer.exchange (nullptr);
+	while (buffer)
+	{
+		ThreadBuffer* next = buffer->next;
+		delete buffer;
+		buffer = next;
+	}
+}
+
+void Logger::install_crash_handlers ()
+{
+	if (crash_handlers_installed) return;
+	for (size_t i = 0; i < CrashSignalCount; i++)
+	{
+#if defined(_WIN32)
+		previous_actions[i] = std::signal (CrashSignals[i], crash_handler);
+#else
+		struct sigaction action = {};
+		action.sa_handler = crash_handler;
+		sigemptyset (&action.sa_mask);
+		sigaction (CrashSignals[i], &action, &previous_actions[i]);
+#endif
+	}
+	crash_handlers_installed = true;
+}
+
+void Logger::remove_crash_handlers ()
+{
+	if (!crash_handlers_installed) return;
+	for (size_t i = 0; i < CrashSignalCount; i++)
+	{
+#if defined(_WIN32)
+		std::signal (CrashSignals[i], previous_actions[i]);
+#else
+		sigaction (CrashSignals[i], &previous_actions[i], nullptr);
+#endif
+	}
+	crash_handlers_installed = false;
+}
+
+Logger::ThreadBuffer& Logger::get_thread_buffer ()
+{
+	if (local_buffer.buffer == nullptr)
+	{
+		std::lock_guard lg (buffers_lock);
+		for (auto buffer = first_buffer.load (std::memory_order_acquire); buffer; buffer = buffer->next)
+		{
+			// everything the previous owner logged has been written
+			if (buffer->retired.load (std::memory_order_acquire) &&
+			    buffer->tail.load (std::memory_order_acquire) == buffer->head.load (std::memory_order_relaxed))
+			{
+				buffer->retired.store (false, std::memory_order_relaxed);
+				local_buffer.buffer = buffer;
+				break;
+			}
+		}
+		if (local_buffer.buffer == nullptr)
+		{
+			auto buffer = new ThreadBuffer ();
+			buffer->next = first_buffer.load (std::memory_order_relaxed);
+			first_buffer.store (buffer, std::memory_order_release);
+			local_buffer.buffer = buffer;
+		}
+	}
+	return *local_buffer.buffer;
+}
+
+void Logger::push (LogLevel level, std::string_view str_v)
+{
+	auto& buffer = get_thread_buffer ();
+	uint64_t time_ns = log_time_ns ();
+
+	// messages longer than a record are split over consecutive records, which are published with a
+	// single store so a drain never writes half a message and lets another thread's records in between
+	size_t count = std::max<size_t> (1, (str_v.size () + RecordTextSize - 1) / RecordTextSize);
+	count = std::min (count, MaxRecordsPerMessage);
+
+	uint64_t head = buffer.head.load (std::memory_order_relaxed);
+	while (head + count - buffer.tail.load (std::memory_order_acquire) > RecordsPerThread)
+	{
+		if (!running.load (std::memory_order_relaxed))
+		{
+			flush ();
+			continue;
+		}
+		{
+			std::lock_guard lg (wake_lock);
+			wake_requested = true;
+		}
+		wake_cond.notify_one ();
+		std::this_thread::yield ();
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto& record = buffer.records[(head + i) % RecordsPerThread];
+		size_t length = std::min (str_v.size (), RecordTextSize);
+		record.time_ns = time_ns;
+		record.level = level;
+		record.length = static_cast<uint16_t> (length);
+		record.continues = i + 1 < count;
+		std::copy_n (str_v.data (), length, record.text.data ());
+		str_v.remove_prefix (length);
+	}
+	buffer.head.store (head + count, std::memory_order_release);
+
+	if (level == LogLevel::error)
+	{
+		{
+			std::lock_guard lg (wake_lock);
+			wake_requested = true;
+		}
+		wake_cond.notify_one ();
+	}
+}
+
+void Logger::flush ()
+{
+	std::lock_guard lg (drain_lock);
+	drain ();
+}
+
+void Logger::flusher_main ()
+{
+	while (running)
+	{
+		{
+			std::unique_lock lk (wake_lock);
+			wake_cond.wait_for (lk, std::chrono::milliseconds (10), [this] { return wake_requested.load (); });
+			wake_requested = false;
+		}
+		std::lock_guard lg (drain_lock);
+		drain ();
+	}
+}
+
+bool Logger::drain ()
+{
+	struct Range
+	{
+		ThreadBuffer* buffer;
+		uint64_t head;
+	};
+	std::vector<Range> ranges;
+	for (auto buffer = first_buffer.load (std::memory_order_acquire); buffer; buffer = buffer->next)
+		ranges.push_back ({ buffer, buffer->head.load (std::memory_order_acquire) });
+
+	batch.clear ();
+	for (auto& range : ranges)
+	{
+		for (uint64_t i = range.buffer->tail.load (std::memory_order_relaxed); i < range.head; i++)
+			batch.push_back (&range.buffer->records[i % RecordsPerThread]);
+	}
+	if (batch.empty ()) return false;
+
+	// the records of a message share a time and are gathered in order, a stable sort keeps them together
+	std::stable_sort (std::begin (batch), std::end (batch), [] (Record const* a, Record const* b) {
+		return a->time_ns < b->time_ns;
+	});
+
+	for (auto record : batch)
+		write_record (*record);
+
+	std::fflush (stdout);
+	std::fflush (stderr);
+	if (fp_debug.fp) std::fflush (fp_debug.fp);
+	if (fp_error.fp) std::fflush (fp_error.fp);
+
+	for (auto& range : ranges)
+		range.buffer->tail.store (range.head, std::memory_order_release);
+	return true;
+}
+
+void Logger::write_record (Record const& record)
+{
+	bool is_error = record.level == LogLevel::error;
+
+	auto out = [&] (FILE* fp) {
+		if (fp == nullptr) return;
+		std::fwrite (record.text.data (), 1, record.length, fp);
+		if (!record.continues) std::fputc ('\n', fp);
+	};
+
+	out (is_error ? stderr : stdout);
+	out (fp_debug.fp);
+	if (is_error) out (fp_error.fp);
+}
+
+void Logger::crash_handler (int signal)
+{
+	Log.write_crash_records ();
+
+	// the previous handler, or the default action, runs once this handler returns
+	Log.remove_crash_handlers ();
+	std::raise (signal);
+}
+
+void Logger::write_crash_records ()
+{
+	// records the flusher is writing at the same time may come out twice
+	for (auto buffer = first_buffer.load (std::memory_order_acquire); buffer; buffer = buffer->next)
+		buffer->crash_cursor = buffer->tail.load (std::memory_order_acquire);
+
+	while (true)
+	{
+		// merge the buffers by time without allocating
+		ThreadBuffer* oldest = nullptr;
+		for (auto buffer = first_buffer.load (std::memory_order_acquire); buffer; buffer = buffer->next)
+		{
+			if (buffer->crash_cursor >= buffer->head.load (std::memory_order_acquire)) continue;
+			if (oldest == nullptr || buffer->records[buffer->crash_cursor % RecordsPerThread].time_ns <
+			                             oldest->records[oldest->crash_cursor % RecordsPerThread].time_ns)
+				oldest = buffer;
+		}
+		if (oldest == nullptr) break;
+
+		// write the whole message before looking at the other buffers again
+		bool continues = true;
+		while (continues && oldest->crash_cursor < oldest->head.load (std::memory_order_acquire))
+		{
+			auto const& record = oldest->records[oldest->crash_cursor % RecordsPerThread];
+			oldest->crash_cursor++;
+			continues = record.continues;
+
+			size_t length = std::min<size_t> (record.length, RecordTextSize);
+			std::copy_n (record.text.data (), length, crash_line);
+			if (!continues) crash_line[length++] = '\n';
+
+			bool is_error = record.level == LogLevel::error;
+			crash_write (is_error ? 2 : 1, crash_line, length);
+			crash_write (fp_debug.fd, crash_line, length);
+			if (is_error) crash_write (fp_error.fd, crash_line, length);
+		}
+	}
+}
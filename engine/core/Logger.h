@@ -1,26 +1,189 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdio>
-#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+enum class LogLevel : uint8_t
+{
+	trace,
+	debug,
+	info,
+	warn,
+	error
+};
 
+// Messages below this level compile to nothing, including the formatting of their arguments
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 0
+#endif
+
+// Asynchronous logger. Each thread formats into its own single producer ring of fixed size records,
+// a background thread drains them in batches to stdout, output.txt and error.txt. Logging from a
+// hot path is a format into the ring and an atomic store, never a syscall or a lock.
+//
+// Log.debug ("Tex {}", id) formats straight into the record, Log.debug (str) copies an existing string.
+// Errors wake the flusher immediately, flush () blocks until everything logged so far is written.
+// A thread's ring is reused by a later thread once it has exited and its records are written.
 class Logger
 {
 	public:
+	static constexpr size_t RecordTextSize = 240;
+	static constexpr size_t RecordsPerThread = 1024;
+	// longer messages are cut off, a message is always published to the flusher as a whole
+	static constexpr size_t MaxRecordsPerMessage = 64;
+
 	Logger ();
-	void debug (std::string_view str_v);
-	void error (std::string_view str_v);
+	~Logger ();
+
+	Logger (Logger const&) = delete;
+	Logger& operator= (Logger const&) = delete;
+
+	void set_level (LogLevel level) { runtime_level.store (level, std::memory_order_relaxed); }
+	LogLevel get_level () const { return runtime_level.load (std::memory_order_relaxed); }
+
+	void trace (std::string_view str_v) { write<LogLevel::trace> (str_v); }
+	void debug (std::string_view str_v) { write<LogLevel::debug> (str_v); }
+	void info (std::string_view str_v) { write<LogLevel::info> (str_v); }
+	void warn (std::string_view str_v) { write<LogLevel::warn> (str_v); }
+	void error (std::string_view str_v) { write<LogLevel::error> (str_v); }
+
+	template <typename... Args> void trace (std::string_view format_str, Args const&... args)
+	{
+		write<LogLevel::trace> (format_str, args...);
+	}
+	template <typename... Args> void debug (std::string_view format_str, Args const&... args)
+	{
+		write<LogLevel::debug> (format_str, args...);
+	}
+	template <typename... Args> void info (std::string_view format_str, Args const&... args)
+	{
+		write<LogLevel::info> (format_str, args...);
+	}
+	template <typename... Args> void warn (std::string_view format_str, Args const&... args)
+	{
+		write<LogLevel::warn> (format_str, args...);
+	}
+	template <typename... Args> void error (std::string_view format_str, Args const&... args)
+	{
+		write<LogLevel::error> (format_str, args...);
+	}
+
+	// blocks until every record logged before the call is written out
+	void flush ();
+
+	// On SEGV, ABRT, FPE and ILL, writes the records not yet flushed and passes the signal on to
+	// the handler that was installed before, such as a sanitizer's. Call from main, after anything
+	// else that installs handlers.
+	void install_crash_handlers ();
+	// restores the handlers install_crash_handlers replaced
+	void remove_crash_handlers ();
 
 	private:
+	struct Record
+	{
+		uint64_t time_ns;
+		LogLevel level;
+		bool continues; // text carries on in the next record
+		uint16_t length;
+		std::array<char, RecordTextSize> text;
+	};
+
+	struct ThreadBuffer
+	{
+		std::atomic<uint64_t> head = 0; // written by the owning thread only
+		std::atomic<uint64_t> tail = 0; // written by the flusher only
+		std::atomic_bool retired = false; // the owning thread exited
+		ThreadBuffer* next = nullptr; // never changes once the buffer is published
+		uint64_t crash_cursor = 0; // only used by the crash handler
+		std::array<Record, RecordsPerThread> records;
+	};
+
+	// marks the thread's buffer as retired when the thread exits
+	struct LocalBuffer
+	{
+		~LocalBuffer ();
+		ThreadBuffer* buffer = nullptr;
+	};
+
+	template <LogLevel level> bool is_enabled () const
+	{
+		if constexpr (static_cast<int> (level) < LOG_COMPILED_LEVEL)
+			return false;
+		else
+			return level >= runtime_level.load (std::memory_order_relaxed);
+	}
+
+	template <LogLevel level> void write (std::string_view str_v)
+	{
+		if (!is_enabled<level> ()) return;
+		push (level, str_v);
+	}
+
+	template <LogLevel level, typename... Args> void write (std::string_view format_str, Args const&... args)
+	{
+		if (!is_enabled<level> ()) return;
+
+		// short messages are formatted on the stack, long ones fall back to a heap string
+		std::array<char, RecordTextSize> buf;
+		auto res = fmt::format_to_n (buf.data (), buf.size (), format_str, args...);
+		if (res.size <= buf.size ())
+			push (level, std::string_view (buf.data (), res.size));
+		else
+			push (level, fmt::format (format_str, args...));
+	}
+
+	void push (LogLevel level, std::string_view str_v);
+
+	ThreadBuffer& get_thread_buffer ();
+	static thread_local LocalBuffer local_buffer;
+
+	void flusher_main ();
+	// returns false if there was nothing to write
+	bool drain ();
+	void write_record (Record const& record);
+
+	static void crash_handler (int signal);
+	// only calls write (2), the crashed thread may hold any lock or be inside malloc
+	void write_crash_records ();
+
 	struct OutputFileHandle
 	{
 		OutputFileHandle (std::string file_name);
 		~OutputFileHandle ();
 		FILE* fp = nullptr;
+		int fd = -1;
 	};
 
 	OutputFileHandle fp_debug;
 	OutputFileHandle fp_error;
+
+	std::atomic<LogLevel> runtime_level = LogLevel::trace;
+
+	// buffers are pushed to the front of the list and only freed with the logger, so the list can be
+	// walked without a lock. The lock serializes adding and reusing buffers.
+	std::mutex buffers_lock;
+	std::atomic<ThreadBuffer*> first_buffer = nullptr;
+
+	// held while draining so flush () and the flusher thread don't consume at the same time
+	std::mutex drain_lock;
+	std::vector<Record const*> batch;
+
+	std::mutex wake_lock;
+	std::condition_variable wake_cond;
+	std::atomic_bool wake_requested = false;
+	std::atomic_bool running = true;
+	std::thread flusher;
 };
 
-extern Logger Log;
\ No newline at end of file
+extern Logger Log;
@@ -0,0 +1,197 @@
+#include "MemoryTracker.h"
+
+#include <fstream>
+#include <iomanip>
+
+#include <nlohmann/json.hpp>
+
+#include "Logger.h"
+
+MemoryTracker MemTracker;
+
+char const* memory_tag_name (MemoryTag tag)
+{
+	switch (tag)
+	{
+		case MemoryTag::texture_data: return "texture_data";
+		case MemoryTag::mesh_data: return "mesh_data";
+		case MemoryTag::noise_image: return "noise_image";
+		case MemoryTag::uniform_buffer: return "uniform_buffer";
+		case MemoryTag::storage_buffer: return "storage_buffer";
+		case MemoryTag::vertex_buffer: return "vertex_buffer";
+		case MemoryTag::index_buffer: return "index_buffer";
+		case MemoryTag::instance_buffer: return "instance_buffer";
+		case MemoryTag::staging_buffer: return "staging_buffer";
+		case MemoryTag::texture: return "texture";
+		case MemoryTag::render_target: return "render_target";
+		default: return "unknown";
+	}
+}
+
+std::optional<MemoryTag> memory_tag_from_name (std::string_view name)
+{
+	for (size_t i = 0; i < MemoryTagCount; i++)
+		if (name == memory_tag_name (static_cast<MemoryTag> (i))) return static_cast<MemoryTag> (i);
+	return {};
+}
+
+bool is_gpu_memory_tag (MemoryTag tag) { return tag >= MemoryTag::uniform_buffer; }
+
+void MemoryTracker::allocate (MemoryTag tag, size_t bytes)
+{
+	auto& counters = tags[static_cast<size_t> (tag)];
+	int64_t current = counters.current_bytes.fetch_add (static_cast<int64_t> (bytes), std::memory_order_relaxed) +
+	                  static_cast<int64_t> (bytes);
+	counters.total_allocations.fetch_add (1, std::memory_order_relaxed);
+
+	int64_t peak = counters.peak_bytes.load (std::memory_order_relaxed);
+	while (current > peak && !counters.peak_bytes.compare_exchange_weak (peak, current, std::memory_order_relaxed))
+	{
+	}
+
+	uint64_t budget = counters.budget_bytes.load (std::memory_order_relaxed);
+	if (budget > 0 && static_cast<uint64_t> (current) > budget && !counters.over_budget.exchange (true))
+	{
+		Log.warn ("Memory budget for {} exceeded: {} of {} bytes", memory_tag_name (tag), current, budget);
+	}
+}
+
+void MemoryTracker::free (MemoryTag tag, size_t bytes)
+{
+	auto& counters = tags[static_cast<size_t> (tag)];
+	int64_t current = counters.current_bytes.fetch_sub (static_cast<int64_t> (bytes), std::memory_order_relaxed) -
+	                  static_cast<int64_t> (bytes);
+
+	uint64_t budget = counters.budget_bytes.load (std::memory_order_relaxed);
+	if (budget > 0 && static_cast<uint64_t> (current) <= budget) counters.over_budget = false;
+}
+
+void MemoryTracker::set_budget (MemoryTag tag, uint64_t bytes)
+{
+	auto& counters = tags[static_cast<size_t> (tag)];
+	counters.budget_bytes = bytes;
+	counters.over_budget = false;
+}
+
+void MemoryTracker::set_heap_stats (std::vector<MemoryHeapStats> const& new_heaps)
+{
+	{
+		std::lock_guard lg (heap_lock);
+		heaps = new_heaps;
+	}
+
+	uint64_t budget = device_budget.load ();
+	uint64_t usage = device_local_usage ();
+	if (budget > 0 && usage > budget && !device_over_budget)
+	{
+		Log.warn ("Device memory budget exceeded: {} of {} bytes", usage, budget);
+	}
+	device_over_budget = budget > 0 && usage > budget;
+}
+
+void MemoryTracker::new_frame ()
+{
+	for (auto& counters : tags)
+	{
+		uint64_t total = counters.total_allocations.load (std::memory_order_relaxed);
+		counters.frame_allocations.store (total - counters.frame_start_allocations, std::memory_order_relaxed);
+		counters.frame_start_allocations = total;
+	}
+
+	if (csv && csv_interval > 0 && frame_number % csv_interval == 0) write_csv_row ();
+	frame_number++;
+}
+
+MemoryTagStats MemoryTracker::get_stats (MemoryTag tag) const
+{
+	auto& counters = tags[static_cast<size_t> (tag)];
+	return MemoryTagStats{ counters.current_bytes.load (std::memory_order_relaxed),
+		counters.peak_bytes.load (std::memory_order_relaxed),
+		counters.total_allocations.load (std::memory_order_relaxed),
+		counters.frame_allocations.load (std::memory_order_relaxed),
+		counters.budget_bytes.load (std::memory_order_relaxed) };
+}
+
+std::vector<MemoryHeapStats> MemoryTracker::get_heap_stats () const
+{
+	std::lock_guard lg (heap_lock);
+	return heaps;
+}
+
+uint64_t MemoryTracker::device_local_usage () const
+{
+	std::lock_guard lg (heap_lock);
+	uint64_t usage = 0;
+	for (auto& heap : heaps)
+		if (heap.device_local) usage += heap.block_bytes;
+	return usage;
+}
+
+bool MemoryTracker::write_json (std::filesystem::path const& file_name) const
+{
+	nlohmann::json j;
+	for (size_t i = 0; i < MemoryTagCount; i++)
+	{
+		auto tag = static_cast<MemoryTag> (i);
+		auto stats = get_stats (tag);
+		j["tags"][memory_tag_name (tag)] = { { "gpu", is_gpu_memory_tag (tag) },
+			{ "current-bytes", stats.current_bytes },
+			{ "peak-bytes", stats.peak_bytes },
+			{ "total-allocations", stats.total_allocations },
+			{ "frame-allocations", stats.frame_allocations },
+			{ "budget-bytes", stats.budget_bytes } };
+	}
+	j["heaps"] = nlohmann::json::array ();
+	for (auto& heap : get_heap_stats ())
+	{
+		j["heaps"].push_back ({ { "device-local", heap.device_local },
+		    { "block-bytes", heap.block_bytes },
+		    { "allocation-bytes", heap.allocation_bytes },
+		    { "budget-bytes", heap.budget_bytes } });
+	}
+	j["device-budget-bytes"] = device_budget.load ();
+
+	std::ofstream out_file (file_name);
+	if (!out_file)
+	{
+		Log.error ("Couldn't open {} to write the memory report", file_name.string ());
+		return false;
+	}
+	out_file << std::setw (4) << j;
+	return true;
+}
+
+MemoryTracker::CSVFile::~CSVFile ()
+{
+	if (fp) std::fclose (fp);
+}
+
+void MemoryTracker::set_csv_dump (std::filesystem::path const& file_name, uint32_t interval)
+{
+	csv.reset ();
+	csv_interval = interval;
+	if (interval == 0) return;
+
+	csv = std::make_unique<CSVFile> ();
+	csv->fp = std::fopen (file_name.string ().c_str (), "w");
+	if (!csv->fp)
+	{
+		Log.error ("Couldn't open {} for the memory csv dump", file_name.string ());
+		csv.reset ();
+		return;
+	}
+
+	fmt::print (csv->fp, "frame");
+	for (size_t i = 0; i < MemoryTagCount; i++)
+		fmt::print (csv->fp, ",{}", memory_tag_name (static_cast<MemoryTag> (i)));
+	fmt::print (csv->fp, ",device_local_usage\n");
+}
+
+void MemoryTracker::write_csv_row ()
+{
+	fmt::print (csv->fp, "{}", frame_number);
+	for (auto& counters : tags)
+		fmt::print (csv->fp, ",{}", counters.current_bytes.load (std::memory_order_relaxed));
+	fmt::print (csv->fp, ",{}\n", device_local_usage ());
+	std::fflush (csv->fp);
+}
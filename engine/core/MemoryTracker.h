@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Byte and allocation counters for tagged CPU and GPU allocations, plus the device heap budgets
+// reported by VMA. Counters are relaxed atomics so tagging an allocation is cheap from any thread.
+enum class MemoryTag : uint32_t
+{
+	// cpu
+	texture_data,
+	mesh_data,
+	noise_image,
+	// gpu
+	uniform_buffer,
+	storage_buffer,
+	vertex_buffer,
+	index_buffer,
+	instance_buffer,
+	staging_buffer,
+	texture,
+	render_target,
+
+	count
+};
+
+constexpr size_t MemoryTagCount = static_cast<size_t> (MemoryTag::count);
+
+char const* memory_tag_name (MemoryTag tag);
+std::optional<MemoryTag> memory_tag_from_name (std::string_view name);
+bool is_gpu_memory_tag (MemoryTag tag);
+
+struct MemoryTagStats
+{
+	int64_t current_bytes = 0;
+	int64_t peak_bytes = 0;
+	uint64_t total_allocations = 0;
+	uint64_t frame_allocations = 0; // allocations during the last complete frame
+	uint64_t budget_bytes = 0;      // 0 means no budget
+};
+
+struct MemoryHeapStats
+{
+	bool device_local = false;
+	uint64_t block_bytes = 0;      // memory allocated from the driver
+	uint64_t allocation_bytes = 0; // memory handed out to resources
+	uint64_t budget_bytes = 0;
+};
+
+class MemoryTracker
+{
+	public:
+	void allocate (MemoryTag tag, size_t bytes);
+	void free (MemoryTag tag, size_t bytes);
+
+	// exceeding a budget logs a warning once, until usage drops back below it
+	void set_budget (MemoryTag tag, uint64_t bytes);
+	void set_device_budget (uint64_t bytes) { device_budget = bytes; }
+
+	void set_heap_stats (std::vector<MemoryHeapStats> const& heaps);
+
+	// rolls the per frame allocation counts and appends to the csv dump when one is due
+	void new_frame ();
+
+	MemoryTagStats get_stats (MemoryTag tag) const;
+	std::vector<MemoryHeapStats> get_heap_stats () const;
+	uint64_t get_device_budget () const { return device_budget; }
+	uint64_t device_local_usage () const;
+
+	bool write_json (std::filesystem::path const& file_name) const;
+
+	// every interval frames a row of current bytes per tag and heap usage is appended, 0 disables it
+	void set_csv_dump (std::filesystem::path const& file_name, uint32_t interval);
+
+	private:
+	struct TagCounters
+	{
+		std::atomic<int64_t> current_bytes = 0;
+		std::atomic<int64_t> peak_bytes = 0;
+		std::atomic<uint64_t> total_allocations = 0;
+		std::atomic<uint64_t> budget_bytes = 0;
+		std::atomic_bool over_budget = false;
+		uint64_t frame_start_allocations = 0; // main thread only
+		std::atomic<uint64_t> frame_allocations = 0;
+	};
+	std::array<TagCounters, MemoryTagCount> tags;
+
+	mutable std::mutex heap_lock;
+	std::vector<MemoryHeapStats> heaps;
+	std::atomic<uint64_t> device_budget = 0;
+	bool device_over_budget = false;
+
+	uint64_t frame_number = 0;
+
+	struct CSVFile
+	{
+		~CSVFile ();
+		FILE* fp = nullptr;
+	};
+	std::unique_ptr<CSVFile> csv;
+	uint32_t csv_interval = 0;
+
+	void write_csv_row ();
+};
+
+extern MemoryTracker MemTracker;
+
+// std allocator that reports to MemTracker, for containers owned by resource caches
+template <typename T, MemoryTag Tag> struct TrackedAllocator
+{
+	using value_type = T;
+
+	TrackedAllocator () noexcept = default;
+	template <typename U> TrackedAllocator (TrackedAllocator<U, Tag> const&) noexcept {}
+
+	template <typename U> struct rebind
+	{
+		using other = TrackedAllocator<U, Tag>;
+	};
+
+	T* allocate (size_t n)
+	{
+		MemTracker.allocate (Tag, n * sizeof (T));
+		return std::allocator<T>{}.allocate (n);
+	}
+	void deallocate (T* p, size_t n) noexcept
+	{
+		MemTracker.free (Tag, n * sizeof (T));
+		std::allocator<T>{}.deallocate (p, n);
+	}
+
+	template <typename U> bool operator== (TrackedAllocator<U, Tag> const&) const noexcept { return true; }
+	template <typename U> bool operator!= (TrackedAllocator<U, Tag> const&) const noexcept { return false; }
+};
+
+template <typename T, MemoryTag Tag> using TrackedVector = std::vector<T, TrackedAllocator<T, Tag>>;
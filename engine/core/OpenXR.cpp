@@ -166,7 +166,7 @@ std::optional<OpenXR::Display> create_swapchains (XrInstance inst, OpenXR::SysIn
 	    inst, sys.id, view_config_type, view_count, &view_count, configuration_views.data ());
 	if (ret != XR_SUCCESS) return {};
 
-	if (view_count < 0) return {};
+	if (view_count == 0) return {};
 
 	uint32_t swapchain_format_count;
 	ret = xrEnumerateSwapchainFormats (session, 0, &swapchain_format_count, nullptr);
@@ -178,12 +178,22 @@ std::optional<OpenXR::Display> create_swapchains (XrInstance inst, OpenXR::SysIn
 
 	uint64_t color_swapchains_format = SelectColorSwapchainFormat (swapchain_formats);
 
+	// views of the same size share one layered swapchain, so a multiview pass draws all of them
+	auto const& first_view = configuration_views.front ();
+	bool layered = std::all_of (
+	    std::begin (configuration_views), std::end (configuration_views), [&] (XrViewConfigurationView const& view) {
+		    return view.recommendedImageRectWidth == first_view.recommendedImageRectWidth &&
+		           view.recommendedImageRectHeight == first_view.recommendedImageRectHeight &&
+		           view.recommendedSwapchainSampleCount == first_view.recommendedSwapchainSampleCount;
+	    });
+	uint32_t swapchain_count = layered ? 1 : view_count;
+
 	std::vector<OpenXR::Display::Swapchain> swapchains;
-	for (uint32_t i = 0; i < view_count; i++)
+	for (uint32_t i = 0; i < swapchain_count; i++)
 	{
 		const XrViewConfigurationView& vp = configuration_views[i];
 		XrSwapchainCreateInfo swapchain_info{ XR_TYPE_SWAPCHAIN_CREATE_INFO };
-		swapchain_info.arraySize = 1;
+		swapchain_info.arraySize = layered ? view_count : 1;
 		swapchain_info.format = color_swapchains_format;
 		swapchain_info.width = vp.recommendedImageRectWidth;
 		swapchain_info.height = vp.recommendedImageRectHeight;
@@ -198,6 +208,7 @@ std::optional<OpenXR::Display> create_swapchains (XrInstance inst, OpenXR::SysIn
 		OpenXR::Display::Swapchain swapchain;
 		swapchain.width = swapchain_info.width;
 		swapchain.height = swapchain_info.height;
+		swapchain.layers = swapchain_info.arraySize;
 		swapchain.swapchain = xr_swapchain;
 		swapchains.push_back (swapchain);
 
@@ -30,6 +30,7 @@ struct OpenXR
 		{
 			int32_t width;
 			int32_t height;
+			uint32_t layers; // one per view when every view renders into it with multiview
 			XrSwapchain swapchain;
 		};
 		std::vector<Swapchain> swapchains;
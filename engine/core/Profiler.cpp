@@ -0,0 +1,133 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#include <nlohmann/json.hpp>
+
+#include "Logger.h"
+
+Profiler Prof;
+
+thread_local uint32_t ProfileScope::current_depth = 0;
+thread_local Profiler::ThreadBuffer* Profiler::local_buffer = nullptr;
+
+Profiler::Profiler () : epoch (now ()) {}
+
+uint64_t Profiler::now ()
+{
+	return static_cast<uint64_t> (std::chrono::duration_cast<std::chrono::nanoseconds> (
+	    std::chrono::steady_clock::now ().time_since_epoch ())
+	                                  .count ());
+}
+
+Profiler::ThreadBuffer& Profiler::get_thread_buffer ()
+{
+	if (local_buffer == nullptr)
+	{
+		std::lock_guard lg (buffers_lock);
+		auto buffer = std::make_unique<ThreadBuffer> ();
+		buffer->thread_index = static_cast<uint32_t> (thread_buffers.size ());
+		buffer->thread_name = fmt::format ("Thread {}", buffer->thread_index);
+		local_buffer = buffer.get ();
+		thread_buffers.push_back (std::move (buffer));
+	}
+	return *local_buffer;
+}
+
+void Profiler::set_thread_name (std::string name)
+{
+	auto& buffer = get_thread_buffer ();
+	std::lock_guard lg (buffers_lock);
+	buffer.thread_name = name;
+}
+
+void Profiler::new_frame ()
+{
+	prev_frame_start = cur_frame_start.load ();
+	cur_frame_start = now ();
+}
+
+char const* Profiler::intern (std::string const& name)
+{
+	std::lock_guard lg (names_lock);
+	return names.insert (name).first->c_str ();
+}
+
+void Profiler::record (ProfileEvent const& event)
+{
+	auto& buffer = get_thread_buffer ();
+	uint64_t head = buffer.head.load (std::memory_order_relaxed);
+	buffer.events[head % EventsPerThread] = event;
+	buffer.head.store (head + 1, std::memory_order_release);
+}
+
+std::vector<ProfileThreadEvents> Profiler::collect ()
+{
+	std::lock_guard lg (buffers_lock);
+	std::vector<ProfileThreadEvents> out;
+	for (auto& buffer : thread_buffers)
+	{
+		ProfileThreadEvents thread_events{ buffer->thread_name, buffer->thread_index, {} };
+
+		uint64_t head = buffer->head.load (std::memory_order_acquire);
+		uint64_t first = head > EventsPerThread ? head - EventsPerThread : 0;
+		thread_events.events.reserve (head - first);
+		for (uint64_t i = first; i < head; i++)
+			thread_events.events.push_back (buffer->events[i % EventsPerThread]);
+
+		// the owner kept writing while we copied, anything it lapped is unreliable. That includes the
+		// slot of the event it may be writing right now, new_head, which isn't published yet.
+		uint64_t new_head = buffer->head.load (std::memory_order_acquire);
+		if (new_head + 1 > EventsPerThread + first)
+		{
+			uint64_t lapped = std::min (new_head + 1 - EventsPerThread - first, head - first);
+			thread_events.events.erase (std::begin (thread_events.events),
+			    std::begin (thread_events.events) + static_cast<std::ptrdiff_t> (lapped));
+		}
+		out.push_back (std::move (thread_events));
+	}
+	return out;
+}
+
+bool Profiler::write_chrome_trace (std::filesystem::path const& file_name)
+{
+	auto threads = collect ();
+
+	nlohmann::json trace_events = nlohmann::json::array ();
+	for (auto& thread : threads)
+	{
+		trace_events.push_back ({ { "name", "thread_name" },
+		    { "ph", "M" },
+		    { "pid", 0 },
+		    { "tid", thread.thread_index },
+		    { "args", { { "name", thread.thread_name } } } });
+
+		for (auto& event : thread.events)
+		{
+			// trace timestamps are in microseconds
+			trace_events.push_back ({ { "name", event.name },
+			    { "ph", "X" },
+			    { "pid", 0 },
+			    { "tid", thread.thread_index },
+			    { "ts", static_cast<double> (event.start_ns - epoch) / 1000.0 },
+			    { "dur", static_cast<double> (event.end_ns - event.start_ns) / 1000.0 } });
+		}
+	}
+
+	nlohmann::json j;
+	j["traceEvents"] = std::move (trace_events);
+	j["displayTimeUnit"] = "ms";
+
+	std::ofstream out_file (file_name);
+	if (!out_file)
+	{
+		Log.error ("Couldn't open {} to write the profile", file_name.string ());
+		return false;
+	}
+	out_file << j;
+	out_file.close ();
+	Log.debug ("Wrote profile to {}", file_name.string ());
+	return true;
+}
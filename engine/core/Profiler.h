@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Scoped CPU timing. Every thread writes completed scopes into its own ring buffer, so recording
+// never takes a lock. When disabled a scope costs one relaxed load and a branch.
+//
+// PROFILE_SCOPE ("name") takes a string literal, PROFILE_SCOPE_DYNAMIC (str) copies the name into
+// the profiler's string table first and is meant for rare events like resource loads.
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL (a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT (profile_scope_, __LINE__) (name)
+#define PROFILE_SCOPE_DYNAMIC(name) \
+	ProfileScope PROFILE_CONCAT (profile_scope_, __LINE__) (Prof.is_enabled () ? Prof.intern (name) : nullptr)
+#define PROFILE_FUNCTION() PROFILE_SCOPE (__func__)
+
+struct ProfileEvent
+{
+	char const* name; // string literal or interned, never freed
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint32_t depth;
+};
+
+struct ProfileThreadEvents
+{
+	std::string thread_name;
+	uint32_t thread_index;
+	std::vector<ProfileEvent> events; // ordered by end time
+};
+
+class Profiler
+{
+	public:
+	static constexpr size_t EventsPerThread = 1 << 14;
+
+	Profiler ();
+
+	bool is_enabled () const { return enabled.load (std::memory_order_relaxed); }
+	void set_enabled (bool enable) { enabled.store (enable, std::memory_order_relaxed); }
+
+	static uint64_t now ();
+
+	// names the calling thread in exported traces
+	void set_thread_name (std::string name);
+
+	// marks the start of a frame on the main thread, used to find the last complete frame
+	void new_frame ();
+	uint64_t last_frame_start () const { return prev_frame_start.load (); }
+	uint64_t last_frame_end () const { return cur_frame_start.load (); }
+
+	char const* intern (std::string const& name);
+
+	void record (ProfileEvent const& event);
+
+	// copies out the events still held in the ring buffers, events overwritten while copying are dropped
+	std::vector<ProfileThreadEvents> collect ();
+
+	// Chrome trace event format, loadable in chrome://tracing and ui.perfetto.dev
+	bool write_chrome_trace (std::filesystem::path const& file_name);
+
+	private:
+	struct ThreadBuffer
+	{
+		std::string thread_name;
+		uint32_t thread_index;
+		std::atomic<uint64_t> head = 0; // total events written, only the owning thread writes
+		std::array<ProfileEvent, EventsPerThread> events;
+	};
+
+	ThreadBuffer& get_thread_buffer ();
+	static thread_local ThreadBuffer* local_buffer;
+
+	std::atomic_bool enabled = false;
+	std::atomic<uint64_t> prev_frame_start = 0;
+	std::atomic<uint64_t> cur_frame_start = 0;
+	uint64_t epoch;
+
+	std::mutex buffers_lock;
+	std::vector<std::unique_ptr<ThreadBuffer>> thread_buffers;
+
+	std::mutex names_lock;
+	std::unordered_set<std::string> names;
+};
+
+extern Profiler Prof;
+
+class ProfileScope
+{
+	public:
+	ProfileScope (char const* name)
+	{
+		if (name != nullptr && Prof.is_enabled ())
+		{
+			this->name = name;
+			depth = current_depth++;
+			start = Profiler::now ();
+		}
+	}
+	~ProfileScope ()
+	{
+		if (this->name != nullptr)
+		{
+			current_depth--;
+			Prof.record (ProfileEvent{ name, start, Profiler::now (), depth });
+		}
+	}
+
+	ProfileScope (ProfileScope const&) = delete;
+	ProfileScope& operator= (ProfileScope const&) = delete;
+
+	private:
+	char const* name = nullptr;
+	uint64_t start = 0;
+	uint32_t depth = 0;
+
+	static thread_local uint32_t current_depth;
+};
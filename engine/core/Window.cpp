@@ -30,8 +30,8 @@ Window::Window (Input::InputDirector& input,
 		const GLFWvidmode* mode = glfwGetVideoMode (primary);
 
 		window = glfwCreateWindow (mode->width, mode->height, window_title, primary, NULL);
-		Log.debug (fmt::format ("Monitor Width {}", mode->width));
-		Log.debug (fmt::format ("Monitor Height {}", mode->height));
+		Log.debug ("Monitor Width {}", mode->width);
+		Log.debug ("Monitor Height {}", mode->height);
 	}
 	else
 	{
@@ -120,7 +120,7 @@ cml::vec2i Window::get_window_size ()
 
 void Window::error_handler (int error, const char* description)
 {
-	Log.error (fmt::format ("Error Code:{}, {}", error, description));
+	Log.error ("Error Code:{}, {}", error, description);
 }
 
 void Window::keyboard_handler (GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -160,12 +160,12 @@ void Window::joystick_configuration_change_handler (int joy, int event)
 {
 	if (event == GLFW_CONNECTED)
 	{
-		Log.debug (fmt::format ("Controller {} Connected", joy));
+		Log.debug ("Controller {} Connected", joy);
 		Input::InputDirector::connect_joystick (joy);
 	}
 	else if (event == GLFW_DISCONNECTED)
 	{
-		Log.debug (fmt::format ("Controller {} Disconnected", joy));
+		Log.debug ("Controller {} Disconnected", joy);
 		Input::InputDirector::disconnect_joystick (joy);
 	}
 }
@@ -0,0 +1,437 @@
+#include "Atmosphere.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "core/JobSystem.h"
+#include "core/Profiler.h"
+
+namespace
+{
+const float Pi = 3.14159265358979f;
+
+const uint32_t TransmittanceSteps = 40;
+const uint32_t MultiScatteringSteps = 20;
+const uint32_t MultiScatteringDirections = 8; // squared, spread over the sphere
+const uint32_t SkyViewSteps = 32;
+
+struct Rgb
+{
+	float r = 0.f;
+	float g = 0.f;
+	float b = 0.f;
+
+	Rgb () = default;
+	Rgb (float value) : r (value), g (value), b (value) {}
+	Rgb (float r, float g, float b) : r (r), g (g), b (b) {}
+	Rgb (cml::vec3f value) : r (value.x), g (value.y), b (value.z) {}
+
+	Rgb operator+ (Rgb o) const { return { r + o.r, g + o.g, b + o.b }; }
+	Rgb operator* (Rgb o) const { return { r * o.r, g * o.g, b * o.b }; }
+	Rgb operator/ (Rgb o) const { return { r / o.r, g / o.g, b / o.b }; }
+	Rgb& operator+= (Rgb o) { return *this = *this + o; }
+	Rgb& operator*= (Rgb o) { return *this = *this * o; }
+};
+
+Rgb exp (Rgb value) { return { std::exp (value.r), std::exp (value.g), std::exp (value.b) }; }
+
+struct Medium
+{
+	Rgb rayleigh; // scattering
+	float mie = 0.f; // scattering
+	Rgb scattering;
+	Rgb extinction;
+};
+
+Medium sample_medium (AtmosphereSettings const& settings, float height)
+{
+	float rayleigh_density = std::exp (-height / settings.rayleigh_scale_height);
+	float mie_density = std::exp (-height / settings.mie_scale_height);
+	float ozone_density = std::max (0.f, 1.f - std::abs (height - settings.ozone_center) / settings.ozone_half_width);
+
+	Medium medium;
+	medium.rayleigh = Rgb (settings.rayleigh_scattering) * rayleigh_density;
+	medium.mie = settings.mie_scattering * mie_density;
+	medium.scattering = medium.rayleigh + medium.mie;
+	medium.extinction =
+	    medium.rayleigh + settings.mie_extinction * mie_density + Rgb (settings.ozone_absorption) * ozone_density;
+	return medium;
+}
+
+// distance along a ray starting radius away from the planet's center, mu the cosine between the
+// ray and the up direction, to where it leaves a sphere of sphere_radius around it. Negative when
+// it never reaches that sphere.
+float distance_to_sphere (float radius, float mu, float sphere_radius)
+{
+	float discriminant = radius * radius * (mu * mu - 1.f) + sphere_radius * sphere_radius;
+	if (discriminant < 0.f) return -1.f;
+	return -radius * mu + std::sqrt (discriminant);
+}
+
+float distance_to_ground (AtmosphereSettings const& settings, float radius, float mu)
+{
+	float discriminant = radius * radius * (mu * mu - 1.f) + settings.bottom_radius * settings.bottom_radius;
+	if (mu >= 0.f || discriminant < 0.f) return -1.f;
+	return -radius * mu - std::sqrt (discriminant);
+}
+
+// rays along the ground cross the densest air within the first few kilometres, so the steps grow
+// quadratically away from the start
+float march_distance (float ray_length, float step, uint32_t steps)
+{
+	float t = step / static_cast<float> (steps);
+	return ray_length * t * t;
+}
+
+// Bilinear lookup of an RGBA table baked with its first and last texel on the edges
+Rgb sample_table (std::vector<float> const& table, uint32_t width, uint32_t height, float u, float v)
+{
+	float x = std::clamp (u, 0.f, 1.f) * static_cast<float> (width - 1);
+	float y = std::clamp (v, 0.f, 1.f) * static_cast<float> (height - 1);
+	uint32_t x0 = std::min (static_cast<uint32_t> (x), width - 2);
+	uint32_t y0 = std::min (static_cast<uint32_t> (y), height - 2);
+	float tx = x - static_cast<float> (x0);
+	float ty = y - static_cast<float> (y0);
+
+	auto texel = [&] (uint32_t tx_, uint32_t ty_) {
+		float const* t = &table[(static_cast<size_t> (ty_) * width + tx_) * 4];
+		return Rgb (t[0], t[1], t[2]);
+	};
+	return texel (x0, y0) * ((1.f - tx) * (1.f - ty)) + texel (x0 + 1, y0) * (tx * (1.f - ty)) +
+	       texel (x0, y0 + 1) * ((1.f - tx) * ty) + texel (x0 + 1, y0 + 1) * (tx * ty);
+}
+
+void store_texel (std::vector<float>& table, size_t index, Rgb value)
+{
+	table[index * 4 + 0] = value.r;
+	table[index * 4 + 1] = value.g;
+	table[index * 4 + 2] = value.b;
+	table[index * 4 + 3] = 1.f;
+}
+
+// Bruneton's parametrization, rows by height and columns by the distance to the top of the
+// atmosphere, which puts most texels near the horizon
+void transmittance_coordinates (AtmosphereSettings const& settings, float u, float v, float& radius, float& mu)
+{
+	float horizon = std::sqrt (
+	    settings.top_radius * settings.top_radius - settings.bottom_radius * settings.bottom_radius);
+	float rho = horizon * v;
+	radius = std::sqrt (rho * rho + settings.bottom_radius * settings.bottom_radius);
+	float d_min = settings.top_radius - radius;
+	float d_max = rho + horizon;
+	float d = d_min + u * (d_max - d_min);
+	mu = d == 0.f ? 1.f : (horizon * horizon - rho * rho - d * d) / (2.f * radius * d);
+	mu = std::clamp (mu, -1.f, 1.f);
+}
+
+// zero when the ray hits the ground, which is what keeps the planet's shadow out of the sky
+Rgb lookup_transmittance (
+    AtmosphereSettings const& settings, std::vector<float> const& table, float radius, float mu)
+{
+	if (distance_to_ground (settings, radius, mu) >= 0.f) return Rgb (0.f);
+
+	float horizon = std::sqrt (
+	    settings.top_radius * settings.top_radius - settings.bottom_radius * settings.bottom_radius);
+	float rho = std::sqrt (std::max (0.f, radius * radius - settings.bottom_radius * settings.bottom_radius));
+	float d = std::max (0.f, distance_to_sphere (radius, mu, settings.top_radius));
+	float d_min = settings.top_radius - radius;
+	float d_max = rho + horizon;
+	float u = d_max > d_min ? (d - d_min) / (d_max - d_min) : 0.f;
+	return sample_table (table, settings.transmittance_width, settings.transmittance_height, u, rho / horizon);
+}
+
+Rgb lookup_multi_scattering (
+    AtmosphereSettings const& settings, std::vector<float> const& table, float radius, float mu_sun)
+{
+	float u = mu_sun * 0.5f + 0.5f;
+	float v = (radius - settings.bottom_radius) / (settings.top_radius - settings.bottom_radius);
+	return sample_table (table, settings.multi_scattering_size, settings.multi_scattering_size, u, v);
+}
+
+float rayleigh_phase (float cos_theta) { return 3.f / (16.f * Pi) * (1.f + cos_theta * cos_theta); }
+
+// Cornette-Shanks
+float mie_phase (float cos_theta, float g)
+{
+	float k = 3.f / (8.f * Pi) * (1.f - g * g) / (2.f + g * g);
+	return k * (1.f + cos_theta * cos_theta) / std::pow (1.f + g * g - 2.f * g * cos_theta, 1.5f);
+}
+
+// the sky view spends half its rows on either side of the horizon, squeezed towards it
+float sky_view_elevation (float v)
+{
+	float side = v < 0.5f ? -1.f : 1.f;
+	float t = 2.f * std::abs (v - 0.5f);
+	return side * t * t * Pi * 0.5f;
+}
+
+float sky_view_v (float elevation)
+{
+	float t = std::sqrt (std::min (std::abs (elevation) / (Pi * 0.5f), 1.f));
+	return 0.5f + (elevation < 0.f ? -0.5f : 0.5f) * t;
+}
+
+float dot3 (cml::vec3f a, cml::vec3f b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+// Integrates the light scattered towards a viewer radius away from the planet's center along dir,
+// up to the ground or the top of the atmosphere. source gives the light a sample scatters towards
+// the viewer per unit of length. When transfer isn't null it receives the fraction of light
+// scattered along the ray, which doesn't include the lit ground at the end.
+template <typename Source>
+Rgb integrate_ray (AtmosphereSettings const& settings,
+    std::vector<float> const& transmittance,
+    float radius,
+    cml::vec3f dir,
+    cml::vec3f sun,
+    uint32_t steps,
+    Source const& source,
+    Rgb* transfer = nullptr)
+{
+	float ground = distance_to_ground (settings, radius, dir.y);
+	float ray_length =
+	    ground >= 0.f ? ground : std::max (0.f, distance_to_sphere (radius, dir.y, settings.top_radius));
+
+	Rgb throughput (1.f);
+	Rgb light;
+	for (uint32_t step = 0; step < steps; step++)
+	{
+		float t0 = march_distance (ray_length, static_cast<float> (step), steps);
+		float t1 = march_distance (ray_length, static_cast<float> (step + 1), steps);
+		float t = 0.5f * (t0 + t1);
+		cml::vec3f pos (dir.x * t, radius + dir.y * t, dir.z * t);
+		float sample_radius = std::sqrt (dot3 (pos, pos));
+		float sample_mu_sun = dot3 (pos, sun) / sample_radius;
+		Medium medium = sample_medium (settings, sample_radius - settings.bottom_radius);
+
+		// the in-scattering is integrated analytically over the step
+		Rgb step_transmittance = exp (medium.extinction * -(t1 - t0));
+		Rgb integral = (Rgb (1.f) + step_transmittance * -1.f) / (medium.extinction + 1e-9f);
+		light += throughput * source (medium, sample_radius, sample_mu_sun) * integral;
+		if (transfer) *transfer += throughput * medium.scattering * integral;
+		throughput *= step_transmittance;
+	}
+
+	// diffuse ground, lit by the sun
+	if (ground >= 0.f)
+	{
+		cml::vec3f pos (dir.x * ground, radius + dir.y * ground, dir.z * ground);
+		float ground_mu_sun = dot3 (pos, sun) / settings.bottom_radius;
+		Rgb sun_light = lookup_transmittance (settings, transmittance, settings.bottom_radius, ground_mu_sun);
+		light += throughput * sun_light * Rgb (settings.ground_albedo) * (std::max (0.f, ground_mu_sun) / Pi);
+	}
+	return light;
+}
+
+float view_radius (AtmosphereSettings const& settings, float view_height)
+{
+	// metres to kilometres, kept inside the atmosphere
+	float height = std::clamp (view_height / 1000.f, 0.001f, settings.top_radius - settings.bottom_radius - 0.01f);
+	return settings.bottom_radius + height;
+}
+} // namespace
+
+AmbientProbe AmbientProbe::uniform (cml::vec3f irradiance)
+{
+	return AmbientProbe{ { irradiance.x, irradiance.y, irradiance.z, 0.f }, {}, {}, {} };
+}
+
+AtmosphereLUTs::AtmosphereLUTs (AtmosphereSettings settings)
+: settings (settings),
+  transmittance (static_cast<size_t> (settings.transmittance_width) * settings.transmittance_height * 4, 1.f),
+  multi_scattering (static_cast<size_t> (settings.multi_scattering_size) * settings.multi_scattering_size * 4, 0.f),
+  sky_view{ std::vector<float> (static_cast<size_t> (settings.sky_view_width) * settings.sky_view_height * 4, 0.f) }
+{
+}
+
+void AtmosphereLUTs::generate (job::ThreadPool& pool)
+{
+	PROFILE_SCOPE ("AtmosphereLUTs::generate");
+	uint32_t width = settings.transmittance_width;
+	uint32_t height = settings.transmittance_height;
+	job::parallel_for (pool, height, 1, [&] (size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+			for (uint32_t column = 0; column < width; column++)
+			{
+				float radius, mu;
+				transmittance_coordinates (settings,
+				    static_cast<float> (column) / static_cast<float> (width - 1),
+				    static_cast<float> (row) / static_cast<float> (height - 1),
+				    radius,
+				    mu);
+
+				float ray_length = std::max (0.f, distance_to_sphere (radius, mu, settings.top_radius));
+				Rgb optical_depth;
+				for (uint32_t step = 0; step < TransmittanceSteps; step++)
+				{
+					float t0 = march_distance (ray_length, static_cast<float> (step), TransmittanceSteps);
+					float t1 = march_distance (ray_length, static_cast<float> (step + 1), TransmittanceSteps);
+					float t = 0.5f * (t0 + t1);
+					float sample_radius = std::sqrt (radius * radius + t * t + 2.f * radius * mu * t);
+					Medium medium = sample_medium (settings, sample_radius - settings.bottom_radius);
+					optical_depth += medium.extinction * (t1 - t0);
+				}
+				store_texel (transmittance, row * width + column, exp (optical_depth * -1.f));
+			}
+	});
+
+	// Hillaire's multiple scattering: the second order light arriving from every direction with an
+	// isotropic phase, and the fraction f of it scattered again, give every higher order as the
+	// geometric series L2 / (1 - f)
+	uint32_t size = settings.multi_scattering_size;
+	job::parallel_for (pool, size, 1, [&] (size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+			for (uint32_t column = 0; column < size; column++)
+			{
+				float mu_sun = -1.f + 2.f * static_cast<float> (column) / static_cast<float> (size - 1);
+				// kept just off the ground and below the top
+				float thickness = settings.top_radius - settings.bottom_radius;
+				float height = static_cast<float> (row) / static_cast<float> (size - 1) * thickness;
+				float radius = settings.bottom_radius + std::clamp (height, 0.01f, thickness - 0.01f);
+				cml::vec3f sun (std::sqrt (std::max (0.f, 1.f - mu_sun * mu_sun)), mu_sun, 0.f);
+
+				auto source = [&] (Medium const& medium, float sample_radius, float sample_mu_sun) {
+					Rgb sun_light = lookup_transmittance (settings, transmittance, sample_radius, sample_mu_sun);
+					return sun_light * medium.scattering * (1.f / (4.f * Pi));
+				};
+
+				Rgb second_order;
+				Rgb transfer;
+				for (uint32_t a = 0; a < MultiScatteringDirections; a++)
+					for (uint32_t b = 0; b < MultiScatteringDirections; b++)
+					{
+						float cos_theta = 1.f - 2.f * (static_cast<float> (a) + 0.5f) / MultiScatteringDirections;
+						float sin_theta = std::sqrt (std::max (0.f, 1.f - cos_theta * cos_theta));
+						float phi = 2.f * Pi * (static_cast<float> (b) + 0.5f) / MultiScatteringDirections;
+						cml::vec3f dir (sin_theta * std::cos (phi), cos_theta, sin_theta * std::sin (phi));
+						second_order += integrate_ray (
+						    settings, transmittance, radius, dir, sun, MultiScatteringSteps, source, &transfer);
+					}
+				float direction_count = static_cast<float> (MultiScatteringDirections * MultiScatteringDirections);
+				second_order *= Rgb (1.f / direction_count);
+				transfer *= Rgb (1.f / direction_count);
+				store_texel (multi_scattering, row * size + column, second_order / (Rgb (1.f) + transfer * -1.f));
+			}
+	});
+	has_sky_view = false;
+}
+
+bool AtmosphereLUTs::update_sky_view (job::ThreadPool& pool, cml::vec3f sun_direction, float view_height)
+{
+	if (!needs_sky_view (sun_direction, view_height)) return false;
+	set_sky_view (bake_sky_view (pool, sun_direction, view_height));
+	return true;
+}
+
+bool AtmosphereLUTs::needs_sky_view (cml::vec3f sun_direction, float view_height) const
+{
+	float sun_elevation = std::asin (std::clamp (sun_direction.y, -1.f, 1.f));
+	return !has_sky_view || std::abs (sun_elevation - sky_view.sun_elevation) >= settings.refresh_angle ||
+	       std::abs (view_height - sky_view.view_height) >= settings.refresh_height;
+}
+
+SkyViewBake AtmosphereLUTs::bake_sky_view (job::ThreadPool& pool, cml::vec3f sun_direction, float view_height) const
+{
+	PROFILE_SCOPE ("AtmosphereLUTs::bake_sky_view");
+	SkyViewBake bake;
+	bake.sun_elevation = std::asin (std::clamp (sun_direction.y, -1.f, 1.f));
+	bake.view_height = view_height;
+	bake.texels.resize (static_cast<size_t> (settings.sky_view_width) * settings.sky_view_height * 4, 0.f);
+
+	float radius = view_radius (settings, view_height);
+	// the sky is symmetric around the sun's vertical plane, columns go from towards the sun to away
+	cml::vec3f sun (std::cos (bake.sun_elevation), std::sin (bake.sun_elevation), 0.f);
+
+	uint32_t width = settings.sky_view_width;
+	uint32_t height = settings.sky_view_height;
+	job::parallel_for (pool, height, 1, [&] (size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+		{
+			float elevation = sky_view_elevation (static_cast<float> (row) / static_cast<float> (height - 1));
+			for (uint32_t column = 0; column < width; column++)
+			{
+				float azimuth = Pi * static_cast<float> (column) / static_cast<float> (width - 1);
+				float horizontal = std::cos (elevation);
+				cml::vec3f dir (horizontal * std::cos (azimuth), std::sin (elevation), horizontal * std::sin (azimuth));
+				float cos_theta = dot3 (dir, sun);
+				float rayleigh = rayleigh_phase (cos_theta);
+				float mie = mie_phase (cos_theta, settings.mie_anisotropy);
+
+				auto source = [&] (Medium const& medium, float sample_radius, float sample_mu_sun) {
+					Rgb sun_light = lookup_transmittance (settings, transmittance, sample_radius, sample_mu_sun);
+					Rgb multiple = lookup_multi_scattering (settings, multi_scattering, sample_radius, sample_mu_sun);
+					return sun_light * (medium.rayleigh * rayleigh + medium.mie * mie) + multiple * medium.scattering;
+				};
+				Rgb light = integrate_ray (settings, transmittance, radius, dir, sun, SkyViewSteps, source);
+				store_texel (bake.texels, row * width + column, light);
+			}
+		}
+	});
+
+	bake.ambient = bake_ambient (bake.texels);
+	return bake;
+}
+
+void AtmosphereLUTs::set_sky_view (SkyViewBake&& bake)
+{
+	sky_view = std::move (bake);
+	has_sky_view = true;
+}
+
+AmbientProbe AtmosphereLUTs::bake_ambient (std::vector<float> const& texels) const
+{
+	// projects the sky view onto L1 spherical harmonics, with x towards the sun. The sky mirrors
+	// around the sun's vertical plane, so the z coefficient is zero.
+	const uint32_t rows = 32;
+	const uint32_t columns = 64;
+	Rgb total;
+	Rgb towards_sun;
+	Rgb up;
+	for (uint32_t row = 0; row < rows; row++)
+	{
+		float elevation = Pi * ((static_cast<float> (row) + 0.5f) / rows - 0.5f);
+		float solid_angle = std::cos (elevation) * (Pi / rows) * (2.f * Pi / columns);
+		float v = sky_view_v (elevation);
+		for (uint32_t column = 0; column < columns; column++)
+		{
+			float azimuth = 2.f * Pi * (static_cast<float> (column) + 0.5f) / columns;
+			float folded = azimuth > Pi ? 2.f * Pi - azimuth : azimuth;
+			Rgb radiance = sample_table (texels, settings.sky_view_width, settings.sky_view_height, folded / Pi, v);
+			radiance *= Rgb (solid_angle);
+			total += radiance;
+			towards_sun += radiance * (std::cos (elevation) * std::cos (azimuth));
+			up += radiance * std::sin (elevation);
+		}
+	}
+
+	// convolved with the cosine lobe, the constant band scales by pi and the linear band by 2 pi / 3
+	total *= Rgb (0.25f);
+	towards_sun *= Rgb (0.5f);
+	up *= Rgb (0.5f);
+	return AmbientProbe{ { total.r, total.g, total.b, 0.f },
+		{ towards_sun.r, towards_sun.g, towards_sun.b, 0.f },
+		{ up.r, up.g, up.b, 0.f },
+		{} };
+}
+
+cml::vec3f AtmosphereLUTs::sun_transmittance (cml::vec3f sun_direction, float view_height) const
+{
+	Rgb value = lookup_transmittance (
+	    settings, transmittance, view_radius (settings, view_height), std::clamp (sun_direction.y, -1.f, 1.f));
+	return cml::vec3f (value.r, value.g, value.b);
+}
+
+AmbientProbe AtmosphereLUTs::get_ambient (cml::vec3f sun_direction) const
+{
+	// the sky view only tracks the sun's elevation, its azimuth turns the probe around the up axis
+	float length = std::sqrt (sun_direction.x * sun_direction.x + sun_direction.z * sun_direction.z);
+	float towards_x = length > 1e-5f ? sun_direction.x / length : 1.f;
+	float towards_z = length > 1e-5f ? sun_direction.z / length : 0.f;
+
+	AmbientProbe probe = sky_view.ambient;
+	for (int i = 0; i < 3; i++)
+	{
+		probe.x[i] = sky_view.ambient.x[i] * towards_x;
+		probe.z[i] = sky_view.ambient.x[i] * towards_z;
+	}
+	return probe;
+}
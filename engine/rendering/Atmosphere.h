@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cml/cml.h"
+
+namespace job
+{
+class ThreadPool;
+}
+
+// Earth-like defaults from Hillaire's "A Scalable and Production Ready Sky and Atmosphere
+// Rendering Technique". Distances are in kilometres, coefficients per kilometre.
+struct AtmosphereSettings
+{
+	float bottom_radius = 6360.f;
+	float top_radius = 6460.f;
+
+	cml::vec3f rayleigh_scattering = cml::vec3f (5.802e-3f, 13.558e-3f, 33.1e-3f);
+	float rayleigh_scale_height = 8.f;
+	float mie_scattering = 3.996e-3f;
+	float mie_extinction = 4.44e-3f;
+	float mie_scale_height = 1.2f;
+	float mie_anisotropy = 0.8f;
+	// ozone only absorbs, its density is a tent around ozone_center
+	cml::vec3f ozone_absorption = cml::vec3f (0.65e-3f, 1.881e-3f, 0.085e-3f);
+	float ozone_center = 25.f;
+	float ozone_half_width = 15.f;
+	cml::vec3f ground_albedo = cml::vec3f (0.3f, 0.3f, 0.3f);
+
+	uint32_t transmittance_width = 256;
+	uint32_t transmittance_height = 64;
+	uint32_t multi_scattering_size = 32;
+	uint32_t sky_view_width = 192;
+	uint32_t sky_view_height = 108;
+
+	// the sky view is baked again once the sun turned further than this, in radians, or the viewer
+	// moved further than refresh_height metres up or down
+	float refresh_angle = 0.002f;
+	float refresh_height = 50.f;
+};
+
+// Irradiance as L1 spherical harmonics, already convolved with the cosine lobe and scaled by the
+// basis constants, so E(N) = constant + x * N.x + y * N.y + z * N.z. Matches AmbientProbe in
+// lighting.glsl (std430), the fourth component of each row is unused.
+struct AmbientProbe
+{
+	float constant[4];
+	float x[4];
+	float y[4];
+	float z[4];
+
+	// the same irradiance from every direction
+	static AmbientProbe uniform (cml::vec3f irradiance);
+};
+
+// One bake of the sky view and its ambient probe, see AtmosphereLUTs::bake_sky_view
+struct SkyViewBake
+{
+	std::vector<float> texels;
+	AmbientProbe ambient = AmbientProbe::uniform (cml::vec3f (0.f, 0.f, 0.f)); // x points towards the sun
+	float sun_elevation = 0.f;
+	float view_height = 0.f;
+};
+
+// Lookup tables of a planet's atmosphere, all RGBA float texels in row order:
+//  - transmittance from a point to the top of the atmosphere, by height and view zenith
+//  - the radiance multiple scattering adds, by height and sun zenith, which stands in for every
+//    order past the first
+//  - the sky's radiance around a viewer, by elevation and azimuth from the sun
+// The first two only depend on the settings and are baked once. The sky view depends on the sun's
+// elevation and the viewer's height and is baked again when those change, which can happen off to
+// the side while the current one is in use. Radiance is per unit of sun illuminance at the top of
+// the atmosphere.
+class AtmosphereLUTs
+{
+	public:
+	explicit AtmosphereLUTs (AtmosphereSettings settings = {});
+
+	// bakes transmittance and multiple scattering across the pool
+	void generate (job::ThreadPool& pool);
+
+	// Bakes the sky view and the ambient probe for a sun along sun_direction (towards the sun, y up)
+	// and a viewer view_height metres above the ground. Returns false without baking when neither
+	// moved enough since the last bake.
+	bool update_sky_view (job::ThreadPool& pool, cml::vec3f sun_direction, float view_height);
+
+	// true when there is no sky view yet or the sun or the viewer moved enough since its bake
+	bool needs_sky_view (cml::vec3f sun_direction, float view_height) const;
+	// The bake update_sky_view makes, without touching the sky view in use. Only reads the tables
+	// generate made, so it can run on another thread while the current sky view is read.
+	SkyViewBake bake_sky_view (job::ThreadPool& pool, cml::vec3f sun_direction, float view_height) const;
+	void set_sky_view (SkyViewBake&& bake);
+
+	// the part of the sunlight that reaches the viewer, zero once the sun is below the horizon
+	cml::vec3f sun_transmittance (cml::vec3f sun_direction, float view_height) const;
+
+	std::vector<float> const& get_transmittance () const { return transmittance; }
+	std::vector<float> const& get_multi_scattering () const { return multi_scattering; }
+	std::vector<float> const& get_sky_view () const { return sky_view.texels; }
+	AtmosphereSettings const& get_settings () const { return settings; }
+
+	// the ambient probe of the last sky view bake, turned to where the sun is now
+	AmbientProbe get_ambient (cml::vec3f sun_direction) const;
+
+	private:
+	AtmosphereSettings settings;
+	std::vector<float> transmittance;
+	std::vector<float> multi_scattering;
+	SkyViewBake sky_view;
+	bool has_sky_view = false;
+
+	AmbientProbe bake_ambient (std::vector<float> const& texels) const;
+};
@@ -0,0 +1,257 @@
+#include "Culling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#define CULLING_USE_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CULLING_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "core/JobSystem.h"
+#include "core/Profiler.h"
+
+namespace
+{
+// multiple of CullingBounds::Width
+const size_t CullChunkSize = 2048;
+} // namespace
+
+Frustum extract_frustum (cml::mat4f const& proj_view)
+{
+	// column major, row r is (m[r], m[4 + r], m[8 + r], m[12 + r])
+	float const* m = reinterpret_cast<float const*> (&proj_view);
+	auto row = [m] (int r) { return cml::vec4f (m[r], m[4 + r], m[8 + r], m[12 + r]); };
+	cml::vec4f r0 = row (0), r1 = row (1), r2 = row (2), r3 = row (3);
+
+	Frustum f;
+	f.planes[0] = r3 + r0; // left
+	f.planes[1] = r3 - r0; // right
+	f.planes[2] = r3 + r1; // bottom
+	f.planes[3] = r3 - r1; // top
+	f.planes[4] = r2; // z >= 0
+	f.planes[5] = r3 - r2; // z <= w
+	for (auto& p : f.planes)
+	{
+		float len = std::sqrt (p.x * p.x + p.y * p.y + p.z * p.z);
+		if (len > 0.f) p = p * (1.f / len);
+	}
+	return f;
+}
+
+// CullingBounds
+
+uint32_t CullingBounds::push ()
+{
+	uint32_t index = static_cast<uint32_t> (count++);
+	if (count > center_x.size ())
+	{
+		// padding objects have a negative infinite reach, so they never pass a test
+		size_t padded = (count + Width - 1) / Width * Width;
+		center_x.resize (padded, 0.f);
+		center_y.resize (padded, 0.f);
+		center_z.resize (padded, 0.f);
+		extent_x.resize (padded, 0.f);
+		extent_y.resize (padded, 0.f);
+		extent_z.resize (padded, 0.f);
+		radius.resize (padded, -INFINITY);
+	}
+	return index;
+}
+
+uint32_t CullingBounds::add_sphere (cml::vec3f center, float radius)
+{
+	uint32_t index = push ();
+	set_sphere (index, center, radius);
+	return index;
+}
+
+uint32_t CullingBounds::add_aabb (cml::vec3f min, cml::vec3f max)
+{
+	uint32_t index = push ();
+	set_aabb (index, min, max);
+	return index;
+}
+
+void CullingBounds::set_sphere (uint32_t index, cml::vec3f center, float r)
+{
+	center_x.at (index) = center.x;
+	center_y[index] = center.y;
+	center_z[index] = center.z;
+	extent_x[index] = r;
+	extent_y[index] = r;
+	extent_z[index] = r;
+	radius[index] = r;
+}
+
+void CullingBounds::set_aabb (uint32_t index, cml::vec3f min, cml::vec3f max)
+{
+	cml::vec3f center = (min + max) * 0.5f;
+	cml::vec3f extent = (max - min) * 0.5f;
+	center_x.at (index) = center.x;
+	center_y[index] = center.y;
+	center_z[index] = center.z;
+	extent_x[index] = extent.x;
+	extent_y[index] = extent.y;
+	extent_z[index] = extent.z;
+	radius[index] = std::sqrt (extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+}
+
+void CullingBounds::clear ()
+{
+	count = 0;
+	center_x.clear ();
+	center_y.clear ();
+	center_z.clear ();
+	extent_x.clear ();
+	extent_y.clear ();
+	extent_z.clear ();
+	radius.clear ();
+}
+
+// FrustumCuller
+
+uint32_t FrustumCuller::test_frustum (CullingBounds const& b, size_t base, std::array<Plane, 6> const& planes)
+{
+#if defined(CULLING_USE_AVX)
+	__m256 cx = _mm256_loadu_ps (&b.center_x[base]);
+	__m256 cy = _mm256_loadu_ps (&b.center_y[base]);
+	__m256 cz = _mm256_loadu_ps (&b.center_z[base]);
+	__m256 ex = _mm256_loadu_ps (&b.extent_x[base]);
+	__m256 ey = _mm256_loadu_ps (&b.extent_y[base]);
+	__m256 ez = _mm256_loadu_ps (&b.extent_z[base]);
+	__m256 r = _mm256_loadu_ps (&b.radius[base]);
+	__m256 inside = _mm256_castsi256_ps (_mm256_set1_epi32 (-1));
+	for (auto& p : planes)
+	{
+		__m256 dist = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (cx, _mm256_set1_ps (p.nx)),
+		                                 _mm256_mul_ps (cy, _mm256_set1_ps (p.ny))),
+		    _mm256_add_ps (_mm256_mul_ps (cz, _mm256_set1_ps (p.nz)), _mm256_set1_ps (p.d)));
+		__m256 box = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (ex, _mm256_set1_ps (p.ax)),
+		                                _mm256_mul_ps (ey, _mm256_set1_ps (p.ay))),
+		    _mm256_mul_ps (ez, _mm256_set1_ps (p.az)));
+		__m256 reach = _mm256_min_ps (r, box);
+		inside = _mm256_and_ps (inside, _mm256_cmp_ps (_mm256_add_ps (dist, reach), _mm256_setzero_ps (), _CMP_GE_OQ));
+	}
+	return static_cast<uint32_t> (_mm256_movemask_ps (inside));
+#elif defined(CULLING_USE_SSE)
+	uint32_t result = 0;
+	for (size_t half = 0; half < CullingBounds::Width; half += 4)
+	{
+		size_t i = base + half;
+		__m128 cx = _mm_loadu_ps (&b.center_x[i]);
+		__m128 cy = _mm_loadu_ps (&b.center_y[i]);
+		__m128 cz = _mm_loadu_ps (&b.center_z[i]);
+		__m128 ex = _mm_loadu_ps (&b.extent_x[i]);
+		__m128 ey = _mm_loadu_ps (&b.extent_y[i]);
+		__m128 ez = _mm_loadu_ps (&b.extent_z[i]);
+		__m128 r = _mm_loadu_ps (&b.radius[i]);
+		__m128 inside = _mm_castsi128_ps (_mm_set1_epi32 (-1));
+		for (auto& p : planes)
+		{
+			__m128 dist = _mm_add_ps (_mm_add_ps (_mm_mul_ps (cx, _mm_set1_ps (p.nx)), _mm_mul_ps (cy, _mm_set1_ps (p.ny))),
+			    _mm_add_ps (_mm_mul_ps (cz, _mm_set1_ps (p.nz)), _mm_set1_ps (p.d)));
+			__m128 box = _mm_add_ps (_mm_add_ps (_mm_mul_ps (ex, _mm_set1_ps (p.ax)), _mm_mul_ps (ey, _mm_set1_ps (p.ay))),
+			    _mm_mul_ps (ez, _mm_set1_ps (p.az)));
+			__m128 reach = _mm_min_ps (r, box);
+			inside = _mm_and_ps (inside, _mm_cmpge_ps (_mm_add_ps (dist, reach), _mm_setzero_ps ()));
+		}
+		result |= static_cast<uint32_t> (_mm_movemask_ps (inside)) << half;
+	}
+	return result;
+#else
+	uint32_t result = 0;
+	for (size_t n = 0; n < CullingBounds::Width; n++)
+	{
+		size_t i = base + n;
+		bool inside = true;
+		for (auto& p : planes)
+		{
+			float dist = b.center_x[i] * p.nx + b.center_y[i] * p.ny + b.center_z[i] * p.nz + p.d;
+			float box = b.extent_x[i] * p.ax + b.extent_y[i] * p.ay + b.extent_z[i] * p.az;
+			inside = inside && dist + std::min (b.radius[i], box) >= 0.f;
+		}
+		if (inside) result |= 1u << n;
+	}
+	return result;
+#endif
+}
+
+void FrustumCuller::cull (job::ThreadPool& pool, CullingBounds const& bounds, std::vector<Frustum> const& frustums)
+{
+	PROFILE_SCOPE ("FrustumCuller::cull");
+	uint32_t frustum_count = static_cast<uint32_t> (std::min<size_t> (frustums.size (), MaxFrustums));
+
+	std::vector<std::array<Plane, 6>> planes (frustum_count);
+	for (uint32_t f = 0; f < frustum_count; f++)
+	{
+		for (size_t p = 0; p < 6; p++)
+		{
+			auto& in = frustums[f].planes[p];
+			planes[f][p] = { in.x, in.y, in.z, in.w, std::abs (in.x), std::abs (in.y), std::abs (in.z) };
+		}
+	}
+
+	size_t padded = bounds.center_x.size ();
+	size_t chunk_count = (padded + CullChunkSize - 1) / CullChunkSize;
+	masks.resize (padded);
+	chunk_counts.assign (chunk_count * MaxFrustums, 0);
+
+	// pass one, visibility masks and per chunk counts
+	job::parallel_for (pool, chunk_count, 1, [&] (size_t chunk_begin, size_t chunk_end) {
+		for (size_t c = chunk_begin; c < chunk_end; c++)
+		{
+			size_t begin = c * CullChunkSize;
+			size_t end = std::min (begin + CullChunkSize, padded);
+			std::fill (masks.begin () + begin, masks.begin () + end, 0u);
+			uint32_t* counts = &chunk_counts[c * MaxFrustums];
+			for (uint32_t f = 0; f < frustum_count; f++)
+			{
+				for (size_t base = begin; base < end; base += CullingBounds::Width)
+				{
+					uint32_t lanes = test_frustum (bounds, base, planes[f]);
+					for (size_t n = 0; lanes != 0; n++, lanes >>= 1)
+					{
+						if ((lanes & 1) == 0) continue;
+						masks[base + n] |= 1u << f;
+						counts[f]++;
+					}
+				}
+			}
+		}
+	});
+
+	// turn the counts into write offsets
+	for (uint32_t f = 0; f < frustum_count; f++)
+	{
+		uint32_t total = 0;
+		for (size_t c = 0; c < chunk_count; c++)
+		{
+			uint32_t count = chunk_counts[c * MaxFrustums + f];
+			chunk_counts[c * MaxFrustums + f] = total;
+			total += count;
+		}
+		visible[f].resize (total);
+	}
+	for (uint32_t f = frustum_count; f < MaxFrustums; f++)
+		visible[f].clear ();
+
+	// pass two, compaction keeps each list in index order
+	job::parallel_for (pool, chunk_count, 1, [&] (size_t chunk_begin, size_t chunk_end) {
+		for (size_t c = chunk_begin; c < chunk_end; c++)
+		{
+			size_t begin = c * CullChunkSize;
+			size_t end = std::min (begin + CullChunkSize, padded);
+			for (uint32_t f = 0; f < frustum_count; f++)
+			{
+				uint32_t* out = visible[f].data () + chunk_counts[c * MaxFrustums + f];
+				for (size_t i = begin; i < end; i++)
+					if ((masks[i] >> f) & 1) *out++ = static_cast<uint32_t> (i);
+			}
+		}
+	});
+	masks.resize (bounds.size ());
+}
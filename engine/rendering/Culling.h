@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "cml/cml.h"
+
+namespace job
+{
+class ThreadPool;
+}
+
+// plane.xyz is the inward facing normal, a point p is inside when dot (xyz, p) + w >= 0
+struct Frustum
+{
+	std::array<cml::vec4f, 6> planes;
+};
+
+// Gribb-Hartmann extraction for Vulkan clip space (0 <= z <= w), planes are normalized
+Frustum extract_frustum (cml::mat4f const& proj_view);
+
+// World space bounds in SoA layout, padded to a multiple of CullingBounds::Width so the SIMD
+// loops never need a scalar tail. Every object has a bounding sphere and an axis aligned half
+// size, the test uses whichever of the two is tighter for each plane.
+class CullingBounds
+{
+	public:
+	static constexpr size_t Width = 8;
+
+	uint32_t add_sphere (cml::vec3f center, float radius);
+	uint32_t add_aabb (cml::vec3f min, cml::vec3f max);
+	void set_sphere (uint32_t index, cml::vec3f center, float radius);
+	void set_aabb (uint32_t index, cml::vec3f min, cml::vec3f max);
+	void clear ();
+
+	size_t size () const { return count; }
+	cml::vec3f get_center (uint32_t index) const { return cml::vec3f (center_x[index], center_y[index], center_z[index]); }
+	cml::vec3f get_extent (uint32_t index) const { return cml::vec3f (extent_x[index], extent_y[index], extent_z[index]); }
+
+	private:
+	size_t count = 0;
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> extent_x, extent_y, extent_z;
+	std::vector<float> radius;
+
+	uint32_t push ();
+
+	friend class FrustumCuller;
+};
+
+// Tests every object against up to 32 frustums in one pass over the bounds. Each chunk of objects
+// stays in cache while it's checked against all frustums, producing a visibility bitmask per
+// object, which is then compacted into a sorted index list per frustum. Chunks run on the pool.
+class FrustumCuller
+{
+	public:
+	static constexpr uint32_t MaxFrustums = 32;
+
+	void cull (job::ThreadPool& pool, CullingBounds const& bounds, std::vector<Frustum> const& frustums);
+
+	std::vector<uint32_t> const& get_visible (uint32_t frustum) const { return visible.at (frustum); }
+	// for later stages that narrow the lists down further, like occlusion culling
+	std::vector<uint32_t>& get_visible (uint32_t frustum) { return visible.at (frustum); }
+	// bit i is set when the object is visible in frustum i
+	std::vector<uint32_t> const& get_masks () const { return masks; }
+
+	private:
+	struct Plane
+	{
+		float nx, ny, nz, d;
+		float ax, ay, az; // abs of the normal
+	};
+	// bit n is set when object base + n is inside all planes
+	static uint32_t test_frustum (CullingBounds const& b, size_t base, std::array<Plane, 6> const& planes);
+
+	std::array<std::vector<uint32_t>, MaxFrustums> visible;
+	std::vector<uint32_t> masks;
+	std::vector<uint32_t> chunk_counts; // chunk major, MaxFrustums per chunk
+};
@@ -0,0 +1,81 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "backend/GPUProfiler.h"
+
+DynamicResolution::DynamicResolution (DynamicResolutionSettings settings)
+: settings (settings), scale (settings.max_scale)
+{
+	history.reserve (settings.raise_frames);
+}
+
+float DynamicResolution::update (double gpu_ms)
+{
+	if (!settings.enabled) return scale;
+
+	// frames recorded before the last change would move the scale a second time
+	frames_since_change++;
+	if (gpu_ms <= 0.0 || frames_since_change <= settings.latency_frames) return scale;
+
+	double budget = settings.target_ms * (1.0 - settings.headroom);
+	if (gpu_ms > settings.target_ms)
+	{
+		float wanted = scale * static_cast<float> (std::sqrt (budget / gpu_ms));
+		// whole steps down, so the new scale fits in the budget
+		if (settings.scale_step > 0.f) wanted = std::floor (wanted / settings.scale_step + 1e-4f) * settings.scale_step;
+		change_scale (wanted);
+		return scale;
+	}
+
+	if (history.size () >= settings.raise_frames && !history.empty ()) history.erase (history.begin ());
+	history.push_back (gpu_ms);
+	if (history.size () < settings.raise_frames) return scale;
+
+	double average = std::accumulate (std::begin (history), std::end (history), 0.0) / history.size ();
+	float raised = scale + settings.scale_step;
+	double raised_ms = average * (raised * raised) / (scale * scale);
+	if (raised_ms <= budget) change_scale (raised);
+	return scale;
+}
+
+double DynamicResolution::frame_gpu_ms (std::vector<GPUScopeTiming> const& timings)
+{
+	double total = 0.0;
+	for (auto& timing : timings)
+		if (timing.depth == 0) total += timing.ms;
+	return total;
+}
+
+VkExtent2D DynamicResolution::get_extent (VkExtent2D full) const
+{
+	auto scale_axis = [this] (uint32_t size) {
+		// the slack keeps rounding errors in the scale from adding a pixel
+		auto scaled = static_cast<uint32_t> (std::ceil (static_cast<float> (size) * scale - 0.01f));
+		return std::clamp (scaled, std::min (size, 1u), size);
+	};
+	return { scale_axis (full.width), scale_axis (full.height) };
+}
+
+void DynamicResolution::set_enabled (bool enabled)
+{
+	settings.enabled = enabled;
+	if (!enabled) change_scale (settings.max_scale);
+}
+
+void DynamicResolution::set_target_ms (float target_ms)
+{
+	settings.target_ms = target_ms;
+	history.clear ();
+}
+
+void DynamicResolution::change_scale (float new_scale)
+{
+	new_scale = std::clamp (new_scale, settings.min_scale, settings.max_scale);
+	if (std::abs (new_scale - scale) < 1e-4f) return;
+	scale = new_scale;
+	frames_since_change = 0;
+	history.clear ();
+}
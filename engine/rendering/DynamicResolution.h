@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+struct GPUScopeTiming;
+
+struct DynamicResolutionSettings
+{
+	bool enabled = false;
+	float target_ms = 16.0f; // GPU time a frame may take
+	float headroom = 0.1f; // fraction of the target kept free, so a spike doesn't miss it right away
+	float min_scale = 0.5f; // of each axis
+	float max_scale = 1.0f;
+	float scale_step = 0.05f; // the scale moves in whole steps and rises one step at a time
+	// frames the GPU time is averaged over before the scale rises again
+	uint32_t raise_frames = 30;
+	// frames a new scale takes to show up in the timings, they're read back once a slot is reused
+	uint32_t latency_frames = 3;
+};
+
+// Picks the fraction of the attachments the scene renders into, per axis, from GPU frame times.
+// Pixel cost grows with the square of the scale, so the scale wanted for the budget is the current
+// one times the square root of the budget over the measured time. A frame over the target lowers it
+// straight away, raising it waits for raise_frames frames averaging under the budget, which keeps
+// it from oscillating between two steps.
+class DynamicResolution
+{
+	public:
+	explicit DynamicResolution (DynamicResolutionSettings settings = {});
+
+	// gpu_ms is the GPU time of the most recently resolved frame, 0 when there is none. Returns the
+	// scale to render the next frame at.
+	float update (double gpu_ms);
+
+	// the sum of the outermost scopes of a GPUProfiler's results
+	static double frame_gpu_ms (std::vector<GPUScopeTiming> const& timings);
+
+	float get_scale () const { return scale; }
+	// full scaled per axis, rounded up to whole pixels
+	VkExtent2D get_extent (VkExtent2D full) const;
+
+	DynamicResolutionSettings const& get_settings () const { return settings; }
+	void set_enabled (bool enabled);
+	void set_target_ms (float target_ms);
+
+	private:
+	DynamicResolutionSettings settings;
+	float scale = 1.0f;
+	uint32_t frames_since_change = 0;
+	std::vector<double> history; // GPU times since the last change, up to raise_frames of them
+
+	void change_scale (float new_scale);
+};
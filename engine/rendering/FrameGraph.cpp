@@ -1,9 +1,11 @@
 #include "FrameGraph.h"
 
+#include <algorithm>
 #include <map>
 
 #include "Initializers.h"
 #include "backend/Device.h"
+#include "backend/GPUProfiler.h"
 #include "backend/RenderTools.h"
 #include "backend/SwapChain.h"
 #include "backend/Texture.h"
@@ -24,6 +26,7 @@ void SubpassDescription::add_preserve_attachments (std::string name)
 {
 	preserve_attachments.push_back (name);
 }
+void SubpassDescription::set_view_mask (uint32_t mask) { view_mask = mask; }
 void SubpassDescription::set_depth_stencil (std::string name, DepthStencilAccess access)
 {
 	depth_stencil_attachment = name;
@@ -89,6 +92,21 @@ void RenderPassDescription::add_subpass (SubpassDescription subpass)
 	subpasses.push_back (subpass);
 }
 
+void RenderPassDescription::set_condition (std::function<bool ()> condition)
+{
+	this->condition = std::move (condition);
+}
+
+void RenderPassDescription::add_sampled_output (std::string attachment_name)
+{
+	sampled_outputs.insert (attachment_name);
+}
+
+void RenderPassDescription::set_render_area (std::function<VkExtent2D ()> area)
+{
+	render_area = std::move (area);
+}
+
 VkRenderPassCreateInfo RenderPassDescription::get_renderpass_create_info (AttachmentMap& attachment_map)
 {
 	// Get all used attachments from subpasses(ignoring duplicate usages with std::unordered_set)
@@ -166,6 +184,29 @@ VkRenderPassCreateInfo RenderPassDescription::get_renderpass_create_info (Attach
 		sb_dependencies.push_back (desc.get ());
 	// TODO Subpass Dependencies
 
+	if (!sampled_outputs.empty ())
+	{
+		// earlier readers have to finish before the pass writes again, and the writes have to
+		// land before later passes sample them
+		VkSubpassDependency before{};
+		before.srcSubpass = VK_SUBPASS_EXTERNAL;
+		before.dstSubpass = 0;
+		before.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		before.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		before.srcAccessMask = 0;
+		before.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		sb_dependencies.push_back (before);
+
+		VkSubpassDependency after{};
+		after.srcSubpass = static_cast<uint32_t> (subpasses.size ()) - 1;
+		after.dstSubpass = VK_SUBPASS_EXTERNAL;
+		after.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		after.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		after.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		after.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		sb_dependencies.push_back (after);
+	}
+
 
 	// get attachment reference details
 	for (auto& attach : attachment_uses)
@@ -326,7 +367,12 @@ VkRenderPassCreateInfo RenderPassDescription::get_renderpass_create_info (Attach
 		if (present_attachment && is_output && !is_depth_output)
 		{
 			initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+			finalLayout = present_layout;
+		}
+
+		if (sampled_outputs.count (attach.rpAttach.name) == 1)
+		{
+			finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		}
 
 		attach.initialLayout = initialLayout;
@@ -346,6 +392,22 @@ VkRenderPassCreateInfo RenderPassDescription::get_renderpass_create_info (Attach
 	renderPassInfo.dependencyCount = (uint32_t)sb_dependencies.size ();
 	renderPassInfo.pDependencies = sb_dependencies.data ();
 
+	if (is_multiview ())
+	{
+		// every view of a pass sees nearly the same scene, which lets the driver share work
+		for (auto& subpass : subpasses)
+		{
+			view_masks.push_back (subpass.view_mask);
+			correlation_mask |= subpass.view_mask;
+		}
+		multiview_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+		multiview_info.subpassCount = static_cast<uint32_t> (view_masks.size ());
+		multiview_info.pViewMasks = view_masks.data ();
+		multiview_info.correlationMaskCount = 1;
+		multiview_info.pCorrelationMasks = &correlation_mask;
+		renderPassInfo.pNext = &multiview_info;
+	}
+
 	std::map<int, VkClearValue> map_clearColors;
 
 	// get all the clear colors by name, put them in a map by their index
@@ -375,6 +437,13 @@ std::vector<RenderFunc> RenderPassDescription::get_subpass_functions ()
 	return funcs;
 }
 
+bool RenderPassDescription::is_multiview () const
+{
+	return std::any_of (std::begin (subpasses), std::end (subpasses), [] (auto const& subpass) {
+		return subpass.view_mask != 0;
+	});
+}
+
 std::vector<std::string> RenderPassDescription::get_used_attachment_names ()
 {
 	std::vector<std::string> attachments;
@@ -428,6 +497,52 @@ FrameBuffer& FrameBuffer::operator= (FrameBuffer&& fb) noexcept
 
 //// RENDER PASS ////
 
+namespace
+{
+template <typename T> void append_key (std::string& key, T const& value)
+{
+	key.append (reinterpret_cast<char const*> (&value), sizeof (T));
+}
+
+void append_references (std::string& key, VkAttachmentReference const* refs, uint32_t count)
+{
+	append_key (key, count);
+	for (uint32_t i = 0; refs != nullptr && i < count; i++)
+		append_key (key, refs[i].attachment);
+}
+
+// Everything two render passes have to agree on to be compatible: attachment formats and sample
+// counts, the attachments each subpass references and the view masks. Layouts, load and store ops
+// and dependencies don't matter.
+std::string render_pass_compatibility_key (VkRenderPassCreateInfo const& info)
+{
+	std::string key;
+	append_key (key, info.attachmentCount);
+	for (uint32_t i = 0; i < info.attachmentCount; i++)
+	{
+		append_key (key, info.pAttachments[i].format);
+		append_key (key, info.pAttachments[i].samples);
+	}
+	append_key (key, info.subpassCount);
+	for (uint32_t i = 0; i < info.subpassCount; i++)
+	{
+		auto& subpass = info.pSubpasses[i];
+		append_key (key, subpass.pipelineBindPoint);
+		append_references (key, subpass.pInputAttachments, subpass.inputAttachmentCount);
+		append_references (key, subpass.pColorAttachments, subpass.colorAttachmentCount);
+		append_references (key, subpass.pResolveAttachments, subpass.pResolveAttachments ? subpass.colorAttachmentCount : 0);
+		append_references (key, subpass.pDepthStencilAttachment, subpass.pDepthStencilAttachment ? 1 : 0);
+	}
+	auto multiview = static_cast<VkRenderPassMultiviewCreateInfo const*> (info.pNext);
+	if (multiview != nullptr && multiview->sType == VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO)
+	{
+		for (uint32_t i = 0; i < multiview->subpassCount; i++)
+			append_key (key, multiview->pViewMasks[i]);
+	}
+	return key;
+}
+} // namespace
+
 RenderPass::RenderPass (VkDevice device, RenderPassDescription desc_in, AttachmentMap& attachments)
 : device (device), desc (desc_in)
 {
@@ -438,6 +553,7 @@ RenderPass::RenderPass (VkDevice device, RenderPassDescription desc_in, Attachme
 	{
 		throw std::runtime_error ("failed to create render pass!");
 	}
+	compatibility_key = render_pass_compatibility_key (renderPassInfo);
 
 	subpassFuncs = desc.get_subpass_functions ();
 }
@@ -448,7 +564,11 @@ RenderPass::~RenderPass ()
 }
 
 RenderPass::RenderPass (RenderPass&& rp) noexcept
-: device (rp.device), subpassFuncs (std::move (rp.subpassFuncs)), rp (rp.rp), desc (rp.desc)
+: device (rp.device),
+  subpassFuncs (std::move (rp.subpassFuncs)),
+  rp (rp.rp),
+  compatibility_key (std::move (rp.compatibility_key)),
+  desc (rp.desc)
 {
 	rp.rp = nullptr;
 }
@@ -457,35 +577,42 @@ RenderPass& RenderPass::operator= (RenderPass&& rp) noexcept
 	device = rp.device;
 	subpassFuncs = std::move (rp.subpassFuncs);
 	this->rp = rp.rp;
+	compatibility_key = std::move (rp.compatibility_key);
 	desc = rp.desc;
 	rp.rp = nullptr;
 	return *this;
 }
 
-void RenderPass::BuildCmdBuf (VkCommandBuffer cmdBuf, FrameBufferView fb_view)
+void RenderPass::BuildCmdBuf (VkCommandBuffer cmdBuf, FrameBufferView fb_view, GPUProfiler* gpu_profiler)
 {
 	VkRenderPassBeginInfo renderPassInfo = initializers::render_pass_begin_info (
 	    rp, fb_view.fb, fb_view.view.offset, fb_view.view.extent, desc.clear_values);
 
+	// statistics queries have to begin outside the render pass to cover all subpasses
+	if (gpu_profiler) gpu_profiler->begin_scope (cmdBuf, desc.name, true);
 
 	vkCmdBeginRenderPass (cmdBuf, &renderPassInfo, VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE);
-	if (subpassFuncs.size () == 0)
-	{
-		// nothing to draw;
-	}
-	else if (subpassFuncs.size () == 1)
-	{
-		subpassFuncs.at (0) (cmdBuf);
-	}
-	else
+	for (size_t i = 0; i < subpassFuncs.size (); i++)
 	{
-		for (auto& func : subpassFuncs)
-		{
-			func (cmdBuf);
-			vkCmdNextSubpass (cmdBuf, VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE);
-		}
+		if (i > 0) vkCmdNextSubpass (cmdBuf, VkSubpassContents::VK_SUBPASS_CONTENTS_INLINE);
+
+		// inside a multiview subpass a timestamp takes one query per view and would run into the
+		// next scope's, the pass' scope still times it
+		bool subpass_scope = gpu_profiler && desc.subpasses.at (i).view_mask == 0;
+		if (subpass_scope) gpu_profiler->begin_scope (cmdBuf, desc.subpasses.at (i).name);
+		subpassFuncs.at (i) (cmdBuf);
+		if (subpass_scope) gpu_profiler->end_scope (cmdBuf);
 	}
 	vkCmdEndRenderPass (cmdBuf);
+
+	if (gpu_profiler) gpu_profiler->end_scope (cmdBuf);
+}
+
+VkRect2D RenderPass::get_render_area (VkRect2D full) const
+{
+	if (!desc.render_area) return full;
+	VkExtent2D area = desc.render_area ();
+	return { full.offset, { std::min (area.width, full.extent.width), std::min (area.height, full.extent.height) } };
 }
 
 std::vector<VkImageView> RenderPass::order_attachments (
@@ -522,6 +649,7 @@ void FrameGraphBuilder::add_attachment (RenderPassAttachment attachment)
 
 void FrameGraphBuilder::add_render_pass (RenderPassDescription renderPass)
 {
+	if (render_passes.count (renderPass.name) == 0) pass_order.push_back (renderPass.name);
 	render_passes[renderPass.name] = renderPass;
 }
 
@@ -535,19 +663,23 @@ void FrameGraphBuilder::set_final_output_attachment_name (std::string name)
 
 //// FRAME GRAPH ////
 
-FrameGraph::FrameGraph (VulkanDevice& device, VulkanSwapChain& swapchain, FrameGraphBuilder builder)
-: device (device), swapchain (swapchain), builder (builder)
+FrameGraph::FrameGraph (
+    VulkanDevice& device, VulkanSwapChain& swapchain, FrameGraphBuilder builder, GPUProfiler* gpu_profiler)
+: device (device), swapchain (swapchain), gpu_profiler (gpu_profiler), builder (builder)
 {
 	int swapchain_count = swapchain.GetChainCount ();
 
 	auto& final_attachment = builder.attachments.at (builder.final_output_attachment);
 	auto& final_renderpass_desc = builder.render_passes.at (builder.final_renderpass);
 	final_renderpass_desc.present_attachment = true;
+	final_renderpass_desc.present_layout =
+	    swapchain.is_headless () ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	create_attachments ();
 
-	for (auto& [name, pass] : builder.render_passes)
+	for (auto& name : builder.pass_order)
 	{
+		auto& pass = builder.render_passes.at (name);
 		if (name == builder.final_renderpass)
 		{
 			final_renderpass = std::make_unique<RenderPass> (device.device, pass, builder.attachments);
@@ -564,10 +696,35 @@ FrameGraph::~FrameGraph () {}
 
 VkRenderPass FrameGraph::get (int index) const { return render_passes.at (index).get (); }
 
+std::vector<std::pair<std::string, VkRenderPass>> FrameGraph::get_render_passes () const
+{
+	std::vector<std::pair<std::string, VkRenderPass>> out;
+	out.emplace_back (final_renderpass->get_name (), final_renderpass->get ());
+	for (auto& pass : render_passes)
+		out.emplace_back (pass.get_name (), pass.get ());
+	return out;
+}
+
+std::vector<std::pair<VkRenderPass, std::string>> FrameGraph::get_compatibility_keys () const
+{
+	std::vector<std::pair<VkRenderPass, std::string>> out;
+	out.emplace_back (final_renderpass->get (), final_renderpass->get_compatibility_key ());
+	for (auto& pass : render_passes)
+		out.emplace_back (pass.get (), pass.get_compatibility_key ());
+	return out;
+}
+
 
 void FrameGraph::fill_command_buffer (VkCommandBuffer cmdBuf, FrameBufferView frame_buffer_view)
 {
-	final_renderpass->BuildCmdBuf (cmdBuf, frame_buffer_view);
+	for (size_t i = 0; i < render_passes.size (); i++)
+	{
+		if (!render_passes[i].should_record ()) continue;
+		auto& fb = framebuffers.at (i);
+		auto area = render_passes[i].get_render_area (fb.get_full_size ());
+		render_passes[i].BuildCmdBuf (cmdBuf, FrameBufferView (fb.get (), area), gpu_profiler);
+	}
+	final_renderpass->BuildCmdBuf (cmdBuf, frame_buffer_view, gpu_profiler);
 }
 
 void FrameGraph::fill_command_buffer (VkCommandBuffer cmdBuf, std::string frame_buffer)
@@ -593,6 +750,16 @@ void FrameGraph::create_present_resources ()
 	create_framebuffers ();
 }
 
+namespace
+{
+bool is_depth_format (VkFormat format)
+{
+	return format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || format == VK_FORMAT_D32_SFLOAT ||
+	       format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT ||
+	       format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+} // namespace
+
 void FrameGraph::create_attachments ()
 {
 	for (auto& [name, attachment] : builder.attachments)
@@ -605,6 +772,8 @@ void FrameGraph::create_attachments ()
 
 			TexCreateDetails tex_details (
 			    attachment.format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, 0, width, height);
+			tex_details.layers = attachment.layers;
+			if (!is_depth_format (attachment.format)) tex_details.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 			render_targets[name] = std::make_unique<VulkanTexture> (device, tex_details);
 		}
 	}
@@ -623,10 +792,12 @@ void FrameGraph::create_framebuffers ()
 		{
 			auto tex = render_targets.at (attachment).get ();
 			views.push_back (tex->imageView);
-			uint32_t width = tex->get_width ();
-			uint32_t height = tex->get_height ();
-			uint32_t layers = tex->get_layers ();
+			width = tex->get_width ();
+			height = tex->get_height ();
+			layers = tex->get_layers ();
 		}
+		// multiview passes pick the layers with their view masks
+		if (pass.is_multiview ()) layers = 1;
 		framebuffers.emplace_back (device, views, pass.get (), width, height, layers);
 	}
 
@@ -666,11 +837,27 @@ FrameBuffer const& FrameGraph::get_framebuffer (int index)
 int FrameGraph::get_frame_buffer_id (std::string fb_name) const
 {
 	if (fb_name == builder.final_renderpass) return 0;
+	// framebuffers follow render_passes, which skip the final pass
 	int i = 1;
-	for (auto& [name, pass] : builder.render_passes)
+	for (auto& name : builder.pass_order)
 	{
+		if (name == builder.final_renderpass) continue;
 		if (fb_name == name) break;
 		i++;
 	}
 	return i;
 }
+
+VkImageView FrameGraph::get_image_view (std::string const& attachment_name) const
+{
+	auto it = render_targets.find (attachment_name);
+	if (it == render_targets.end () || !it->second) return VK_NULL_HANDLE;
+	return it->second->imageView;
+}
+
+VkImage FrameGraph::get_image (std::string const& attachment_name) const
+{
+	auto it = render_targets.find (attachment_name);
+	if (it == render_targets.end () || !it->second) return VK_NULL_HANDLE;
+	return it->second->image;
+}
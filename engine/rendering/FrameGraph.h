@@ -12,6 +12,7 @@
 class VulkanDevice;
 class VulkanSwapChain;
 class VulkanTexture;
+class GPUProfiler;
 
 using RenderFunc = std::function<void (VkCommandBuffer cmdBuf)>;
 
@@ -77,6 +78,10 @@ struct SubpassDescription
 	void add_resolve_attachments (std::string name);
 	void add_preserve_attachments (std::string name);
 
+	// Draws once into every attachment layer whose bit is set, shaders tell them apart with
+	// gl_ViewIndex. Either all subpasses of a pass have a view mask or none do.
+	void set_view_mask (uint32_t mask);
+
 	void set_function (RenderFunc&& func);
 
 	std::vector<std::string> attachments_used (AttachmentMap const& attachment_map) const;
@@ -91,6 +96,7 @@ struct SubpassDescription
 	std::optional<std::string> depth_stencil_attachment;
 	DepthStencilAccess depth_stencil_access;
 	std::vector<std::string> preserve_attachments;
+	uint32_t view_mask = 0; // 0 when the subpass isn't multiview
 
 	std::unordered_map<std::string, VkClearValue> clear_values;
 
@@ -156,19 +162,36 @@ struct RenderPassDescription
 
 	void add_subpass (SubpassDescription subpass);
 
+	// passes other than the final one only record when this returns true, so an attachment can
+	// keep its contents from an earlier frame
+	void set_condition (std::function<bool ()> condition);
+	// the attachment ends up ready to be sampled by later passes
+	void add_sampled_output (std::string attachment_name);
+	// passes other than the final one record into the top left area of this size instead of their
+	// whole framebuffer, so attachments can be allocated once at the largest size
+	void set_render_area (std::function<VkExtent2D ()> area);
+
 	VkRenderPassCreateInfo get_renderpass_create_info (AttachmentMap& attachment_map);
 	std::vector<RenderFunc> get_subpass_functions ();
 	std::vector<std::string> get_used_attachment_names ();
+	bool is_multiview () const;
 
 	bool present_attachment = false;
+	VkImageLayout present_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // TRANSFER_SRC when headless
 	std::string name;
 	std::vector<SubpassDescription> subpasses;
+	std::function<bool ()> condition;
+	std::function<VkExtent2D ()> render_area;
+	std::unordered_set<std::string> sampled_outputs;
 
 	// needed for the call to create_render_pass
 	std::vector<VulkanSubpassDescription> vulkan_sb_descriptions;
 	std::vector<VkAttachmentDescription> rp_attachments;
 	std::vector<VkSubpassDescription> sb_descriptions;
 	std::vector<VkSubpassDependency> sb_dependencies;
+	std::vector<uint32_t> view_masks;
+	uint32_t correlation_mask = 0;
+	VkRenderPassMultiviewCreateInfo multiview_info{};
 
 	std::vector<AttachmentUse> attachment_uses;
 	std::vector<VkClearValue> clear_values;
@@ -190,6 +213,7 @@ struct FrameGraphBuilder
 	private:
 	std::unordered_map<std::string, RenderPassAttachment> attachments;
 	std::unordered_map<std::string, RenderPassDescription> render_passes;
+	std::vector<std::string> pass_order; // passes record in the order they were added
 	std::string final_renderpass;
 	std::string final_output_attachment;
 };
@@ -240,13 +264,21 @@ class RenderPass
 	RenderPass (RenderPass&& rp) noexcept;
 	RenderPass& operator= (RenderPass&& rp) noexcept;
 
-	void BuildCmdBuf (VkCommandBuffer cmdBuf, FrameBufferView fb_view);
+	// passes and subpasses are bracketed with GPU timestamps when a profiler is given
+	void BuildCmdBuf (VkCommandBuffer cmdBuf, FrameBufferView fb_view, GPUProfiler* gpu_profiler = nullptr);
 	std::vector<std::string> get_used_attachment_names ()
 	{
 		return desc.get_used_attachment_names ();
 	}
 
 	VkRenderPass get () const { return rp; }
+	std::string const& get_name () const { return desc.name; }
+	// equal for render passes a pipeline can be used with interchangeably
+	std::string const& get_compatibility_key () const { return compatibility_key; }
+	bool should_record () const { return !desc.condition || desc.condition (); }
+	bool is_multiview () const { return desc.is_multiview (); }
+	// the render area within full, all of it unless the description set one
+	VkRect2D get_render_area (VkRect2D full) const;
 
 	std::vector<VkImageView> order_attachments (std::vector<std::pair<std::string, VkImageView>> const& named_views);
 
@@ -254,6 +286,7 @@ class RenderPass
 	VkDevice device;
 	std::vector<RenderFunc> subpassFuncs;
 	VkRenderPass rp;
+	std::string compatibility_key;
 
 	RenderPassDescription desc;
 };
@@ -261,15 +294,21 @@ class RenderPass
 class FrameGraph
 {
 	public:
-	FrameGraph (VulkanDevice& device, VulkanSwapChain& swapchain, FrameGraphBuilder builder);
+	FrameGraph (VulkanDevice& device,
+	    VulkanSwapChain& swapchain,
+	    FrameGraphBuilder builder,
+	    GPUProfiler* gpu_profiler = nullptr);
 	~FrameGraph ();
 
 	VkRenderPass get (int index) const;
 	VkRenderPass get_present_render_pass () const { return final_renderpass->get (); };
+	std::vector<std::pair<std::string, VkRenderPass>> get_render_passes () const;
+	std::vector<std::pair<VkRenderPass, std::string>> get_compatibility_keys () const;
 
 	void create_present_resources ();
 	void destroy_present_resources ();
 
+	// records the other passes whose condition holds, then the final pass into frame_buffer_view
 	void fill_command_buffer (VkCommandBuffer cmdBuf, FrameBufferView frame_buffer_view);
 	void fill_command_buffer (VkCommandBuffer cmdBuf, std::string frame_buffer);
 
@@ -277,6 +316,10 @@ class FrameGraph
 
 	int get_frame_buffer_id (std::string name) const;
 
+	// views are recreated along with the present resources
+	VkImageView get_image_view (std::string const& attachment_name) const;
+	VkImage get_image (std::string const& attachment_name) const;
+
 	private:
 	void create_attachments ();
 	void create_framebuffers ();
@@ -285,6 +328,7 @@ class FrameGraph
 
 	VulkanDevice& device;
 	VulkanSwapChain& swapchain;
+	GPUProfiler* gpu_profiler;
 
 	std::vector<RenderPass> render_passes;
 	std::unique_ptr<RenderPass> final_renderpass;
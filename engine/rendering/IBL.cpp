@@ -0,0 +1,558 @@
+#include "IBL.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define IBL_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "core/JobSystem.h"
+#include "core/Logger.h"
+#include "core/Profiler.h"
+
+#include "rendering/backend/RenderTools.h"
+
+namespace
+{
+const float Pi = 3.14159265358979f;
+
+const std::filesystem::path ibl_cache_dir = ".cache";
+constexpr uint32_t ibl_cache_magic = 0x4C424956; // "VIBL"
+constexpr uint32_t ibl_cache_version = 1;
+
+// On disk layout of the cached maps, followed by the irradiance, the specular and the BRDF floats
+struct IBLCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t specular_size;
+	uint32_t specular_mips;
+	uint32_t brdf_lut_size;
+	uint32_t padding;
+	uint64_t source_hash;
+	uint64_t data_size;
+	uint64_t data_hash;
+};
+
+struct Vec3
+{
+	float x, y, z;
+};
+
+Vec3 operator+ (Vec3 a, Vec3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+Vec3 operator* (Vec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+float dot3 (Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+Vec3 cross3 (Vec3 a, Vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+Vec3 normalize3 (Vec3 a) { return a * (1.f / std::sqrt (dot3 (a, a))); }
+
+#if defined(IBL_USE_SSE)
+using Texel = __m128;
+inline Texel texel_zero () { return _mm_setzero_ps (); }
+inline Texel load_texel (float const* rgba) { return _mm_loadu_ps (rgba); }
+inline void store_texel (float* rgba, Texel t) { _mm_storeu_ps (rgba, t); }
+inline Texel add_scaled (Texel sum, Texel t, float scale) { return _mm_add_ps (sum, _mm_mul_ps (t, _mm_set1_ps (scale))); }
+#else
+struct Texel
+{
+	float v[4];
+};
+inline Texel texel_zero () { return Texel{}; }
+inline Texel load_texel (float const* rgba) { return Texel{ { rgba[0], rgba[1], rgba[2], rgba[3] } }; }
+inline void store_texel (float* rgba, Texel t) { std::memcpy (rgba, t.v, sizeof (t.v)); }
+inline Texel add_scaled (Texel sum, Texel t, float scale)
+{
+	for (int i = 0; i < 4; i++)
+		sum.v[i] += t.v[i] * scale;
+	return sum;
+}
+#endif
+
+// one level of a cube map, RGBA floats with the six faces back to back
+struct CubeLevel
+{
+	uint32_t size = 0;
+	std::vector<float> texels;
+
+	float const* texel (uint32_t face, uint32_t x, uint32_t y) const
+	{
+		return &texels[((static_cast<size_t> (face) * size + y) * size + x) * 4];
+	}
+};
+
+// s and t in [-1, 1] across the face, t pointing down, in Vulkan's face order
+Vec3 face_direction (uint32_t face, float s, float t)
+{
+	switch (face)
+	{
+		case 0: return normalize3 ({ 1.f, -t, -s });
+		case 1: return normalize3 ({ -1.f, -t, s });
+		case 2: return normalize3 ({ s, 1.f, t });
+		case 3: return normalize3 ({ s, -1.f, -t });
+		case 4: return normalize3 ({ s, -t, 1.f });
+		default: return normalize3 ({ -s, -t, -1.f });
+	}
+}
+
+void direction_face (Vec3 dir, uint32_t& face, float& s, float& t)
+{
+	float ax = std::abs (dir.x), ay = std::abs (dir.y), az = std::abs (dir.z);
+	float major;
+	if (ax >= ay && ax >= az)
+	{
+		face = dir.x > 0.f ? 0 : 1;
+		major = ax;
+		s = dir.x > 0.f ? -dir.z : dir.z;
+		t = -dir.y;
+	}
+	else if (ay >= az)
+	{
+		face = dir.y > 0.f ? 2 : 3;
+		major = ay;
+		s = dir.x;
+		t = dir.y > 0.f ? dir.z : -dir.z;
+	}
+	else
+	{
+		face = dir.z > 0.f ? 4 : 5;
+		major = az;
+		s = dir.z > 0.f ? dir.x : -dir.x;
+		t = -dir.y;
+	}
+	s /= major;
+	t /= major;
+}
+
+// bilinear within the face, clamped at its edges
+Texel sample_level (CubeLevel const& level, Vec3 dir)
+{
+	uint32_t face;
+	float s, t;
+	direction_face (dir, face, s, t);
+	float max_coord = static_cast<float> (level.size - 1);
+	float x = std::clamp ((s * 0.5f + 0.5f) * level.size - 0.5f, 0.f, max_coord);
+	float y = std::clamp ((t * 0.5f + 0.5f) * level.size - 0.5f, 0.f, max_coord);
+	uint32_t x0 = static_cast<uint32_t> (x), y0 = static_cast<uint32_t> (y);
+	uint32_t x1 = std::min (x0 + 1, level.size - 1), y1 = std::min (y0 + 1, level.size - 1);
+	float fx = x - static_cast<float> (x0), fy = y - static_cast<float> (y0);
+
+	Texel sum = texel_zero ();
+	sum = add_scaled (sum, load_texel (level.texel (face, x0, y0)), (1.f - fx) * (1.f - fy));
+	sum = add_scaled (sum, load_texel (level.texel (face, x1, y0)), fx * (1.f - fy));
+	sum = add_scaled (sum, load_texel (level.texel (face, x0, y1)), (1.f - fx) * fy);
+	sum = add_scaled (sum, load_texel (level.texel (face, x1, y1)), fx * fy);
+	return sum;
+}
+
+bool is_loaded_cube_map (Resource::Texture::TexResource const& cube_map)
+{
+	if (cube_map.tex_type != Resource::Texture::TextureType::cubemap2D || cube_map.dims.size () != 6) return false;
+	int size = cube_map.dims.front ().width;
+	for (auto const& dims : cube_map.dims)
+		if (dims.width != size || dims.height != size) return false;
+	// Textures loads every image as RGBA8
+	return size > 0 && cube_map.data.size () == static_cast<size_t> (size) * size * 4 * 6;
+}
+
+uint64_t hash_source (Resource::Texture::TexResource const& cube_map, IBLSettings const& settings)
+{
+	uint32_t header[7] = { ibl_cache_version,
+		static_cast<uint32_t> (cube_map.dims.front ().width),
+		settings.specular_size,
+		settings.specular_mips,
+		settings.specular_samples,
+		settings.brdf_lut_size,
+		settings.brdf_samples };
+	uint64_t hash = fnv1a_hash (reinterpret_cast<std::byte const*> (header), sizeof (header));
+	return fnv1a_hash (cube_map.data.data (), cube_map.data.size (), hash);
+}
+
+// The source as linear floats, halved down to a single texel. Prefiltering reads coarser levels
+// for samples that cover more of the sphere, which keeps a few samples from aliasing.
+std::vector<CubeLevel> build_source_levels (job::ThreadPool& pool, Resource::Texture::TexResource const& cube_map)
+{
+	float srgb_to_linear[256];
+	for (int i = 0; i < 256; i++)
+	{
+		float c = static_cast<float> (i) / 255.f;
+		srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f : std::pow ((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	std::vector<CubeLevel> levels (1);
+	levels[0].size = static_cast<uint32_t> (cube_map.dims.front ().width);
+	levels[0].texels.resize (cube_map.data.size ());
+	job::parallel_for (pool, cube_map.data.size () / 4, 4096, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			for (size_t c = 0; c < 3; c++)
+				levels[0].texels[i * 4 + c] = srgb_to_linear[static_cast<uint8_t> (cube_map.data[i * 4 + c])];
+			levels[0].texels[i * 4 + 3] = static_cast<uint8_t> (cube_map.data[i * 4 + 3]) / 255.f;
+		}
+	});
+
+	while (levels.back ().size > 1)
+	{
+		CubeLevel const& source = levels.back ();
+		CubeLevel level;
+		level.size = source.size / 2;
+		level.texels.resize (static_cast<size_t> (level.size) * level.size * 6 * 4);
+		for (uint32_t face = 0; face < 6; face++)
+			for (uint32_t y = 0; y < level.size; y++)
+				for (uint32_t x = 0; x < level.size; x++)
+				{
+					Texel sum = texel_zero ();
+					sum = add_scaled (sum, load_texel (source.texel (face, x * 2, y * 2)), 0.25f);
+					sum = add_scaled (sum, load_texel (source.texel (face, x * 2 + 1, y * 2)), 0.25f);
+					sum = add_scaled (sum, load_texel (source.texel (face, x * 2, y * 2 + 1)), 0.25f);
+					sum = add_scaled (sum, load_texel (source.texel (face, x * 2 + 1, y * 2 + 1)), 0.25f);
+					store_texel (&level.texels[((static_cast<size_t> (face) * level.size + y) * level.size + x) * 4], sum);
+				}
+		levels.push_back (std::move (level));
+	}
+	return levels;
+}
+
+// Projects the radiance onto the nine SH bands, convolves them with the cosine lobe and folds in
+// the basis constants
+IrradianceSH project_irradiance (job::ThreadPool& pool, CubeLevel const& level)
+{
+	uint32_t rows = level.size * 6;
+	std::vector<float> row_sums (static_cast<size_t> (rows) * 9 * 4, 0.f);
+	job::parallel_for (pool, rows, 8, [&] (size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+		{
+			uint32_t face = static_cast<uint32_t> (row / level.size);
+			uint32_t y = static_cast<uint32_t> (row % level.size);
+			Texel sums[9];
+			for (auto& sum : sums)
+				sum = texel_zero ();
+
+			float texel_size = 2.f / static_cast<float> (level.size);
+			float t = (static_cast<float> (y) + 0.5f) * texel_size - 1.f;
+			for (uint32_t x = 0; x < level.size; x++)
+			{
+				float s = (static_cast<float> (x) + 0.5f) * texel_size - 1.f;
+				float length_squared = 1.f + s * s + t * t;
+				float solid_angle = texel_size * texel_size / (length_squared * std::sqrt (length_squared));
+				Vec3 n = face_direction (face, s, t);
+				float basis[9] = { 0.282095f,
+					0.488603f * n.y,
+					0.488603f * n.z,
+					0.488603f * n.x,
+					1.092548f * n.x * n.y,
+					1.092548f * n.y * n.z,
+					0.315392f * (3.f * n.z * n.z - 1.f),
+					1.092548f * n.x * n.z,
+					0.546274f * (n.x * n.x - n.y * n.y) };
+				Texel radiance = load_texel (level.texel (face, x, y));
+				for (int i = 0; i < 9; i++)
+					sums[i] = add_scaled (sums[i], radiance, basis[i] * solid_angle);
+			}
+			for (int i = 0; i < 9; i++)
+				store_texel (&row_sums[(row * 9 + i) * 4], sums[i]);
+		}
+	});
+
+	// cosine lobe per band times the basis constant the shader leaves out
+	const float band_scale[9] = { Pi * 0.282095f,
+		2.f * Pi / 3.f * 0.488603f,
+		2.f * Pi / 3.f * 0.488603f,
+		2.f * Pi / 3.f * 0.488603f,
+		Pi / 4.f * 1.092548f,
+		Pi / 4.f * 1.092548f,
+		Pi / 4.f * 0.315392f,
+		Pi / 4.f * 1.092548f,
+		Pi / 4.f * 0.546274f };
+
+	IrradianceSH sh{};
+	for (uint32_t row = 0; row < rows; row++)
+		for (int i = 0; i < 9; i++)
+			for (int c = 0; c < 3; c++)
+				sh.coefficients[i][c] += row_sums[(static_cast<size_t> (row) * 9 + i) * 4 + c];
+	for (int i = 0; i < 9; i++)
+		for (int c = 0; c < 3; c++)
+			sh.coefficients[i][c] *= band_scale[i];
+	return sh;
+}
+
+float radical_inverse (uint32_t bits)
+{
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+	return static_cast<float> (bits) * 2.3283064365386963e-10f;
+}
+
+// GGX half vector around +z for the i-th of count Hammersley points
+Vec3 importance_sample_ggx (uint32_t i, uint32_t count, float alpha)
+{
+	float u = static_cast<float> (i) / static_cast<float> (count);
+	float v = radical_inverse (i);
+	float phi = 2.f * Pi * u;
+	float cos_theta = std::sqrt ((1.f - v) / (1.f + (alpha * alpha - 1.f) * v));
+	float sin_theta = std::sqrt (std::max (0.f, 1.f - cos_theta * cos_theta));
+	return { sin_theta * std::cos (phi), sin_theta * std::sin (phi), cos_theta };
+}
+
+struct PrefilterSample
+{
+	Vec3 direction; // around +z
+	float weight;   // N dot L
+	uint32_t level; // of the source
+};
+
+// Karis' split sum with N = V = R. Every texel uses the same samples, rotated around its direction.
+std::vector<PrefilterSample> prefilter_samples (float roughness, uint32_t count, std::vector<CubeLevel> const& levels)
+{
+	float alpha = std::max (roughness * roughness, 1e-4f);
+	float texel_solid_angle = 4.f * Pi / (6.f * levels.front ().size * levels.front ().size);
+	std::vector<PrefilterSample> samples;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Vec3 h = importance_sample_ggx (i, count, alpha);
+		Vec3 l = { 2.f * h.z * h.x, 2.f * h.z * h.y, 2.f * h.z * h.z - 1.f };
+		if (l.z <= 0.f) continue;
+
+		float a2 = alpha * alpha;
+		float d = (a2 - 1.f) * h.z * h.z + 1.f;
+		float pdf = a2 / (Pi * d * d) * 0.25f;
+		float sample_solid_angle = 1.f / (static_cast<float> (count) * pdf + 1e-6f);
+		float lod = std::max (0.5f * std::log2 (sample_solid_angle / texel_solid_angle) + 1.f, 0.f);
+		uint32_t level = std::min (static_cast<uint32_t> (lod + 0.5f), static_cast<uint32_t> (levels.size () - 1));
+		samples.push_back ({ l, l.z, level });
+	}
+	return samples;
+}
+
+// a smooth mip is the source at that size
+void prefilter_face_row (std::vector<CubeLevel> const& levels,
+    std::vector<PrefilterSample> const& samples,
+    uint32_t size,
+    uint32_t face,
+    uint32_t y,
+    float* out)
+{
+	CubeLevel const* mirror = &levels.front ();
+	for (auto const& level : levels)
+		if (level.size >= size) mirror = &level;
+
+	float t = (static_cast<float> (y) + 0.5f) / size * 2.f - 1.f;
+	for (uint32_t x = 0; x < size; x++)
+	{
+		float s = (static_cast<float> (x) + 0.5f) / size * 2.f - 1.f;
+		Vec3 n = face_direction (face, s, t);
+		if (samples.empty ())
+		{
+			store_texel (out + x * 4, sample_level (*mirror, n));
+			continue;
+		}
+
+		Vec3 up = std::abs (n.z) < 0.999f ? Vec3{ 0.f, 0.f, 1.f } : Vec3{ 1.f, 0.f, 0.f };
+		Vec3 tangent = normalize3 (cross3 (up, n));
+		Vec3 bitangent = cross3 (n, tangent);
+
+		Texel sum = texel_zero ();
+		float weight = 0.f;
+		for (auto const& sample : samples)
+		{
+			Vec3 l = tangent * sample.direction.x + bitangent * sample.direction.y + n * sample.direction.z;
+			sum = add_scaled (sum, sample_level (levels[sample.level], l), sample.weight);
+			weight += sample.weight;
+		}
+		store_texel (out + x * 4, add_scaled (texel_zero (), sum, 1.f / weight));
+	}
+}
+
+// Smith GGX visibility with k = alpha / 2, as fit for image based lighting
+float geometry_smith (float n_dot_v, float n_dot_l, float alpha)
+{
+	float k = alpha * 0.5f;
+	return n_dot_v / (n_dot_v * (1.f - k) + k) * n_dot_l / (n_dot_l * (1.f - k) + k);
+}
+} // namespace
+
+IBLMaps::IBLMaps (IBLSettings settings) : settings (settings) {}
+
+size_t IBLMaps::get_specular_offset (uint32_t mip, uint32_t face) const
+{
+	size_t offset = 0;
+	for (uint32_t i = 0; i < mip; i++)
+	{
+		size_t size = std::max (specular_size >> i, 1u);
+		offset += size * size * 6 * 4;
+	}
+	size_t size = std::max (specular_size >> mip, 1u);
+	return offset + size * size * face * 4;
+}
+
+bool IBLMaps::load_or_bake (job::ThreadPool& pool, Resource::Texture::TexResource const& cube_map)
+{
+	if (!is_loaded_cube_map (cube_map))
+	{
+		Log.error ("{} isn't a loaded cube map, can't light with it", cube_map.name);
+		return false;
+	}
+
+	uint64_t source_hash = hash_source (cube_map, settings);
+	loaded_from_cache = load_cache (source_hash);
+	if (loaded_from_cache) return true;
+
+	if (!bake (pool, cube_map)) return false;
+	save_cache (source_hash);
+	return true;
+}
+
+bool IBLMaps::bake (job::ThreadPool& pool, Resource::Texture::TexResource const& cube_map)
+{
+	if (!is_loaded_cube_map (cube_map)) return false;
+
+	PROFILE_SCOPE ("IBLMaps::bake");
+	auto levels = build_source_levels (pool, cube_map);
+
+	// low frequency, a small level is plenty
+	CubeLevel const* irradiance_level = &levels.front ();
+	for (auto const& level : levels)
+		if (level.size >= 32) irradiance_level = &level;
+	irradiance = project_irradiance (pool, *irradiance_level);
+
+	specular_size = std::min (settings.specular_size, levels.front ().size);
+	specular_mips = 1;
+	while (specular_mips < settings.specular_mips && (specular_size >> specular_mips) > 0)
+		specular_mips++;
+	specular.assign (get_specular_offset (specular_mips, 0), 0.f);
+
+	for (uint32_t mip = 0; mip < specular_mips; mip++)
+	{
+		float roughness = specular_mips > 1 ? static_cast<float> (mip) / static_cast<float> (specular_mips - 1) : 0.f;
+		auto samples = mip == 0 ? std::vector<PrefilterSample>{} :
+		                          prefilter_samples (roughness, settings.specular_samples, levels);
+		uint32_t size = std::max (specular_size >> mip, 1u);
+		job::parallel_for (pool, size * 6, 4, [&] (size_t begin, size_t end) {
+			for (size_t row = begin; row < end; row++)
+			{
+				uint32_t face = static_cast<uint32_t> (row / size);
+				uint32_t y = static_cast<uint32_t> (row % size);
+				float* out = &specular[get_specular_offset (mip, face) + static_cast<size_t> (y) * size * 4];
+				prefilter_face_row (levels, samples, size, face, y, out);
+			}
+		});
+	}
+
+	// Split sum: the specular integral is F0 * scale + bias, by N dot V and roughness
+	uint32_t lut_size = settings.brdf_lut_size;
+	brdf_lut.assign (static_cast<size_t> (lut_size) * lut_size * 2, 0.f);
+	job::parallel_for (pool, lut_size, 4, [&] (size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+		{
+			float roughness = (static_cast<float> (row) + 0.5f) / lut_size;
+			float alpha = roughness * roughness;
+			for (uint32_t column = 0; column < lut_size; column++)
+			{
+				float n_dot_v = (static_cast<float> (column) + 0.5f) / lut_size;
+				Vec3 v = { std::sqrt (1.f - n_dot_v * n_dot_v), 0.f, n_dot_v };
+				float scale = 0.f, bias = 0.f;
+				for (uint32_t i = 0; i < settings.brdf_samples; i++)
+				{
+					Vec3 h = importance_sample_ggx (i, settings.brdf_samples, alpha);
+					float v_dot_h = dot3 (v, h);
+					Vec3 l = h * (2.f * v_dot_h) + v * -1.f;
+					if (l.z <= 0.f) continue;
+
+					float visibility = geometry_smith (n_dot_v, l.z, alpha) * v_dot_h / (h.z * n_dot_v);
+					float fresnel = std::pow (1.f - v_dot_h, 5.f);
+					scale += (1.f - fresnel) * visibility;
+					bias += fresnel * visibility;
+				}
+				size_t index = (row * lut_size + column) * 2;
+				brdf_lut[index] = scale / settings.brdf_samples;
+				brdf_lut[index + 1] = bias / settings.brdf_samples;
+			}
+		}
+	});
+	return true;
+}
+
+std::filesystem::path IBLMaps::cache_path (uint64_t source_hash) const
+{
+	return ibl_cache_dir / fmt::format ("ibl_{:016x}.bin", source_hash);
+}
+
+bool IBLMaps::load_cache (uint64_t source_hash)
+{
+	auto path = cache_path (source_hash);
+	if (!std::filesystem::exists (path)) return false;
+
+	std::ifstream in (path, std::ios::binary);
+	IBLCacheHeader header{};
+	in.read (reinterpret_cast<char*> (&header), sizeof (header));
+	if (!in || header.magic != ibl_cache_magic || header.version != ibl_cache_version ||
+	    header.source_hash != source_hash || header.brdf_lut_size != settings.brdf_lut_size)
+	{
+		Log.debug ("IBL cache {} is stale or malformed, baking again", path.string ());
+		return false;
+	}
+
+	uint32_t size = header.specular_size;
+	uint32_t mips = header.specular_mips;
+	size_t specular_floats = 0;
+	for (uint32_t i = 0; i < mips; i++)
+		specular_floats += static_cast<size_t> (std::max (size >> i, 1u)) * std::max (size >> i, 1u) * 6 * 4;
+	size_t brdf_floats = static_cast<size_t> (header.brdf_lut_size) * header.brdf_lut_size * 2;
+	size_t expected = sizeof (IrradianceSH) + (specular_floats + brdf_floats) * sizeof (float);
+	if (header.data_size != expected)
+	{
+		Log.debug ("IBL cache {} has the wrong size, baking again", path.string ());
+		return false;
+	}
+
+	std::vector<std::byte> data (expected);
+	in.read (reinterpret_cast<char*> (data.data ()), data.size ());
+	if (!in || fnv1a_hash (data.data (), data.size ()) != header.data_hash)
+	{
+		Log.debug ("IBL cache {} is corrupt, baking again", path.string ());
+		return false;
+	}
+
+	std::memcpy (&irradiance, data.data (), sizeof (IrradianceSH));
+	specular.resize (specular_floats);
+	std::memcpy (specular.data (), data.data () + sizeof (IrradianceSH), specular_floats * sizeof (float));
+	brdf_lut.resize (brdf_floats);
+	std::memcpy (brdf_lut.data (),
+	    data.data () + sizeof (IrradianceSH) + specular_floats * sizeof (float),
+	    brdf_floats * sizeof (float));
+	specular_size = size;
+	specular_mips = mips;
+	return true;
+}
+
+void IBLMaps::save_cache (uint64_t source_hash) const
+{
+	size_t data_size = sizeof (IrradianceSH) + (specular.size () + brdf_lut.size ()) * sizeof (float);
+	std::vector<std::byte> file_data (sizeof (IBLCacheHeader) + data_size);
+	std::byte* data = file_data.data () + sizeof (IBLCacheHeader);
+	std::memcpy (data, &irradiance, sizeof (IrradianceSH));
+	std::memcpy (data + sizeof (IrradianceSH), specular.data (), specular.size () * sizeof (float));
+	std::memcpy (data + sizeof (IrradianceSH) + specular.size () * sizeof (float),
+	    brdf_lut.data (),
+	    brdf_lut.size () * sizeof (float));
+
+	IBLCacheHeader header{};
+	header.magic = ibl_cache_magic;
+	header.version = ibl_cache_version;
+	header.specular_size = specular_size;
+	header.specular_mips = specular_mips;
+	header.brdf_lut_size = settings.brdf_lut_size;
+	header.source_hash = source_hash;
+	header.data_size = data_size;
+	header.data_hash = fnv1a_hash (data, data_size);
+	std::memcpy (file_data.data (), &header, sizeof (header));
+
+	std::error_code ec;
+	std::filesystem::create_directories (ibl_cache_dir, ec);
+	write_file_atomic (cache_path (source_hash), reinterpret_cast<char const*> (file_data.data ()), file_data.size ());
+}
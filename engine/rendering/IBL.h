@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "resources/Texture.h"
+
+namespace job
+{
+class ThreadPool;
+}
+
+struct IBLSettings
+{
+	// the largest specular mip, smaller sources keep their own size
+	uint32_t specular_size = 128;
+	// mip i is prefiltered for roughness i / (specular_mips - 1)
+	uint32_t specular_mips = 6;
+	uint32_t specular_samples = 128;
+	uint32_t brdf_lut_size = 64;
+	uint32_t brdf_samples = 256;
+};
+
+// Irradiance as nine spherical harmonics, convolved with the cosine lobe and scaled by the basis
+// constants, so E(N) only needs the polynomial terms (see EnvironmentIrradiance in lighting.glsl).
+// The fourth component of each coefficient is unused.
+struct IrradianceSH
+{
+	float coefficients[9][4];
+};
+
+// Image based lighting for a cube map TexResource: SH9 diffuse irradiance, a GGX prefiltered
+// specular mip chain and the split sum BRDF table. Baking runs on the pool and the result is
+// cached under .cache by a hash of the source pixels and the settings, so it only runs again when
+// either changes.
+//
+// Specular texels are RGBA floats, mip after mip, each mip's six faces in Vulkan order
+// (+X, -X, +Y, -Y, +Z, -Z). BRDF texels are (scale, bias) pairs applied to F0, rows by roughness
+// and columns by N dot V.
+class IBLMaps
+{
+	public:
+	explicit IBLMaps (IBLSettings settings = {});
+
+	// Loads the cached maps of cube_map, or bakes and caches them. False when cube_map isn't a
+	// loaded cube map.
+	bool load_or_bake (job::ThreadPool& pool, Resource::Texture::TexResource const& cube_map);
+	bool bake (job::ThreadPool& pool, Resource::Texture::TexResource const& cube_map);
+
+	IrradianceSH const& get_irradiance () const { return irradiance; }
+	std::vector<float> const& get_specular () const { return specular; }
+	std::vector<float> const& get_brdf_lut () const { return brdf_lut; }
+	uint32_t get_specular_size () const { return specular_size; }
+	uint32_t get_specular_mips () const { return specular_mips; }
+	// index of the first float of a mip's face in get_specular
+	size_t get_specular_offset (uint32_t mip, uint32_t face) const;
+	IBLSettings const& get_settings () const { return settings; }
+	bool was_loaded_from_cache () const { return loaded_from_cache; }
+
+	private:
+	IBLSettings settings;
+	IrradianceSH irradiance{};
+	std::vector<float> specular;
+	std::vector<float> brdf_lut;
+	uint32_t specular_size = 0;
+	uint32_t specular_mips = 0;
+	bool loaded_from_cache = false;
+
+	std::filesystem::path cache_path (uint64_t source_hash) const;
+	bool load_cache (uint64_t source_hash);
+	void save_cache (uint64_t source_hash) const;
+};
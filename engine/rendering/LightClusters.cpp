@@ -0,0 +1,282 @@
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define LIGHT_CLUSTERS_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "core/JobSystem.h"
+#include "core/Logger.h"
+#include "core/Profiler.h"
+
+namespace
+{
+const uint32_t LightIndexBits = 20;
+const uint32_t LightIndexMask = (1u << LightIndexBits) - 1;
+const uint32_t TileClusterCount = LightClusterGrid::TilesX * LightClusterGrid::TilesY;
+
+cml::vec3f transform_point (float const* m, cml::vec3f p)
+{
+	return cml::vec3f (m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+	    m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+	    m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+}
+
+uint32_t to_tile (float ndc, uint32_t tile_count)
+{
+	float t = std::floor ((ndc * 0.5f + 0.5f) * static_cast<float> (tile_count));
+	return static_cast<uint32_t> (std::clamp (t, 0.f, static_cast<float> (tile_count - 1)));
+}
+} // namespace
+
+void LightClusterGrid::compute_bounds (float const* proj, float clip_near, float clip_far)
+{
+	static_assert (TilesX % 4 == 0, "rows are tested 4 clusters at a time");
+	for (auto& b : bounds_min)
+		b.resize (ClusterCount);
+	for (auto& b : bounds_max)
+		b.resize (ClusterCount);
+
+	float sign = proj[11] < 0.f ? -1.f : 1.f;
+	for (uint32_t s = 0; s < Slices; s++)
+	{
+		float d0 = clip_near * std::pow (clip_far / clip_near, static_cast<float> (s) / Slices);
+		float d1 = clip_near * std::pow (clip_far / clip_near, static_cast<float> (s + 1) / Slices);
+		for (uint32_t ty = 0; ty < TilesY; ty++)
+		{
+			float y0 = -1.f + 2.f * ty / TilesY;
+			float y1 = -1.f + 2.f * (ty + 1) / TilesY;
+			for (uint32_t tx = 0; tx < TilesX; tx++)
+			{
+				float x0 = -1.f + 2.f * tx / TilesX;
+				float x1 = -1.f + 2.f * (tx + 1) / TilesX;
+
+				// the corners of the frustum slab, x = ndc * depth / P00
+				float xs[4] = { x0 * d0, x1 * d0, x0 * d1, x1 * d1 };
+				float ys[4] = { y0 * d0, y1 * d0, y0 * d1, y1 * d1 };
+				uint32_t c = (s * TilesY + ty) * TilesX + tx;
+				float view_x0 = *std::min_element (xs, xs + 4) / proj[0], view_x1 = *std::max_element (xs, xs + 4) / proj[0];
+				float view_y0 = *std::min_element (ys, ys + 4) / proj[5], view_y1 = *std::max_element (ys, ys + 4) / proj[5];
+				bounds_min[0][c] = std::min (view_x0, view_x1);
+				bounds_max[0][c] = std::max (view_x0, view_x1);
+				bounds_min[1][c] = std::min (view_y0, view_y1);
+				bounds_max[1][c] = std::max (view_y0, view_y1);
+				bounds_min[2][c] = std::min (d0 * sign, d1 * sign);
+				bounds_max[2][c] = std::max (d0 * sign, d1 * sign);
+			}
+		}
+	}
+	std::memcpy (bounds_proj.data (), proj, sizeof (float) * 16);
+	bounds_near = clip_near;
+	bounds_far = clip_far;
+}
+
+void LightClusterGrid::build (job::ThreadPool& pool,
+    cml::mat4f const& view,
+    cml::mat4f const& proj,
+    float clip_near,
+    float clip_far,
+    float viewport_width,
+    float viewport_height,
+    std::vector<LightSphere> const& points,
+    std::vector<LightSphere> const& spots)
+{
+	PROFILE_SCOPE ("LightClusterGrid::build");
+	if (points.size () > MaxLightCount || spots.size () > MaxLightCount)
+		throw std::runtime_error ("too many lights for the cluster grid");
+
+	float const* p = reinterpret_cast<float const*> (&proj);
+	float const* v = reinterpret_cast<float const*> (&view);
+	if (std::memcmp (bounds_proj.data (), p, sizeof (float) * 16) != 0 || bounds_near != clip_near || bounds_far != clip_far)
+		compute_bounds (p, clip_near, clip_far);
+
+	float sign = p[11] < 0.f ? -1.f : 1.f;
+	float depth_scale = Slices / std::log (clip_far / clip_near);
+	params.tiles_x = TilesX;
+	params.tiles_y = TilesY;
+	params.slices = Slices;
+	params.viewport_width = viewport_width;
+	params.viewport_height = viewport_height;
+	params.depth_scale = depth_scale;
+	params.depth_bias = -std::log (clip_near) * depth_scale;
+	params.depth_sign = sign;
+	params.point_count = static_cast<uint32_t> (points.size ());
+	params.spot_count = static_cast<uint32_t> (spots.size ());
+
+	auto slice_of = [&] (float depth) {
+		float s = std::floor (std::log (depth) * depth_scale + params.depth_bias);
+		return static_cast<uint32_t> (std::clamp (s, 0.f, static_cast<float> (Slices - 1)));
+	};
+
+	// find the slice and tile range of every light up front so the slices only test the clusters
+	// the light can reach
+	uint32_t point_count = static_cast<uint32_t> (points.size ());
+	binned.resize (points.size () + spots.size ());
+	job::parallel_for (pool, binned.size (), 1024, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			auto& light = i < point_count ? points[i] : spots[i - point_count];
+			auto& b = binned[i];
+			b.center = transform_point (v, light.center);
+			b.radius = light.radius;
+
+			float depth = b.center.z * sign;
+			float depth_min = depth - light.radius;
+			float depth_max = depth + light.radius;
+			if (depth_max < clip_near || depth_min > clip_far)
+			{
+				b.slice_min = 1;
+				b.slice_max = 0;
+				continue;
+			}
+			b.slice_min = slice_of (std::max (depth_min, clip_near));
+			b.slice_max = slice_of (std::min (depth_max, clip_far));
+
+			if (depth_min <= clip_near)
+			{
+				// crosses the camera plane, the projection is unbounded
+				b.tile_min_x = b.tile_min_y = 0;
+				b.tile_max_x = TilesX - 1;
+				b.tile_max_y = TilesY - 1;
+				continue;
+			}
+			// x / depth over the box around the sphere peaks at its corners
+			float nx[4] = { (b.center.x - b.radius) / depth_min,
+				(b.center.x + b.radius) / depth_min,
+				(b.center.x - b.radius) / depth_max,
+				(b.center.x + b.radius) / depth_max };
+			float ny[4] = { (b.center.y - b.radius) / depth_min,
+				(b.center.y + b.radius) / depth_min,
+				(b.center.y - b.radius) / depth_max,
+				(b.center.y + b.radius) / depth_max };
+			float x0 = *std::min_element (nx, nx + 4) * p[0], x1 = *std::max_element (nx, nx + 4) * p[0];
+			float y0 = *std::min_element (ny, ny + 4) * p[5], y1 = *std::max_element (ny, ny + 4) * p[5];
+			b.tile_min_x = to_tile (std::min (x0, x1), TilesX);
+			b.tile_max_x = to_tile (std::max (x0, x1), TilesX);
+			b.tile_min_y = to_tile (std::min (y0, y1), TilesY);
+			b.tile_max_y = to_tile (std::max (y0, y1), TilesY);
+		}
+	});
+
+	clusters.resize (ClusterCount);
+	job::parallel_for (pool, Slices, 1, [&] (size_t begin, size_t end) {
+		for (size_t s = begin; s < end; s++)
+			bin_slice (static_cast<uint32_t> (s), point_count);
+	});
+
+	// slices were binned with local offsets, lay them out back to back
+	indices.clear ();
+	bool was_overflowing = did_overflow;
+	did_overflow = false;
+	for (uint32_t s = 0; s < Slices; s++)
+	{
+		auto& slice_indices = slice_outputs[s].indices;
+		uint32_t base = static_cast<uint32_t> (indices.size ());
+		if (base + slice_indices.size () <= MaxIndexCount)
+		{
+			indices.insert (indices.end (), slice_indices.begin (), slice_indices.end ());
+			for (uint32_t c = 0; c < TileClusterCount; c++)
+				clusters[s * TileClusterCount + c].offset += base;
+			continue;
+		}
+		// out of space, keep the clusters that still fit whole
+		did_overflow = true;
+		for (uint32_t c = 0; c < TileClusterCount; c++)
+		{
+			auto& cluster = clusters[s * TileClusterCount + c];
+			uint32_t count = cluster.point_count + cluster.spot_count;
+			if (indices.size () + count > MaxIndexCount)
+			{
+				cluster = LightCluster{};
+				continue;
+			}
+			auto first = slice_indices.begin () + cluster.offset;
+			cluster.offset = static_cast<uint32_t> (indices.size ());
+			indices.insert (indices.end (), first, first + count);
+		}
+	}
+	if (did_overflow && !was_overflowing) Log.debug ("Light cluster index list is full, some lights were dropped");
+}
+
+void LightClusterGrid::bin_slice (uint32_t slice, uint32_t point_count)
+{
+	auto& out = slice_outputs[slice];
+	out.entries.clear ();
+
+	uint32_t slice_first = slice * TileClusterCount;
+	float const* min_x = bounds_min[0].data () + slice_first;
+	float const* min_y = bounds_min[1].data () + slice_first;
+	float const* min_z = bounds_min[2].data () + slice_first;
+	float const* max_x = bounds_max[0].data () + slice_first;
+	float const* max_y = bounds_max[1].data () + slice_first;
+	float const* max_z = bounds_max[2].data () + slice_first;
+
+	for (uint32_t l = 0; l < binned.size (); l++)
+	{
+		auto& b = binned[l];
+		if (slice < b.slice_min || slice > b.slice_max) continue;
+		uint32_t kind = l < point_count ? 0 : 1;
+		uint32_t light = kind == 0 ? l : l - point_count;
+
+		for (uint32_t ty = b.tile_min_y; ty <= b.tile_max_y; ty++)
+		{
+			// 4 tiles at a time, lanes outside the light's tile range are masked off after the test
+			for (uint32_t tx = b.tile_min_x & ~3u; tx <= b.tile_max_x; tx += 4)
+			{
+				uint32_t c = ty * TilesX + tx;
+				uint32_t hits = 0;
+#if defined(LIGHT_CLUSTERS_USE_SSE)
+				__m128 zero = _mm_setzero_ps ();
+				__m128 dx = _mm_max_ps (_mm_max_ps (_mm_sub_ps (_mm_loadu_ps (min_x + c), _mm_set1_ps (b.center.x)),
+				                            _mm_sub_ps (_mm_set1_ps (b.center.x), _mm_loadu_ps (max_x + c))),
+				    zero);
+				__m128 dy = _mm_max_ps (_mm_max_ps (_mm_sub_ps (_mm_loadu_ps (min_y + c), _mm_set1_ps (b.center.y)),
+				                            _mm_sub_ps (_mm_set1_ps (b.center.y), _mm_loadu_ps (max_y + c))),
+				    zero);
+				__m128 dz = _mm_max_ps (_mm_max_ps (_mm_sub_ps (_mm_loadu_ps (min_z + c), _mm_set1_ps (b.center.z)),
+				                            _mm_sub_ps (_mm_set1_ps (b.center.z), _mm_loadu_ps (max_z + c))),
+				    zero);
+				__m128 dist = _mm_add_ps (_mm_add_ps (_mm_mul_ps (dx, dx), _mm_mul_ps (dy, dy)), _mm_mul_ps (dz, dz));
+				hits = static_cast<uint32_t> (_mm_movemask_ps (_mm_cmple_ps (dist, _mm_set1_ps (b.radius * b.radius))));
+#else
+				for (uint32_t lane = 0; lane < 4; lane++)
+				{
+					float dx = std::max ({ min_x[c + lane] - b.center.x, b.center.x - max_x[c + lane], 0.f });
+					float dy = std::max ({ min_y[c + lane] - b.center.y, b.center.y - max_y[c + lane], 0.f });
+					float dz = std::max ({ min_z[c + lane] - b.center.z, b.center.z - max_z[c + lane], 0.f });
+					if (dx * dx + dy * dy + dz * dz <= b.radius * b.radius) hits |= 1u << lane;
+				}
+#endif
+				for (uint32_t lane = 0; lane < 4; lane++)
+				{
+					if (!(hits & (1u << lane)) || tx + lane < b.tile_min_x || tx + lane > b.tile_max_x) continue;
+					out.entries.push_back ((((c + lane) * 2 + kind) << LightIndexBits) | light);
+				}
+			}
+		}
+	}
+
+	// counting sort by cluster then kind, stable so every list stays in light order
+	out.counts.assign (TileClusterCount * 2 + 1, 0);
+	for (uint32_t e : out.entries)
+		out.counts[(e >> LightIndexBits) + 1]++;
+	for (uint32_t i = 1; i < out.counts.size (); i++)
+		out.counts[i] += out.counts[i - 1];
+
+	for (uint32_t c = 0; c < TileClusterCount; c++)
+	{
+		auto& cluster = clusters[slice_first + c];
+		cluster.offset = out.counts[c * 2];
+		cluster.point_count = out.counts[c * 2 + 1] - out.counts[c * 2];
+		cluster.spot_count = out.counts[c * 2 + 2] - out.counts[c * 2 + 1];
+	}
+
+	out.indices.resize (out.entries.size ());
+	for (uint32_t e : out.entries)
+		out.indices[out.counts[e >> LightIndexBits]++] = e & LightIndexMask;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "cml/cml.h"
+
+namespace job
+{
+class ThreadPool;
+}
+
+struct LightSphere
+{
+	cml::vec3f center; // world space
+	float radius;
+};
+
+// Matches ClusterParams in lighting.glsl (std430)
+struct ClusterParams
+{
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	uint32_t slices;
+	uint32_t directional_count;
+	float viewport_width;
+	float viewport_height;
+	float depth_scale; // slice = log (depth) * depth_scale + depth_bias
+	float depth_bias;
+	float depth_sign; // view depth = depth_sign * view space z
+	uint32_t point_count;
+	uint32_t spot_count;
+	uint32_t padding;
+};
+
+// Matches Cluster in lighting.glsl, point light indices come first, then spot light indices
+struct LightCluster
+{
+	uint32_t offset = 0;
+	uint32_t point_count = 0;
+	uint32_t spot_count = 0;
+	uint32_t padding = 0;
+};
+
+// Bins light bounding spheres into a froxel grid: screen tiles split into slices that get
+// exponentially deeper with distance. Each cluster gets a contiguous range of light indices, which
+// the fragment shader finds from gl_FragCoord and its view depth.
+//
+// Slices are binned in parallel and tested 4 clusters at a time against each light, lists keep the
+// lights in submission order so the output is deterministic. Pure CPU, runs headless.
+//
+// Expects a symmetric perspective projection, off center terms are ignored.
+class LightClusterGrid
+{
+	public:
+	static constexpr uint32_t TilesX = 16;
+	static constexpr uint32_t TilesY = 9;
+	static constexpr uint32_t Slices = 24;
+	static constexpr uint32_t ClusterCount = TilesX * TilesY * Slices;
+	static constexpr uint32_t MaxIndexCount = 1 << 18;
+	static constexpr uint32_t MaxLightCount = 1 << 20; // of each kind
+
+	void build (job::ThreadPool& pool,
+	    cml::mat4f const& view,
+	    cml::mat4f const& proj,
+	    float clip_near,
+	    float clip_far,
+	    float viewport_width,
+	    float viewport_height,
+	    std::vector<LightSphere> const& points,
+	    std::vector<LightSphere> const& spots);
+
+	ClusterParams const& get_params () const { return params; }
+	std::vector<LightCluster> const& get_clusters () const { return clusters; }
+	std::vector<uint32_t> const& get_indices () const { return indices; }
+	// true when the last build ran out of index space and dropped lights from some clusters
+	bool overflowed () const { return did_overflow; }
+
+	private:
+	ClusterParams params{};
+	std::vector<LightCluster> clusters;
+	std::vector<uint32_t> indices;
+	bool did_overflow = false;
+
+	// view space cluster bounds, SoA and indexed like clusters
+	std::array<std::vector<float>, 3> bounds_min;
+	std::array<std::vector<float>, 3> bounds_max;
+	std::array<float, 16> bounds_proj{};
+	float bounds_near = 0.f;
+	float bounds_far = 0.f;
+
+	struct BinnedLight
+	{
+		cml::vec3f center; // view space
+		float radius;
+		uint32_t slice_min, slice_max;
+		uint32_t tile_min_x, tile_max_x;
+		uint32_t tile_min_y, tile_max_y;
+	};
+	std::vector<BinnedLight> binned; // points then spots
+
+	struct SliceOutput
+	{
+		std::vector<uint32_t> entries; // (cluster in slice * 2 + kind) << 20 | light
+		std::vector<uint32_t> counts;
+		std::vector<uint32_t> indices;
+	};
+	std::array<SliceOutput, Slices> slice_outputs;
+
+	void compute_bounds (float const* proj, float clip_near, float clip_far);
+	void bin_slice (uint32_t slice, uint32_t point_count);
+};
@@ -0,0 +1,360 @@
+#include "OcclusionCulling.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCCLUSION_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "core/JobSystem.h"
+#include "core/Profiler.h"
+
+namespace
+{
+// the near plane triangles are clipped at, and closer than which boxes count as visible
+const float NearW = 0.01f;
+
+cml::vec3f transform_point (float const* m, cml::vec3f p)
+{
+	return cml::vec3f (m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+	    m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+	    m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14]);
+}
+
+// pixels exactly on an edge are inside when the triangle owns the edge
+#if defined(OCCLUSION_USE_SSE)
+__m128 inside_edge (__m128 e, bool owns)
+{
+	__m128 zero = _mm_setzero_ps ();
+	return owns ? _mm_cmpge_ps (e, zero) : _mm_cmpgt_ps (e, zero);
+}
+#else
+bool inside_edge (float e, bool owns) { return e > 0.f || (owns && e == 0.f); }
+#endif
+
+uint32_t round_up (uint32_t value, uint32_t multiple) { return (value + multiple - 1) / multiple * multiple; }
+} // namespace
+
+OcclusionCuller::OcclusionCuller (uint32_t width, uint32_t height)
+: width (round_up (std::max (width, 1u), TileWidth)),
+  height (round_up (std::max (height, 1u), TileHeight)),
+  tiles_x (this->width / TileWidth),
+  tiles_y (this->height / TileHeight),
+  blocks_x (this->width / BlockSize),
+  tile_bins (tiles_x * tiles_y),
+  depth (static_cast<size_t> (this->width) * this->height, 0.f),
+  block_min (static_cast<size_t> (blocks_x) * (this->height / BlockSize), 0.f)
+{
+	static_assert (TileWidth % BlockSize == 0 && TileHeight % BlockSize == 0, "blocks can't straddle tiles");
+	static_assert (TileWidth % 4 == 0, "rows are rasterized 4 pixels at a time");
+}
+
+cml::vec4f OcclusionCuller::to_clip (cml::vec3f p) const
+{
+	float const* m = reinterpret_cast<float const*> (&proj_view);
+	return cml::vec4f (m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12],
+	    m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13],
+	    m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14],
+	    m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15]);
+}
+
+void OcclusionCuller::begin_frame (cml::mat4f const& proj_view)
+{
+	this->proj_view = proj_view;
+	vertices.clear ();
+	triangles.clear ();
+}
+
+void OcclusionCuller::add_occluder (std::vector<cml::vec3f> const& positions, std::vector<uint32_t> const& indices)
+{
+	uint32_t base = static_cast<uint32_t> (vertices.size ());
+	vertices.insert (vertices.end (), positions.begin (), positions.end ());
+	for (size_t i = 0; i + 2 < indices.size (); i += 3)
+	{
+		triangles.push_back (base + indices[i]);
+		triangles.push_back (base + indices[i + 1]);
+		triangles.push_back (base + indices[i + 2]);
+	}
+}
+
+void OcclusionCuller::add_occluder (
+    std::vector<cml::vec3f> const& positions, std::vector<uint32_t> const& indices, cml::mat4f const& model_matrix)
+{
+	std::vector<cml::vec3f> world_positions;
+	world_positions.reserve (positions.size ());
+	float const* m = reinterpret_cast<float const*> (&model_matrix);
+	for (auto& p : positions)
+		world_positions.push_back (transform_point (m, p));
+	add_occluder (world_positions, indices);
+}
+
+void OcclusionCuller::add_heightfield_occluder (
+    std::vector<float> const& heights, uint32_t resolution, cml::vec3f origin, float size)
+{
+	if (resolution < 2 || heights.size () < static_cast<size_t> (resolution) * resolution) return;
+
+	std::vector<cml::vec3f> positions;
+	positions.reserve (static_cast<size_t> (resolution) * resolution);
+	float step = size / static_cast<float> (resolution - 1);
+	for (uint32_t z = 0; z < resolution; z++)
+		for (uint32_t x = 0; x < resolution; x++)
+			positions.push_back (origin + cml::vec3f (x * step, heights[z * resolution + x], z * step));
+
+	std::vector<uint32_t> indices;
+	indices.reserve (static_cast<size_t> (resolution - 1) * (resolution - 1) * 6);
+	for (uint32_t z = 0; z + 1 < resolution; z++)
+	{
+		for (uint32_t x = 0; x + 1 < resolution; x++)
+		{
+			uint32_t i = z * resolution + x;
+			indices.insert (indices.end (), { i, i + resolution, i + 1, i + 1, i + resolution, i + resolution + 1 });
+		}
+	}
+	add_occluder (positions, indices);
+}
+
+void OcclusionCuller::render (job::ThreadPool& pool)
+{
+	PROFILE_SCOPE ("OcclusionCuller::render");
+	size_t triangle_count = triangles.size () / 3;
+	// clipping at the near plane splits a triangle into at most two
+	screen_triangles.resize (triangle_count * 2);
+	std::vector<uint8_t> valid (triangle_count * 2, 0);
+
+	// triangle setup, clipping, projection and bounds
+	job::parallel_for (pool, triangle_count, 512, [&] (size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++)
+		{
+			cml::vec4f clip[3];
+			for (int v = 0; v < 3; v++)
+				clip[v] = to_clip (vertices[triangles[t * 3 + v]]);
+
+			// Sutherland-Hodgman against w = NearW
+			cml::vec4f polygon[4];
+			int count = 0;
+			for (int v = 0; v < 3; v++)
+			{
+				cml::vec4f const& from = clip[v];
+				cml::vec4f const& to = clip[(v + 1) % 3];
+				if (from.w >= NearW) polygon[count++] = from;
+				if ((from.w >= NearW) != (to.w >= NearW))
+				{
+					float f = (NearW - from.w) / (to.w - from.w);
+					polygon[count++] = cml::vec4f (from.x + (to.x - from.x) * f,
+					    from.y + (to.y - from.y) * f,
+					    from.z + (to.z - from.z) * f,
+					    NearW);
+				}
+			}
+			if (count < 3) continue;
+
+			valid[t * 2] = setup_triangle (screen_triangles[t * 2], polygon[0], polygon[1], polygon[2]);
+			if (count == 4)
+				valid[t * 2 + 1] = setup_triangle (screen_triangles[t * 2 + 1], polygon[0], polygon[2], polygon[3]);
+		}
+	});
+
+	// binning runs in submission order so every tile sees its triangles in the same order
+	for (auto& bin : tile_bins)
+		bin.clear ();
+	for (size_t t = 0; t < screen_triangles.size (); t++)
+	{
+		if (!valid[t]) continue;
+		auto& tri = screen_triangles[t];
+		for (int ty = tri.min_y / static_cast<int> (TileHeight); ty <= tri.max_y / static_cast<int> (TileHeight); ty++)
+			for (int tx = tri.min_x / static_cast<int> (TileWidth); tx <= tri.max_x / static_cast<int> (TileWidth); tx++)
+				tile_bins[ty * tiles_x + tx].push_back (static_cast<uint32_t> (t));
+	}
+
+	job::parallel_for (pool, tile_bins.size (), 1, [&] (size_t begin, size_t end) {
+		for (size_t tile = begin; tile < end; tile++)
+			rasterize_tile (static_cast<uint32_t> (tile));
+	});
+}
+
+bool OcclusionCuller::setup_triangle (ScreenTriangle& tri, cml::vec4f a, cml::vec4f b, cml::vec4f c) const
+{
+	cml::vec4f const* clip[3] = { &a, &b, &c };
+	for (int v = 0; v < 3; v++)
+	{
+		tri.inv_w[v] = 1.f / clip[v]->w;
+		tri.x[v] = (clip[v]->x * tri.inv_w[v] * 0.5f + 0.5f) * static_cast<float> (width);
+		tri.y[v] = (clip[v]->y * tri.inv_w[v] * 0.5f + 0.5f) * static_cast<float> (height);
+	}
+
+	float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+	if (std::abs (area) < 1e-6f) return false;
+	// occluders are double sided, wind everything the same way
+	if (area < 0.f)
+	{
+		std::swap (tri.x[1], tri.x[2]);
+		std::swap (tri.y[1], tri.y[2]);
+		std::swap (tri.inv_w[1], tri.inv_w[2]);
+	}
+
+	tri.min_x = std::max (0, static_cast<int> (std::floor (std::min ({ tri.x[0], tri.x[1], tri.x[2] }))));
+	tri.min_y = std::max (0, static_cast<int> (std::floor (std::min ({ tri.y[0], tri.y[1], tri.y[2] }))));
+	tri.max_x = std::min (
+	    static_cast<int> (width) - 1, static_cast<int> (std::floor (std::max ({ tri.x[0], tri.x[1], tri.x[2] }))));
+	tri.max_y = std::min (
+	    static_cast<int> (height) - 1, static_cast<int> (std::floor (std::max ({ tri.y[0], tri.y[1], tri.y[2] }))));
+	return tri.min_x <= tri.max_x && tri.min_y <= tri.max_y;
+}
+
+void OcclusionCuller::rasterize_tile (uint32_t tile)
+{
+	int tile_x0 = static_cast<int> ((tile % tiles_x) * TileWidth);
+	int tile_y0 = static_cast<int> ((tile / tiles_x) * TileHeight);
+	int tile_x1 = tile_x0 + static_cast<int> (TileWidth) - 1;
+	int tile_y1 = tile_y0 + static_cast<int> (TileHeight) - 1;
+
+	for (int y = tile_y0; y <= tile_y1; y++)
+		std::fill_n (depth.begin () + y * width + tile_x0, TileWidth, 0.f);
+
+	for (auto t : tile_bins[tile])
+	{
+		auto& tri = screen_triangles[t];
+		int min_x = std::max (tri.min_x, tile_x0) & ~3;
+		int max_x = std::min (tri.max_x, tile_x1);
+		int min_y = std::max (tri.min_y, tile_y0);
+		int max_y = std::min (tri.max_y, tile_y1);
+
+		// edge e runs from vertex e to e + 1 and is positive inside, e (x, y) = a x + b y + c. A
+		// shared edge has negated coefficients in the two triangles, exactly one of them owns the
+		// pixels on it, so there are no cracks along the diagonals of quads.
+		float a[3], b[3], c[3];
+		bool owns[3];
+		for (int e = 0; e < 3; e++)
+		{
+			int n = (e + 1) % 3;
+			a[e] = tri.y[e] - tri.y[n];
+			b[e] = tri.x[n] - tri.x[e];
+			c[e] = tri.x[e] * tri.y[n] - tri.x[n] * tri.y[e];
+			owns[e] = a[e] > 0.f || (a[e] == 0.f && b[e] > 0.f);
+		}
+		// the weight of a vertex is the edge opposite to it over the area, interpolate 1/w with them
+		float area = c[0] + c[1] + c[2];
+		float inv_area = 1.f / area;
+		float za = (a[1] * tri.inv_w[0] + a[2] * tri.inv_w[1] + a[0] * tri.inv_w[2]) * inv_area;
+		float zb = (b[1] * tri.inv_w[0] + b[2] * tri.inv_w[1] + b[0] * tri.inv_w[2]) * inv_area;
+		float zc = (c[1] * tri.inv_w[0] + c[2] * tri.inv_w[1] + c[0] * tri.inv_w[2]) * inv_area;
+
+		for (int y = min_y; y <= max_y; y++)
+		{
+			float py = static_cast<float> (y) + 0.5f;
+			float* row = depth.data () + y * width;
+#if defined(OCCLUSION_USE_SSE)
+			__m128 lane = _mm_set_ps (3.5f, 2.5f, 1.5f, 0.5f);
+			__m128 e0_row = _mm_set1_ps (b[0] * py + c[0]);
+			__m128 e1_row = _mm_set1_ps (b[1] * py + c[1]);
+			__m128 e2_row = _mm_set1_ps (b[2] * py + c[2]);
+			__m128 z_row = _mm_set1_ps (zb * py + zc);
+			for (int x = min_x; x <= max_x; x += 4)
+			{
+				__m128 px = _mm_add_ps (_mm_set1_ps (static_cast<float> (x)), lane);
+				__m128 e0 = _mm_add_ps (_mm_mul_ps (_mm_set1_ps (a[0]), px), e0_row);
+				__m128 e1 = _mm_add_ps (_mm_mul_ps (_mm_set1_ps (a[1]), px), e1_row);
+				__m128 e2 = _mm_add_ps (_mm_mul_ps (_mm_set1_ps (a[2]), px), e2_row);
+				__m128 inside = _mm_and_ps (_mm_and_ps (inside_edge (e0, owns[0]), inside_edge (e1, owns[1])),
+				    inside_edge (e2, owns[2]));
+				if (_mm_movemask_ps (inside) == 0) continue;
+
+				__m128 z = _mm_add_ps (_mm_mul_ps (_mm_set1_ps (za), px), z_row);
+				__m128 old_depth = _mm_loadu_ps (row + x);
+				__m128 new_depth = _mm_max_ps (old_depth, z);
+				_mm_storeu_ps (row + x, _mm_or_ps (_mm_and_ps (inside, new_depth), _mm_andnot_ps (inside, old_depth)));
+			}
+#else
+			for (int x = min_x; x <= max_x; x++)
+			{
+				float px = static_cast<float> (x) + 0.5f;
+				if (!inside_edge (a[0] * px + b[0] * py + c[0], owns[0]) ||
+				    !inside_edge (a[1] * px + b[1] * py + c[1], owns[1]) ||
+				    !inside_edge (a[2] * px + b[2] * py + c[2], owns[2]))
+					continue;
+				row[x] = std::max (row[x], za * px + zb * py + zc);
+			}
+#endif
+		}
+	}
+
+	// farthest depth of every block in the tile
+	for (int by = tile_y0; by <= tile_y1; by += BlockSize)
+	{
+		for (int bx = tile_x0; bx <= tile_x1; bx += BlockSize)
+		{
+			float farthest = INFINITY;
+			for (int y = by; y < by + static_cast<int> (BlockSize); y++)
+				for (int x = bx; x < bx + static_cast<int> (BlockSize); x++)
+					farthest = std::min (farthest, depth[y * width + x]);
+			block_min[(by / BlockSize) * blocks_x + bx / BlockSize] = farthest;
+		}
+	}
+}
+
+bool OcclusionCuller::is_visible (cml::vec3f min, cml::vec3f max) const
+{
+	float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+	float nearest = 0.f;
+	for (int corner = 0; corner < 8; corner++)
+	{
+		cml::vec3f p ((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z);
+		cml::vec4f clip = to_clip (p);
+		// too close to say anything about
+		if (clip.w < NearW) return true;
+		float inv_w = 1.f / clip.w;
+		float sx = (clip.x * inv_w * 0.5f + 0.5f) * static_cast<float> (width);
+		float sy = (clip.y * inv_w * 0.5f + 0.5f) * static_cast<float> (height);
+		min_x = std::min (min_x, sx);
+		max_x = std::max (max_x, sx);
+		min_y = std::min (min_y, sy);
+		max_y = std::max (max_y, sy);
+		nearest = std::max (nearest, inv_w);
+	}
+
+	int x0 = std::max (0, static_cast<int> (std::floor (min_x)));
+	int y0 = std::max (0, static_cast<int> (std::floor (min_y)));
+	int x1 = std::min (static_cast<int> (width) - 1, static_cast<int> (std::floor (max_x)));
+	int y1 = std::min (static_cast<int> (height) - 1, static_cast<int> (std::floor (max_y)));
+	// off screen, that's for the frustum culling to decide
+	if (x0 > x1 || y0 > y1) return true;
+
+	for (int by = y0 / static_cast<int> (BlockSize); by <= y1 / static_cast<int> (BlockSize); by++)
+	{
+		for (int bx = x0 / static_cast<int> (BlockSize); bx <= x1 / static_cast<int> (BlockSize); bx++)
+		{
+			// everything in the block is closer than the object
+			if (block_min[by * blocks_x + bx] > nearest) continue;
+
+			int px0 = std::max (x0, bx * static_cast<int> (BlockSize));
+			int px1 = std::min (x1, (bx + 1) * static_cast<int> (BlockSize) - 1);
+			int py0 = std::max (y0, by * static_cast<int> (BlockSize));
+			int py1 = std::min (y1, (by + 1) * static_cast<int> (BlockSize) - 1);
+			for (int y = py0; y <= py1; y++)
+				for (int x = px0; x <= px1; x++)
+					if (depth[y * width + x] <= nearest) return true;
+		}
+	}
+	return false;
+}
+
+void OcclusionCuller::filter (job::ThreadPool& pool, CullingBounds const& bounds, std::vector<uint32_t>& indices) const
+{
+	PROFILE_SCOPE ("OcclusionCuller::filter");
+	std::vector<uint8_t> keep (indices.size ());
+	job::parallel_for (pool, indices.size (), 256, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			cml::vec3f center = bounds.get_center (indices[i]);
+			cml::vec3f extent = bounds.get_extent (indices[i]);
+			keep[i] = is_visible (center - extent, center + extent) ? 1 : 0;
+		}
+	});
+
+	size_t out = 0;
+	for (size_t i = 0; i < indices.size (); i++)
+		if (keep[i]) indices[out++] = indices[i];
+	indices.resize (out);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "Culling.h"
+
+namespace job
+{
+class ThreadPool;
+}
+
+// CPU depth rasterizer for occlusion culling. Low poly occluders are rendered into a small depth
+// buffer, objects are then tested by projecting their box against it. Depth is stored as 1/w,
+// which interpolates linearly in screen space and keeps the test independent of the projection's
+// depth range, larger values are closer and 0 is empty. Meant for perspective projections.
+//
+// The buffer is split into tiles that rasterize in parallel, each owning its pixels, and every
+// step is order independent, so results are deterministic. Nothing here touches Vulkan, so it can
+// run headless.
+//
+// Coverage is sampled at pixel centers and triangles are clipped at the near plane, so an occluder
+// can only ever hide less than it really does.
+class OcclusionCuller
+{
+	public:
+	static constexpr uint32_t TileWidth = 64;
+	static constexpr uint32_t TileHeight = 32;
+	static constexpr uint32_t BlockSize = 8; // side of the hierarchical depth blocks
+
+	// rounded up to whole tiles
+	OcclusionCuller (uint32_t width = 320, uint32_t height = 192);
+
+	void begin_frame (cml::mat4f const& proj_view);
+	// triangle list in world space, or transformed by model_matrix
+	void add_occluder (std::vector<cml::vec3f> const& positions, std::vector<uint32_t> const& indices);
+	void add_occluder (
+	    std::vector<cml::vec3f> const& positions, std::vector<uint32_t> const& indices, cml::mat4f const& model_matrix);
+	// a resolution x resolution grid of heights covering size x size starting at origin, for
+	// coarse terrain
+	void add_heightfield_occluder (std::vector<float> const& heights, uint32_t resolution, cml::vec3f origin, float size);
+	void render (job::ThreadPool& pool);
+
+	bool is_visible (cml::vec3f min, cml::vec3f max) const;
+	// removes the hidden objects from indices, keeping the order of the rest
+	void filter (job::ThreadPool& pool, CullingBounds const& bounds, std::vector<uint32_t>& indices) const;
+
+	uint32_t get_width () const { return width; }
+	uint32_t get_height () const { return height; }
+	std::vector<float> const& get_depth () const { return depth; }
+
+	private:
+	uint32_t width;
+	uint32_t height;
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	uint32_t blocks_x;
+
+	cml::mat4f proj_view;
+	std::vector<cml::vec3f> vertices; // world space
+	std::vector<uint32_t> triangles; // 3 per triangle into vertices
+
+	struct ScreenTriangle
+	{
+		float x[3], y[3];
+		float inv_w[3];
+		int min_x, min_y, max_x, max_y; // inclusive pixel bounds, clamped to the buffer
+	};
+	std::vector<ScreenTriangle> screen_triangles;
+	std::vector<std::vector<uint32_t>> tile_bins;
+
+	std::vector<float> depth;
+	std::vector<float> block_min; // farthest depth in each block
+
+	cml::vec4f to_clip (cml::vec3f p) const;
+	// projects a clipped triangle, false when it covers no pixel centers
+	bool setup_triangle (ScreenTriangle& tri, cml::vec4f a, cml::vec4f b, cml::vec4f c) const;
+	void rasterize_tile (uint32_t tile);
+};
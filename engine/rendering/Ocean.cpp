@@ -0,0 +1,336 @@
+#include "Ocean.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCEAN_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "core/JobSystem.h"
+#include "core/Profiler.h"
+
+namespace
+{
+const float Pi = 3.14159265358979f;
+
+// columns one task transforms, a multiple of the SSE width
+const uint32_t ColumnBlock = 16;
+
+inline void butterfly (float* a_re, float* a_im, float* b_re, float* b_im, float w_re, float w_im)
+{
+	float t_re = *b_re * w_re - *b_im * w_im;
+	float t_im = *b_re * w_im + *b_im * w_re;
+	*b_re = *a_re - t_re;
+	*b_im = *a_im - t_im;
+	*a_re += t_re;
+	*a_im += t_im;
+}
+
+#if defined(OCEAN_USE_SSE)
+inline void butterfly_4 (float* a_re, float* a_im, float* b_re, float* b_im, __m128 w_re, __m128 w_im)
+{
+	__m128 br = _mm_loadu_ps (b_re);
+	__m128 bi = _mm_loadu_ps (b_im);
+	__m128 ar = _mm_loadu_ps (a_re);
+	__m128 ai = _mm_loadu_ps (a_im);
+	__m128 t_re = _mm_sub_ps (_mm_mul_ps (br, w_re), _mm_mul_ps (bi, w_im));
+	__m128 t_im = _mm_add_ps (_mm_mul_ps (br, w_im), _mm_mul_ps (bi, w_re));
+	_mm_storeu_ps (b_re, _mm_sub_ps (ar, t_re));
+	_mm_storeu_ps (b_im, _mm_sub_ps (ai, t_im));
+	_mm_storeu_ps (a_re, _mm_add_ps (ar, t_re));
+	_mm_storeu_ps (a_im, _mm_add_ps (ai, t_im));
+}
+#endif
+
+// FFT order, the upper half are the negative frequencies
+int32_t signed_frequency (uint32_t index, uint32_t size)
+{
+	return index < size / 2 ? static_cast<int32_t> (index) : static_cast<int32_t> (index) - static_cast<int32_t> (size);
+}
+} // namespace
+
+OceanSimulation::OceanSimulation (OceanSettings settings) : settings (settings)
+{
+	uint32_t size = settings.resolution;
+	if (size < ColumnBlock || (size & (size - 1)) != 0)
+		throw std::runtime_error ("Ocean resolution has to be a power of two of at least 16");
+	if (settings.cascade_count == 0 || settings.cascade_count > OceanSettings::MaxCascades)
+		throw std::runtime_error ("Ocean cascade count has to be 1 to 3");
+
+	while ((1u << log_size) < size)
+		log_size++;
+	bit_reverse.resize (size);
+	for (uint32_t i = 0; i < size; i++)
+	{
+		uint32_t reversed = 0;
+		for (uint32_t bit = 0; bit < log_size; bit++)
+			if (i & (1u << bit)) reversed |= 1u << (log_size - 1 - bit);
+		bit_reverse[i] = reversed;
+	}
+
+	// the inverse transform turns the other way, e^(+i pi j / half)
+	twiddle_re.resize (size - 1);
+	twiddle_im.resize (size - 1);
+	for (uint32_t half = 1; half < size; half *= 2)
+		for (uint32_t j = 0; j < half; j++)
+		{
+			float angle = Pi * static_cast<float> (j) / static_cast<float> (half);
+			twiddle_re[half - 1 + j] = std::cos (angle);
+			twiddle_im[half - 1 + j] = std::sin (angle);
+		}
+
+	cascades.resize (settings.cascade_count);
+	for (uint32_t i = 0; i < settings.cascade_count; i++)
+		init_spectrum (cascades[i], i);
+}
+
+void OceanSimulation::init_spectrum (Cascade& cascade, uint32_t index)
+{
+	uint32_t size = settings.resolution;
+	size_t count = static_cast<size_t> (size) * size;
+	float patch_size = settings.patch_sizes.at (index);
+	float dk = 2.f * Pi / patch_size;
+
+	// every cascade covers the waves too short for the one before and long enough to leave to the
+	// one after, the first and last reach out to the ends of the spectrum
+	float band_low = index == 0 ? 0.f : 2.f * Pi / (settings.patch_sizes[index] * settings.cascade_overlap);
+	float band_high = index + 1 == settings.cascade_count ?
+	                      INFINITY :
+	                      2.f * Pi / (settings.patch_sizes[index + 1] * settings.cascade_overlap);
+
+	float wind_length = settings.wind_speed * settings.wind_speed / settings.gravity; // largest wave
+	float wind_x = std::cos (settings.wind_direction);
+	float wind_z = std::sin (settings.wind_direction);
+
+	std::mt19937 rng (settings.seed + index);
+	std::normal_distribution<float> gauss;
+
+	cascade.patch_size = patch_size;
+	cascade.h0.re.assign (count, 0.f);
+	cascade.h0.im.assign (count, 0.f);
+	cascade.omega.assign (count, 0.f);
+	for (uint32_t m = 0; m < size; m++)
+		for (uint32_t n = 0; n < size; n++)
+		{
+			size_t i = static_cast<size_t> (m) * size + n;
+			float xi_re = gauss (rng);
+			float xi_im = gauss (rng);
+
+			// the Nyquist row and column have no mirrored wave, so they'd break the real transform
+			if (n == size / 2 || m == size / 2) continue;
+			float kx = dk * static_cast<float> (signed_frequency (n, size));
+			float kz = dk * static_cast<float> (signed_frequency (m, size));
+			float k = std::sqrt (kx * kx + kz * kz);
+			if (k == 0.f || k < band_low || k >= band_high) continue;
+
+			float alignment = (kx * wind_x + kz * wind_z) / k;
+			float directional = std::pow (std::abs (alignment), settings.wind_alignment);
+			if (alignment < 0.f) directional *= settings.against_wind;
+			float kl = k * wind_length;
+			float phillips = settings.amplitude * std::exp (-1.f / (kl * kl)) / (k * k * k * k) * directional;
+
+			// the spectrum is a density, each grid wave stands for dk * dk of it
+			float amplitude = std::sqrt (phillips * dk * dk * 0.5f);
+			cascade.h0.re[i] = xi_re * amplitude;
+			cascade.h0.im[i] = xi_im * amplitude;
+			cascade.omega[i] = std::sqrt (settings.gravity * k);
+		}
+
+	cascade.h0_minus_conj.re.resize (count);
+	cascade.h0_minus_conj.im.resize (count);
+	for (uint32_t m = 0; m < size; m++)
+		for (uint32_t n = 0; n < size; n++)
+		{
+			size_t i = static_cast<size_t> (m) * size + n;
+			size_t mirrored = static_cast<size_t> ((size - m) % size) * size + (size - n) % size;
+			cascade.h0_minus_conj.re[i] = cascade.h0.re[mirrored];
+			cascade.h0_minus_conj.im[i] = -cascade.h0.im[mirrored];
+		}
+
+	for (auto& field : cascade.fields)
+	{
+		field.re.resize (count);
+		field.im.resize (count);
+	}
+	cascade.texels.resize (count);
+}
+
+void OceanSimulation::update_spectrum (Cascade& cascade, size_t row, float time) const
+{
+	uint32_t size = settings.resolution;
+	float dk = 2.f * Pi / cascade.patch_size;
+	float kz = dk * static_cast<float> (signed_frequency (static_cast<uint32_t> (row), size));
+
+	for (uint32_t n = 0; n < size; n++)
+	{
+		size_t i = row * size + n;
+		float kx = dk * static_cast<float> (signed_frequency (n, size));
+		float k = std::sqrt (kx * kx + kz * kz);
+		float ux = k > 0.f ? kx / k : 0.f;
+		float uz = k > 0.f ? kz / k : 0.f;
+
+		// h0(k) e^(i w t) + conj (h0(-k)) e^(-i w t)
+		float c = std::cos (cascade.omega[i] * time);
+		float s = std::sin (cascade.omega[i] * time);
+		float h0_re = cascade.h0.re[i], h0_im = cascade.h0.im[i];
+		float hm_re = cascade.h0_minus_conj.re[i], hm_im = cascade.h0_minus_conj.im[i];
+		float h_re = (h0_re + hm_re) * c - (h0_im - hm_im) * s;
+		float h_im = (h0_re - hm_re) * s + (h0_im + hm_im) * c;
+
+		// displacement is -i k/|k| h, slopes i k h and the displacement derivatives k k/|k| h,
+		// each pair packed as a + i b
+		float dx_re = ux * h_im, dx_im = -ux * h_re;
+		float dz_re = uz * h_im, dz_im = -uz * h_re;
+		float sx_re = -kx * h_im, sx_im = kx * h_re;
+		float sz_re = -kz * h_im, sz_im = kz * h_re;
+		float dxx_re = kx * ux * h_re, dxx_im = kx * ux * h_im;
+		float dzz_re = kz * uz * h_re, dzz_im = kz * uz * h_im;
+		float dxz_re = kz * ux * h_re, dxz_im = kz * ux * h_im;
+
+		cascade.fields[0].re[i] = h_re - dx_im;
+		cascade.fields[0].im[i] = h_im + dx_re;
+		cascade.fields[1].re[i] = dz_re - sx_im;
+		cascade.fields[1].im[i] = dz_im + sx_re;
+		cascade.fields[2].re[i] = sz_re - dxx_im;
+		cascade.fields[2].im[i] = sz_im + dxx_re;
+		cascade.fields[3].re[i] = dzz_re - dxz_im;
+		cascade.fields[3].im[i] = dzz_im + dxz_re;
+	}
+}
+
+void OceanSimulation::inverse_fft_row (float* re, float* im) const
+{
+	uint32_t size = settings.resolution;
+	for (uint32_t i = 0; i < size; i++)
+	{
+		uint32_t j = bit_reverse[i];
+		if (i < j)
+		{
+			std::swap (re[i], re[j]);
+			std::swap (im[i], im[j]);
+		}
+	}
+
+	for (uint32_t half = 1; half < size; half *= 2)
+	{
+		float const* w_re = twiddle_re.data () + half - 1;
+		float const* w_im = twiddle_im.data () + half - 1;
+		for (uint32_t start = 0; start < size; start += 2 * half)
+		{
+			uint32_t j = 0;
+#if defined(OCEAN_USE_SSE)
+			for (; j + 4 <= half; j += 4)
+				butterfly_4 (re + start + j,
+				    im + start + j,
+				    re + start + j + half,
+				    im + start + j + half,
+				    _mm_loadu_ps (w_re + j),
+				    _mm_loadu_ps (w_im + j));
+#endif
+			for (; j < half; j++)
+				butterfly (re + start + j, im + start + j, re + start + j + half, im + start + j + half, w_re[j], w_im[j]);
+		}
+	}
+}
+
+void OceanSimulation::inverse_fft_columns (float* re, float* im, uint32_t first, uint32_t count) const
+{
+	uint32_t size = settings.resolution;
+	uint32_t end = first + count;
+	for (uint32_t i = 0; i < size; i++)
+	{
+		uint32_t j = bit_reverse[i];
+		if (i < j)
+		{
+			std::swap_ranges (re + i * size + first, re + i * size + end, re + j * size + first);
+			std::swap_ranges (im + i * size + first, im + i * size + end, im + j * size + first);
+		}
+	}
+
+	// neighbouring columns share every twiddle, so the SSE lanes run across columns
+	for (uint32_t half = 1; half < size; half *= 2)
+		for (uint32_t start = 0; start < size; start += 2 * half)
+			for (uint32_t j = 0; j < half; j++)
+			{
+				float* a_re = re + (start + j) * size;
+				float* a_im = im + (start + j) * size;
+				float* b_re = re + (start + j + half) * size;
+				float* b_im = im + (start + j + half) * size;
+				float w_re = twiddle_re[half - 1 + j];
+				float w_im = twiddle_im[half - 1 + j];
+
+				uint32_t c = first;
+#if defined(OCEAN_USE_SSE)
+				__m128 w_re_4 = _mm_set1_ps (w_re);
+				__m128 w_im_4 = _mm_set1_ps (w_im);
+				for (; c + 4 <= end; c += 4)
+					butterfly_4 (a_re + c, a_im + c, b_re + c, b_im + c, w_re_4, w_im_4);
+#endif
+				for (; c < end; c++)
+					butterfly (a_re + c, a_im + c, b_re + c, b_im + c, w_re, w_im);
+			}
+}
+
+void OceanSimulation::write_texels (Cascade& cascade, size_t row) const
+{
+	uint32_t size = settings.resolution;
+	float chop = settings.choppiness;
+	for (uint32_t n = 0; n < size; n++)
+	{
+		size_t i = row * size + n;
+		float height = cascade.fields[0].re[i];
+		float dx = cascade.fields[0].im[i];
+		float dz = cascade.fields[1].re[i];
+		float sx = cascade.fields[1].im[i];
+		float sz = cascade.fields[2].re[i];
+		float dxx = cascade.fields[2].im[i];
+		float dzz = cascade.fields[3].re[i];
+		float dxz = cascade.fields[3].im[i];
+
+		// below zero the surface folds over itself, where breaking waves leave foam
+		float jacobian = (1.f + chop * dxx) * (1.f + chop * dzz) - chop * dxz * chop * dxz;
+		cascade.texels[i] = { { chop * dx, height, chop * dz, 0.f }, { sx, sz, jacobian, 0.f } };
+	}
+}
+
+void OceanSimulation::simulate (job::ThreadPool& pool, float time)
+{
+	PROFILE_SCOPE ("OceanSimulation::simulate");
+	uint32_t size = settings.resolution;
+	size_t cascade_count = cascades.size ();
+	size_t rows = cascade_count * size;
+
+	job::parallel_for (pool, rows, 16, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			update_spectrum (cascades[i / size], i % size, time);
+	});
+
+	// every row of every field of every cascade
+	job::parallel_for (pool, rows * FieldCount, 16, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			auto& field = cascades[i / (size * FieldCount)].fields[(i / size) % FieldCount];
+			size_t row = (i % size) * size;
+			inverse_fft_row (field.re.data () + row, field.im.data () + row);
+		}
+	});
+
+	uint32_t blocks = size / ColumnBlock;
+	job::parallel_for (pool, cascade_count * FieldCount * blocks, 1, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			auto& field = cascades[i / (blocks * FieldCount)].fields[(i / blocks) % FieldCount];
+			uint32_t first = static_cast<uint32_t> (i % blocks) * ColumnBlock;
+			inverse_fft_columns (field.re.data (), field.im.data (), first, ColumnBlock);
+		}
+	});
+
+	job::parallel_for (pool, rows, 16, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			write_texels (cascades[i / size], i % size);
+	});
+}
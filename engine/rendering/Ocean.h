@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace job
+{
+class ThreadPool;
+}
+
+struct OceanSettings
+{
+	static constexpr uint32_t MaxCascades = 3;
+
+	uint32_t resolution = 256; // FFT size along each side of a cascade, a power of two
+	uint32_t cascade_count = 3;
+	// world size every cascade's tile repeats over, largest first. Ratios that aren't whole
+	// numbers keep the tiles of different cascades from lining up.
+	std::array<float, MaxCascades> patch_sizes = { 250.f, 37.f, 5.3f };
+	// a cascade keeps the waves longer than this many of the next cascade's tile
+	float cascade_overlap = 0.16f;
+
+	float wind_speed = 12.f; // metres per second
+	float wind_direction = 0.6f; // radians from +x towards +z
+	float amplitude = 0.002f; // Phillips constant, about 3 m significant wave height at 12 m/s
+	float wind_alignment = 2.f; // power of the cosine between wave and wind, higher is narrower
+	float against_wind = 0.07f; // how much waves travelling against the wind are kept
+	float choppiness = 1.2f; // horizontal displacement scale
+	float gravity = 9.81f;
+	uint32_t seed = 1337;
+};
+
+// Texels of a cascade's maps, in z then x order. Matches the RGBA16F layouts water.vert and
+// water.frag sample, after conversion.
+struct OceanTexel
+{
+	float displacement[4]; // x, height, z, unused
+	float slope[4]; // height slope along x and z, the surface's jacobian, unused
+};
+
+// Tessendorf FFT ocean. Each cascade is a tile of the sea surface with its own band of the
+// Phillips spectrum, so summing the cascades gives long swells and short ripples without
+// counting any wave twice. The initial spectrum is drawn once. simulate advances it analytically
+// to a point in time and runs the inverse FFTs across the thread pool: rows first, then columns,
+// both SSE where available.
+//
+// Hermitian spectra have real transforms, so two of the eight fields share one complex
+// transform. Height and x displacement are paired, as are z displacement and x slope, z slope and
+// the x derivative of the x displacement, and the z and cross derivatives of the displacement.
+class OceanSimulation
+{
+	public:
+	explicit OceanSimulation (OceanSettings settings = {});
+
+	// time in seconds, fills every cascade's texels
+	void simulate (job::ThreadPool& pool, float time);
+
+	std::vector<OceanTexel> const& get_texels (uint32_t cascade) const { return cascades.at (cascade).texels; }
+	OceanSettings const& get_settings () const { return settings; }
+
+	private:
+	static constexpr uint32_t FieldCount = 4;
+
+	// split complex values, real and imaginary parts in separate arrays so SSE loads four at once
+	struct ComplexGrid
+	{
+		std::vector<float> re;
+		std::vector<float> im;
+	};
+
+	struct Cascade
+	{
+		float patch_size = 0.f;
+		// initial spectrum at k and the conjugate at -k, resolution * resolution each
+		ComplexGrid h0;
+		ComplexGrid h0_minus_conj;
+		std::vector<float> omega; // angular frequency of each wave
+		std::array<ComplexGrid, FieldCount> fields;
+		std::vector<OceanTexel> texels;
+	};
+
+	OceanSettings settings;
+	uint32_t log_size = 0;
+	std::vector<uint32_t> bit_reverse;
+	// twiddles of every stage, the stage combining halves of length h starts at h - 1
+	std::vector<float> twiddle_re;
+	std::vector<float> twiddle_im;
+	std::vector<Cascade> cascades;
+
+	void init_spectrum (Cascade& cascade, uint32_t index);
+	void update_spectrum (Cascade& cascade, size_t row, float time) const;
+	void inverse_fft_row (float* re, float* im) const;
+	void inverse_fft_columns (float* re, float* im, uint32_t first, uint32_t count) const;
+	void write_texels (Cascade& cascade, size_t row) const;
+};
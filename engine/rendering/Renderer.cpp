@@ -1,5 +1,7 @@
 #include "Renderer.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iomanip>
 
@@ -8,6 +10,8 @@
 #include <nlohmann/json.hpp>
 
 #include "core/Logger.h"
+#include "core/MemoryTracker.h"
+#include "core/Profiler.h"
 #include "core/Window.h"
 #include "resources/Resource.h"
 
@@ -18,6 +22,45 @@
 #include "backend/ImGuiImplGLFW.h"
 #include "backend/RenderTools.h"
 
+// terrain nodes per side that stand in for the terrain when occlusion culling, finer only adds
+// triangles to rasterize without hiding much more
+const uint32_t TerrainOccluderNodes = 32;
+
+// missing keys keep their defaults, out of range values are clamped
+ShadowSettings shadow_settings_from_json (nlohmann::json const& j)
+{
+	ShadowSettings defaults;
+	ShadowSettings out;
+	out.cascade_count = std::clamp (j.value ("cascade_count", defaults.cascade_count), 1u, ShadowCascades::MaxCascades);
+	out.resolution = std::clamp (j.value ("resolution", defaults.resolution), 64u, 8192u);
+	out.max_distance = std::max (j.value ("max_distance", defaults.max_distance), 1.f);
+	out.split_lambda = std::clamp (j.value ("split_lambda", defaults.split_lambda), 0.f, 1.f);
+	out.caster_distance = std::max (j.value ("caster_distance", defaults.caster_distance), 0.f);
+	out.depth_bias = j.value ("depth_bias", defaults.depth_bias);
+	out.normal_bias = j.value ("normal_bias", defaults.normal_bias);
+	out.first_cached_cascade = j.value ("first_cached_cascade", defaults.first_cached_cascade);
+	out.cache_interval = std::max (j.value ("cache_interval", defaults.cache_interval), 1u);
+	out.cache_padding = std::max (j.value ("cache_padding", defaults.cache_padding), 0.f);
+	out.light_turn_threshold = std::clamp (j.value ("light_turn_threshold", defaults.light_turn_threshold), -1.f, 1.f);
+	return out;
+}
+
+nlohmann::json shadow_settings_to_json (ShadowSettings const& settings)
+{
+	nlohmann::json j;
+	j["cascade_count"] = settings.cascade_count;
+	j["resolution"] = settings.resolution;
+	j["max_distance"] = settings.max_distance;
+	j["split_lambda"] = settings.split_lambda;
+	j["caster_distance"] = settings.caster_distance;
+	j["depth_bias"] = settings.depth_bias;
+	j["normal_bias"] = settings.normal_bias;
+	j["first_cached_cascade"] = settings.first_cached_cascade;
+	j["cache_interval"] = settings.cache_interval;
+	j["cache_padding"] = settings.cache_padding;
+	j["light_turn_threshold"] = settings.light_turn_threshold;
+	return j;
+}
 
 RenderSettings::RenderSettings (std::filesystem::path file_name) : file_name (file_name)
 {
@@ -36,16 +79,28 @@ void RenderSettings::load ()
 
 
 			memory_dump = j["memory_dump_on_exit"];
+			memory_budget_mb = j.value ("memory_budget_mb", 0u);
+			memory_tag_budgets_mb = j.value ("memory_tag_budgets_mb", std::map<std::string, uint32_t>{});
+			memory_csv_interval = j.value ("memory_csv_interval", 0u);
+			draw_ocean = j.value ("draw_ocean", false);
+			draw_sky = j.value ("draw_sky", false);
+			terrain_virtual_texture = j.value ("terrain_virtual_texture", false);
+			environment_map = j.value ("environment_map", std::string{});
+			eye_separation = j.value ("eye_separation", 0.064f);
+			dynamic_resolution = j.value ("dynamic_resolution", false);
+			target_frame_ms = j.value ("target_frame_ms", 16.0f);
+			min_render_scale = j.value ("min_render_scale", 0.5f);
+			shadows = shadow_settings_from_json (j.value ("shadows", nlohmann::json::object ()));
 		}
 		catch (std::runtime_error& e)
 		{
-			Log.debug (fmt::format ("Render Settings was incorrect, recreating: {}", e.what ()));
+			Log.debug ("Render Settings was incorrect, recreating: {}", e.what ());
 			save ();
 		}
 	}
 	else
 	{
-		Log.debug (fmt::format ("Render Settings not found, creating one"));
+		Log.debug ("Render Settings not found, creating one");
 		save ();
 	}
 }
@@ -54,24 +109,105 @@ void RenderSettings::save ()
 	nlohmann::json j;
 
 	j["memory_dump_on_exit"] = memory_dump;
+	j["memory_budget_mb"] = memory_budget_mb;
+	j["memory_tag_budgets_mb"] = memory_tag_budgets_mb;
+	j["memory_csv_interval"] = memory_csv_interval;
+	j["draw_ocean"] = draw_ocean;
+	j["draw_sky"] = draw_sky;
+	j["terrain_virtual_texture"] = terrain_virtual_texture;
+	j["environment_map"] = environment_map;
+	j["eye_separation"] = eye_separation;
+	j["dynamic_resolution"] = dynamic_resolution;
+	j["target_frame_ms"] = target_frame_ms;
+	j["min_render_scale"] = min_render_scale;
+	j["shadows"] = shadow_settings_to_json (shadows);
 
 	std::ofstream outFile (file_name);
 	outFile << std::setw (4) << j;
 	outFile.close ();
 }
 
+DynamicResolutionSettings dynamic_resolution_settings (RenderSettings const& settings, uint32_t frame_count)
+{
+	DynamicResolutionSettings out;
+	out.enabled = settings.dynamic_resolution;
+	out.target_ms = settings.target_frame_ms;
+	out.min_scale = settings.min_render_scale;
+	out.latency_frames = frame_count;
+	return out;
+}
+
 VulkanRenderer::VulkanRenderer (
     bool validationLayer, job::ThreadPool& thread_pool, Window& window, Resource::Resources& resource_man)
+: VulkanRenderer (validationLayer, thread_pool, &window, VkExtent2D{}, resource_man, 1)
+{
+}
+
+VulkanRenderer::VulkanRenderer (bool validationLayer,
+    job::ThreadPool& thread_pool,
+    VkExtent2D headless_extent,
+    Resource::Resources& resource_man,
+    uint32_t view_count)
+: VulkanRenderer (validationLayer, thread_pool, nullptr, headless_extent, resource_man, view_count)
+{
+}
+
+VulkanRenderer::VulkanRenderer (bool validationLayer,
+    job::ThreadPool& thread_pool,
+    Window* window,
+    VkExtent2D headless_extent,
+    Resource::Resources& resource_man,
+    uint32_t view_count)
 
 : settings ("render_settings.json"),
   thread_pool (thread_pool),
-  back_end (validationLayer, thread_pool, window, resource_man),
-  render_cameras (back_end.device),
-  frame_data (back_end.device),
-  lighting (back_end.device, back_end.textures, frame_data),
-  mesh_renderer (back_end)
-
+  back_end (validationLayer, thread_pool, window, resource_man, headless_extent, view_count),
+  render_cameras (back_end.device, back_end.vulkanSwapChain.GetChainCount ()),
+  frame_data (back_end.device, back_end.vulkanSwapChain.GetChainCount ()),
+  lighting (back_end.device, frame_data, back_end.vulkanSwapChain.GetChainCount ()),
+  mesh_renderer (back_end, lighting.get_descriptor_stack (), back_end.vulkanSwapChain.GetChainCount ()),
+  shadow_renderer (mesh_renderer, terrain_renderer, settings.shadows),
+  terrain_renderer (back_end, lighting.get_descriptor_stack (), back_end.vulkanSwapChain.GetChainCount ()),
+  ocean_renderer (
+      back_end, thread_pool, lighting.get_descriptor_stack (), back_end.vulkanSwapChain.GetChainCount ()),
+  atmosphere_renderer (
+      back_end, thread_pool, lighting.get_descriptor_stack (), back_end.vulkanSwapChain.GetChainCount ()),
+  upscale_renderer (back_end),
+  dynamic_resolution (dynamic_resolution_settings (settings, back_end.vulkanSwapChain.GetChainCount ())),
+  render_extent (back_end.vulkanSwapChain.GetImageExtent ()),
+  upscaled (settings.dynamic_resolution),
+  headless (window == nullptr)
 {
+	MemTracker.set_device_budget (static_cast<uint64_t> (settings.memory_budget_mb) * 1024 * 1024);
+	for (auto& [name, budget_mb] : settings.memory_tag_budgets_mb)
+	{
+		auto tag = memory_tag_from_name (name);
+		if (tag)
+			MemTracker.set_budget (tag.value (), static_cast<uint64_t> (budget_mb) * 1024 * 1024);
+		else
+			Log.warn ("Unknown memory tag {} in memory_tag_budgets_mb", name);
+	}
+	if (settings.memory_csv_interval > 0) MemTracker.set_csv_dump ("memory.csv", settings.memory_csv_interval);
+	ocean_renderer.set_enabled (settings.draw_ocean);
+	atmosphere_renderer.set_enabled (settings.draw_sky);
+	terrain_renderer.set_virtual_texture_enabled (settings.terrain_virtual_texture);
+
+	if (view_count > 1)
+	{
+		if (view_count != MaxViewCount || !back_end.device.has_multiview () ||
+		    back_end.device.max_multiview_views () < view_count)
+		{
+			Log.error ("Rendering {} views needs multiview, rendering a single view", view_count);
+		}
+		else
+		{
+			stereo_cameras = render_cameras.create_stereo (
+			    CameraType::perspective, cml::vec3f::zero, cml::quatf::identity);
+			this->view_count = view_count;
+		}
+	}
+	frame_data.set_cameras (render_cameras, this->view_count > 1 ? stereo_cameras.left : 0);
+
 	frame_objects.reserve (back_end.vulkanSwapChain.GetChainCount ());
 	for (size_t i = 0; i < back_end.vulkanSwapChain.GetChainCount (); i++)
 	{
@@ -80,22 +216,101 @@ VulkanRenderer::VulkanRenderer (
 
 	construct_frame_graph ();
 
-	imgui_setup ();
+	register_render_passes ();
+	for (auto& [name, render_pass] : frame_graph->get_render_passes ())
+	{
+		if (name == "main_work")
+		{
+			mesh_renderer.create_pipeline (render_pass, 0);
+			terrain_renderer.create_pipeline (render_pass, 0);
+			ocean_renderer.create_pipeline (render_pass, 0);
+			atmosphere_renderer.create_pipeline (render_pass, 0);
+		}
+		if (name == "present") upscale_renderer.create_pipeline (render_pass, 0);
+		// the cascade passes are compatible, so they share one pipeline
+		if (name == "shadow_cascade_0")
+		{
+			mesh_renderer.create_shadow_pipeline (render_pass, 0);
+			terrain_renderer.create_shadow_pipeline (render_pass, 0);
+		}
+	}
+	update_shadow_maps ();
+	update_upscale_source ();
+	back_end.pipeline_cache.warmup (back_end.shaders, thread_pool);
+
+	if (!settings.environment_map.empty ())
+	{
+		try
+		{
+			auto id = resource_man.textures.get_tex_id_by_name (settings.environment_map);
+			set_environment (resource_man.textures.get_tex_resource_by_id (id));
+		}
+		catch (std::runtime_error& e)
+		{
+			Log.error ("Environment map not loaded: {}", e.what ());
+		}
+	}
+
+	if (!headless) imgui_setup ();
 }
 
 VulkanRenderer::~VulkanRenderer ()
 {
 	back_end.async_task_queue.CleanFinishQueue ();
-	if (settings.memory_dump) back_end.device.LogMemory ();
+	if (settings.memory_dump)
+	{
+		back_end.device.LogMemory ();
+		MemTracker.write_json ("memory_report.json");
+	}
 
 	device_wait ();
-	imgui_shutdown ();
+	if (!headless) imgui_shutdown ();
 }
 
 void VulkanRenderer::device_wait () { vkDeviceWaitIdle (back_end.device.device); }
 
+void VulkanRenderer::set_dynamic_resolution (bool enabled)
+{
+	if (enabled && !upscaled)
+	{
+		Log.warn ("The frame graph has no upscale pass, enable dynamic_resolution in render_settings.json and restart");
+		return;
+	}
+	dynamic_resolution.set_enabled (enabled);
+}
+
+bool VulkanRenderer::set_environment (Resource::Texture::TexResource const& cube_map)
+{
+	PROFILE_SCOPE ("VulkanRenderer::set_environment");
+	IBLMaps maps;
+	if (!maps.load_or_bake (thread_pool, cube_map)) return false;
+	Log.debug ("Environment {} {}", cube_map.name, maps.was_loaded_from_cache () ? "loaded from the cache" : "baked");
+	lighting.set_environment (maps);
+	return true;
+}
+
+void VulkanRenderer::occlusion_cull ()
+{
+	// a stereo pair shares one draw list and the buffer only holds one eye's view, so only the
+	// single view is occlusion culled
+	if (view_count > 1 || !terrain_renderer.has_terrain ()) return;
+	PROFILE_SCOPE ("VulkanRenderer::occlusion_cull");
+
+	auto const& quadtree = terrain_renderer.get_quadtree ();
+	auto const& terrain = quadtree.get_settings ();
+	std::vector<float> heights = quadtree.get_occluder_heights (TerrainOccluderNodes);
+	uint32_t resolution = static_cast<uint32_t> (std::lround (std::sqrt (static_cast<double> (heights.size ()))));
+
+	occlusion.begin_frame (render_cameras.get_camera_data (0).get_proj_view_mat ());
+	occlusion.add_heightfield_occluder (
+	    heights, resolution, cml::vec3f (terrain.origin_x, 0.f, terrain.origin_z), terrain.world_size);
+	occlusion.render (thread_pool);
+	render_cameras.occlusion_cull (thread_pool, 0, occlusion, draw_bounds);
+}
+
 void VulkanRenderer::render_frame ()
 {
+	PROFILE_SCOPE ("VulkanRenderer::render_frame");
 	VkResult result = frame_objects.at (frame_index).AcquireNextSwapchainImage ();
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
 	{
@@ -107,12 +322,72 @@ void VulkanRenderer::render_frame ()
 	}
 
 	frame_objects.at (frame_index).PrepareFrame ();
+	back_end.transient_descriptors.begin_frame (frame_index);
+	back_end.bindless.begin_frame (frame_index);
+	back_end.materials.begin_frame (frame_index);
+	back_end.models.begin_frame (frame_index);
+	back_end.gpu_profiler.begin_frame (frame_objects.at (frame_index).GetPrimaryCmdBuf (), frame_index);
+	MemTracker.set_heap_stats (back_end.device.get_heap_stats ());
+	// simulates while the frame is recorded
+	ocean_renderer.update (frame_index);
+
+	// the scene is scaled by the GPU time of the most recently resolved frame
+	dynamic_resolution.update (DynamicResolution::frame_gpu_ms (back_end.gpu_profiler.get_results ()));
+	render_extent = dynamic_resolution.get_extent (back_end.vulkanSwapChain.GetImageExtent ());
+
+	if (!headless) ImGui::Render ();
+
+	// the sky decides the sun's color and the ambient light before anything is lit
+	atmosphere_renderer.update (frame_index, render_cameras.get_camera_data (0));
+	atmosphere_renderer.record_uploads (frame_objects.at (frame_index).GetPrimaryCmdBuf (), frame_index);
+	if (atmosphere_renderer.is_enabled ())
+	{
+		lighting.set_sun (atmosphere_renderer.get_sun_light ());
+		lighting.set_ambient (atmosphere_renderer.get_ambient ());
+	}
+	else
+	{
+		lighting.set_sun (std::nullopt);
+		lighting.set_ambient (std::nullopt);
+	}
 
+	if (view_count > 1)
+		render_cameras.set_stereo_pose (stereo_cameras, render_cameras.get_camera_data (0), settings.eye_separation);
 
-	ImGui::Render ();
+	// every camera is culled in one pass, a stereo pair against one frustum around both eyes
+	mesh_renderer.fill_bounds (draw_bounds);
+	render_cameras.cull (thread_pool, draw_bounds);
+	occlusion_cull ();
 
-	frame_graph->set_current_frame_index (frame_index);
-	frame_graph->fill_command_buffer (frame_objects.at (frame_index).GetPrimaryCmdBuf (), "main_work");
+	shadow_renderer.prepare (
+	    thread_pool, render_cameras.get_camera_data (0), lighting.get_shadow_direction (), draw_bounds);
+	lighting.set_shadows (shadow_renderer.get_gpu_data ());
+	// both eyes look up the head camera's clusters
+	float eye_offset = view_count > 1 ? settings.eye_separation * 0.5f : 0.f;
+	lighting.update (thread_pool, frame_index, render_cameras.get_camera_data (0), render_extent, eye_offset);
+	terrain_renderer.update (
+	    frame_index, render_cameras.get_camera_data (0), shadow_renderer.get_render_frustums ());
+	terrain_renderer.record_uploads (frame_objects.at (frame_index).GetPrimaryCmdBuf (), frame_index);
+	ocean_renderer.record_uploads (frame_objects.at (frame_index).GetPrimaryCmdBuf (), frame_index);
+
+	render_cameras.update_gpu_buffer (frame_index);
+
+	{
+		GPUProfileScope gpu_scope (
+		    back_end.gpu_profiler, frame_objects.at (frame_index).GetPrimaryCmdBuf (), "mesh_cull", true);
+		// both eyes draw the same draws
+		ViewCameraID draw_camera = view_count > 1 ? stereo_cameras.left : 0;
+		mesh_renderer.cull (
+		    frame_objects.at (frame_index).GetPrimaryCmdBuf (), frame_index, render_cameras.get_visible (draw_camera));
+	}
+
+	// the framebuffer has to match the acquired image, which can differ from the frame slot
+	last_image_index = frame_objects.at (frame_index).get_image_index ();
+	frame_graph->set_current_frame_index (last_image_index);
+	frame_graph->fill_command_buffer (
+	    frame_objects.at (frame_index).GetPrimaryCmdBuf (), upscaled ? "present" : "main_work");
+	terrain_renderer.record_readback (frame_objects.at (frame_index).GetPrimaryCmdBuf (), frame_index);
+	ocean_renderer.finish_update ();
 	frame_objects.at (frame_index).submit ();
 
 	result = frame_objects.at (frame_index).Present ();
@@ -130,15 +405,94 @@ void VulkanRenderer::render_frame ()
 	back_end.async_task_queue.CleanFinishQueue ();
 }
 
+bool VulkanRenderer::save_frame (std::filesystem::path const& file_name)
+{
+	if (!headless)
+	{
+		Log.error ("Saving frames is only supported when rendering headless");
+		return false;
+	}
+	device_wait ();
+
+	auto extent = back_end.vulkanSwapChain.GetImageExtent ();
+	uint32_t row_width = extent.width * view_count; // the views side by side
+	VkDeviceSize image_size = static_cast<VkDeviceSize> (row_width) * extent.height * 4;
+	VulkanBuffer readback (back_end.device,
+	    BufCreateDetails{ BufferType::staging,
+	        image_size,
+	        (VkBufferUsageFlags) (VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+	        VMA_MEMORY_USAGE_GPU_TO_CPU,
+	        VMA_ALLOCATION_CREATE_MAPPED_BIT,
+	        1,
+	        true });
+
+	// the final render pass leaves headless images in TRANSFER_SRC_OPTIMAL
+	std::vector<VkBufferImageCopy> regions (view_count);
+	for (uint32_t layer = 0; layer < view_count; layer++)
+	{
+		auto& region = regions[layer];
+		region.bufferOffset = static_cast<VkDeviceSize> (extent.width) * layer * 4;
+		region.bufferRowLength = row_width;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.baseArrayLayer = layer;
+		region.imageSubresource.layerCount = 1;
+		region.imageExtent = { extent.width, extent.height, 1 };
+	}
+
+	CommandPool pool (back_end.device.device, back_end.device.graphics_queue ());
+	CommandBuffer cmd_buf (pool);
+	cmd_buf.allocate ().begin ();
+	vkCmdCopyImageToBuffer (cmd_buf.get (),
+	    back_end.vulkanSwapChain.GetSwapChainImage (last_image_index),
+	    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	    readback.get (),
+	    static_cast<uint32_t> (regions.size ()),
+	    regions.data ());
+	cmd_buf.end ().submit ().wait ();
+
+	void* pixels = nullptr;
+	readback.map (&pixels);
+	int res = stbi_write_png (file_name.string ().c_str (),
+	    static_cast<int> (row_width),
+	    static_cast<int> (extent.height),
+	    4,
+	    pixels,
+	    static_cast<int> (row_width * 4));
+	readback.unmap ();
+
+	if (res == 0)
+	{
+		Log.error ("Failed to write frame to {}", file_name.string ());
+		return false;
+	}
+	return true;
+}
+
 void VulkanRenderer::recreate_swapchain ()
 {
-	Log.debug (fmt::format ("Recreating Swapchain"));
+	Log.debug ("Recreating Swapchain");
 	device_wait ();
+	// warmups compile against the registered render passes, none may run across the recreate
+	back_end.pipeline_cache.clear_render_passes ();
+	back_end.pipeline_registry.collect_unused ();
 
 	frame_graph->destroy_present_resources ();
 	back_end.vulkanSwapChain.recreate_swapchain ();
 	frame_graph->create_present_resources ();
-	ImGui_ImplVulkan_SetMinImageCount (back_end.vulkanSwapChain.GetChainCount ());
+	register_render_passes ();
+	// the shadow maps were recreated along with the other attachments
+	shadow_renderer.invalidate ();
+	update_shadow_maps ();
+	update_upscale_source ();
+	if (!headless) ImGui_ImplVulkan_SetMinImageCount (back_end.vulkanSwapChain.GetChainCount ());
+}
+
+void VulkanRenderer::register_render_passes ()
+{
+	for (auto& [name, render_pass] : frame_graph->get_render_passes ())
+		back_end.pipeline_cache.register_render_pass (name, render_pass);
+	for (auto& [render_pass, key] : frame_graph->get_compatibility_keys ())
+		back_end.pipeline_registry.register_render_pass (render_pass, key);
 }
 
 void VulkanRenderer::construct_frame_graph ()
@@ -149,29 +503,122 @@ void VulkanRenderer::construct_frame_graph ()
 
 	frame_graph_builder.add_attachment ({ "img_color", back_end.vulkanSwapChain.GetFormat () });
 	frame_graph_builder.set_final_output_attachment_name ("img_color");
-	frame_graph_builder.add_attachment ({ "img_depth",
+	// without dynamic resolution the scene renders straight into the swapchain image
+	std::string scene_image = upscaled ? "img_scene" : "img_color";
+	if (upscaled)
+	{
+		// allocated at the image extent, the scene only renders into the dynamic resolution's part of it
+		RenderPassAttachment scene{ scene_image, back_end.vulkanSwapChain.GetFormat () };
+		scene.layers = view_count;
+		frame_graph_builder.add_attachment (scene);
+	}
+	RenderPassAttachment depth{ "img_depth",
 	    back_end.device.find_supported_format ({ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
 	        VK_IMAGE_TILING_OPTIMAL,
-	        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) });
+	        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) };
+	depth.layers = view_count;
+	frame_graph_builder.add_attachment (depth);
 
 	SubpassDescription color_subpass ("sub_color");
-	color_subpass.add_color_output ("img_color");
-	color_subpass.add_clear_color ("img_color", { { 0.1f, 0.1f, 0.1f, 1.0f } });
+	color_subpass.add_color_output (scene_image);
+	color_subpass.add_clear_color (scene_image, { { 0.1f, 0.1f, 0.1f, 1.0f } });
 	color_subpass.set_depth_stencil ("img_depth", SubpassDescription::DepthStencilAccess::read_write);
 	color_subpass.add_clear_color ("img_depth", { { 0.0f, 0 } });
+	// each view draws into its own layer of the color and depth images
+	if (view_count > 1) color_subpass.set_view_mask ((1u << view_count) - 1);
 
 	color_subpass.set_function ([&] (VkCommandBuffer cmdBuf) { main_draw (cmdBuf); });
 	main_work.add_subpass (color_subpass);
+	if (upscaled)
+	{
+		main_work.add_sampled_output (scene_image);
+		main_work.set_render_area ([this] { return render_extent; });
+	}
+
+	// one pass per cascade so cached cascades can skip theirs
+	uint32_t shadow_resolution = shadow_renderer.get_settings ().resolution;
+	for (uint32_t i = 0; i < shadow_renderer.get_settings ().cascade_count; i++)
+	{
+		std::string map_name = "shadow_map_" + std::to_string (i);
+		RenderPassAttachment shadow_map{ map_name, VK_FORMAT_D32_SFLOAT };
+		shadow_map.width = shadow_resolution;
+		shadow_map.height = shadow_resolution;
+		frame_graph_builder.add_attachment (shadow_map);
+
+		SubpassDescription shadow_subpass ("sub_shadow");
+		shadow_subpass.set_depth_stencil (map_name, SubpassDescription::DepthStencilAccess::read_write);
+		shadow_subpass.add_clear_color (map_name, { { 0.0f, 0 } });
+		shadow_subpass.set_function (
+		    [this, i] (VkCommandBuffer cmdBuf) { shadow_renderer.draw (cmdBuf, frame_index, i); });
+
+		RenderPassDescription shadow_pass ("shadow_cascade_" + std::to_string (i));
+		shadow_pass.add_subpass (shadow_subpass);
+		shadow_pass.add_sampled_output (map_name);
+		shadow_pass.set_condition ([this, i] { return shadow_renderer.needs_render (i); });
+		frame_graph_builder.add_render_pass (shadow_pass);
+	}
 
 	frame_graph_builder.add_render_pass (main_work);
-	frame_graph_builder.set_final_render_pass_name (main_work.name);
+	if (upscaled)
+	{
+		// upscales the scene to the whole image, ImGui draws on top at full resolution
+		SubpassDescription present_subpass ("sub_present");
+		present_subpass.add_color_output ("img_color");
+		present_subpass.add_clear_color ("img_color", { { 0.1f, 0.1f, 0.1f, 1.0f } });
+		if (view_count > 1) present_subpass.set_view_mask ((1u << view_count) - 1);
+		present_subpass.set_function ([&] (VkCommandBuffer cmdBuf) { present_draw (cmdBuf); });
+		RenderPassDescription present_pass ("present");
+		present_pass.add_subpass (present_subpass);
+		frame_graph_builder.add_render_pass (present_pass);
+		frame_graph_builder.set_final_render_pass_name (present_pass.name);
+	}
+	else
+		frame_graph_builder.set_final_render_pass_name (main_work.name);
+
+	frame_graph = std::make_unique<FrameGraph> (
+	    back_end.device, back_end.vulkanSwapChain, frame_graph_builder, &back_end.gpu_profiler);
+}
+
+void VulkanRenderer::update_shadow_maps ()
+{
+	std::vector<VkImageView> views;
+	for (uint32_t i = 0; i < shadow_renderer.get_settings ().cascade_count; i++)
+		views.push_back (frame_graph->get_image_view ("shadow_map_" + std::to_string (i)));
+	lighting.set_shadow_maps (views);
+}
 
-	frame_graph = std::make_unique<FrameGraph> (back_end.device, back_end.vulkanSwapChain, frame_graph_builder);
+void VulkanRenderer::update_upscale_source ()
+{
+	if (!upscaled) return;
+	upscale_renderer.set_source (frame_graph->get_image ("img_scene"),
+	    back_end.vulkanSwapChain.GetFormat (),
+	    view_count,
+	    back_end.vulkanSwapChain.GetImageExtent ());
 }
 
 void VulkanRenderer::main_draw (VkCommandBuffer cmdBuf)
 {
+	VkViewport viewport = initializers::viewport (
+	    static_cast<float> (render_extent.width), static_cast<float> (render_extent.height), 0.0f, 1.0f);
+	vkCmdSetViewport (cmdBuf, 0, 1, &viewport);
+
+	VkRect2D scissor = initializers::rect2D (render_extent.width, render_extent.height, 0, 0);
+	vkCmdSetScissor (cmdBuf, 0, 1, &scissor);
+
+	frame_data.bind (cmdBuf, lighting.get_pipeline_layout (), frame_index);
+	lighting.bind (cmdBuf, frame_index);
+
+	terrain_renderer.draw (cmdBuf, frame_index);
+	mesh_renderer.draw (cmdBuf, frame_index);
+	ocean_renderer.draw (cmdBuf, frame_index);
+	atmosphere_renderer.draw (cmdBuf, frame_index);
 
+	// the scene is the final pass then
+	if (!upscaled) imgui_draw (cmdBuf);
+}
+
+void VulkanRenderer::present_draw (VkCommandBuffer cmdBuf)
+{
 	auto extent = back_end.vulkanSwapChain.GetImageExtent ();
 	VkViewport viewport = initializers::viewport (
 	    static_cast<float> (extent.width), static_cast<float> (extent.height), 0.0f, 1.0f);
@@ -180,15 +627,19 @@ void VulkanRenderer::main_draw (VkCommandBuffer cmdBuf)
 	VkRect2D scissor = initializers::rect2D (extent.width, extent.height, 0, 0);
 	vkCmdSetScissor (cmdBuf, 0, 1, &scissor);
 
-	frame_data.bind (cmdBuf);
-	lighting.bind (cmdBuf);
+	upscale_renderer.draw (cmdBuf, render_extent);
+	imgui_draw (cmdBuf);
+};
 
+void VulkanRenderer::imgui_draw (VkCommandBuffer cmdBuf)
+{
+	if (headless) return;
 	auto draw_data = ImGui::GetDrawData ();
 	if (draw_data)
 	{
 		ImGui_ImplVulkan_RenderDrawData (draw_data, cmdBuf);
 	}
-};
+}
 
 void VulkanRenderer::imgui_setup ()
 {
@@ -242,6 +693,7 @@ void VulkanRenderer::imgui_shutdown ()
 
 void VulkanRenderer::imgui_new_frame ()
 {
+	if (headless) return;
 	ImGui_ImplGlfw_NewFrame ();
 	ImGui_ImplVulkan_NewFrame ();
 	ImGui::NewFrame ();
@@ -4,6 +4,7 @@
 #include <condition_variable>
 #include <filesystem>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -16,14 +17,19 @@
 
 #include "backend/BackEnd.h"
 
+#include "DynamicResolution.h"
 #include "FrameGraph.h"
 #include "ViewCamera.h"
 
 #include "rendering/renderers/FrameData.h"
 #include "rendering/renderers/Lighting.h"
 #include "rendering/renderers/MeshRenderer.h"
+#include "rendering/renderers/AtmosphereRenderer.h"
+#include "rendering/renderers/OceanRenderer.h"
+#include "rendering/renderers/ShadowRenderer.h"
 #include "rendering/renderers/SkyboxRenderer.h"
 #include "rendering/renderers/TerrainRenderer.h"
+#include "rendering/renderers/UpscaleRenderer.h"
 
 
 class Window;
@@ -40,6 +46,21 @@ class RenderSettings
 {
 	public:
 	bool memory_dump = false;
+	uint32_t memory_budget_mb = 0;    // device local memory, 0 disables the check
+	// per MemoryTag budgets keyed by memory_tag_name, tags left out have no budget
+	std::map<std::string, uint32_t> memory_tag_budgets_mb;
+	uint32_t memory_csv_interval = 0; // frames between memory.csv rows, 0 disables the dump
+	bool draw_ocean = false;
+	bool draw_sky = false;
+	// distant terrain samples pages composited from the splat map instead of blending its layers
+	bool terrain_virtual_texture = false;
+	std::string environment_map; // name of the cube map lighting the scene, empty for none
+	float eye_separation = 0.064f; // meters between the eyes when rendering stereo
+	// lowers the scene's resolution while the GPU takes longer than target_frame_ms
+	bool dynamic_resolution = false;
+	float target_frame_ms = 16.0f;
+	float min_render_scale = 0.5f;
+	ShadowSettings shadows; // the "shadows" object, read once at startup
 
 	RenderSettings (std::filesystem::path file_name);
 
@@ -64,6 +85,15 @@ class VulkanRenderer
 	VulkanRenderer (
 	    bool enableValidationLayer, job::ThreadPool& thread_pool, Window& window, Resource::Resources& resource_man);
 
+	// Renders without a surface or swapchain into offscreen images, for benchmarks and captures.
+	// ImGui isn't set up in this mode. A view_count of 2 renders a stereo pair around camera 0 into
+	// the two layers of the images in a single multiview pass, when the device supports it.
+	VulkanRenderer (bool enableValidationLayer,
+	    job::ThreadPool& thread_pool,
+	    VkExtent2D headless_extent,
+	    Resource::Resources& resource_man,
+	    uint32_t view_count = 1);
+
 	VulkanRenderer (VulkanRenderer const& other) = delete; // copy
 	VulkanRenderer& operator= (VulkanRenderer const&) = delete;
 	VulkanRenderer (VulkanRenderer&& other) = delete; // move
@@ -80,7 +110,39 @@ class VulkanRenderer
 
 	VulkanOpenXRInit get_openxr_init ();
 
+	std::vector<GPUScopeTiming> const& get_gpu_timings () const { return back_end.gpu_profiler.get_results (); }
+	VkDeviceSize get_allocated_bytes () const { return back_end.device.allocated_bytes (); }
+	VkExtent2D get_image_extent () { return back_end.vulkanSwapChain.GetImageExtent (); }
+	// for the scene to upload what the MeshRenderer draws
+	Models& get_models () { return back_end.models; }
+	Materials& get_materials () { return back_end.materials; }
+
+	bool is_headless () const { return headless; }
+	// views drawn each frame, 1 unless rendering stereo
+	uint32_t get_view_count () const { return view_count; }
+	// the part of the image extent the scene was last rendered at before being upscaled
+	VkExtent2D get_render_extent () const { return render_extent; }
+	float get_render_scale () const { return dynamic_resolution.get_scale (); }
+	// can only be turned on when it was enabled in the settings at startup
+	void set_dynamic_resolution (bool enabled);
+	bool is_dynamic_resolution_enabled () const { return dynamic_resolution.get_settings ().enabled; }
+
+	// Writes the most recently rendered headless image out as a png, the views side by side. Waits
+	// on the device.
+	bool save_frame (std::filesystem::path const& file_name);
+
+	// Lights the scene with cube_map's IBLMaps, baked on the thread pool unless they're cached.
+	// Waits on the device.
+	bool set_environment (Resource::Texture::TexResource const& cube_map);
+
 	private:
+	VulkanRenderer (bool enableValidationLayer,
+	    job::ThreadPool& thread_pool,
+	    Window* window,
+	    VkExtent2D headless_extent,
+	    Resource::Resources& resource_man,
+	    uint32_t view_count);
+
 	void imgui_setup ();
 	void imgui_shutdown ();
 
@@ -96,19 +158,49 @@ class VulkanRenderer
 	FrameData frame_data;
 	Lighting lighting;
 	MeshRenderer mesh_renderer;
+	ShadowRenderer shadow_renderer;
+	TerrainRenderer terrain_renderer;
+	OceanRenderer ocean_renderer;
+	AtmosphereRenderer atmosphere_renderer;
+	UpscaleRenderer upscale_renderer;
 
 	private:
+	DynamicResolution dynamic_resolution;
+	VkExtent2D render_extent{};
+	// Only with dynamic resolution enabled at startup does the scene render into its own image
+	// and get upscaled, otherwise it renders straight into the swapchain image
+	bool upscaled = false;
+
+	// the MeshRenderer's draws, culled for every camera and the shadow cascades
+	CullingBounds draw_bounds;
+	// the terrain seen from the main camera, hides the draws behind hills
+	OcclusionCuller occlusion;
+
 	std::unique_ptr<FrameGraph> frame_graph;
 
 	std::vector<FrameObject> frame_objects;
 
 
 	uint32_t frame_index = 0; // which of the swapchain images the app is rendering to
+	uint32_t last_image_index = 0;
+	bool headless = false;
+	uint32_t view_count = 1;
+	StereoCameras stereo_cameras; // the eyes when view_count is 2
 
+	// hides the main camera's draws behind the terrain, between frustum culling and building draws
+	void occlusion_cull ();
 	void construct_frame_graph ();
+	// lets the pipeline cache and registry identify the frame graph's render passes
+	void register_render_passes ();
+	// points the lighting descriptors at the frame graph's shadow maps
+	void update_shadow_maps ();
+	// points the upscale pass at the frame graph's scene image
+	void update_upscale_source ();
 
 	VkDescriptorPool imgui_pool;
 
 	// drawing functions
 	void main_draw (VkCommandBuffer cmdBuf);
+	void present_draw (VkCommandBuffer cmdBuf);
+	void imgui_draw (VkCommandBuffer cmdBuf);
 };
@@ -0,0 +1,141 @@
+#include "ShadowCascades.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "rendering/ViewCamera.h"
+
+namespace
+{
+float dot (cml::vec3f a, cml::vec3f b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+} // namespace
+
+ShadowCascades::ShadowCascades (ShadowSettings settings) : settings (settings)
+{
+	if (settings.cascade_count == 0 || settings.cascade_count > MaxCascades)
+		throw std::runtime_error ("shadow cascade count must be between 1 and 4");
+}
+
+void ShadowCascades::invalidate ()
+{
+	for (auto& cascade : cascades)
+		cascade.valid = false;
+}
+
+void ShadowCascades::fit (Cascade& cascade, cml::vec3f center, float radius, cml::vec3f light_direction) const
+{
+	// light space basis, the light travels along forward
+	cml::vec3f forward = light_direction * -1.f;
+	cml::vec3f reference = std::abs (forward.y) > 0.99f ? cml::vec3f (1.f, 0.f, 0.f) : cml::vec3f (0.f, 1.f, 0.f);
+	cml::vec3f right = cml::normalize (cml::cross (reference, forward));
+	cml::vec3f up = cml::cross (forward, right);
+
+	// moving the cascade in whole texels keeps every texel sampling the same spot in the world
+	float texel = 2.f * radius / static_cast<float> (settings.resolution);
+	float x = std::floor (dot (center, right) / texel) * texel;
+	float y = std::floor (dot (center, up) / texel) * texel;
+	float z_near = dot (center, forward) - radius - settings.caster_distance;
+	float z_far = dot (center, forward) + radius;
+	float depth_range = z_far - z_near;
+
+	float* m = reinterpret_cast<float*> (&cascade.proj_view);
+	m[0] = right.x / radius;
+	m[4] = right.y / radius;
+	m[8] = right.z / radius;
+	m[12] = -x / radius;
+	m[1] = up.x / radius;
+	m[5] = up.y / radius;
+	m[9] = up.z / radius;
+	m[13] = -y / radius;
+	m[2] = -forward.x / depth_range;
+	m[6] = -forward.y / depth_range;
+	m[10] = -forward.z / depth_range;
+	m[14] = z_far / depth_range;
+	m[3] = m[7] = m[11] = 0.f;
+	m[15] = 1.f;
+
+	cascade.frustum = extract_frustum (cascade.proj_view);
+	cascade.center = center;
+	cascade.radius = radius;
+	cascade.light_direction = light_direction;
+}
+
+void ShadowCascades::update (ViewCameraData& camera, cml::vec3f light_direction)
+{
+	frame++;
+	light_direction = cml::normalize (light_direction);
+
+	cml::mat4f proj_mat = camera.get_proj_mat ();
+	cml::mat4f view = camera.get_view_mat ();
+	float const* proj = reinterpret_cast<float const*> (&proj_mat);
+	float const* v = reinterpret_cast<float const*> (&view);
+	// the view space axis the camera looks down, in world space
+	float sign = proj[11] < 0.f ? -1.f : 1.f;
+	cml::vec3f forward = cml::normalize (cml::vec3f (v[2], v[6], v[10]) * sign);
+	cml::vec3f position = camera.get_position ();
+
+	float tan_y = std::tan (camera.get_fov () * 0.5f);
+	float tan_x = tan_y * camera.get_aspect_ratio ();
+	float k2 = tan_x * tan_x + tan_y * tan_y;
+
+	float clip_near = camera.get_clip_near ();
+	float clip_far = std::min (camera.get_clip_far (), settings.max_distance);
+	uint32_t count = settings.cascade_count;
+
+	bool refreshed_cached = false;
+	float split_near = clip_near;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		// practical split scheme
+		float t = static_cast<float> (i + 1) / static_cast<float> (count);
+		float log_split = clip_near * std::pow (clip_far / clip_near, t);
+		float even_split = clip_near + (clip_far - clip_near) * t;
+		float split_far = settings.split_lambda * log_split + (1.f - settings.split_lambda) * even_split;
+
+		// bounding sphere of the slice, it only depends on the split distances and the field of
+		// view, so its size doesn't change as the camera turns
+		float center_depth = std::min ((split_near + split_far) * 0.5f * (1.f + k2), split_far);
+		float far_offset = split_far - center_depth;
+		float radius = std::sqrt (far_offset * far_offset + split_far * split_far * k2);
+		radius = std::ceil (radius * 16.f) / 16.f; // keeps float noise from changing the texel size
+		cml::vec3f center = position + forward * center_depth;
+
+		auto& cascade = cascades[i];
+		if (i < settings.first_cached_cascade)
+		{
+			fit (cascade, center, radius, light_direction);
+			cascade.needs_render = true;
+		}
+		else
+		{
+			float moved = cml::distance (center, cascade.center);
+			bool must_render = !cascade.valid || moved + radius > cascade.radius ||
+			                   dot (light_direction, cascade.light_direction) < settings.light_turn_threshold;
+			// stale maps are refreshed one per frame to spread the cost
+			bool stale = frame - cascade.rendered_frame >= settings.cache_interval && !refreshed_cached;
+
+			cascade.needs_render = must_render || stale;
+			if (cascade.needs_render)
+			{
+				if (stale) refreshed_cached = true;
+				float padded = std::ceil (radius * (1.f + settings.cache_padding) * 16.f) / 16.f;
+				fit (cascade, center, padded, light_direction);
+			}
+		}
+		if (cascade.needs_render)
+		{
+			cascade.rendered_frame = frame;
+			cascade.valid = true;
+		}
+
+		gpu_data.proj_view[i] = cascade.proj_view;
+		reinterpret_cast<float*> (&gpu_data.split_depths)[i] = split_far;
+		reinterpret_cast<float*> (&gpu_data.texel_sizes)[i] =
+		    2.f * cascade.radius / static_cast<float> (settings.resolution);
+		split_near = split_far;
+	}
+	gpu_data.cascade_count = count;
+	gpu_data.depth_bias = settings.depth_bias;
+	gpu_data.normal_bias = settings.normal_bias;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "cml/cml.h"
+
+#include "rendering/Culling.h"
+
+class ViewCameraData;
+
+struct ShadowSettings
+{
+	uint32_t cascade_count = 4;
+	uint32_t resolution = 2048;
+	float max_distance = 300.f; // shadows end here or at the camera's far plane
+	float split_lambda = 0.75f; // 0 spaces the splits evenly, 1 logarithmically
+	float caster_distance = 500.f; // how far towards the light casters are picked up
+	float depth_bias = 0.0005f;
+	float normal_bias = 1.5f; // in texels of the cascade
+
+	// cascades from this one on keep their map between frames and are only re-rendered every
+	// cache_interval frames, when the light turns or when the camera leaves their padded bounds
+	uint32_t first_cached_cascade = 2;
+	uint32_t cache_interval = 8;
+	float cache_padding = 0.25f; // fraction of the radius a cached cascade is grown by
+	float light_turn_threshold = 0.9999f; // cosine of the angle the light may turn before re-rendering
+};
+
+// Matches ShadowData in lighting.glsl (std430)
+struct ShadowGPUData
+{
+	static constexpr uint32_t MaxCascades = 4;
+	std::array<cml::mat4f, MaxCascades> proj_view;
+	cml::vec4f split_depths; // far view depth of each cascade
+	cml::vec4f texel_sizes; // world size of a texel in each cascade
+	uint32_t cascade_count = 0;
+	float depth_bias = 0.f;
+	float normal_bias = 0.f;
+	uint32_t padding = 0;
+};
+
+// Fits cascaded shadow maps for a directional light to a perspective camera. Splits blend between
+// logarithmic and even spacing, each cascade covers the bounding sphere of its slice of the view
+// frustum, which doesn't change size as the camera turns, and is snapped to whole texels so the
+// maps don't shimmer as the camera moves.
+//
+// Depth is reversed to match the main pass: 1 is the side facing the light, 0 the far side.
+class ShadowCascades
+{
+	public:
+	static constexpr uint32_t MaxCascades = ShadowGPUData::MaxCascades;
+
+	explicit ShadowCascades (ShadowSettings settings = {});
+
+	// light_direction points towards the light
+	void update (ViewCameraData& camera, cml::vec3f light_direction);
+	// forces every cascade to re-render, for when the maps were recreated
+	void invalidate ();
+
+	uint32_t cascade_count () const { return settings.cascade_count; }
+	bool needs_render (uint32_t cascade) const { return cascades.at (cascade).needs_render; }
+	cml::mat4f const& get_proj_view (uint32_t cascade) const { return cascades.at (cascade).proj_view; }
+	Frustum const& get_frustum (uint32_t cascade) const { return cascades.at (cascade).frustum; }
+	ShadowGPUData const& get_gpu_data () const { return gpu_data; }
+	ShadowSettings const& get_settings () const { return settings; }
+
+	private:
+	ShadowSettings settings;
+	uint64_t frame = 0;
+
+	struct Cascade
+	{
+		cml::mat4f proj_view;
+		Frustum frustum;
+		cml::vec3f center; // of the covered sphere
+		float radius = 0.f;
+		cml::vec3f light_direction;
+		uint64_t rendered_frame = 0;
+		bool valid = false;
+		bool needs_render = false;
+	};
+	std::array<Cascade, MaxCascades> cascades;
+	ShadowGPUData gpu_data;
+
+	void fit (Cascade& cascade, cml::vec3f center, float radius, cml::vec3f light_direction) const;
+};
@@ -0,0 +1,288 @@
+#include "TerrainLOD.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+struct Box
+{
+	float min_x, min_y, min_z;
+	float max_x, max_y, max_z;
+};
+
+bool box_in_sphere_range (Box const& box, cml::vec3f center, float radius)
+{
+	float dx = std::max ({ box.min_x - center.x, 0.f, center.x - box.max_x });
+	float dy = std::max ({ box.min_y - center.y, 0.f, center.y - box.max_y });
+	float dz = std::max ({ box.min_z - center.z, 0.f, center.z - box.max_z });
+	return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+// conservative, only rejects boxes fully outside a plane
+bool box_in_frustum (Box const& box, Frustum const& frustum)
+{
+	for (auto& plane : frustum.planes)
+	{
+		float x = plane.x >= 0.f ? box.max_x : box.min_x;
+		float y = plane.y >= 0.f ? box.max_y : box.min_y;
+		float z = plane.z >= 0.f ? box.max_z : box.min_z;
+		if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.f) return false;
+	}
+	return true;
+}
+
+struct StackNode
+{
+	uint32_t x, z, lod;
+};
+} // namespace
+
+TerrainQuadtree::TerrainQuadtree (TerrainSettings settings) : settings (settings)
+{
+	if (settings.lod_count == 0 || settings.lod_count > TerrainSelectionStats::MaxLods)
+		throw std::runtime_error ("terrain lod count must be between 1 and 16");
+	if (settings.grid_resolution < 2 || settings.grid_resolution % 2 != 0)
+		throw std::runtime_error ("terrain grid resolution must be even");
+	if (settings.tile_count == 0 || settings.tile_samples < 2)
+		throw std::runtime_error ("terrain needs at least one tile of two samples");
+	// a level's range has to reach past its nodes, or a node can sit next to one two levels coarser
+	// and the morph can't close the crack between them
+	if (settings.lod_0_range < 2.f * get_node_size (0))
+		throw std::runtime_error ("terrain lod 0 range must be at least twice the size of a lod 0 node");
+
+	heights.assign (static_cast<size_t> (settings.tile_count) * settings.tile_count * settings.tile_samples *
+	                    settings.tile_samples,
+	    0.f);
+	bounds.resize (settings.lod_count);
+	update_bounds ();
+}
+
+void TerrainQuadtree::set_tile (uint32_t tile_x, uint32_t tile_z, std::vector<float> const& tile_heights)
+{
+	size_t tile_size = static_cast<size_t> (settings.tile_samples) * settings.tile_samples;
+	if (tile_x >= settings.tile_count || tile_z >= settings.tile_count || tile_heights.size () != tile_size)
+		throw std::runtime_error ("terrain tile out of range or of the wrong size");
+
+	size_t tile_index = static_cast<size_t> (tile_z) * settings.tile_count + tile_x;
+	std::copy (tile_heights.begin (), tile_heights.end (), heights.begin () + tile_index * tile_size);
+}
+
+float TerrainQuadtree::sample (uint32_t x, uint32_t z) const
+{
+	uint32_t edge = settings.tile_samples - 1;
+	uint32_t tile_x = std::min (x / edge, settings.tile_count - 1);
+	uint32_t tile_z = std::min (z / edge, settings.tile_count - 1);
+	size_t tile_index = static_cast<size_t> (tile_z) * settings.tile_count + tile_x;
+	size_t local = static_cast<size_t> (x - tile_x * edge) * settings.tile_samples + (z - tile_z * edge);
+	return heights[tile_index * settings.tile_samples * settings.tile_samples + local];
+}
+
+void TerrainQuadtree::update_bounds ()
+{
+	uint32_t last_sample = samples_per_side () - 1;
+	float spacing = settings.world_size / static_cast<float> (last_sample);
+
+	// leaves scan the samples under them, including the ones on their edges
+	uint32_t leaves = nodes_per_side (0);
+	float leaf_size = get_node_size (0);
+	auto& leaf_bounds = bounds[0];
+	leaf_bounds.assign (static_cast<size_t> (leaves) * leaves * 2, 0.f);
+	for (uint32_t z = 0; z < leaves; z++)
+	{
+		uint32_t z0 = static_cast<uint32_t> (std::floor (z * leaf_size / spacing));
+		uint32_t z1 = std::min (static_cast<uint32_t> (std::ceil ((z + 1) * leaf_size / spacing)), last_sample);
+		for (uint32_t x = 0; x < leaves; x++)
+		{
+			uint32_t x0 = static_cast<uint32_t> (std::floor (x * leaf_size / spacing));
+			uint32_t x1 = std::min (static_cast<uint32_t> (std::ceil ((x + 1) * leaf_size / spacing)), last_sample);
+
+			float low = std::numeric_limits<float>::max ();
+			float high = std::numeric_limits<float>::lowest ();
+			for (uint32_t sx = x0; sx <= x1; sx++)
+				for (uint32_t sz = z0; sz <= z1; sz++)
+				{
+					float h = sample (sx, sz) * settings.height_scale;
+					low = std::min (low, h);
+					high = std::max (high, h);
+				}
+			size_t index = (static_cast<size_t> (z) * leaves + x) * 2;
+			leaf_bounds[index] = low;
+			leaf_bounds[index + 1] = high;
+		}
+	}
+
+	update_parent_bounds ();
+}
+
+void TerrainQuadtree::set_leaf_bounds (std::vector<float> const& min_max)
+{
+	uint32_t leaves = nodes_per_side (0);
+	if (min_max.size () != static_cast<size_t> (leaves) * leaves * 2)
+		throw std::runtime_error ("terrain leaf bounds are of the wrong size");
+	bounds[0] = min_max;
+	update_parent_bounds ();
+}
+
+void TerrainQuadtree::update_parent_bounds ()
+{
+	for (uint32_t lod = 1; lod < settings.lod_count; lod++)
+	{
+		uint32_t count = nodes_per_side (lod);
+		uint32_t child_count = count * 2;
+		auto const& children = bounds[lod - 1];
+		auto& level = bounds[lod];
+		level.assign (static_cast<size_t> (count) * count * 2, 0.f);
+		for (uint32_t z = 0; z < count; z++)
+			for (uint32_t x = 0; x < count; x++)
+			{
+				float low = std::numeric_limits<float>::max ();
+				float high = std::numeric_limits<float>::lowest ();
+				for (uint32_t q = 0; q < 4; q++)
+				{
+					size_t child = (static_cast<size_t> (z * 2 + (q >> 1)) * child_count + x * 2 + (q & 1)) * 2;
+					low = std::min (low, children[child]);
+					high = std::max (high, children[child + 1]);
+				}
+				size_t index = (static_cast<size_t> (z) * count + x) * 2;
+				level[index] = low;
+				level[index + 1] = high;
+			}
+	}
+}
+
+float TerrainQuadtree::get_range (uint32_t lod) const
+{
+	return settings.lod_0_range * static_cast<float> (1u << lod);
+}
+
+float TerrainQuadtree::get_node_size (uint32_t lod) const
+{
+	return settings.world_size / static_cast<float> (nodes_per_side (lod));
+}
+
+float TerrainQuadtree::get_height (float x, float z) const
+{
+	uint32_t last_sample = samples_per_side () - 1;
+	float spacing = settings.world_size / static_cast<float> (last_sample);
+	float fx = std::clamp ((x - settings.origin_x) / spacing, 0.f, static_cast<float> (last_sample));
+	float fz = std::clamp ((z - settings.origin_z) / spacing, 0.f, static_cast<float> (last_sample));
+
+	uint32_t x0 = std::min (static_cast<uint32_t> (fx), last_sample - 1);
+	uint32_t z0 = std::min (static_cast<uint32_t> (fz), last_sample - 1);
+	float tx = fx - static_cast<float> (x0);
+	float tz = fz - static_cast<float> (z0);
+
+	float h0 = sample (x0, z0) * (1.f - tx) + sample (x0 + 1, z0) * tx;
+	float h1 = sample (x0, z0 + 1) * (1.f - tx) + sample (x0 + 1, z0 + 1) * tx;
+	return (h0 * (1.f - tz) + h1 * tz) * settings.height_scale;
+}
+
+std::vector<float> TerrainQuadtree::get_occluder_heights (uint32_t max_nodes) const
+{
+	uint32_t lod = 0;
+	while (lod + 1 < settings.lod_count && nodes_per_side (lod) > max_nodes)
+		lod++;
+
+	uint32_t count = nodes_per_side (lod);
+	uint32_t corners = count + 1;
+	std::vector<float> heights (static_cast<size_t> (corners) * corners, std::numeric_limits<float>::max ());
+	for (uint32_t z = 0; z < count; z++)
+		for (uint32_t x = 0; x < count; x++)
+		{
+			float low = bounds[lod][(static_cast<size_t> (z) * count + x) * 2];
+			for (uint32_t q = 0; q < 4; q++)
+			{
+				float& corner = heights[static_cast<size_t> (z + (q >> 1)) * corners + x + (q & 1)];
+				corner = std::min (corner, low);
+			}
+		}
+	return heights;
+}
+
+TerrainSelectionStats TerrainQuadtree::select (cml::vec3f camera_pos,
+    Frustum const& frustum,
+    std::vector<TerrainPatch>& patches,
+    std::array<uint32_t, 4>& quadrant_counts) const
+{
+	TerrainSelectionStats stats;
+
+	auto node_box = [&] (StackNode node) {
+		float size = get_node_size (node.lod);
+		size_t index = (static_cast<size_t> (node.z) * nodes_per_side (node.lod) + node.x) * 2;
+		float x = settings.origin_x + node.x * size;
+		float z = settings.origin_z + node.z * size;
+		return Box{ x, bounds[node.lod][index], z, x + size, bounds[node.lod][index + 1], z + size };
+	};
+
+	// whole nodes set all four quadrant bits
+	struct Selected
+	{
+		TerrainPatch patch;
+		uint32_t quadrants;
+	};
+	std::vector<Selected> selected;
+	auto add = [&] (StackNode node, Box const& box, uint32_t quadrants) {
+		float range = get_range (node.lod);
+		float previous = node.lod == 0 ? 0.f : get_range (node.lod - 1);
+		float morph_start = previous + (range - previous) * settings.morph_start_ratio;
+
+		TerrainPatch patch;
+		patch.offset_size = cml::vec4f (box.min_x, box.min_z, box.max_x - box.min_x, static_cast<float> (node.lod));
+		patch.morph = cml::vec4f (morph_start, range, 0.f, 0.f);
+		selected.push_back (Selected{ patch, quadrants });
+
+		stats.selected_nodes++;
+		stats.nodes_per_lod[node.lod]++;
+	};
+
+	std::vector<StackNode> stack;
+	stack.push_back (StackNode{ 0, 0, settings.lod_count - 1 });
+	while (!stack.empty ())
+	{
+		StackNode node = stack.back ();
+		stack.pop_back ();
+		stats.visited_nodes++;
+
+		Box box = node_box (node);
+		if (!box_in_frustum (box, frustum))
+		{
+			stats.culled_nodes++;
+			continue;
+		}
+
+		float split_range = node.lod == 0 ? 0.f : get_range (node.lod - 1);
+		if (node.lod == 0 || !box_in_sphere_range (box, camera_pos, split_range))
+		{
+			add (node, box, 0xF);
+			continue;
+		}
+
+		// children within the finer range are selected on their own, the rest are drawn as
+		// quadrants of this node
+		uint32_t quadrants = 0;
+		for (uint32_t q = 0; q < 4; q++)
+		{
+			StackNode child{ node.x * 2 + (q & 1), node.z * 2 + (q >> 1), node.lod - 1 };
+			Box child_box = node_box (child);
+			if (box_in_sphere_range (child_box, camera_pos, split_range))
+				stack.push_back (child);
+			else if (box_in_frustum (child_box, frustum))
+				quadrants |= 1u << q;
+		}
+		if (quadrants != 0) add (node, box, quadrants);
+	}
+
+	patches.clear ();
+	for (uint32_t q = 0; q < 4; q++)
+	{
+		size_t start = patches.size ();
+		for (auto& entry : selected)
+			if (entry.quadrants & (1u << q)) patches.push_back (entry.patch);
+		quadrant_counts[q] = static_cast<uint32_t> (patches.size () - start);
+	}
+	stats.patch_count = static_cast<uint32_t> (patches.size ());
+	return stats;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "rendering/Culling.h"
+
+struct TerrainSettings
+{
+	float origin_x = -2048.f; // corner of the terrain, it covers origin to origin + world_size in x and z
+	float origin_z = -2048.f;
+	float world_size = 4096.f;
+	float height_scale = 200.f; // tile heights are multiplied by this
+
+	uint32_t lod_count = 8; // LOD 0 is the finest, the root node is lod_count - 1
+	uint32_t grid_resolution = 32; // quads along each side of the shared patch mesh, must be even
+	float lod_0_range = 96.f; // distance LOD 0 reaches, every level reaches twice as far as the last
+	float morph_start_ratio = 0.66f; // how far into its range band a level starts morphing to the next
+
+	uint32_t tile_count = 8; // heightmap tiles along each side
+	uint32_t tile_samples = 257; // per side, neighbouring tiles share their edge samples
+};
+
+// Matches TerrainPatch in terrain.vert (std430)
+struct TerrainPatch
+{
+	cml::vec4f offset_size; // x and z of the corner, world size, lod
+	cml::vec4f morph; // morph start and end distance, unused zw
+};
+
+struct TerrainSelectionStats
+{
+	static constexpr uint32_t MaxLods = 16;
+
+	uint32_t visited_nodes = 0;
+	uint32_t culled_nodes = 0;
+	uint32_t selected_nodes = 0; // nodes drawn whole or in part
+	uint32_t patch_count = 0; // quadrant draws, a whole node counts four
+	std::array<uint32_t, MaxLods> nodes_per_lod = {};
+};
+
+// Continuous distance LOD (CDLOD) quadtree over a tiled heightmap. The nodes are implicit, only
+// their height bounds are stored, level by level in flat arrays. Selection walks the tree with an
+// explicit stack: a node within the range of the next finer level is split, children out of that
+// range are drawn as quadrants of their parent so every patch of a level has the same vertex
+// spacing. Vertices morph towards the next coarser level over the last part of each range band,
+// so neighbouring levels meet without cracks or popping.
+class TerrainQuadtree
+{
+	public:
+	explicit TerrainQuadtree (TerrainSettings settings = {});
+
+	// tile_samples * tile_samples heights in x major order, like GraphUser's height map
+	void set_tile (uint32_t tile_x, uint32_t tile_z, std::vector<float> const& heights);
+	// rebuilds the node height bounds, call after the tiles changed
+	void update_bounds ();
+	// takes the min and max world height of every leaf node, in z then x order, for heights that
+	// were written on the GPU and never reached set_tile
+	void set_leaf_bounds (std::vector<float> const& min_max);
+	uint32_t leaf_count () const { return nodes_per_side (0); }
+
+	// Fills patches with the selected quadrants, grouped by quadrant (-x-z, +x-z, -x+z, +x+z),
+	// quadrant_counts tells how many patches each group has.
+	TerrainSelectionStats select (cml::vec3f camera_pos,
+	    Frustum const& frustum,
+	    std::vector<TerrainPatch>& patches,
+	    std::array<uint32_t, 4>& quadrant_counts) const;
+
+	// world space, bilinear between samples and clamped to the terrain
+	float get_height (float x, float z) const;
+	// corner heights of the finest level with at most max_nodes nodes per side, (n + 1)^2 of them
+	// in z then x order. Each corner takes the lowest node touching it, so a surface through them
+	// never rises above the terrain and can stand in for it as an occluder.
+	std::vector<float> get_occluder_heights (uint32_t max_nodes) const;
+
+	float get_range (uint32_t lod) const;
+	float get_node_size (uint32_t lod) const;
+	uint32_t samples_per_side () const { return settings.tile_count * (settings.tile_samples - 1) + 1; }
+
+	// every tile's samples, tile after tile in z then x order, unscaled
+	std::vector<float> const& get_heights () const { return heights; }
+	TerrainSettings const& get_settings () const { return settings; }
+
+	private:
+	TerrainSettings settings;
+	std::vector<float> heights;
+
+	// per level, nodes in z then x order, min and max world height interleaved
+	std::vector<std::vector<float>> bounds;
+
+	float sample (uint32_t x, uint32_t z) const;
+	void update_parent_bounds ();
+	uint32_t nodes_per_side (uint32_t lod) const { return 1u << (settings.lod_count - 1 - lod); }
+};
@@ -0,0 +1,63 @@
+#include "TerrainMaterial.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "core/JobSystem.h"
+
+#include "TerrainLOD.h"
+
+namespace
+{
+uint8_t to_unorm8 (float value)
+{
+	return static_cast<uint8_t> (std::lround (std::clamp (value, 0.f, 1.f) * 255.f));
+}
+
+float smoothstep (float edge_0, float edge_1, float x)
+{
+	float t = std::clamp ((x - edge_0) / (edge_1 - edge_0), 0.f, 1.f);
+	return t * t * (3.f - 2.f * t);
+}
+} // namespace
+
+uint32_t terrain_splat (cml::vec3f normal, float height)
+{
+	// grass on flat ground, rock on slopes, snow up high
+	float slope = 1.f - normal.y;
+	float rock = smoothstep (0.2f, 0.4f, slope);
+	float snow = smoothstep (120.f, 160.f, height) * (1.f - smoothstep (0.3f, 0.5f, slope));
+
+	float weights[4] = { (1.f - rock) * (1.f - snow), rock * (1.f - snow), snow, 0.f };
+	uint32_t texel = 0;
+	for (int i = 0; i < 4; i++)
+		texel |= static_cast<uint32_t> (to_unorm8 (weights[i])) << (8 * i);
+	return texel;
+}
+
+std::vector<uint32_t> compute_splat_map (job::ThreadPool& thread_pool, TerrainQuadtree const& quadtree)
+{
+	auto const& settings = quadtree.get_settings ();
+	uint32_t samples = quadtree.samples_per_side ();
+	float spacing = settings.world_size / static_cast<float> (samples - 1);
+
+	// rows write to separate ranges
+	std::vector<uint32_t> splat (static_cast<size_t> (samples) * samples);
+	job::parallel_for (thread_pool, samples, 16, [&] (size_t begin, size_t end) {
+		for (size_t z = begin; z < end; z++)
+		{
+			float world_z = settings.origin_z + static_cast<float> (z) * spacing;
+			for (uint32_t x = 0; x < samples; x++)
+			{
+				float world_x = settings.origin_x + static_cast<float> (x) * spacing;
+				float dx = quadtree.get_height (world_x + spacing, world_z) -
+				           quadtree.get_height (world_x - spacing, world_z);
+				float dz = quadtree.get_height (world_x, world_z + spacing) -
+				           quadtree.get_height (world_x, world_z - spacing);
+				cml::vec3f normal = cml::normalize (cml::vec3f (-dx, 2.f * spacing, -dz));
+				splat[z * samples + x] = terrain_splat (normal, quadtree.get_height (world_x, world_z));
+			}
+		}
+	});
+	return splat;
+}
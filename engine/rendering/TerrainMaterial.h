@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cml/cml.h"
+
+class TerrainQuadtree;
+namespace job
+{
+class ThreadPool;
+}
+
+// The terrain's surface blends four layers, grass, rock, snow and dirt, by the weights in a splat
+// map with one RGBA8 texel per height sample. Graphs run on the GPU write their own weights,
+// heights made on the CPU get the slope and height blend of terrain_splat. terrain_material.glsl
+// blends the layers by those weights, per pixel in terrain.frag and per page texel in
+// terrain_vt_composite.comp.
+
+// weights of the layers in r, g, b and a, packed like an RGBA8 texel
+uint32_t terrain_splat (cml::vec3f normal, float height);
+
+// A splat map for the quadtree's heights, samples_per_side texels along each side in z then x
+// order, the rows of the image.
+std::vector<uint32_t> compute_splat_map (job::ThreadPool& thread_pool, TerrainQuadtree const& quadtree);
@@ -1,5 +1,8 @@
 #include "ViewCamera.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "rendering/backend/Device.h"
 
 const cml::vec3f WorldUp = cml::vec3f::up;
@@ -47,10 +50,9 @@ cml::mat4f ViewCameraData::get_proj_mat ()
 
 cml::mat4f ViewCameraData::get_proj_view_mat ()
 {
-	if (proj_mat_dirty || view_mat_dirty)
-	{
-		mat_proj_view = get_proj_mat () * get_view_mat ();
-	}
+	// the getters clear the dirty flags, so checking them here missed changes if either getter
+	// had been called on its own
+	mat_proj_view = get_proj_mat () * get_view_mat ();
 	return mat_proj_view;
 }
 
@@ -100,10 +102,15 @@ void ViewCameraData::set_clip_far (float far)
 	clip_far = far;
 }
 
-RenderCameras::RenderCameras (VulkanDevice& device)
-: device (device), data_buffers (device, uniform_details (sizeof (CameraGPUData) * MaxCameraCount))
+RenderCameras::RenderCameras (VulkanDevice& device, uint32_t frame_count)
+: device (device)
 {
+	data_buffers.reserve (frame_count);
+	for (uint32_t i = 0; i < frame_count; i++)
+		data_buffers.emplace_back (device, uniform_details (sizeof (CameraGPUData) * MaxCameraCount));
 	camera_data.resize (MaxCameraCount);
+	camera_frustum.fill (-1);
+	stereo_partner.fill (-1);
 };
 
 ViewCameraID RenderCameras::create (CameraType type, cml::vec3f position, cml::quatf rotation)
@@ -127,6 +134,52 @@ void RenderCameras::remove (ViewCameraID id)
 	camera_data.at (id).is_active = false;
 }
 
+StereoCameras RenderCameras::create_stereo (CameraType type, cml::vec3f position, cml::quatf rotation)
+{
+	std::lock_guard lg (lock);
+	for (ViewCameraID i = static_cast<ViewCameraID> (camera_data.size ()) - 2; i >= 0; i--)
+	{
+		if (camera_data.at (i).is_active || camera_data.at (i + 1).is_active) continue;
+		for (ViewCameraID eye : { i, i + 1 })
+		{
+			camera_data.at (eye).is_active = true;
+			camera_data.at (eye).Setup (type, position, rotation);
+		}
+		stereo_partner.at (i) = i + 1;
+		stereo_partner.at (i + 1) = i;
+		return StereoCameras{ i, i + 1 };
+	}
+	return StereoCameras{};
+}
+void RenderCameras::remove_stereo (StereoCameras pair)
+{
+	std::lock_guard lg (lock);
+	for (ViewCameraID eye : { pair.left, pair.right })
+	{
+		camera_data.at (eye).is_active = false;
+		stereo_partner.at (eye) = -1;
+	}
+}
+
+void RenderCameras::set_stereo_pose (StereoCameras pair, ViewCameraData const& head, float eye_separation)
+{
+	std::lock_guard lg (lock);
+	// same right vector get_view_mat builds the view from
+	cml::vec3f right = cml::normalize (cml::cross (cml::vec3f::forward, WorldUp));
+	for (auto [eye, side] : { std::pair{ pair.left, -0.5f }, std::pair{ pair.right, 0.5f } })
+	{
+		auto& cam = camera_data.at (eye);
+		cam.type = head.type;
+		cam.set_fov (head.fov);
+		cam.set_aspect_ratio (head.aspect);
+		cam.set_view_size (head.size);
+		cam.set_clip_near (head.clip_near);
+		cam.set_clip_far (head.clip_far);
+		cam.set_rotation (head.rotation);
+		cam.set_position (head.position + right * (eye_separation * side));
+	}
+}
+
 
 ViewCameraData& RenderCameras::get_camera_data (ViewCameraID id)
 {
@@ -146,7 +199,7 @@ void RenderCameras::update_gpu_buffer (int index)
 	data.reserve (MaxCameraCount);
 	for (auto& cam : camera_data)
 	{
-		CameraGPUData gpu_cam;
+		CameraGPUData gpu_cam{};
 		gpu_cam.proj_view = cam.get_proj_view_mat ();
 		gpu_cam.view = cam.get_view_mat ();
 		gpu_cam.camera_pos = cam.get_position ();
@@ -155,7 +208,53 @@ void RenderCameras::update_gpu_buffer (int index)
 
 		data.push_back (gpu_cam);
 	}
-	data_buffers.Write ().copy_to_buffer (data);
+	data_buffers.at (index).copy_to_buffer (data);
+}
+
+void RenderCameras::cull (job::ThreadPool& pool, CullingBounds const& bounds)
+{
+	std::vector<Frustum> frustums;
+	{
+		std::lock_guard lg (lock);
+		for (uint32_t i = 0; i < MaxCameraCount; i++)
+		{
+			camera_frustum[i] = -1;
+			if (!camera_data[i].is_active) continue;
+			int partner = stereo_partner[i];
+			if (partner >= 0 && static_cast<uint32_t> (partner) < i)
+			{
+				// the first eye already culled for both
+				camera_frustum[i] = camera_frustum[partner];
+				continue;
+			}
+			camera_frustum[i] = static_cast<int> (frustums.size ());
+			cml::mat4f cull_mat = partner >= 0 ? stereo_cull_mat (i, partner) : camera_data[i].get_proj_view_mat ();
+			frustums.push_back (extract_frustum (cull_mat));
+		}
+	}
+	culler.cull (pool, bounds, frustums);
+}
+
+std::vector<uint32_t> const& RenderCameras::get_visible (ViewCameraID id) const
+{
+	int frustum = camera_frustum.at (id);
+	if (frustum < 0) return empty_visible;
+	return culler.get_visible (static_cast<uint32_t> (frustum));
+}
+
+void RenderCameras::occlusion_cull (
+    job::ThreadPool& pool, ViewCameraID id, OcclusionCuller const& occlusion, CullingBounds const& bounds)
+{
+	int frustum = camera_frustum.at (id);
+	if (frustum < 0) return;
+	occlusion.filter (pool, bounds, culler.get_visible (static_cast<uint32_t> (frustum)));
+}
+
+VkDescriptorBufferInfo RenderCameras::get_descriptor_info (int index, ViewCameraID id)
+{
+	// covers the cameras after id as well, so multiview passes can index them with gl_ViewIndex
+	uint32_t views = std::min (MaxViewCount, MaxCameraCount - static_cast<uint32_t> (id));
+	return data_buffers.at (index).get_descriptor_info (sizeof (CameraGPUData) * id, sizeof (CameraGPUData) * views);
 }
 
 void RenderCameras::setup_view_camera (ViewCameraID id, CameraType type, cml::vec3f position, cml::quatf rotation)
@@ -165,4 +264,27 @@ void RenderCameras::setup_view_camera (ViewCameraID id, CameraType type, cml::ve
 	camera_data.at (id).rotation = rotation;
 	camera_data.at (id).proj_mat_dirty = true;
 	camera_data.at (id).view_mat_dirty = true;
-}
\ No newline at end of file
+}
+
+cml::mat4f RenderCameras::stereo_cull_mat (ViewCameraID left, ViewCameraID right)
+{
+	ViewCameraData cull_cam = camera_data.at (left);
+	ViewCameraData const& right_cam = camera_data.at (right);
+	cml::vec3f center = (cull_cam.position + right_cam.position) * 0.5f;
+	float half_separation = cml::distance (cull_cam.position, right_cam.position) * 0.5f;
+	if (cull_cam.type == CameraType::perspective)
+	{
+		// moving the apex back until the side planes pass through both eyes' side planes keeps the
+		// eyes' fov and aspect, the clip planes move back with it
+		float back = half_separation / (cull_cam.aspect * std::tan (cull_cam.fov * 0.5f));
+		cull_cam.set_position (center - cml::vec3f::forward * back);
+		cull_cam.set_clip_near (cull_cam.clip_near + back);
+		cull_cam.set_clip_far (cull_cam.clip_far + back);
+	}
+	else
+	{
+		cull_cam.set_position (center);
+		cull_cam.set_view_size (cull_cam.size + half_separation);
+	}
+	return cull_cam.get_proj_view_mat ();
+}
@@ -5,9 +5,15 @@
 
 #include "cml/cml.h"
 
+#include "rendering/Culling.h"
+#include "rendering/OcclusionCulling.h"
 #include "rendering/backend/Buffer.h"
 
 class VulkanDevice;
+namespace job
+{
+class ThreadPool;
+}
 
 enum CameraType
 {
@@ -64,41 +70,80 @@ class ViewCameraData
 	bool is_active = false;
 };
 
+// matches CameraData in camera.glsl, padded so every camera starts on a valid uniform buffer offset
 struct CameraGPUData
 {
 	cml::mat4f proj_view;
 	cml::mat4f view;
 	cml::vec3f camera_dir;
+	float padding_0;
 	cml::vec3f camera_pos;
+	float padding_1;
+	float padding_2[24];
 };
+static_assert (sizeof (CameraGPUData) == 256, "must match the std140 layout of CameraData");
 
 using ViewCameraID = int;
 const uint32_t MaxCameraCount = 32;
+static_assert (MaxCameraCount <= FrustumCuller::MaxFrustums, "every camera needs a bit in the visibility masks");
+// cameras a camera.glsl binding covers, gl_ViewIndex picks one of them in multiview passes
+const uint32_t MaxViewCount = 2;
+
+// two adjacent cameras, so binding the left one lets the right eye's view read right after it
+struct StereoCameras
+{
+	ViewCameraID left = -1;
+	ViewCameraID right = -1;
+};
 class RenderCameras
 {
 	public:
-	RenderCameras (VulkanDevice& device);
+	RenderCameras (VulkanDevice& device, uint32_t frame_count);
 	RenderCameras (RenderCameras const& cam) = delete;
 	RenderCameras operator= (RenderCameras const& cam) = delete;
 
 	ViewCameraID create (CameraType type, cml::vec3f position, cml::quatf rotation);
 	void remove (ViewCameraID id);
 
+	// takes the highest free adjacent pair so single cameras keep the low ids, both are -1 when
+	// no pair is free
+	StereoCameras create_stereo (CameraType type, cml::vec3f position, cml::quatf rotation);
+	void remove_stereo (StereoCameras pair);
+	// places the eyes eye_separation apart around head and gives them its projection
+	void set_stereo_pose (StereoCameras pair, ViewCameraData const& head, float eye_separation);
+
 	ViewCameraData& get_camera_data (ViewCameraID id);
 	void set_camera_data (ViewCameraID id, ViewCameraData const& data);
 
+	// writes every camera into the frame's buffer
 	void update_gpu_buffer (int index);
 
+	// frustum culls bounds for every active camera at once, a stereo pair is tested once against
+	// a frustum enclosing both eyes' frustums
+	void cull (job::ThreadPool& pool, CullingBounds const& bounds);
+	// indices into the bounds passed to the last cull, empty for cameras that weren't active
+	std::vector<uint32_t> const& get_visible (ViewCameraID id) const;
+	// drops objects hidden behind the occluders rendered into occlusion from the camera's visible
+	// list, call after cull and before building draws from the list
+	void occlusion_cull (
+	    job::ThreadPool& pool, ViewCameraID id, OcclusionCuller const& occlusion, CullingBounds const& bounds);
+
 	VkDescriptorBufferInfo get_descriptor_info (int index, ViewCameraID id);
 	VkDescriptorType get_descriptor_type () { return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER; }
 
 	private:
 	void setup_view_camera (ViewCameraID id, CameraType type, cml::vec3f position, cml::quatf rotation);
+	cml::mat4f stereo_cull_mat (ViewCameraID left, ViewCameraID right);
 
 	ViewCameraID cur_id = 0;
 	std::mutex lock;
 	std::vector<ViewCameraData> camera_data;
 
 	VulkanDevice& device;
-	DoubleBuffer data_buffers;
+	std::vector<VulkanBuffer> data_buffers; // one per frame in flight
+
+	FrustumCuller culler;
+	std::array<int, MaxCameraCount> camera_frustum; // -1 when not culled
+	std::array<int, MaxCameraCount> stereo_partner; // the other eye, -1 when not part of a pair
+	std::vector<uint32_t> empty_visible;
 };
\ No newline at end of file
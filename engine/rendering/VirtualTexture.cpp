@@ -0,0 +1,107 @@
+#include "VirtualTexture.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+VirtualPageCache::VirtualPageCache (VirtualTextureSettings settings) : settings (settings)
+{
+	if (settings.level_count == 0 || settings.level_count > 12)
+		throw std::runtime_error ("Virtual texture level count has to be 1 to 12");
+	if (settings.page_texels < 4 || settings.atlas_pages == 0)
+		throw std::runtime_error ("Virtual texture pages need at least 4 texels and the atlas one page");
+
+	uint32_t total = 0;
+	for (uint32_t level = 0; level < settings.level_count; level++)
+	{
+		level_offsets.push_back (total);
+		total += pages_per_side (level) * pages_per_side (level);
+	}
+	page_table.resize (total, 0);
+	last_used.resize (total, 0);
+	slot_pages.resize (settings.atlas_pages * settings.atlas_pages, EmptySlot);
+}
+
+uint32_t VirtualPageCache::page_index (VirtualPage page) const
+{
+	return level_offsets.at (page.level) + page.z * pages_per_side (page.level) + page.x;
+}
+
+VirtualPage VirtualPageCache::get_page (uint32_t index) const
+{
+	// levels get smaller, so the page is in the last level starting at or before index
+	uint32_t level = static_cast<uint32_t> (
+	    std::upper_bound (std::begin (level_offsets), std::end (level_offsets), index) - std::begin (level_offsets) - 1);
+	uint32_t local = index - level_offsets[level];
+	return { level, local % pages_per_side (level), local / pages_per_side (level) };
+}
+
+void VirtualPageCache::mark_used (uint32_t page, uint64_t frame, std::vector<uint32_t>& requests)
+{
+	// walks up until a page this frame already reached, whose ancestors are marked too
+	VirtualPage current = get_page (page);
+	while (true)
+	{
+		uint32_t index = page_index (current);
+		if (last_used[index] == frame) return;
+		last_used[index] = frame;
+		if (page_table[index] == 0) requests.push_back (index);
+
+		if (current.level + 1 == settings.level_count) return;
+		current = { current.level + 1, current.x / 2, current.z / 2 };
+	}
+}
+
+std::vector<uint32_t> VirtualPageCache::gather_requests (uint32_t const* feedback, uint64_t frame)
+{
+	evicted = 0;
+	std::vector<uint32_t> requests;
+	mark_used (page_count () - 1, frame, requests);
+	for (uint32_t i = 0; i < page_count (); i++)
+		if (feedback[i] != 0) mark_used (i, frame, requests);
+
+	// higher indices are coarser levels
+	std::sort (std::begin (requests), std::end (requests), std::greater<uint32_t> ());
+	return requests;
+}
+
+std::optional<uint32_t> VirtualPageCache::place_page (uint32_t page, uint64_t frame)
+{
+	uint32_t slot = EmptySlot;
+	uint64_t oldest = frame;
+	for (uint32_t i = 0; i < slot_pages.size (); i++)
+	{
+		if (slot_pages[i] == EmptySlot)
+		{
+			slot = i;
+			break;
+		}
+		if (last_used[slot_pages[i]] < oldest)
+		{
+			oldest = last_used[slot_pages[i]];
+			slot = i;
+		}
+	}
+	if (slot == EmptySlot) return std::nullopt;
+
+	if (slot_pages[slot] != EmptySlot)
+	{
+		page_table[slot_pages[slot]] = 0;
+		resident--;
+		evicted++;
+	}
+	slot_pages[slot] = page;
+	page_table[page] = slot + 1;
+	last_used[page] = frame;
+	resident++;
+	return slot;
+}
+
+void VirtualPageCache::clear ()
+{
+	std::fill (std::begin (page_table), std::end (page_table), 0);
+	std::fill (std::begin (last_used), std::end (last_used), 0);
+	std::fill (std::begin (slot_pages), std::end (slot_pages), EmptySlot);
+	resident = 0;
+	evicted = 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+struct VirtualTextureSettings
+{
+	uint32_t level_count = 7; // level 0 is the finest, the last level is one page over everything
+	uint32_t page_texels = 128; // per side, including a one texel border on every edge for filtering
+	uint32_t atlas_pages = 16; // physical pages along each side of the atlas
+	uint32_t max_pages_per_frame = 8; // composited on the GPU before the frame's passes
+	float near_distance = 48.f; // closer than this the terrain still blends its layers per pixel
+};
+
+struct VirtualPage
+{
+	uint32_t level = 0;
+	uint32_t x = 0;
+	uint32_t z = 0;
+};
+
+struct VirtualTextureStats
+{
+	uint32_t resident_pages = 0;
+	uint32_t requested_pages = 0; // missing pages the last feedback asked for
+	uint32_t composited_pages = 0; // in the last frame
+	uint32_t evicted_pages = 0; // in the last frame
+};
+
+// Page table and physical page cache of a virtual texture. Every level is a grid of pages, half as
+// many along each side as the level below. Pages are indexed level after level, each in z then x
+// order, and the page table holds the physical slot of every resident page plus one, so zero means
+// not resident. Lookups fall back to the closest resident ancestor, so ancestors of every requested
+// page are requested as well and the root page is always kept.
+//
+// Frames report the pages they wanted through a feedback buffer with one flag per page. A slot is
+// only taken from a page the latest feedback didn't use, least recently used first. Frames are
+// counted from 1, 0 means never used.
+class VirtualPageCache
+{
+	public:
+	explicit VirtualPageCache (VirtualTextureSettings settings = {});
+
+	// Marks the pages a frame's feedback flagged, and their ancestors, as used in frame. Returns
+	// the ones that aren't resident, coarse levels first so distant terrain fills in before detail.
+	std::vector<uint32_t> gather_requests (uint32_t const* feedback, uint64_t frame);
+
+	// Gives page a physical slot and puts it in the page table: a free slot, else the slot of the
+	// page used the longest ago, which leaves the page table. Nothing when every slot was used in
+	// frame. The caller has to fill the slot before anything reads this frame's page table.
+	std::optional<uint32_t> place_page (uint32_t page, uint64_t frame);
+	void clear ();
+
+	uint32_t page_count () const { return static_cast<uint32_t> (page_table.size ()); }
+	uint32_t pages_per_side (uint32_t level) const { return 1u << (settings.level_count - 1 - level); }
+	uint32_t page_index (VirtualPage page) const;
+	VirtualPage get_page (uint32_t index) const;
+	bool is_resident (uint32_t page) const { return page_table.at (page) != 0; }
+
+	std::vector<uint32_t> const& get_page_table () const { return page_table; }
+	VirtualTextureSettings const& get_settings () const { return settings; }
+	uint32_t resident_count () const { return resident; }
+	uint32_t evicted_count () const { return evicted; } // since the last gather_requests
+
+	private:
+	static constexpr uint32_t EmptySlot = UINT32_MAX;
+
+	VirtualTextureSettings settings;
+	std::vector<uint32_t> level_offsets;
+	std::vector<uint32_t> page_table;
+	std::vector<uint64_t> last_used; // per page
+	std::vector<uint32_t> slot_pages; // per slot, EmptySlot when free
+	uint32_t resident = 0;
+	uint32_t evicted = 0;
+
+	void mark_used (uint32_t page, uint64_t frame, std::vector<uint32_t>& requests);
+};
@@ -3,13 +3,23 @@
 #include "core/Window.h"
 #include "resources/Resource.h"
 
-BackEnd::BackEnd (bool validationLayer, job::ThreadPool& thread_pool, Window& window, Resource::Resources& resource_man)
+BackEnd::BackEnd (bool validationLayer,
+    job::ThreadPool& thread_pool,
+    Window* window,
+    Resource::Resources& resource_man,
+    VkExtent2D headless_extent,
+    uint32_t headless_layers)
 : device (window, validationLayer),
-  vulkanSwapChain (device, window),
+  vulkanSwapChain (device, window, headless_extent, headless_layers),
   async_task_queue (thread_pool, device),
+  gpu_profiler (device, vulkanSwapChain.GetChainCount ()),
   shaders (resource_man.shaders, device.device),
-  pipeline_cache (device.device),
-  models (resource_man.meshes, device, async_task_queue),
-  textures (resource_man.textures, device, async_task_queue)
+  pipeline_cache (device.device, device.phys_device.properties),
+  pipeline_registry (device.device, pipeline_cache, shaders, thread_pool),
+  bindless (device, vulkanSwapChain.GetChainCount ()),
+  transient_descriptors (device.device, vulkanSwapChain.GetChainCount ()),
+  models (resource_man.meshes, device, async_task_queue, vulkanSwapChain.GetChainCount ()),
+  textures (resource_man.textures, device, async_task_queue, bindless),
+  materials (resource_man.materials, device, textures, bindless, vulkanSwapChain.GetChainCount ())
 {
 }
\ No newline at end of file
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "AsyncTask.h"
+#include "Bindless.h"
 #include "Buffer.h"
 #include "Descriptor.h"
 #include "Device.h"
 #include "FrameResources.h"
+#include "GPUProfiler.h"
+#include "Material.h"
 #include "Model.h"
 #include "Pipeline.h"
 #include "Shader.h"
@@ -22,13 +25,25 @@ class Resources;
 
 struct BackEnd
 {
-	BackEnd (bool validationLayer, job::ThreadPool& thread_pool, Window& window, Resource::Resources& resource_man);
+	// a null window runs headless, rendering into offscreen images of headless_extent with
+	// headless_layers layers
+	BackEnd (bool validationLayer,
+	    job::ThreadPool& thread_pool,
+	    Window* window,
+	    Resource::Resources& resource_man,
+	    VkExtent2D headless_extent = {},
+	    uint32_t headless_layers = 1);
 
 	VulkanDevice device;
 	VulkanSwapChain vulkanSwapChain;
 	AsyncTaskQueue async_task_queue;
+	GPUProfiler gpu_profiler;
 	Shaders shaders;
 	PipelineCache pipeline_cache;
+	PipelineRegistry pipeline_registry;
+	BindlessDescriptors bindless;
+	TransientDescriptorAllocator transient_descriptors;
 	Models models;
 	Textures textures;
+	Materials materials;
 };
\ No newline at end of file
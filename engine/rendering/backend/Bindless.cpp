@@ -0,0 +1,127 @@
+#include "Bindless.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "core/Logger.h"
+
+#include "Device.h"
+#include "RenderTools.h"
+#include "rendering/Initializers.h"
+
+BindlessDescriptors::BindlessDescriptors (VulkanDevice& device, uint32_t frame_count)
+: device (device), enabled (device.has_descriptor_indexing ()), retired_texture_indices (frame_count)
+{
+	if (!enabled) return;
+
+	// leave room for the non bindless sets sharing the stage limit
+	texture_count = std::min (MaxTextureCount, device.max_bindless_textures () / 2);
+
+	std::vector<VkDescriptorSetLayoutBinding> bindings = {
+		initializers::descriptor_set_layout_binding (
+		    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_ALL_GRAPHICS, TextureBinding, texture_count),
+		initializers::descriptor_set_layout_binding (
+		    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_ALL_GRAPHICS, MaterialBinding, 1)
+	};
+
+	// textures are written while earlier frames may still have the set bound
+	std::vector<VkDescriptorBindingFlagsEXT> binding_flags = {
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+	};
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_info{};
+	flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	flags_info.bindingCount = static_cast<uint32_t> (binding_flags.size ());
+	flags_info.pBindingFlags = binding_flags.data ();
+
+	auto layout_info = initializers::descriptor_set_layout_create_info (bindings);
+	layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layout_info.pNext = &flags_info;
+	VK_CHECK_RESULT (vkCreateDescriptorSetLayout (device.device, &layout_info, nullptr, &layout));
+
+	std::vector<VkDescriptorPoolSize> pool_sizes = {
+		initializers::descriptor_pool_size (VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, texture_count),
+		initializers::descriptor_pool_size (VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
+	};
+	auto pool_info = initializers::descriptor_pool_create_info (pool_sizes, 1);
+	pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	VK_CHECK_RESULT (vkCreateDescriptorPool (device.device, &pool_info, nullptr, &pool));
+
+	VkDescriptorSetAllocateInfo alloc_info{};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = pool;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &layout;
+	VK_CHECK_RESULT (vkAllocateDescriptorSets (device.device, &alloc_info, &set));
+
+	Log.debug ("Bindless descriptor set holds {} textures", texture_count);
+}
+
+BindlessDescriptors::~BindlessDescriptors ()
+{
+	if (!enabled) return;
+	vkDestroyDescriptorPool (device.device, pool, nullptr);
+	vkDestroyDescriptorSetLayout (device.device, layout, nullptr);
+}
+
+uint32_t BindlessDescriptors::allocate_texture_index ()
+{
+	std::lock_guard lg (lock);
+	if (!free_texture_indices.empty ())
+	{
+		uint32_t index = free_texture_indices.back ();
+		free_texture_indices.pop_back ();
+		return index;
+	}
+	if (next_texture_index >= texture_count)
+		throw std::runtime_error ("Ran out of bindless texture slots!");
+	return next_texture_index++;
+}
+
+void BindlessDescriptors::free_texture_index (uint32_t index)
+{
+	std::lock_guard lg (lock);
+	retired_texture_indices.retire (index);
+}
+
+void BindlessDescriptors::begin_frame (uint32_t frame_index)
+{
+	std::lock_guard lg (lock);
+	auto released = retired_texture_indices.begin_frame (frame_index);
+	free_texture_indices.insert (std::end (free_texture_indices), std::begin (released), std::end (released));
+}
+
+void BindlessDescriptors::write_texture (uint32_t index, VkDescriptorImageInfo const& info)
+{
+	if (!enabled) return;
+	std::lock_guard lg (lock);
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = set;
+	write.dstBinding = TextureBinding;
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.pImageInfo = &info;
+	vkUpdateDescriptorSets (device.device, 1, &write, 0, nullptr);
+}
+
+void BindlessDescriptors::write_material_buffer (VkDescriptorBufferInfo const& info)
+{
+	if (!enabled) return;
+	std::lock_guard lg (lock);
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = set;
+	write.dstBinding = MaterialBinding;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.pBufferInfo = &info;
+	vkUpdateDescriptorSets (device.device, 1, &write, 0, nullptr);
+}
+
+void BindlessDescriptors::bind (VkCommandBuffer cmdBuf, VkPipelineLayout pipe_layout, uint32_t location) const
+{
+	if (!enabled) return;
+	vkCmdBindDescriptorSets (cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe_layout, location, 1, &set, 0, nullptr);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "FrameResources.h"
+
+class VulkanDevice;
+
+// One descriptor set holding every 2D texture and the material buffer. Shaders index into it with
+// the material index of each draw, so draws don't bind a set per material.
+// Requires VK_EXT_descriptor_indexing, without it is_enabled () is false and every call is a no-op.
+class BindlessDescriptors
+{
+	public:
+	static constexpr uint32_t MaxTextureCount = 4096;
+	static constexpr uint32_t TextureBinding = 0;
+	static constexpr uint32_t MaterialBinding = 1;
+	// marks an unused texture slot of a material, matches NoTexture in common/bindless.glsl
+	static constexpr uint32_t NoTexture = 0xFFFFFFFF;
+
+	BindlessDescriptors (VulkanDevice& device, uint32_t frame_count);
+	~BindlessDescriptors ();
+
+	BindlessDescriptors (BindlessDescriptors const& other) = delete;
+	BindlessDescriptors& operator= (BindlessDescriptors const& other) = delete;
+
+	bool is_enabled () const { return enabled; }
+
+	// indices are stable for the lifetime of the texture
+	uint32_t allocate_texture_index ();
+	// the index is reused once the frames in flight have finished
+	void free_texture_index (uint32_t index);
+	// call once the frame's fence has signaled
+	void begin_frame (uint32_t frame_index);
+	void write_texture (uint32_t index, VkDescriptorImageInfo const& info);
+
+	void write_material_buffer (VkDescriptorBufferInfo const& info);
+
+	VkDescriptorSetLayout get_layout () const { return layout; }
+	void bind (VkCommandBuffer cmdBuf, VkPipelineLayout pipe_layout, uint32_t location) const;
+
+	private:
+	VulkanDevice& device;
+	bool enabled = false;
+	uint32_t texture_count = 0;
+
+	VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+
+	std::mutex lock; // descriptor writes to the same set must be externally synchronized
+	uint32_t next_texture_index = 0;
+	std::vector<uint32_t> free_texture_indices;
+	FrameDeferred<uint32_t> retired_texture_indices;
+};
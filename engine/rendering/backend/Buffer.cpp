@@ -3,6 +3,8 @@
 #include <cassert>
 #include <cstring>
 
+#include "core/MemoryTracker.h"
+
 #include "Device.h"
 #include "RenderTools.h"
 #include "rendering/Initializers.h"
@@ -10,6 +12,21 @@
 const uint32_t VERTEX_BUFFER_BIND_ID = 0;
 const uint32_t INSTANCE_BUFFER_BIND_ID = 1;
 
+MemoryTag buffer_memory_tag (BufferType type)
+{
+	switch (type)
+	{
+		case BufferType::uniform:
+		case BufferType::uniform_dynamic: return MemoryTag::uniform_buffer;
+		case BufferType::storage:
+		case BufferType::storage_dynamic: return MemoryTag::storage_buffer;
+		case BufferType::vertex: return MemoryTag::vertex_buffer;
+		case BufferType::index: return MemoryTag::index_buffer;
+		case BufferType::instance: return MemoryTag::instance_buffer;
+		default: return MemoryTag::staging_buffer;
+	}
+}
+
 VulkanBuffer::VulkanBuffer (VulkanDevice& device, BufCreateDetails details)
 {
 	data.device = &device;
@@ -42,6 +59,7 @@ VulkanBuffer::VulkanBuffer (VulkanDevice& device, BufCreateDetails details)
 
 	VK_CHECK_RESULT (vmaCreateBuffer (
 	    data.allocator, &bufferInfo, &allocInfo, &buffer, &data.allocation, &data.allocationInfo));
+	MemTracker.allocate (buffer_memory_tag (data.type), data.allocationInfo.size);
 
 	if (details.persistentlyMapped == true)
 	{
@@ -59,6 +77,7 @@ VulkanBuffer::~VulkanBuffer ()
 			unmap ();
 		}
 		vmaDestroyBuffer (data.allocator, buffer, data.allocation);
+		MemTracker.free (buffer_memory_tag (data.type), data.allocationInfo.size);
 	}
 }
 
@@ -84,7 +103,12 @@ VulkanBuffer& VulkanBuffer::operator= (VulkanBuffer&& other) noexcept
 	return *this;
 }
 
-void VulkanBuffer::map (void** pData) { vmaMapMemory (data.allocator, data.allocation, pData); }
+void VulkanBuffer::map (void** pData)
+{
+	vmaMapMemory (data.allocator, data.allocation, pData);
+	// GPU_TO_CPU memory may not be coherent, the device's writes only show up after an invalidate
+	invalidate ();
+}
 void VulkanBuffer::unmap () { vmaUnmapMemory (data.allocator, data.allocation); }
 
 void VulkanBuffer::flush ()
@@ -102,6 +126,8 @@ void VulkanBuffer::flush ()
 	}
 }
 
+void VulkanBuffer::invalidate () { vmaInvalidateAllocation (data.allocator, data.allocation, 0, VK_WHOLE_SIZE); }
+
 VkDeviceSize VulkanBuffer::size () const { return data.m_size; }
 
 void AlignedMemcpy (uint8_t bytes, VkDeviceSize destMemAlignment, void* src, void* dst)
@@ -116,18 +142,19 @@ void AlignedMemcpy (uint8_t bytes, VkDeviceSize destMemAlignment, void* src, voi
 	}
 }
 
-void VulkanBuffer::copy_to_buffer (void const* pData, size_t size)
+void VulkanBuffer::copy_to_buffer (void const* pData, size_t size, size_t offset)
 {
+	assert (offset + size <= data.m_size);
 	if (data.persistentlyMapped)
 	{
 		assert (data.mapped != nullptr);
-		memcpy (data.mapped, pData, size);
+		memcpy (static_cast<char*> (data.mapped) + offset, pData, size);
 	}
 	else
 	{
 		this->map (&data.mapped);
 		assert (data.mapped != nullptr);
-		memcpy (data.mapped, pData, size);
+		memcpy (static_cast<char*> (data.mapped) + offset, pData, size);
 		this->unmap ();
 	}
 }
@@ -62,6 +62,16 @@ inline BufCreateDetails uniform_dynamic_details (VkDeviceSize size)
 		VMA_ALLOCATION_CREATE_MAPPED_BIT,
 	};
 }
+inline BufCreateDetails storage_mapped_details (uint32_t elem_count, VkDeviceSize size_of_element)
+{
+	return BufCreateDetails{ BufferType::storage,
+		size_of_element,
+		(VkBufferUsageFlags) (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+		(VmaMemoryUsage) (VMA_MEMORY_USAGE_CPU_TO_GPU),
+		VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		elem_count,
+		true };
+}
 inline BufCreateDetails vertex_details (uint32_t elements, uint32_t element_size)
 {
 	return BufCreateDetails{ BufferType::vertex,
@@ -129,15 +139,18 @@ class VulkanBuffer
 	void unmap ();
 
 	void flush ();
+	// makes device writes visible to the host, map already does it, persistently mapped readers
+	// call it after the writing submission finished
+	void invalidate ();
 
-	template <typename T> void copy_to_buffer (std::vector<T> const& data)
+	template <typename T, typename Alloc> void copy_to_buffer (std::vector<T, Alloc> const& data, size_t offset = 0)
 	{
-		copy_to_buffer (static_cast<void const*> (data.data ()), sizeof (T) * data.size ());
+		copy_to_buffer (static_cast<void const*> (data.data ()), sizeof (T) * data.size (), offset);
 	}
 
-	template <typename T> void copy_to_buffer (T const& data)
+	template <typename T> void copy_to_buffer (T const& data, size_t offset = 0)
 	{
-		copy_to_buffer (static_cast<void const*> (&data), sizeof (T));
+		copy_to_buffer (static_cast<void const*> (&data), sizeof (T), offset);
 	}
 
 
@@ -159,7 +172,7 @@ class VulkanBuffer
 
 	details::BufData data;
 
-	void copy_to_buffer (void const* pData, size_t size);
+	void copy_to_buffer (void const* pData, size_t size, size_t offset);
 };
 
 class DoubleBuffer
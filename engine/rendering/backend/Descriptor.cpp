@@ -26,7 +26,7 @@ auto create_descriptor_layout (VkDevice device, std::vector<DescriptorSetLayoutB
 }
 
 DescriptorLayout::DescriptorLayout (VkDevice device, std::vector<DescriptorSetLayoutBinding> const& layout_bindings)
-: layout (create_descriptor_layout (device, layout_bindings))
+: layout (create_descriptor_layout (device, layout_bindings)), bindings (layout_bindings)
 {
 }
 
@@ -88,6 +88,42 @@ VkWriteDescriptorSet DescriptorUse::get_write_descriptor_set (VkDescriptorSet se
 	return writeDescriptorSet;
 }
 
+namespace
+{
+template <typename T> void append_bytes (std::string& key, T const& value)
+{
+	key.append (reinterpret_cast<char const*> (&value), sizeof (T));
+}
+template <typename T> void append_vector (std::string& key, std::vector<T> const& values)
+{
+	append_bytes (key, values.size ());
+	key.append (reinterpret_cast<char const*> (values.data ()), sizeof (T) * values.size ());
+}
+} // namespace
+
+void DescriptorUse::append_key (std::string& key) const
+{
+	append_bytes (key, bindPoint);
+	append_bytes (key, count);
+	append_bytes (key, type);
+	append_bytes (key, info_type);
+	if (info_type == InfoType::buffer)
+		append_vector (key, buffer_infos);
+	else if (info_type == InfoType::image)
+	{
+		// field by field, the struct has padding after imageLayout
+		append_bytes (key, image_infos.size ());
+		for (auto& info : image_infos)
+		{
+			append_bytes (key, info.sampler);
+			append_bytes (key, info.imageView);
+			append_bytes (key, info.imageLayout);
+		}
+	}
+	else if (info_type == InfoType::texel_view)
+		append_vector (key, texel_buffer_views);
+}
+
 //// DESCRIPTOR SET ////
 
 DescriptorSet::DescriptorSet (VkDescriptorSet set, uint16_t pool_id) : set (set), pool_id (pool_id)
@@ -107,9 +143,10 @@ void DescriptorSet::update (VkDevice device, std::vector<DescriptorUse> descript
 }
 
 
-void DescriptorSet::bind (VkCommandBuffer cmdBuf, VkPipelineLayout layout, uint32_t location) const
+void DescriptorSet::bind (
+    VkCommandBuffer cmdBuf, VkPipelineLayout layout, uint32_t location, VkPipelineBindPoint bind_point) const
 {
-	vkCmdBindDescriptorSets (cmdBuf, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, location, 1, &set, 0, nullptr);
+	vkCmdBindDescriptorSets (cmdBuf, bind_point, layout, location, 1, &set, 0, nullptr);
 }
 
 
@@ -235,19 +272,126 @@ DescriptorPool::OptDescSet DescriptorPool::TryAllocate (Pool& pool)
 
 //// DESCRIPTOR STACK ////
 
-DescriptorStack::DescriptorStack (DescriptorLayout const& layout) : layout (layout.get ()) {}
+DescriptorStack::DescriptorStack (DescriptorLayout const& layout)
+: layouts ({ layout.get () }), bindings ({ layout.get_bindings () })
+{
+}
 DescriptorStack::DescriptorStack (DescriptorLayout const& layout, DescriptorStack const& stack)
-: layout (layout.get ()), parent (&stack)
+: layouts (stack.layouts), bindings (stack.bindings)
 {
+	layouts.push_back (layout.get ());
+	bindings.push_back (layout.get_bindings ());
 }
 
-std::vector<VkDescriptorSetLayout> DescriptorStack::get_layouts () const
+
+//// TRANSIENT DESCRIPTOR ALLOCATOR ////
+
+namespace
 {
-	std::vector<VkDescriptorSetLayout> layouts;
-	if (parent)
+constexpr uint32_t transient_pool_max_sets = 256;
+const std::vector<VkDescriptorPoolSize> transient_pool_sizes = {
+	{ VK_DESCRIPTOR_TYPE_SAMPLER, 64 },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 512 },
+	{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 256 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 64 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 64 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 64 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 512 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 256 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 64 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 64 },
+	{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 64 }
+};
+} // namespace
+
+TransientDescriptorAllocator::TransientDescriptorAllocator (VkDevice device, uint32_t frame_count)
+: device (device), frames (frame_count)
+{
+}
+
+TransientDescriptorAllocator::~TransientDescriptorAllocator ()
+{
+	for (auto& frame : frames)
+		for (auto& pool : frame.pools)
+			vkDestroyDescriptorPool (device, pool, nullptr);
+}
+
+void TransientDescriptorAllocator::begin_frame (uint32_t frame_index)
+{
+	std::lock_guard lg (lock);
+	if (frame_index >= frames.size ()) frames.resize (frame_index + 1);
+	current_frame = frame_index;
+
+	auto& frame = frames.at (frame_index);
+	for (size_t i = 0; i < frame.pools.size () && i <= frame.current; i++)
+		vkResetDescriptorPool (device, frame.pools.at (i), 0);
+	frame.current = 0;
+	frame.write_cache.clear ();
+	hits = 0;
+	misses = 0;
+}
+
+DescriptorSet TransientDescriptorAllocator::allocate (VkDescriptorSetLayout layout, std::vector<DescriptorUse> const& writes)
+{
+	std::string key;
+	append_bytes (key, layout);
+	for (auto& write : writes)
+		write.append_key (key);
+
+	std::lock_guard lg (lock);
+	auto& frame = frames.at (current_frame);
+	auto it = frame.write_cache.find (key);
+	if (it != std::end (frame.write_cache))
 	{
-		layouts = parent->get_layouts ();
+		hits++;
+		return DescriptorSet (it->second, 0);
 	}
-	layouts.push_back (layout);
-	return layouts;
+	misses++;
+
+	auto set = DescriptorSet (allocate_set (frame, layout), 0);
+	set.update (device, writes);
+	frame.write_cache[key] = set.get_set ();
+	return set;
 }
+
+uint32_t TransientDescriptorAllocator::cache_hits () const
+{
+	std::lock_guard lg (lock);
+	return hits;
+}
+
+uint32_t TransientDescriptorAllocator::cache_misses () const
+{
+	std::lock_guard lg (lock);
+	return misses;
+}
+
+VkDescriptorPool TransientDescriptorAllocator::create_pool ()
+{
+	VkDescriptorPool pool;
+	auto poolInfo = initializers::descriptor_pool_create_info (transient_pool_sizes, transient_pool_max_sets);
+	if (vkCreateDescriptorPool (device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error ("failed to create transient descriptor pool!");
+	}
+	return pool;
+}
+
+VkDescriptorSet TransientDescriptorAllocator::allocate_set (FramePools& frame, VkDescriptorSetLayout layout)
+{
+	std::vector<VkDescriptorSetLayout> layouts = { layout };
+	while (true)
+	{
+		if (frame.current >= frame.pools.size ()) frame.pools.push_back (create_pool ());
+
+		VkDescriptorSet set;
+		auto allocInfo = initializers::descriptor_set_allocate_info (frame.pools.at (frame.current), layouts);
+		VkResult res = vkAllocateDescriptorSets (device, &allocInfo, &set);
+		if (res == VK_SUCCESS) return set;
+		if (res != VK_ERROR_FRAGMENTED_POOL && res != VK_ERROR_OUT_OF_POOL_MEMORY)
+			throw std::runtime_error ("failed to allocate transient descriptor set!");
+
+		// pool is full, move on to the next one and keep this one until the frame resets
+		frame.current++;
+	}
+}
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "RenderTools.h"
@@ -47,9 +50,11 @@ class DescriptorLayout
 	DescriptorLayout (VkDevice device, std::vector<DescriptorSetLayoutBinding> const& layout_bindings);
 
 	VkDescriptorSetLayout get () const;
+	std::vector<DescriptorSetLayoutBinding> const& get_bindings () const { return bindings; }
 
 	private:
 	VulkanHandle<VkDescriptorSetLayout, PFN_vkDestroyDescriptorSetLayout> layout;
+	std::vector<DescriptorSetLayoutBinding> bindings;
 };
 
 VkDescriptorSetLayout CreateVkDescriptorSetLayout (
@@ -81,6 +86,9 @@ class DescriptorUse
 
 	VkWriteDescriptorSet get_write_descriptor_set (VkDescriptorSet set);
 
+	// appends the bytes identifying this write, equal keys write identical descriptors
+	void append_key (std::string& key) const;
+
 	private:
 	uint32_t bindPoint;
 	uint32_t count;
@@ -104,7 +112,10 @@ class DescriptorSet
 
 	void update (VkDevice device, std::vector<DescriptorUse> descriptors) const;
 
-	void bind (VkCommandBuffer cmdBuf, VkPipelineLayout layout, uint32_t location) const;
+	void bind (VkCommandBuffer cmdBuf,
+	    VkPipelineLayout layout,
+	    uint32_t location,
+	    VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS) const;
 
 	VkDescriptorSet const& get_set () const { return set; }
 	uint16_t get_pool_id () const { return pool_id; }
@@ -155,15 +166,57 @@ class DescriptorPool
 	std::vector<Pool> pools;
 };
 
+// Copies the handles and bindings out of the layouts, so the stack stays valid when the objects
+// owning the layouts or the parent stack are moved
 class DescriptorStack
 {
 	public:
 	DescriptorStack (DescriptorLayout const& layout);
 	DescriptorStack (DescriptorLayout const& layout, DescriptorStack const& stack);
 
-	std::vector<VkDescriptorSetLayout> get_layouts () const;
+	std::vector<VkDescriptorSetLayout> const& get_layouts () const { return layouts; }
+	std::vector<std::vector<DescriptorSetLayoutBinding>> const& get_layout_bindings () const { return bindings; }
 
 	private:
-	VkDescriptorSetLayout layout;
-	DescriptorStack const* parent = nullptr;
+	std::vector<VkDescriptorSetLayout> layouts;
+	std::vector<std::vector<DescriptorSetLayoutBinding>> bindings;
+};
+
+// Hands out descriptor sets that live for a single frame. Sets are bump allocated from pools owned by
+// the frame and released all at once with vkResetDescriptorPool when the frame is reused, so
+// nothing is freed individually. Identical writes within a frame share a set.
+class TransientDescriptorAllocator
+{
+	public:
+	TransientDescriptorAllocator (VkDevice device, uint32_t frame_count);
+	~TransientDescriptorAllocator ();
+	TransientDescriptorAllocator (TransientDescriptorAllocator const& other) = delete;
+	TransientDescriptorAllocator& operator= (TransientDescriptorAllocator const& other) = delete;
+
+	// call once the frame's fence has signaled, the GPU no longer reads its sets
+	void begin_frame (uint32_t frame_index);
+
+	DescriptorSet allocate (VkDescriptorSetLayout layout, std::vector<DescriptorUse> const& writes);
+
+	// counts of the current frame
+	uint32_t cache_hits () const;
+	uint32_t cache_misses () const;
+
+	private:
+	struct FramePools
+	{
+		std::vector<VkDescriptorPool> pools;
+		size_t current = 0;
+		std::unordered_map<std::string, VkDescriptorSet> write_cache;
+	};
+
+	VkDescriptorPool create_pool ();
+	VkDescriptorSet allocate_set (FramePools& frame, VkDescriptorSetLayout layout);
+
+	VkDevice device;
+	mutable std::mutex lock;
+	std::vector<FramePools> frames;
+	uint32_t current_frame = 0;
+	uint32_t hits = 0;
+	uint32_t misses = 0;
 };
\ No newline at end of file
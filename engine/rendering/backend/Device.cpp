@@ -1,5 +1,6 @@
 #include "Device.h"
 
+#include <algorithm>
 #include <string>
 
 #include <GLFW/glfw3.h>
@@ -22,7 +23,7 @@ bool VMA_MemoryResource::create (
 	VkResult res = vmaCreateAllocator (&allocatorInfo, &allocator);
 	if (res != VK_SUCCESS)
 	{
-		Log.error (fmt::format ("Failed to create glfw window{}", errorString (res)));
+		Log.error ("Failed to create glfw window{}", errorString (res));
 		return false;
 	}
 	return true;
@@ -42,7 +43,7 @@ void VMA_MemoryResource::log (bool detailedOutput) const
 	std::string out_str (str);
 	vmaFreeStatsString (allocator, str);
 
-	Log.debug (fmt::format ("Allocator Data Dump:\n {}", out_str));
+	Log.debug ("Allocator Data Dump:\n {}", out_str);
 }
 
 //////// DebugCallback ////////
@@ -54,7 +55,7 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsCallback (VkDebugUtilsMessageSev
 {
 	auto ms = vkb::to_string_message_severity (messageSeverity);
 	auto mt = vkb::to_string_message_type (messageType);
-	Log.error (fmt::format ("{} {}:\n{}", ms, mt, pCallbackData->pMessage));
+	Log.error ("{} {}:\n{}", ms, mt, pCallbackData->pMessage);
 	return VK_FALSE;
 }
 
@@ -63,42 +64,72 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsCallback (VkDebugUtilsMessageSev
 VkPhysicalDeviceFeatures QueryDeviceFeatures ();
 
 
-VulkanDevice::VulkanDevice (Window& window, bool validationLayers)
-: enableValidationLayers (validationLayers), window (&window)
+VulkanDevice::VulkanDevice (Window* window, bool validationLayers)
+: enableValidationLayers (validationLayers), window (window)
 {
 	vkb::InstanceBuilder inst_builder;
-	auto inst_ret = inst_builder.request_validation_layers (validationLayers)
-	                    .set_app_name ("VulkanRenderer")
-	                    .set_debug_callback (debugUtilsCallback)
-	                    .build ();
+	inst_builder.request_validation_layers (validationLayers)
+	    .set_app_name ("VulkanRenderer")
+	    .desire_api_version (1, 1, 0)
+	    .set_debug_callback (debugUtilsCallback);
+	if (is_headless ()) inst_builder.set_headless ();
+	auto inst_ret = inst_builder.build ();
 	if (!inst_ret)
 	{
 		// TODO
-		Log.error (fmt::format ("Failed to create instance: {}", inst_ret.error ().message ()));
+		Log.error ("Failed to create instance: {}", inst_ret.error ().message ());
 	}
 	vkb_instance = inst_ret.value ();
 
-	bool surf_ret = create_surface (vkb_instance.instance, window);
-	if (!surf_ret)
+	if (!is_headless ())
 	{
-		Log.error (fmt::format ("Failed to create surface"));
+		bool surf_ret = create_surface (vkb_instance.instance, *window);
+		if (!surf_ret)
+		{
+			Log.error ("Failed to create surface");
+		}
 	}
 
 	vkb::PhysicalDeviceSelector selector (vkb_instance);
 	selector.set_required_features (QueryDeviceFeatures ());
-	auto phys_ret = selector.set_surface (surface).select ();
+	selector.add_desired_extension (VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+	selector.add_desired_extension (VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+	if (!is_headless ()) selector.set_surface (surface);
+	auto phys_ret = selector.select ();
 	if (!phys_ret)
 	{
 		// TODO
-		Log.error (fmt::format ("Failed to select physical device: {}", phys_ret.error ().message ()));
+		Log.error ("Failed to select physical device: {}", phys_ret.error ().message ());
 	}
 	phys_device = phys_ret.value ();
+
+	// optional features are turned on only when the device has them
+	VkPhysicalDeviceFeatures supported_features{};
+	vkGetPhysicalDeviceFeatures (phys_device.physical_device, &supported_features);
+	pipeline_statistics = supported_features.pipelineStatisticsQuery == VK_TRUE;
+	phys_device.features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+	fragment_stores = supported_features.fragmentStoresAndAtomics == VK_TRUE;
+	phys_device.features.fragmentStoresAndAtomics = supported_features.fragmentStoresAndAtomics;
+
 	vkb::DeviceBuilder dev_builder (phys_device);
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing_features{};
+	indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	descriptor_indexing = query_descriptor_indexing (indexing_features);
+	if (descriptor_indexing) dev_builder.add_pNext (&indexing_features);
+	Log.debug ("Descriptor indexing {}", descriptor_indexing ? "enabled" : "unavailable");
+
+	VkPhysicalDeviceMultiviewFeatures multiview_features{};
+	multiview_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+	multiview = query_multiview (multiview_features);
+	if (multiview) dev_builder.add_pNext (&multiview_features);
+	Log.debug ("Multiview {}", multiview ? "enabled" : "unavailable");
+
 	auto dev_ret = dev_builder.build ();
 	if (!dev_ret)
 	{
 		// TODO
-		Log.error (fmt::format ("Failed to create device: {}", dev_ret.error ().message ()));
+		Log.error ("Failed to create device: {}", dev_ret.error ().message ());
 	}
 	vkb_device = dev_ret.value ();
 	device = vkb_device.device;
@@ -125,14 +156,14 @@ bool VulkanDevice::create_surface (VkInstance instance, Window const& window)
 
 	if (res != VK_SUCCESS)
 	{
-		Log.error (fmt::format ("Failed to create glfw window{}", errorString (res)));
+		Log.error ("Failed to create glfw window{}", errorString (res));
 		return false;
 	}
 	return true;
 }
 void VulkanDevice::destroy_surface ()
 {
-	vkDestroySurfaceKHR (vkb_instance.instance, surface, nullptr);
+	if (surface != VK_NULL_HANDLE) vkDestroySurfaceKHR (vkb_instance.instance, surface, nullptr);
 }
 
 void VulkanDevice::LogMemory () const
@@ -142,6 +173,41 @@ void VulkanDevice::LogMemory () const
 	allocator_optimal_tiling.log ();
 }
 
+VkDeviceSize VulkanDevice::allocated_bytes () const
+{
+	VkDeviceSize total = 0;
+	for (auto allocator : { allocator_general.allocator, allocator_linear_tiling.allocator, allocator_optimal_tiling.allocator })
+	{
+		VmaStats stats{};
+		vmaCalculateStats (allocator, &stats);
+		total += stats.total.usedBytes;
+	}
+	return total;
+}
+
+std::vector<MemoryHeapStats> VulkanDevice::get_heap_stats () const
+{
+	const VkPhysicalDeviceMemoryProperties* mem_props = nullptr;
+	vmaGetMemoryProperties (allocator_general.allocator, &mem_props);
+
+	std::vector<MemoryHeapStats> heaps (mem_props->memoryHeapCount);
+	for (uint32_t i = 0; i < mem_props->memoryHeapCount; i++)
+		heaps[i].device_local = (mem_props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+	for (auto allocator : { allocator_general.allocator, allocator_linear_tiling.allocator, allocator_optimal_tiling.allocator })
+	{
+		VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+		vmaGetBudget (allocator, budgets);
+		for (uint32_t i = 0; i < mem_props->memoryHeapCount; i++)
+		{
+			heaps[i].block_bytes += budgets[i].blockBytes;
+			heaps[i].allocation_bytes += budgets[i].allocationBytes;
+			heaps[i].budget_bytes = budgets[i].budget;
+		}
+	}
+	return heaps;
+}
+
 // Put all device specific features here
 VkPhysicalDeviceFeatures QueryDeviceFeatures ()
 {
@@ -151,10 +217,90 @@ VkPhysicalDeviceFeatures QueryDeviceFeatures ()
 	deviceFeatures.geometryShader = VK_TRUE;
 	deviceFeatures.tessellationShader = VK_TRUE;
 	deviceFeatures.sampleRateShading = VK_TRUE;
+	deviceFeatures.multiDrawIndirect = VK_TRUE;
+	deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
 
 	return deviceFeatures;
 }
 
+// Only the features the bindless path relies on are turned on, the rest of the struct is cleared
+bool VulkanDevice::query_descriptor_indexing (VkPhysicalDeviceDescriptorIndexingFeaturesEXT& features)
+{
+	if (phys_device.properties.apiVersion < VK_API_VERSION_1_1) return false;
+
+	auto get_features2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2> (
+	    vkGetInstanceProcAddr (vkb_instance.instance, "vkGetPhysicalDeviceFeatures2"));
+	auto get_properties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2> (
+	    vkGetInstanceProcAddr (vkb_instance.instance, "vkGetPhysicalDeviceProperties2"));
+	if (get_features2 == nullptr || get_properties2 == nullptr) return false;
+
+	uint32_t ext_count = 0;
+	vkEnumerateDeviceExtensionProperties (phys_device.physical_device, nullptr, &ext_count, nullptr);
+	std::vector<VkExtensionProperties> extensions (ext_count);
+	vkEnumerateDeviceExtensionProperties (phys_device.physical_device, nullptr, &ext_count, extensions.data ());
+	bool has_ext = std::any_of (std::begin (extensions), std::end (extensions), [] (auto const& ext) {
+		return std::string (ext.extensionName) == VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME;
+	});
+	if (!has_ext) return false;
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported{};
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceFeatures2 features2{};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &supported;
+	get_features2 (phys_device.physical_device, &features2);
+
+	if (!supported.shaderSampledImageArrayNonUniformIndexing || !supported.descriptorBindingPartiallyBound ||
+	    !supported.descriptorBindingSampledImageUpdateAfterBind || !supported.runtimeDescriptorArray)
+		return false;
+
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing_props{};
+	indexing_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 props2{};
+	props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props2.pNext = &indexing_props;
+	get_properties2 (phys_device.physical_device, &props2);
+	max_update_after_bind_samplers = std::min (indexing_props.maxDescriptorSetUpdateAfterBindSampledImages,
+	    indexing_props.maxPerStageDescriptorUpdateAfterBindSampledImages);
+
+	features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	features.descriptorBindingPartiallyBound = VK_TRUE;
+	features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	features.runtimeDescriptorArray = VK_TRUE;
+	return true;
+}
+
+// Core in 1.1, only the base feature is turned on, not the geometry or tessellation variants
+bool VulkanDevice::query_multiview (VkPhysicalDeviceMultiviewFeatures& features)
+{
+	if (phys_device.properties.apiVersion < VK_API_VERSION_1_1) return false;
+
+	auto get_features2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2> (
+	    vkGetInstanceProcAddr (vkb_instance.instance, "vkGetPhysicalDeviceFeatures2"));
+	auto get_properties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2> (
+	    vkGetInstanceProcAddr (vkb_instance.instance, "vkGetPhysicalDeviceProperties2"));
+	if (get_features2 == nullptr || get_properties2 == nullptr) return false;
+
+	VkPhysicalDeviceMultiviewFeatures supported{};
+	supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+	VkPhysicalDeviceFeatures2 features2{};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &supported;
+	get_features2 (phys_device.physical_device, &features2);
+	if (!supported.multiview) return false;
+
+	VkPhysicalDeviceMultiviewProperties multiview_props{};
+	multiview_props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES;
+	VkPhysicalDeviceProperties2 props2{};
+	props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	props2.pNext = &multiview_props;
+	get_properties2 (phys_device.physical_device, &props2);
+	max_multiview_view_count = multiview_props.maxMultiviewViewCount;
+
+	features.multiview = VK_TRUE;
+	return true;
+}
+
 void VulkanDevice::create_queues ()
 {
 	auto g_queue_ret = vkb_device.get_queue_index (vkb::QueueType::graphics);
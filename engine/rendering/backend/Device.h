@@ -8,6 +8,8 @@
 #include "vk_mem_alloc.h"
 #include "VkBootstrap.h"
 
+#include "core/MemoryTracker.h"
+
 #include "Wrappers.h"
 
 
@@ -34,19 +36,37 @@ class VulkanDevice
 
 	public:
 	vkb::Instance vkb_instance;
-	VkSurfaceKHR surface;
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 	vkb::PhysicalDevice phys_device;
 
 	vkb::Device vkb_device;
 	VkDevice device;
 
-	VulkanDevice (Window& window, bool validationLayers = false);
+	// a null window creates a headless device, without a surface or present support
+	VulkanDevice (Window* window, bool validationLayers = false);
 
 	~VulkanDevice ();
 	bool has_dedicated_compute () const;
 	bool has_dedicated_transfer () const;
 
+	// VK_EXT_descriptor_indexing with the features needed for bindless texture arrays
+	bool has_descriptor_indexing () const { return descriptor_indexing; }
+	uint32_t max_bindless_textures () const { return max_update_after_bind_samplers; }
+
+	bool has_pipeline_statistics () const { return pipeline_statistics; }
+	// storage buffer writes from fragment shaders, the terrain virtual texture's feedback
+	bool has_fragment_stores () const { return fragment_stores; }
+
+	// Vulkan 1.1 multiview, one render pass draws into every layer of its attachments
+	bool has_multiview () const { return multiview; }
+	uint32_t max_multiview_views () const { return max_multiview_view_count; }
+
+	bool is_headless () const { return window == nullptr; }
+
 	void LogMemory () const;
+	VkDeviceSize allocated_bytes () const;
+	// summed over the allocators, budget is VMA's estimate for the heap
+	std::vector<MemoryHeapStats> get_heap_stats () const;
 
 	CommandQueue& graphics_queue () const;
 	CommandQueue& compute_queue () const;
@@ -73,6 +93,15 @@ class VulkanDevice
 	VMA_MemoryResource allocator_linear_tiling;
 	VMA_MemoryResource allocator_optimal_tiling;
 
+	bool descriptor_indexing = false;
+	uint32_t max_update_after_bind_samplers = 0;
+	bool pipeline_statistics = false;
+	bool fragment_stores = false;
+	bool multiview = false;
+	uint32_t max_multiview_view_count = 1;
+
+	bool query_descriptor_indexing (VkPhysicalDeviceDescriptorIndexingFeaturesEXT& features);
+	bool query_multiview (VkPhysicalDeviceMultiviewFeatures& features);
 	bool create_surface (VkInstance instance, Window const& window);
 	void destroy_surface ();
 	void create_queues ();
@@ -42,6 +42,11 @@ FrameObject& FrameObject::operator= (FrameObject&& fb) noexcept
 
 VkResult FrameObject::AcquireNextSwapchainImage ()
 {
+	if (swapchain->is_headless ())
+	{
+		swapChainIndex = swapchain->acquire_headless_image ();
+		return VK_SUCCESS;
+	}
 	return vkAcquireNextImageKHR (device->device,
 	    swapchain->get (),
 	    std::numeric_limits<uint64_t>::max (),
@@ -60,6 +65,13 @@ void FrameObject::submit ()
 {
 	primary_command_buffer.end ();
 
+	// nothing signals the acquire semaphore or waits on the finish one without a swapchain
+	if (swapchain->is_headless ())
+	{
+		primary_command_buffer.submit ({}, {}, stageMasks);
+		return;
+	}
+
 	std::vector<VkSemaphore> image_avail_sem;
 	image_avail_sem.push_back (imageAvailSem.get ());
 	std::vector<VkSemaphore> render_finish_sem;
@@ -70,6 +82,8 @@ void FrameObject::submit ()
 
 VkResult FrameObject::Present ()
 {
+	if (swapchain->is_headless ()) return VK_SUCCESS;
+
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	presentInfo.waitSemaphoreCount = 1;
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 
@@ -29,10 +31,12 @@ class FrameObject
 
 	VkCommandBuffer GetPrimaryCmdBuf ();
 
+	uint32_t get_image_index () const { return swapChainIndex; }
+
 	private:
 	VulkanDevice* device;
 	VulkanSwapChain* swapchain;
-	uint32_t swapChainIndex; // which frame to render to
+	uint32_t swapChainIndex = 0; // which frame to render to
 
 	VulkanSemaphore imageAvailSem;
 	VulkanSemaphore renderFinishSem;
@@ -41,4 +45,26 @@ class FrameObject
 	CommandBuffer primary_command_buffer;
 
 	VkPipelineStageFlags stageMasks = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+};
+
+// Holds on to values frames in flight may still use, such as descriptor indices. A value retired
+// while frame i is the current frame is handed back by the next begin_frame (i), which must only be
+// called once that frame's fence has signaled. Not thread safe, callers lock.
+template <typename T> class FrameDeferred
+{
+	public:
+	explicit FrameDeferred (uint32_t frame_count) : frames (frame_count) {}
+
+	void retire (T value) { frames.at (current_frame).push_back (std::move (value)); }
+
+	// returns the values no frame can be using anymore
+	std::vector<T> begin_frame (uint32_t frame_index)
+	{
+		current_frame = frame_index;
+		return std::exchange (frames.at (frame_index), {});
+	}
+
+	private:
+	std::vector<std::vector<T>> frames;
+	uint32_t current_frame = 0;
 };
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "GPUProfiler.h"
+
+#include "Device.h"
+
+// Results come back in bit order, matches the GPUPipelineStatistics fields
+const VkQueryPipelineStatisticFlags StatisticFlags = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+                                                     VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+                                                     VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+                                                     VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+                                                     VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+                                                     VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+const uint32_t StatisticCount = 6;
+
+auto create_query_pool (VkDevice device, VkQueryType type, uint32_t count, VkQueryPipelineStatisticFlags statistics)
+{
+	VkQueryPoolCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	info.queryType = type;
+	info.queryCount = count;
+	info.pipelineStatistics = statistics;
+
+	VkQueryPool pool;
+	VK_CHECK_RESULT (vkCreateQueryPool (device, &info, nullptr, &pool));
+	return VulkanHandle (device, pool, vkDestroyQueryPool);
+}
+
+GPUProfiler::GPUProfiler (VulkanDevice& device, uint32_t frame_count)
+: device (device.device),
+  timestamp_pool (device.device, VK_NULL_HANDLE, vkDestroyQueryPool),
+  statistics_pool (device.device, VK_NULL_HANDLE, vkDestroyQueryPool),
+  frames (frame_count)
+{
+	uint32_t family_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties (device.phys_device.physical_device, &family_count, nullptr);
+	std::vector<VkQueueFamilyProperties> families (family_count);
+	vkGetPhysicalDeviceQueueFamilyProperties (device.phys_device.physical_device, &family_count, families.data ());
+
+	uint32_t valid_bits = families.at (device.graphics_queue ().queue_family ()).timestampValidBits;
+	timestamps_supported = valid_bits > 0;
+	timestamp_mask = valid_bits >= 64 ? ~0ULL : (1ULL << valid_bits) - 1;
+	timestamp_period_ns = device.phys_device.properties.limits.timestampPeriod;
+
+	if (timestamps_supported)
+		timestamp_pool = create_query_pool (
+		    device.device, VK_QUERY_TYPE_TIMESTAMP, frame_count * MaxScopesPerFrame * 2, 0);
+	else
+		Log.debug ("Graphics queue doesn't support timestamps, GPU profiling disabled");
+
+	statistics_supported = timestamps_supported && device.has_pipeline_statistics ();
+	if (statistics_supported)
+		statistics_pool = create_query_pool (
+		    device.device, VK_QUERY_TYPE_PIPELINE_STATISTICS, frame_count * MaxScopesPerFrame, StatisticFlags);
+}
+
+void GPUProfiler::begin_frame (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	if (!timestamps_supported) return;
+
+	current_frame = frame_index;
+	resolve (frame_index);
+
+	frames.at (frame_index).scopes.clear ();
+	open_scopes.clear ();
+
+	vkCmdResetQueryPool (cmdBuf, timestamp_pool.handle, frame_index * MaxScopesPerFrame * 2, MaxScopesPerFrame * 2);
+	if (statistics_supported)
+		vkCmdResetQueryPool (cmdBuf, statistics_pool.handle, frame_index * MaxScopesPerFrame, MaxScopesPerFrame);
+}
+
+void GPUProfiler::begin_scope (VkCommandBuffer cmdBuf, std::string const& name, bool with_statistics)
+{
+	if (!timestamps_supported) return;
+
+	auto& frame = frames.at (current_frame);
+	uint32_t index = static_cast<uint32_t> (frame.scopes.size ());
+	if (index >= MaxScopesPerFrame)
+	{
+		// keep begin/end balanced, the scope just isn't recorded
+		open_scopes.push_back (MaxScopesPerFrame);
+		return;
+	}
+
+	bool statistics = with_statistics && statistics_supported;
+	frame.scopes.push_back (Scope{ name, static_cast<uint32_t> (open_scopes.size ()), statistics });
+	open_scopes.push_back (index);
+
+	uint32_t base = current_frame * MaxScopesPerFrame;
+	vkCmdWriteTimestamp (cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_pool.handle, (base + index) * 2);
+	if (statistics) vkCmdBeginQuery (cmdBuf, statistics_pool.handle, base + index, 0);
+}
+
+void GPUProfiler::end_scope (VkCommandBuffer cmdBuf)
+{
+	if (!timestamps_supported || open_scopes.empty ()) return;
+
+	uint32_t index = open_scopes.back ();
+	open_scopes.pop_back ();
+	if (index >= MaxScopesPerFrame) return;
+
+	uint32_t base = current_frame * MaxScopesPerFrame;
+	if (frames.at (current_frame).scopes.at (index).has_statistics)
+		vkCmdEndQuery (cmdBuf, statistics_pool.handle, base + index);
+	vkCmdWriteTimestamp (cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_pool.handle, (base + index) * 2 + 1);
+}
+
+void GPUProfiler::resolve (uint32_t frame_index)
+{
+	auto& frame = frames.at (frame_index);
+	if (frame.scopes.empty ()) return;
+
+	uint32_t scope_count = static_cast<uint32_t> (frame.scopes.size ());
+	uint32_t base = frame_index * MaxScopesPerFrame;
+
+	// no WAIT flag, the frame's fence was already waited on so this never stalls
+	std::vector<uint64_t> timestamps (scope_count * 2);
+	VkResult res = vkGetQueryPoolResults (device,
+	    timestamp_pool.handle,
+	    base * 2,
+	    scope_count * 2,
+	    timestamps.size () * sizeof (uint64_t),
+	    timestamps.data (),
+	    sizeof (uint64_t),
+	    VK_QUERY_RESULT_64_BIT);
+	if (res != VK_SUCCESS) return;
+
+	std::vector<uint64_t> statistics;
+	if (statistics_supported)
+	{
+		statistics.resize (scope_count * StatisticCount);
+		for (uint32_t i = 0; i < scope_count; i++)
+		{
+			if (!frame.scopes.at (i).has_statistics) continue;
+			res = vkGetQueryPoolResults (device,
+			    statistics_pool.handle,
+			    base + i,
+			    1,
+			    StatisticCount * sizeof (uint64_t),
+			    statistics.data () + i * StatisticCount,
+			    StatisticCount * sizeof (uint64_t),
+			    VK_QUERY_RESULT_64_BIT);
+			// keeps the previous results like the timestamps do
+			if (res != VK_SUCCESS) return;
+		}
+	}
+
+	results.clear ();
+	for (uint32_t i = 0; i < scope_count; i++)
+	{
+		auto& scope = frame.scopes.at (i);
+		uint64_t ticks = ((timestamps.at (i * 2 + 1) & timestamp_mask) - (timestamps.at (i * 2) & timestamp_mask)) & timestamp_mask;
+
+		GPUScopeTiming timing{ scope.name, scope.depth, static_cast<double> (ticks) * timestamp_period_ns / 1e6, {} };
+		if (scope.has_statistics)
+		{
+			uint64_t* s = statistics.data () + i * StatisticCount;
+			timing.statistics = GPUPipelineStatistics{ s[0], s[1], s[2], s[3], s[4], s[5] };
+		}
+		results.push_back (timing);
+	}
+}
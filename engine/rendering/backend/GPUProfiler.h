@@ -0,0 +1,98 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "RenderTools.h"
+
+class VulkanDevice;
+
+struct GPUPipelineStatistics
+{
+	uint64_t input_assembly_vertices = 0;
+	uint64_t input_assembly_primitives = 0;
+	uint64_t vertex_shader_invocations = 0;
+	uint64_t clipping_primitives = 0;
+	uint64_t fragment_shader_invocations = 0;
+	uint64_t compute_shader_invocations = 0;
+};
+
+struct GPUScopeTiming
+{
+	std::string name;
+	uint32_t depth;
+	double ms;
+	std::optional<GPUPipelineStatistics> statistics;
+};
+
+// Brackets GPU work with timestamp queries. Each frame in flight owns a slice of the query pools,
+// which is read back when the slot is reused so the results are never waited on.
+class GPUProfiler
+{
+	public:
+	static constexpr uint32_t MaxScopesPerFrame = 64;
+
+	GPUProfiler (VulkanDevice& device, uint32_t frame_count);
+
+	bool is_supported () const { return timestamps_supported; }
+
+	// the slot's previous fence must have been waited on
+	void begin_frame (VkCommandBuffer cmdBuf, uint32_t frame_index);
+
+	// pipeline statistics queries can't nest, so only request them for outermost scopes
+	void begin_scope (VkCommandBuffer cmdBuf, std::string const& name, bool with_statistics = false);
+	void end_scope (VkCommandBuffer cmdBuf);
+
+	// results of the most recently resolved frame
+	std::vector<GPUScopeTiming> const& get_results () const { return results; }
+
+	private:
+	struct Scope
+	{
+		std::string name;
+		uint32_t depth;
+		bool has_statistics;
+	};
+	struct FrameScopes
+	{
+		std::vector<Scope> scopes;
+	};
+
+	void resolve (uint32_t frame_index);
+
+	VkDevice device;
+	bool timestamps_supported = false;
+	bool statistics_supported = false;
+	double timestamp_period_ns = 1.0;
+	uint64_t timestamp_mask = ~0ULL;
+
+	VulkanHandle<VkQueryPool, PFN_vkDestroyQueryPool> timestamp_pool;
+	VulkanHandle<VkQueryPool, PFN_vkDestroyQueryPool> statistics_pool;
+
+	uint32_t current_frame = 0;
+	std::vector<FrameScopes> frames;
+	std::vector<uint32_t> open_scopes;
+	std::vector<GPUScopeTiming> results;
+};
+
+// Closes the scope when it leaves, for recording code with early returns
+class GPUProfileScope
+{
+	public:
+	GPUProfileScope (GPUProfiler& profiler, VkCommandBuffer cmdBuf, std::string const& name, bool with_statistics = false)
+	: profiler (profiler), cmdBuf (cmdBuf)
+	{
+		profiler.begin_scope (cmdBuf, name, with_statistics);
+	}
+	~GPUProfileScope () { profiler.end_scope (cmdBuf); }
+
+	GPUProfileScope (GPUProfileScope const&) = delete;
+	GPUProfileScope& operator= (GPUProfileScope const&) = delete;
+
+	private:
+	GPUProfiler& profiler;
+	VkCommandBuffer cmdBuf;
+};
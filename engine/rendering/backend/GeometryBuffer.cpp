@@ -0,0 +1,109 @@
+#include "GeometryBuffer.h"
+
+#include <numeric>
+
+#include "Device.h"
+
+//// FREE LIST ALLOCATOR ////
+
+FreeListAllocator::FreeListAllocator (VkDeviceSize size) : total_size (size) { free_blocks[0] = size; }
+
+std::optional<VkDeviceSize> FreeListAllocator::allocate (VkDeviceSize size, VkDeviceSize alignment)
+{
+	if (size == 0) return {};
+	if (alignment == 0) alignment = 1;
+	for (auto it = std::begin (free_blocks); it != std::end (free_blocks); it++)
+	{
+		auto [block_offset, block_size] = *it;
+		VkDeviceSize aligned = ((block_offset + alignment - 1) / alignment) * alignment;
+		VkDeviceSize padding = aligned - block_offset;
+		if (padding + size > block_size) continue;
+
+		free_blocks.erase (it);
+		// padding in front stays free, as does whatever is left after the allocation
+		if (padding > 0) free_blocks[block_offset] = padding;
+		if (padding + size < block_size) free_blocks[aligned + size] = block_size - padding - size;
+		return aligned;
+	}
+	return {};
+}
+
+void FreeListAllocator::free (VkDeviceSize offset, VkDeviceSize size)
+{
+	auto next = free_blocks.lower_bound (offset);
+	if (next != std::end (free_blocks) && offset + size == next->first)
+	{
+		size += next->second;
+		next = free_blocks.erase (next);
+	}
+	if (next != std::begin (free_blocks))
+	{
+		auto prev = std::prev (next);
+		if (prev->first + prev->second == offset)
+		{
+			prev->second += size;
+			return;
+		}
+	}
+	free_blocks[offset] = size;
+}
+
+VkDeviceSize FreeListAllocator::free_space () const
+{
+	return std::accumulate (std::begin (free_blocks), std::end (free_blocks), VkDeviceSize (0), [] (auto sum, auto const& block) {
+		return sum + block.second;
+	});
+}
+
+//// GEOMETRY BUFFER ////
+
+GeometryBuffer::GeometryBuffer (VulkanDevice& device, VkDeviceSize vertex_capacity, VkDeviceSize index_capacity)
+: vertices (device,
+      BufCreateDetails{ BufferType::vertex,
+          vertex_capacity,
+          (VkBufferUsageFlags) (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+          VMA_MEMORY_USAGE_GPU_ONLY }),
+  indices (device,
+      BufCreateDetails{ BufferType::index,
+          index_capacity,
+          (VkBufferUsageFlags) (VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+          VMA_MEMORY_USAGE_GPU_ONLY }),
+  vertex_allocator (vertex_capacity),
+  index_allocator (index_capacity)
+{
+}
+
+std::optional<GeometryAllocation> GeometryBuffer::allocate_vertices (VkDeviceSize size, VkDeviceSize stride)
+{
+	std::lock_guard lg (lock);
+	auto offset = vertex_allocator.allocate (size, stride);
+	if (!offset) return {};
+	return GeometryAllocation{ offset.value (), size };
+}
+
+std::optional<GeometryAllocation> GeometryBuffer::allocate_indices (uint32_t index_count)
+{
+	std::lock_guard lg (lock);
+	VkDeviceSize size = index_count * sizeof (uint32_t);
+	auto offset = index_allocator.allocate (size, sizeof (uint32_t));
+	if (!offset) return {};
+	return GeometryAllocation{ offset.value (), size };
+}
+
+void GeometryBuffer::free_vertices (GeometryAllocation const& alloc)
+{
+	std::lock_guard lg (lock);
+	vertex_allocator.free (alloc.offset, alloc.size);
+}
+
+void GeometryBuffer::free_indices (GeometryAllocation const& alloc)
+{
+	std::lock_guard lg (lock);
+	index_allocator.free (alloc.offset, alloc.size);
+}
+
+void GeometryBuffer::bind (VkCommandBuffer cmdBuf)
+{
+	vertices.bind_vertex_buffer (cmdBuf);
+	indices.bind_index_buffer (cmdBuf);
+}
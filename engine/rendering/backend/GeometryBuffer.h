@@ -0,0 +1,67 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <optional>
+
+#include <vulkan/vulkan.h>
+
+#include "Buffer.h"
+
+class VulkanDevice;
+
+// First fit allocator over a range of bytes, free blocks are kept sorted by offset so
+// neighbours coalesce when freed.
+class FreeListAllocator
+{
+	public:
+	FreeListAllocator (VkDeviceSize size);
+
+	// offset is a multiple of alignment, which doesn't need to be a power of two (vertex strides)
+	std::optional<VkDeviceSize> allocate (VkDeviceSize size, VkDeviceSize alignment);
+	void free (VkDeviceSize offset, VkDeviceSize size);
+
+	VkDeviceSize capacity () const { return total_size; }
+	VkDeviceSize free_space () const;
+
+	private:
+	VkDeviceSize total_size;
+	std::map<VkDeviceSize, VkDeviceSize> free_blocks; // offset -> size
+};
+
+struct GeometryAllocation
+{
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+};
+
+// One vertex and one index buffer that every model is suballocated from, so models share a
+// single bind and can be drawn with indirect commands.
+class GeometryBuffer
+{
+	public:
+	static constexpr VkDeviceSize DefaultVertexCapacity = 128 * 1024 * 1024;
+	static constexpr VkDeviceSize DefaultIndexCapacity = 32 * 1024 * 1024;
+
+	GeometryBuffer (VulkanDevice& device,
+	    VkDeviceSize vertex_capacity = DefaultVertexCapacity,
+	    VkDeviceSize index_capacity = DefaultIndexCapacity);
+
+	// vertex allocations are aligned to the stride so the offset can be used as vertexOffset
+	std::optional<GeometryAllocation> allocate_vertices (VkDeviceSize size, VkDeviceSize stride);
+	std::optional<GeometryAllocation> allocate_indices (uint32_t index_count);
+	void free_vertices (GeometryAllocation const& alloc);
+	void free_indices (GeometryAllocation const& alloc);
+
+	void bind (VkCommandBuffer cmdBuf);
+
+	VkBuffer vertex_buffer () const { return vertices.get (); }
+	VkBuffer index_buffer () const { return indices.get (); }
+
+	private:
+	std::mutex lock;
+	VulkanBuffer vertices;
+	VulkanBuffer indices;
+	FreeListAllocator vertex_allocator;
+	FreeListAllocator index_allocator;
+};
@@ -1,5 +1,13 @@
 #include "Material.h"
 
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "core/Logger.h"
+
+#include "Bindless.h"
 #include "Device.h"
 
 MatOutlineID Materials::create_material_outline (Resource::Material::MaterialOutline const& outline)
@@ -25,4 +33,94 @@ MatInstanceID Materials::create_material_instance (
 
 //// MATERIALS ////
 
-Materials::Materials (Resource::Material::Materials& materials, VulkanDevice& device) {}
\ No newline at end of file
+Materials::Materials (Resource::Material::Materials& materials,
+    VulkanDevice& device,
+    Textures& textures,
+    BindlessDescriptors& bindless,
+    uint32_t frame_count)
+: device (device), textures (textures), bindless (bindless), retired_material_indices (frame_count)
+{
+	if (bindless.is_enabled ())
+	{
+		material_buffer = std::make_unique<VulkanBuffer> (
+		    device, storage_mapped_details (MaxBindlessMaterials, sizeof (MaterialGPUData)));
+		bindless.write_material_buffer (material_buffer->get_descriptor_info ());
+
+		using Resource::Material::DataMember;
+		update_bindless_material (
+		    DefaultMaterial, { DataMember{ cml::vec3f (0.8f, 0.8f, 0.8f) }, DataMember{ 0.5f }, DataMember{ 0.0f } }, {});
+	}
+}
+
+bool Materials::uses_bindless () const { return material_buffer != nullptr; }
+
+std::optional<BindlessMaterialIndex> Materials::create_bindless_material (
+    std::vector<Resource::Material::DataMember> const& data_members, std::vector<VulkanTextureID> const& textures)
+{
+	if (!uses_bindless ()) return {};
+
+	BindlessMaterialIndex index;
+	{
+		std::lock_guard lg (index_lock);
+		if (!free_material_indices.empty ())
+		{
+			index = free_material_indices.back ();
+			free_material_indices.pop_back ();
+		}
+		else
+		{
+			if (next_material_index >= MaxBindlessMaterials)
+				throw std::runtime_error ("Ran out of bindless material slots!");
+			index = next_material_index++;
+		}
+	}
+	update_bindless_material (index, data_members, textures);
+	return index;
+}
+
+void Materials::update_bindless_material (BindlessMaterialIndex index,
+    std::vector<Resource::Material::DataMember> const& data_members,
+    std::vector<VulkanTextureID> const& textures)
+{
+	if (!uses_bindless ()) return;
+	if (data_members.size () > MaxMaterialDataMembers || textures.size () > MaxMaterialTextures)
+	{
+		Log.error ("Material has more members than the bindless layout allows, extra are dropped");
+	}
+
+	MaterialGPUData gpu_data{};
+	std::fill (std::begin (gpu_data.textures), std::end (gpu_data.textures), BindlessDescriptors::NoTexture);
+	for (size_t i = 0; i < data_members.size () && i < MaxMaterialDataMembers; i++)
+	{
+		std::visit (
+		    [&] (auto const& value) {
+			    using T = std::decay_t<decltype (value)>;
+			    if constexpr (std::is_same_v<T, bool>)
+				    gpu_data.data[i][0] = value ? 1 : 0;
+			    else
+				    std::memcpy (gpu_data.data[i], &value, sizeof (T));
+		    },
+		    data_members.at (i).data);
+	}
+	for (size_t i = 0; i < textures.size () && i < MaxMaterialTextures; i++)
+	{
+		gpu_data.textures[i] = this->textures.get_bindless_index (textures.at (i)).value_or (BindlessDescriptors::NoTexture);
+	}
+
+	// updates land in the next frame, a frame in flight may briefly see the new values
+	material_buffer->copy_to_buffer (gpu_data, index * sizeof (MaterialGPUData));
+}
+
+void Materials::destroy_bindless_material (BindlessMaterialIndex index)
+{
+	if (index == DefaultMaterial) return;
+	std::lock_guard lg (index_lock);
+	retired_material_indices.retire (index);
+}
+
+void Materials::begin_frame (uint32_t frame_index)
+{
+	std::lock_guard lg (index_lock);
+	auto released = retired_material_indices.begin_frame (frame_index);
+	free_material_indices.insert (std::end (free_material_indices), std::begin (released), std::end (released));
+}
\ No newline at end of file
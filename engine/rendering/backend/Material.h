@@ -1,12 +1,19 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <optional>
+
 #include "resources/Material.h"
 
 #include "Descriptor.h"
+#include "FrameResources.h"
+#include "Texture.h"
 
 #include "rendering/backend/Buffer.h"
 
 class VulkanDevice;
+class BindlessDescriptors;
 
 using MatOutlineID = uint32_t;
 using MatInstanceID = uint32_t;
@@ -32,10 +39,31 @@ class MatInstance
 	std::vector<int> offset_index;
 };
 
+// Layout of one element in the bindless material buffer, matches MaterialData in common/bindless.glsl.
+// Each data member takes a full vec4 slot, textures are indices into the bindless texture array.
+// Meshes drawn by MeshRenderer read albedo (vec3), roughness and metallic from data members 0 to 2
+// and an albedo map from texture 0.
+constexpr uint32_t MaxMaterialDataMembers = 12;
+constexpr uint32_t MaxMaterialTextures = 8;
+struct MaterialGPUData
+{
+	uint32_t data[MaxMaterialDataMembers][4];
+	uint32_t textures[MaxMaterialTextures];
+};
+using BindlessMaterialIndex = uint32_t;
+
 class Materials
 {
 	public:
-	Materials (Resource::Material::Materials& materials, VulkanDevice& device);
+	static constexpr uint32_t MaxBindlessMaterials = 1024;
+	// plain grey, used by draws that don't set a material
+	static constexpr BindlessMaterialIndex DefaultMaterial = 0;
+
+	Materials (Resource::Material::Materials& materials,
+	    VulkanDevice& device,
+	    Textures& textures,
+	    BindlessDescriptors& bindless,
+	    uint32_t frame_count);
 
 	MatOutlineID create_material_outline (Resource::Material::MaterialOutline const& outline);
 	MatInstanceID create_material_instance (MatOutlineID id, Resource::Material::MaterialInstance const& instance);
@@ -43,7 +71,31 @@ class Materials
 	void destroy_material_outline (MatOutlineID id);
 	void destroy_material_instance (MatInstanceID id);
 
+	// With descriptor indexing, material parameters live in one storage buffer and draws carry the
+	// returned index. Returns nullopt when bindless is unavailable so callers use material instances.
+	bool uses_bindless () const;
+	std::optional<BindlessMaterialIndex> create_bindless_material (
+	    std::vector<Resource::Material::DataMember> const& data_members, std::vector<VulkanTextureID> const& textures);
+	void update_bindless_material (BindlessMaterialIndex index,
+	    std::vector<Resource::Material::DataMember> const& data_members,
+	    std::vector<VulkanTextureID> const& textures);
+	// the index is reused once the frames in flight have finished
+	void destroy_bindless_material (BindlessMaterialIndex index);
+
+	// call once the frame's fence has signaled
+	void begin_frame (uint32_t frame_index);
+
 	private:
+	VulkanDevice& device;
+	Textures& textures;
+	BindlessDescriptors& bindless;
+
+	std::unique_ptr<VulkanBuffer> material_buffer;
+	std::mutex index_lock;
+	BindlessMaterialIndex next_material_index = DefaultMaterial + 1;
+	std::vector<BindlessMaterialIndex> free_material_indices;
+	FrameDeferred<BindlessMaterialIndex> retired_material_indices;
+
 	MatOutlineID cur_outline = 0;
 	std::unordered_map<MatOutlineID, MatInstance> outlines;
 };
\ No newline at end of file
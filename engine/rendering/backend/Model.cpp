@@ -2,6 +2,7 @@
 
 #include <iterator>
 #include <numeric>
+#include <stdexcept>
 
 #include "resources/Mesh.h"
 
@@ -31,19 +32,33 @@ VertexLayout::VertexLayout (Resource::Mesh::VertexDescription const& vertDesc)
 		if (vertDesc.layout[i] == Resource::Mesh::VertexType::Vert4)
 			vertSize = VK_FORMAT_R32G32B32A32_SFLOAT;
 
-		attribDesc.push_back (initializers::vertex_input_attribute_description (0, 0, vertSize, offset));
+		attribDesc.push_back (initializers::vertex_input_attribute_description (
+		    0, static_cast<uint32_t> (i), vertSize, offset));
 		offset += static_cast<int> (vertDesc.layout[i]) * sizeof (float);
 	}
 }
 
-VulkanMesh::VulkanMesh (
-    VertexLayout const& vertLayout, VulkanBuffer&& vertices, VulkanBuffer&& indices, uint32_t index_count)
-: vertLayout (vertLayout), vertices (std::move (vertices)), indices (std::move (indices)), index_count (index_count)
+VulkanMesh::VulkanMesh (VertexLayout const& vertLayout,
+    GeometryAllocation vertices,
+    GeometryAllocation indices,
+    uint32_t index_count,
+    uint32_t stride)
+: vertLayout (vertLayout), vertices (vertices), indices (indices), index_count (index_count), stride (stride)
 {
 }
 
-Models::Models (Resource::Mesh::Meshes& meshes, VulkanDevice& device, AsyncTaskQueue& async_task_man)
-: meshes (meshes), device (device), async_task_man (async_task_man)
+MeshDrawInfo VulkanMesh::get_draw_info () const
+{
+	return MeshDrawInfo{ index_count,
+		static_cast<uint32_t> (indices.offset / sizeof (uint32_t)),
+		static_cast<int32_t> (vertices.offset / stride) };
+}
+
+Models::Models (Resource::Mesh::Meshes& meshes,
+    VulkanDevice& device,
+    AsyncTaskQueue& async_task_man,
+    uint32_t frame_count)
+: meshes (meshes), device (device), async_task_man (async_task_man), geometry (device), retired_meshes (frame_count)
 {
 }
 
@@ -52,50 +67,58 @@ ModelID Models::create_model (Resource::Mesh::MeshData const& meshData)
 	std::lock_guard lg (map_lock);
 
 	uint32_t vertexCount = static_cast<uint32_t> (meshData.vertexData.size ());
-	uint32_t vertexelement_count = static_cast<uint32_t> (meshData.desc.element_count ());
 	uint32_t indexCount = static_cast<uint32_t> (meshData.indexData.size ());
 
 	uint32_t vBufferSize = (vertexCount) * sizeof (float);
 	uint32_t iBufferSize = (indexCount) * sizeof (uint32_t);
+	uint32_t stride = static_cast<uint32_t> (meshData.desc.element_count ()) * sizeof (float);
+
+	auto vertex_alloc = geometry.allocate_vertices (vBufferSize, stride);
+	auto index_alloc = geometry.allocate_indices (indexCount);
+	if (!vertex_alloc || !index_alloc)
+	{
+		if (vertex_alloc) geometry.free_vertices (vertex_alloc.value ());
+		if (index_alloc) geometry.free_indices (index_alloc.value ());
+		throw std::runtime_error ("Geometry buffer is out of space!");
+	}
 
 	ModelID new_id = counter++;
 
-	auto model = VulkanMesh (VertexLayout (meshData.desc),
-	    VulkanBuffer (device, vertex_details (vertexCount, vertexelement_count)),
-	    VulkanBuffer (device, vertex_details (vertexCount, vertexelement_count)),
-	    indexCount);
-	auto loading_model = VulkanMesh (VertexLayout (meshData.desc),
-	    VulkanBuffer (device, staging_details (BufferType::vertex, vBufferSize)),
-	    VulkanBuffer (device, staging_details (BufferType::index, iBufferSize)),
-	    indexCount);
+	auto staging = StagingMesh{ VulkanBuffer (device, staging_details (BufferType::vertex, vBufferSize)),
+		VulkanBuffer (device, staging_details (BufferType::index, iBufferSize)) };
 
-	loading_model.vertices.copy_to_buffer (meshData.vertexData);
-	loading_model.indices.copy_to_buffer (meshData.indexData);
+	staging.vertices.copy_to_buffer (meshData.vertexData);
+	staging.indices.copy_to_buffer (meshData.indexData);
 
-	VkBuffer vStage = loading_model.vertices.get ();
-	VkBuffer iStage = loading_model.indices.get ();
+	VkBuffer vStage = staging.vertices.get ();
+	VkBuffer iStage = staging.indices.get ();
 
-	VkBuffer vBuff = model.vertices.get ();
-	VkBuffer iBuff = model.indices.get ();
+	VkBuffer vBuff = geometry.vertex_buffer ();
+	VkBuffer iBuff = geometry.index_buffer ();
+	VkDeviceSize vOffset = vertex_alloc->offset;
+	VkDeviceSize iOffset = index_alloc->offset;
 
-	staging_models.emplace (new_id, std::move (loading_model));
-	models.emplace (new_id, std::move (model));
+	staging_models.emplace (new_id, std::move (staging));
+	models.emplace (new_id,
+	    VulkanMesh (VertexLayout (meshData.desc), vertex_alloc.value (), index_alloc.value (), indexCount, stride));
 
 
 	std::function<void (const VkCommandBuffer)> work =
-	    [vStage, iStage, vBuff, iBuff, vBufferSize, iBufferSize] (const VkCommandBuffer copyCmd) {
+	    [vStage, iStage, vBuff, iBuff, vOffset, iOffset, vBufferSize, iBufferSize] (const VkCommandBuffer copyCmd) {
 		    VkBufferCopy copyRegion{};
 		    copyRegion.size = vBufferSize;
+		    copyRegion.dstOffset = vOffset;
 		    vkCmdCopyBuffer (copyCmd, vStage, vBuff, 1, &copyRegion);
 
 		    copyRegion.size = iBufferSize;
+		    copyRegion.dstOffset = iOffset;
 		    vkCmdCopyBuffer (copyCmd, iStage, iBuff, 1, &copyRegion);
 	    };
 
 	AsyncTask transfer;
 	transfer.type = TaskType::transfer;
 	transfer.work = work;
-	transfer.finish_work = [&] { this->finished_model_upload (new_id); };
+	transfer.finish_work = [this, new_id] { this->finished_model_upload (new_id); };
 
 	async_task_man.SubmitTask (std::move (transfer));
 	return new_id;
@@ -103,7 +126,24 @@ ModelID Models::create_model (Resource::Mesh::MeshData const& meshData)
 void Models::free_model (ModelID id)
 {
 	std::lock_guard lg (map_lock);
-	models.erase (id);
+	auto it = models.find (id);
+	if (it == std::end (models)) return;
+	// the pending transfer would write into whichever model reuses the space
+	if (staging_models.count (id) == 1)
+		freed_while_uploading.emplace (id, std::move (it->second));
+	else
+		retired_meshes.retire (std::move (it->second));
+	models.erase (it);
+}
+
+void Models::begin_frame (uint32_t frame_index)
+{
+	std::lock_guard lg (map_lock);
+	for (auto& mesh : retired_meshes.begin_frame (frame_index))
+	{
+		geometry.free_vertices (mesh.vertices);
+		geometry.free_indices (mesh.indices);
+	}
 }
 
 void Models::finished_model_upload (ModelID id)
@@ -111,6 +151,12 @@ void Models::finished_model_upload (ModelID id)
 	std::lock_guard lg (map_lock);
 
 	staging_models.erase (id);
+	auto freed = freed_while_uploading.find (id);
+	if (freed != std::end (freed_while_uploading))
+	{
+		retired_meshes.retire (std::move (freed->second));
+		freed_while_uploading.erase (freed);
+	}
 }
 
 bool Models::is_uploaded (ModelID id)
@@ -128,12 +174,24 @@ void Models::bind (VkCommandBuffer cmdBuf, ModelID id)
 	// finished uploading
 	if (staging_models.count (id) == 0)
 	{
-		models.at (id).vertices.bind_vertex_buffer (cmdBuf);
-		models.at (id).indices.bind_index_buffer (cmdBuf);
+		geometry.bind (cmdBuf);
 	}
 }
 void Models::draw_indexed (VkCommandBuffer cmdBuf, ModelID id)
 {
 	bind (cmdBuf, id);
-	vkCmdDrawIndexed (cmdBuf, static_cast<uint32_t> (models.at (id).index_count), 1, 0, 0, 0);
+	auto info = get_draw_info (id);
+	if (!info) return;
+	vkCmdDrawIndexed (cmdBuf, info->index_count, 1, info->first_index, info->vertex_offset, 0);
+}
+
+void Models::bind_geometry (VkCommandBuffer cmdBuf) { geometry.bind (cmdBuf); }
+
+std::optional<MeshDrawInfo> Models::get_draw_info (ModelID id)
+{
+	std::lock_guard lg (map_lock);
+	if (staging_models.count (id) == 1) return {};
+	auto it = models.find (id);
+	if (it == std::end (models)) return {};
+	return it->second.get_draw_info ();
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <mutex>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 
@@ -9,6 +10,8 @@
 #include "resources/Mesh.h"
 
 #include "Buffer.h"
+#include "FrameResources.h"
+#include "GeometryBuffer.h"
 
 class VulkanDevice;
 class AsyncTaskQueue;
@@ -20,14 +23,31 @@ struct VertexLayout
 	std::vector<VkVertexInputBindingDescription> bindingDesc;
 	std::vector<VkVertexInputAttributeDescription> attribDesc;
 };
+// Location of a mesh inside the GeometryBuffer, in the units vkCmdDrawIndexed expects
+struct MeshDrawInfo
+{
+	uint32_t index_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+};
+
 struct VulkanMesh
 {
-	VulkanMesh (VertexLayout const& vertLayout, VulkanBuffer&& vertices, VulkanBuffer&& indices, uint32_t index_count);
+	VulkanMesh (VertexLayout const& vertLayout, GeometryAllocation vertices, GeometryAllocation indices, uint32_t index_count, uint32_t stride);
+
+	MeshDrawInfo get_draw_info () const;
 
 	VertexLayout vertLayout;
+	GeometryAllocation vertices;
+	GeometryAllocation indices;
+	uint32_t index_count;
+	uint32_t stride;
+};
+
+struct StagingMesh
+{
 	VulkanBuffer vertices;
 	VulkanBuffer indices;
-	uint32_t index_count;
 };
 
 
@@ -36,7 +56,10 @@ using ModelID = int;
 class Models
 {
 	public:
-	Models (Resource::Mesh::Meshes& meshes, VulkanDevice& device, AsyncTaskQueue& async_task_man);
+	Models (Resource::Mesh::Meshes& meshes,
+	    VulkanDevice& device,
+	    AsyncTaskQueue& async_task_man,
+	    uint32_t frame_count);
 
 	Models (Models const& man) = delete;
 	Models& operator= (Models const& man) = delete;
@@ -46,7 +69,11 @@ class Models
 	ModelID create_model (Resource::Mesh::MeshID mesh_id);
 
 	ModelID create_model (Resource::Mesh::MeshData const& meshData);
+	// The id is invalid right away, its geometry is reused once the frames in flight and the
+	// upload have finished.
 	void free_model (ModelID id);
+	// call once the frame's fence has signaled
+	void begin_frame (uint32_t frame_index);
 	bool is_uploaded (ModelID id);
 
 	VertexLayout get_layout (ModelID id);
@@ -55,6 +82,10 @@ class Models
 
 	void draw_indexed (VkCommandBuffer cmdBuf, ModelID id);
 
+	// every model lives in the same buffers, binding them once is enough for any number of draws
+	void bind_geometry (VkCommandBuffer cmdBuf);
+	std::optional<MeshDrawInfo> get_draw_info (ModelID id);
+
 	private:
 	void finished_model_upload (ModelID id);
 
@@ -62,8 +93,12 @@ class Models
 	VulkanDevice& device;
 	AsyncTaskQueue& async_task_man;
 
+	GeometryBuffer geometry;
+
 	std::mutex map_lock;
 	ModelID counter = 0;
-	std::unordered_map<ModelID, VulkanMesh> staging_models;
+	std::unordered_map<ModelID, StagingMesh> staging_models;
 	std::unordered_map<ModelID, VulkanMesh> models;
+	std::unordered_map<ModelID, VulkanMesh> freed_while_uploading;
+	FrameDeferred<VulkanMesh> retired_meshes;
 };
\ No newline at end of file
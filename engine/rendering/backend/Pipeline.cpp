@@ -1,8 +1,12 @@
 #include "Pipeline.h"
 
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 
+#include "core/Logger.h"
+
 #include "resources/Mesh.h"
 
 #include "Model.h"
@@ -64,6 +68,11 @@ PipelineBuilder::PipelineBuilder (VkDevice device, VkPipelineCache cache)
 {
 }
 
+PipelineBuilder::PipelineBuilder (VkDevice device, PipelineCache& pipeline_cache)
+: device (device), cache (pipeline_cache.get ()), pipeline_cache (&pipeline_cache)
+{
+}
+
 std::optional<PipelineLayout> PipelineBuilder::CreateLayout () const
 {
 	auto layoutInfo = initializers::pipeline_set_layout_create_info (layouts, pushConstantRanges);
@@ -117,6 +126,7 @@ std::optional<GraphicsPipeline> PipelineBuilder::CreatePipeline (
 	{
 		return {};
 	}
+	if (pipeline_cache) pipeline_cache->record (*this, render_pass, subpass);
 	return GraphicsPipeline{ device, pipe };
 }
 
@@ -157,11 +167,29 @@ PipelineBuilder& PipelineBuilder::SetInputAssembly (VkPrimitiveTopology topology
 PipelineBuilder& PipelineBuilder::AddDescriptorLayouts (std::vector<VkDescriptorSetLayout> layouts)
 {
 	this->layouts.insert (std::end (this->layouts), std::begin (layouts), std::end (layouts));
+	layout_bindings.resize (this->layouts.size ());
+	has_raw_layouts = true;
 	return *this;
 }
 PipelineBuilder& PipelineBuilder::AddDescriptorLayout (VkDescriptorSetLayout layout)
 {
 	layouts.push_back (layout);
+	layout_bindings.emplace_back ();
+	has_raw_layouts = true;
+	return *this;
+}
+PipelineBuilder& PipelineBuilder::AddDescriptorLayout (DescriptorLayout const& layout)
+{
+	layouts.push_back (layout.get ());
+	layout_bindings.push_back (layout.get_bindings ());
+	return *this;
+}
+PipelineBuilder& PipelineBuilder::AddDescriptorStack (DescriptorStack const& stack)
+{
+	auto stack_layouts = stack.get_layouts ();
+	auto stack_bindings = stack.get_layout_bindings ();
+	layouts.insert (std::end (layouts), std::begin (stack_layouts), std::end (stack_layouts));
+	layout_bindings.insert (std::end (layout_bindings), std::begin (stack_bindings), std::end (stack_bindings));
 	return *this;
 }
 PipelineBuilder& PipelineBuilder::AddViewport (VkViewport viewport)
@@ -281,41 +309,617 @@ std::optional<ComputePipeline> BuildComputePipeline (
 	return ComputePipeline{ device, pipe };
 }
 
-//// PipelineCache ////
+//// Pipeline Registry ////
+
+PipelineStatus PipelineHandle::status () const
+{
+	if (!slot) return PipelineStatus::failed;
+	return slot->status;
+}
+
+bool PipelineHandle::bind (VkCommandBuffer cmdBuf) const
+{
+	if (!is_ready ()) return false;
+	slot->pipeline->bind (cmdBuf);
+	return true;
+}
+
+namespace
+{
+template <typename T> void append_key (std::string& key, T const& value)
+{
+	key.append (reinterpret_cast<char const*> (&value), sizeof (T));
+}
+void append_key (std::string& key, std::string const& value)
+{
+	append_key (key, value.size ());
+	key.append (value);
+}
 
-PipelineCache::PipelineCache (VkDevice device) : device (device)
+// Byte string of everything that affects the created pipeline. Shader modules and descriptor layouts
+// are identified by name and bindings when known, since every Shaders::GetModule call makes a new
+// VkShaderModule. The render pass is identified by its compatibility key.
+std::string pipeline_state_key (PipelineBuilder const& b, std::string const& render_pass_key, uint32_t subpass)
 {
-	std::vector<std::byte> cache_data;
+	std::string key;
+	auto stage_names = b.set.get_stage_names ();
+	if (stage_names.empty ())
+	{
+		for (auto& stage : b.set.ShaderStageCreateInfos ())
+		{
+			append_key (key, stage.stage);
+			append_key (key, stage.module);
+		}
+	}
+	for (auto& [type, name] : stage_names)
+	{
+		append_key (key, type);
+		append_key (key, name);
+	}
 
-	if (std::filesystem::exists (".cache/pipeline_cache"))
+	for (size_t i = 0; i < b.layouts.size (); i++)
 	{
-		std::ifstream in (".cache/pipeline_cache", std::ios::binary | std::ios::ate);
-		auto size = in.tellg ();
-		std::vector<std::byte> cache_data (size); // construct string to stream size
-		in.seekg (0);
-		in.read (reinterpret_cast<char*> (cache_data.data ()), size);
+		if (i < b.layout_bindings.size () && !b.layout_bindings.at (i).empty ())
+		{
+			for (auto& binding : b.layout_bindings.at (i))
+				append_key (key, binding);
+		}
+		else
+		{
+			append_key (key, b.layouts.at (i));
+		}
+		append_key (key, '|');
 	}
+	for (auto& range : b.pushConstantRanges)
+		append_key (key, range);
+
+	for (auto& bind : b.vertexInputBindingDescription)
+		append_key (key, bind);
+	for (auto& attrib : b.vertexInputAttributeDescriptions)
+		append_key (key, attrib);
+
+	append_key (key, b.inputAssembly.topology);
+	append_key (key, b.inputAssembly.primitiveRestartEnable);
+
+	for (auto& viewport : b.viewports)
+		append_key (key, viewport);
+	for (auto& scissor : b.scissors)
+		append_key (key, scissor);
+
+	append_key (key, b.rasterizer.polygonMode);
+	append_key (key, b.rasterizer.cullMode);
+	append_key (key, b.rasterizer.frontFace);
+	append_key (key, b.rasterizer.depthClampEnable);
+	append_key (key, b.rasterizer.rasterizerDiscardEnable);
+	append_key (key, b.rasterizer.lineWidth);
+	append_key (key, b.rasterizer.depthBiasEnable);
+
+	append_key (key, b.multisampling.rasterizationSamples);
+
+	append_key (key, b.depthStencil.depthTestEnable);
+	append_key (key, b.depthStencil.depthWriteEnable);
+	append_key (key, b.depthStencil.depthCompareOp);
+	append_key (key, b.depthStencil.depthBoundsTestEnable);
+	append_key (key, b.depthStencil.stencilTestEnable);
+
+	for (auto& attachment : b.colorBlendAttachments)
+		append_key (key, attachment);
+	for (auto& state : b.dynamicStates)
+		append_key (key, state);
+
+	append_key (key, render_pass_key);
+	append_key (key, subpass);
+	return key;
+}
+} // namespace
+
+PipelineRegistry::PipelineRegistry (
+    VkDevice device, PipelineCache& pipeline_cache, Shaders& shaders, job::ThreadPool& thread_pool)
+: device (device),
+  pipeline_cache (pipeline_cache),
+  shaders (shaders),
+  thread_pool (thread_pool),
+  async_signal (std::make_shared<job::TaskSignal> ())
+{
+}
+
+PipelineRegistry::~PipelineRegistry () { async_signal->wait (); }
+
+void PipelineRegistry::register_render_pass (VkRenderPass render_pass, std::string const& compatibility_key)
+{
+	std::lock_guard lg (lock);
+	render_pass_keys[render_pass] = compatibility_key;
+}
+
+std::string PipelineRegistry::state_key (PipelineBuilder const& builder, VkRenderPass render_pass, uint32_t subpass)
+{
+	std::lock_guard lg (lock);
+	auto it = render_pass_keys.find (render_pass);
+	if (it != std::end (render_pass_keys)) return pipeline_state_key (builder, it->second, subpass);
+	// not made by the frame graph, the handle is all there is to go on
+	std::string handle_key;
+	append_key (handle_key, render_pass);
+	return pipeline_state_key (builder, handle_key, subpass);
+}
+
+std::shared_ptr<PipelineHandle::Slot> PipelineRegistry::find_slot (std::string const& key, bool& new_slot)
+{
+	std::lock_guard lg (lock);
+	auto it = pipelines.find (key);
+	new_slot = it == std::end (pipelines) || it->second->status == PipelineStatus::failed;
+	if (!new_slot) return it->second;
+	auto slot = std::make_shared<PipelineHandle::Slot> ();
+	pipelines[key] = slot;
+	return slot;
+}
+
+PipelineHandle PipelineRegistry::get_pipeline (
+    PipelineBuilder const& builder, PipelineLayout const& layout, VkRenderPass render_pass, uint32_t subpass)
+{
+	bool new_slot = false;
+	auto slot = find_slot (state_key (builder, render_pass, subpass), new_slot);
+	if (!new_slot) return PipelineHandle{ slot };
+
+	PipelineBuilder recording_builder = builder;
+	recording_builder.cache = pipeline_cache.get ();
+	recording_builder.pipeline_cache = &pipeline_cache;
+
+	slot->pipeline = recording_builder.CreatePipeline (layout, render_pass, subpass);
+	slot->status = slot->pipeline ? PipelineStatus::ready : PipelineStatus::failed;
+	return PipelineHandle{ slot };
+}
+
+PipelineHandle PipelineRegistry::get_pipeline_async (
+    PipelineBuilder const& builder, VkRenderPass render_pass, uint32_t subpass)
+{
+	bool new_slot = false;
+	auto slot = find_slot (state_key (builder, render_pass, subpass), new_slot);
+	if (!new_slot) return PipelineHandle{ slot };
+
+	auto stage_names = builder.set.get_stage_names ();
+	if (stage_names.empty ())
+	{
+		Log.error ("Async pipeline creation needs shader modules from the shader database");
+		slot->status = PipelineStatus::failed;
+		return PipelineHandle{ slot };
+	}
+
+	thread_pool.submit (
+	    [this, slot, stage_names, state = builder, render_pass, subpass] () mutable {
+		    std::vector<ShaderModule> modules;
+		    for (auto& [type, name] : stage_names)
+		    {
+			    auto module = shaders.GetModule (name, type);
+			    if (!module)
+			    {
+				    slot->status = PipelineStatus::failed;
+				    return;
+			    }
+			    modules.push_back (std::move (module.value ()));
+		    }
+		    ShaderModuleSet set;
+		    for (auto& module : modules)
+			    set.Add (module);
+		    state.SetShaderModuleSet (set);
+		    state.cache = pipeline_cache.get ();
+		    state.pipeline_cache = &pipeline_cache;
+
+		    auto layout = state.CreateLayout ();
+		    if (layout) slot->pipeline = state.CreatePipeline (layout.value (), render_pass, subpass);
+		    slot->status = slot->pipeline ? PipelineStatus::ready : PipelineStatus::failed;
+	    },
+	    async_signal);
+
+	return PipelineHandle{ slot };
+}
+
+size_t PipelineRegistry::pipeline_count ()
+{
+	std::lock_guard lg (lock);
+	return pipelines.size ();
+}
+
+void PipelineRegistry::collect_unused ()
+{
+	std::lock_guard lg (lock);
+	for (auto it = std::begin (pipelines); it != std::end (pipelines);)
+	{
+		// async creation holds a reference until it's done
+		if (it->second.use_count () == 1)
+			it = pipelines.erase (it);
+		else
+			++it;
+	}
+}
+
+//// Pipeline State Serialization ////
+
+std::optional<nlohmann::json> serialize_pipeline_state (PipelineBuilder const& builder)
+{
+	auto stage_names = builder.set.get_stage_names ();
+	if (stage_names.empty () || builder.has_raw_layouts) return {};
+
+	nlohmann::json j;
+	j["shaders"] = nlohmann::json::array ();
+	for (auto& [type, name] : stage_names)
+		j["shaders"].push_back ({ static_cast<int> (type), name });
+
+	j["layouts"] = nlohmann::json::array ();
+	for (auto& bindings : builder.layout_bindings)
+	{
+		auto layout = nlohmann::json::array ();
+		for (auto& b : bindings)
+			layout.push_back ({ static_cast<int> (b.type), static_cast<int> (b.stages), b.bind_point, b.count });
+		j["layouts"].push_back (layout);
+	}
+
+	j["push_constants"] = nlohmann::json::array ();
+	for (auto& range : builder.pushConstantRanges)
+		j["push_constants"].push_back ({ range.stageFlags, range.offset, range.size });
+
+	j["vertex_bindings"] = nlohmann::json::array ();
+	for (auto& bind : builder.vertexInputBindingDescription)
+		j["vertex_bindings"].push_back ({ bind.binding, bind.stride, static_cast<int> (bind.inputRate) });
+
+	j["vertex_attributes"] = nlohmann::json::array ();
+	for (auto& attrib : builder.vertexInputAttributeDescriptions)
+		j["vertex_attributes"].push_back (
+		    { attrib.location, attrib.binding, static_cast<int> (attrib.format), attrib.offset });
+
+	j["input_assembly"] = { static_cast<int> (builder.inputAssembly.topology),
+		builder.inputAssembly.primitiveRestartEnable };
+
+	j["viewports"] = nlohmann::json::array ();
+	for (auto& v : builder.viewports)
+		j["viewports"].push_back ({ v.width, v.height, v.minDepth, v.maxDepth, v.x, v.y });
+
+	j["scissors"] = nlohmann::json::array ();
+	for (auto& s : builder.scissors)
+		j["scissors"].push_back ({ s.extent.width, s.extent.height, s.offset.x, s.offset.y });
+
+	auto& r = builder.rasterizer;
+	j["rasterizer"] = { static_cast<int> (r.polygonMode),
+		r.cullMode,
+		static_cast<int> (r.frontFace),
+		r.depthClampEnable,
+		r.rasterizerDiscardEnable,
+		r.lineWidth,
+		r.depthBiasEnable };
+
+	j["multisampling"] = nlohmann::json::array ({ static_cast<int> (builder.multisampling.rasterizationSamples) });
+
+	auto& d = builder.depthStencil;
+	j["depth_stencil"] = { d.depthTestEnable,
+		d.depthWriteEnable,
+		static_cast<int> (d.depthCompareOp),
+		d.depthBoundsTestEnable,
+		d.stencilTestEnable };
+
+	j["color_blend"] = nlohmann::json::array ();
+	for (auto& a : builder.colorBlendAttachments)
+		j["color_blend"].push_back ({ a.blendEnable,
+		    a.colorWriteMask,
+		    static_cast<int> (a.colorBlendOp),
+		    static_cast<int> (a.srcColorBlendFactor),
+		    static_cast<int> (a.dstColorBlendFactor),
+		    static_cast<int> (a.alphaBlendOp),
+		    static_cast<int> (a.srcAlphaBlendFactor),
+		    static_cast<int> (a.dstAlphaBlendFactor) });
+
+	j["dynamic_states"] = nlohmann::json::array ();
+	for (auto& state : builder.dynamicStates)
+		j["dynamic_states"].push_back (static_cast<int> (state));
+
+	return j;
+}
+
+// Shader modules and descriptor layouts are not touched, the caller creates those from the entry
+void deserialize_pipeline_state (nlohmann::json const& j, PipelineBuilder& builder)
+{
+	for (auto& range : j.at ("push_constants"))
+		builder.AddPushConstantRange (
+		    { range[0].get<VkShaderStageFlags> (), range[1].get<uint32_t> (), range[2].get<uint32_t> () });
+
+	for (auto& bind : j.at ("vertex_bindings"))
+		builder.vertexInputBindingDescription.push_back ({ bind[0].get<uint32_t> (),
+		    bind[1].get<uint32_t> (),
+		    static_cast<VkVertexInputRate> (bind[2].get<int> ()) });
+
+	for (auto& attrib : j.at ("vertex_attributes"))
+		builder.vertexInputAttributeDescriptions.push_back ({ attrib[0].get<uint32_t> (),
+		    attrib[1].get<uint32_t> (),
+		    static_cast<VkFormat> (attrib[2].get<int> ()),
+		    attrib[3].get<uint32_t> () });
+
+	auto& ia = j.at ("input_assembly");
+	builder.SetInputAssembly (static_cast<VkPrimitiveTopology> (ia[0].get<int> ()), ia[1].get<VkBool32> ());
+
+	for (auto& v : j.at ("viewports"))
+		builder.AddViewport (v[0].get<float> (),
+		    v[1].get<float> (),
+		    v[2].get<float> (),
+		    v[3].get<float> (),
+		    v[4].get<float> (),
+		    v[5].get<float> ());
+
+	for (auto& s : j.at ("scissors"))
+		builder.AddScissor (
+		    s[0].get<uint32_t> (), s[1].get<uint32_t> (), s[2].get<int32_t> (), s[3].get<int32_t> ());
+
+	auto& r = j.at ("rasterizer");
+	builder.SetRasterizer (static_cast<VkPolygonMode> (r[0].get<int> ()),
+	    static_cast<VkCullModeFlagBits> (r[1].get<VkCullModeFlags> ()),
+	    static_cast<VkFrontFace> (r[2].get<int> ()),
+	    r[3].get<VkBool32> (),
+	    r[4].get<VkBool32> (),
+	    r[5].get<float> (),
+	    r[6].get<VkBool32> ());
+
+	builder.SetMultisampling (static_cast<VkSampleCountFlagBits> (j.at ("multisampling")[0].get<int> ()));
+
+	auto& d = j.at ("depth_stencil");
+	builder.set_depth_stencil (d[0].get<VkBool32> (),
+	    d[1].get<VkBool32> (),
+	    static_cast<VkCompareOp> (d[2].get<int> ()),
+	    d[3].get<VkBool32> (),
+	    d[4].get<VkBool32> ());
+
+	for (auto& a : j.at ("color_blend"))
+		builder.AddColorBlendingAttachment (a[0].get<VkBool32> (),
+		    a[1].get<VkColorComponentFlags> (),
+		    static_cast<VkBlendOp> (a[2].get<int> ()),
+		    static_cast<VkBlendFactor> (a[3].get<int> ()),
+		    static_cast<VkBlendFactor> (a[4].get<int> ()),
+		    static_cast<VkBlendOp> (a[5].get<int> ()),
+		    static_cast<VkBlendFactor> (a[6].get<int> ()),
+		    static_cast<VkBlendFactor> (a[7].get<int> ()));
+
+	for (auto& state : j.at ("dynamic_states"))
+		builder.AddDynamicState (static_cast<VkDynamicState> (state.get<int> ()));
+}
+
+//// PipelineCache ////
+
+namespace
+{
+const std::filesystem::path pipeline_cache_path = ".cache/pipeline_cache";
+const std::filesystem::path pipeline_manifest_path = ".cache/pipeline_manifest.json";
+constexpr uint32_t pipeline_cache_magic = 0x50434B56; // "VKCP"
+} // namespace
+
+PipelineCache::PipelineCache (VkDevice device, VkPhysicalDeviceProperties const& properties)
+: device (device), properties (properties), warmup_signal (std::make_shared<job::TaskSignal> ())
+{
+	std::vector<std::byte> cache_data = load_cache_data ();
 
 	VkPipelineCacheCreateInfo info{};
 	info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
 	info.initialDataSize = cache_data.size ();
 	info.pInitialData = cache_data.data ();
 
-	vkCreatePipelineCache (device, &info, nullptr, &cache);
+	VkResult res = vkCreatePipelineCache (device, &info, nullptr, &cache);
+	if (res != VK_SUCCESS && cache_data.size () > 0)
+	{
+		Log.error ("Driver rejected pipeline cache data, starting with an empty cache");
+		info.initialDataSize = 0;
+		info.pInitialData = nullptr;
+		VK_CHECK_RESULT (vkCreatePipelineCache (device, &info, nullptr, &cache));
+	}
+
+	load_manifest ();
 }
 
 PipelineCache::~PipelineCache ()
 {
-	std::ofstream out (".cache/pipeline_cache", std::ios::binary | std::ios::out);
+	wait_for_warmup ();
+	save_cache_data ();
+	save_manifest ();
+
+	vkDestroyPipelineCache (device, cache, nullptr);
+}
+
+VkPipelineCache PipelineCache::get () const { return cache; }
+
+std::vector<std::byte> PipelineCache::load_cache_data () const
+{
+	if (!std::filesystem::exists (pipeline_cache_path)) return {};
+
+	std::ifstream in (pipeline_cache_path, std::ios::binary | std::ios::ate);
+	auto file_size = static_cast<size_t> (in.tellg ());
+	if (file_size < sizeof (PipelineCacheFileHeader))
+	{
+		Log.debug ("Pipeline cache file too small, ignoring it");
+		return {};
+	}
+	in.seekg (0);
+
+	PipelineCacheFileHeader header{};
+	in.read (reinterpret_cast<char*> (&header), sizeof (header));
+
+	if (header.magic != pipeline_cache_magic || header.header_size != sizeof (PipelineCacheFileHeader) ||
+	    header.data_size != file_size - sizeof (PipelineCacheFileHeader))
+	{
+		Log.debug ("Pipeline cache file is malformed, ignoring it");
+		return {};
+	}
+	if (header.vendor_id != properties.vendorID || header.device_id != properties.deviceID ||
+	    header.driver_version != properties.driverVersion ||
+	    std::memcmp (header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		Log.debug ("Pipeline cache was made by a different device or driver, ignoring it");
+		return {};
+	}
+
+	std::vector<std::byte> cache_data (header.data_size);
+	in.read (reinterpret_cast<char*> (cache_data.data ()), cache_data.size ());
+	if (!in || fnv1a_hash (cache_data.data (), cache_data.size ()) != header.data_hash)
+	{
+		Log.debug ("Pipeline cache data is corrupt, ignoring it");
+		return {};
+	}
+
+	// The driver writes its own header (VkPipelineCacheHeaderVersionOne), check it as well
+	// since some drivers crash instead of rejecting data from another device
+	uint32_t driver_header[4];
+	if (cache_data.size () < sizeof (driver_header) + VK_UUID_SIZE) return {};
+	std::memcpy (driver_header, cache_data.data (), sizeof (driver_header));
+	if (driver_header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || driver_header[2] != properties.vendorID ||
+	    driver_header[3] != properties.deviceID ||
+	    std::memcmp (cache_data.data () + sizeof (driver_header), properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+	{
+		Log.debug ("Pipeline cache driver header doesn't match, ignoring it");
+		return {};
+	}
+
+	return cache_data;
+}
+
+void PipelineCache::save_cache_data () const
+{
 	size_t cache_size = 0;
-	std::vector<std::byte> cache_data;
-	vkGetPipelineCacheData (device, cache, &cache_size, nullptr);
-	cache_data.resize (cache_size);
-	vkGetPipelineCacheData (device, cache, &cache_size, cache_data.data ());
+	VK_CHECK_RESULT (vkGetPipelineCacheData (device, cache, &cache_size, nullptr));
 
-	out.write (reinterpret_cast<char*> (cache_data.data ()), cache_data.size ());
+	std::vector<std::byte> file_data (sizeof (PipelineCacheFileHeader) + cache_size);
+	std::byte* cache_data = file_data.data () + sizeof (PipelineCacheFileHeader);
+	VK_CHECK_RESULT (vkGetPipelineCacheData (device, cache, &cache_size, cache_data));
+	file_data.resize (sizeof (PipelineCacheFileHeader) + cache_size);
 
-	vkDestroyPipelineCache (device, cache, nullptr);
+	PipelineCacheFileHeader header{};
+	header.magic = pipeline_cache_magic;
+	header.header_size = sizeof (PipelineCacheFileHeader);
+	header.vendor_id = properties.vendorID;
+	header.device_id = properties.deviceID;
+	header.driver_version = properties.driverVersion;
+	std::memcpy (header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.data_size = cache_size;
+	header.data_hash = fnv1a_hash (cache_data, cache_size);
+	std::memcpy (file_data.data (), &header, sizeof (header));
+
+	write_file_atomic (pipeline_cache_path, reinterpret_cast<char const*> (file_data.data ()), file_data.size ());
+}
+
+void PipelineCache::load_manifest ()
+{
+	manifest = nlohmann::json::object ();
+	if (!std::filesystem::exists (pipeline_manifest_path)) return;
+	try
+	{
+		std::ifstream in (pipeline_manifest_path);
+		nlohmann::json j;
+		in >> j;
+		if (j.is_object ()) manifest = j;
+	}
+	catch (nlohmann::json::exception& e)
+	{
+		Log.debug ("Pipeline manifest unreadable, starting fresh: {}", e.what ());
+	}
 }
 
-VkPipelineCache PipelineCache::get () const { return cache; }
\ No newline at end of file
+void PipelineCache::save_manifest () const
+{
+	auto text = manifest.dump (1);
+	write_file_atomic (pipeline_manifest_path, text.data (), text.size ());
+}
+
+void PipelineCache::register_render_pass (std::string const& name, VkRenderPass render_pass)
+{
+	std::lock_guard lg (manifest_lock);
+	render_passes[name] = render_pass;
+}
+
+void PipelineCache::clear_render_passes ()
+{
+	wait_for_warmup ();
+	std::lock_guard lg (manifest_lock);
+	render_passes.clear ();
+}
+
+void PipelineCache::record (PipelineBuilder const& builder, VkRenderPass render_pass, uint32_t subpass)
+{
+	auto entry = serialize_pipeline_state (builder);
+	if (!entry) return;
+
+	std::lock_guard lg (manifest_lock);
+	auto rp_name = std::find_if (std::begin (render_passes), std::end (render_passes), [render_pass] (auto const& rp) {
+		return rp.second == render_pass;
+	});
+	if (rp_name == std::end (render_passes)) return;
+
+	(*entry)["render_pass"] = rp_name->first;
+	(*entry)["subpass"] = subpass;
+	auto key = fmt::format ("{:016x}", std::hash<std::string>{}(entry->dump ()));
+	manifest[key] = *entry;
+}
+
+void PipelineCache::warmup (Shaders& shaders, job::ThreadPool& thread_pool)
+{
+	std::vector<std::pair<nlohmann::json, VkRenderPass>> work;
+	{
+		std::lock_guard lg (manifest_lock);
+		for (auto& [key, entry] : manifest.items ())
+		{
+			auto rp = render_passes.find (entry.value ("render_pass", ""));
+			if (rp != std::end (render_passes)) work.emplace_back (entry, rp->second);
+		}
+	}
+	Log.debug ("Warming {} of {} pipelines in the manifest", work.size (), manifest.size ());
+
+	for (auto& [entry, render_pass] : work)
+	{
+		thread_pool.submit (
+		    [this, &shaders, entry = entry, render_pass = render_pass] {
+			    warmup_pipeline (shaders, entry, render_pass);
+		    },
+		    warmup_signal);
+	}
+}
+
+void PipelineCache::wait_for_warmup () { warmup_signal->wait (); }
+
+void PipelineCache::warmup_pipeline (Shaders& shaders, nlohmann::json const& entry, VkRenderPass render_pass)
+{
+	try
+	{
+		std::vector<ShaderModule> modules;
+		for (auto& stage : entry.at ("shaders"))
+		{
+			auto module =
+			    shaders.GetModule (stage[1].get<std::string> (), static_cast<ShaderType> (stage[0].get<int> ()));
+			if (!module) return; // shader was removed since the manifest was written
+			modules.push_back (std::move (module.value ()));
+		}
+
+		ShaderModuleSet set;
+		for (auto& module : modules)
+			set.Add (module);
+
+		std::vector<DescriptorLayout> layouts;
+		layouts.reserve (entry.at ("layouts").size ());
+		for (auto& layout : entry.at ("layouts"))
+		{
+			std::vector<DescriptorSetLayoutBinding> bindings;
+			for (auto& b : layout)
+				bindings.push_back ({ static_cast<DescriptorType> (b[0].get<int> ()),
+				    static_cast<ShaderStage> (b[1].get<int> ()),
+				    b[2].get<uint32_t> (),
+				    b[3].get<uint32_t> () });
+			layouts.emplace_back (device, bindings);
+		}
+
+		// uses the raw cache handle so warming up doesn't record into the manifest again
+		PipelineBuilder builder (device, cache);
+		builder.SetShaderModuleSet (set);
+		for (auto& layout : layouts)
+			builder.AddDescriptorLayout (layout);
+		deserialize_pipeline_state (entry, builder);
+
+		auto pipe_layout = builder.CreateLayout ();
+		if (!pipe_layout) return;
+		auto pipe = builder.CreatePipeline (pipe_layout.value (), render_pass, entry.at ("subpass").get<uint32_t> ());
+		if (!pipe) Log.debug ("Failed to warm pipeline from manifest");
+	}
+	catch (nlohmann::json::exception& e)
+	{
+		Log.debug ("Skipping malformed pipeline manifest entry: {}", e.what ());
+	}
+}
@@ -1,7 +1,18 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <nlohmann/json.hpp>
+
+#include "core/JobSystem.h"
+
+#include "Descriptor.h"
 #include "RenderTools.h"
 #include "Shader.h"
 
@@ -42,10 +53,13 @@ class ComputePipeline
 };
 
 struct VertexLayout;
+class PipelineCache;
 class PipelineBuilder
 {
 	public:
 	PipelineBuilder (VkDevice device, VkPipelineCache cache);
+	// Pipelines created with this builder are recorded into the cache's warmup manifest
+	PipelineBuilder (VkDevice device, PipelineCache& pipeline_cache);
 
 	std::optional<PipelineLayout> CreateLayout () const;
 	std::optional<GraphicsPipeline> CreatePipeline (
@@ -60,6 +74,8 @@ class PipelineBuilder
 
 	PipelineBuilder& AddDescriptorLayouts (std::vector<VkDescriptorSetLayout> layouts);
 	PipelineBuilder& AddDescriptorLayout (VkDescriptorSetLayout layout);
+	PipelineBuilder& AddDescriptorLayout (DescriptorLayout const& layout);
+	PipelineBuilder& AddDescriptorStack (DescriptorStack const& stack);
 
 	PipelineBuilder& SetInputAssembly (VkPrimitiveTopology topology, VkBool32 primitiveRestart);
 
@@ -109,6 +125,9 @@ class PipelineBuilder
 
 	ShaderModuleSet set;
 	std::vector<VkDescriptorSetLayout> layouts;
+	// mirrors layouts, raw VkDescriptorSetLayouts have no bindings and can't be recorded
+	std::vector<std::vector<DescriptorSetLayoutBinding>> layout_bindings;
+	bool has_raw_layouts = false;
 
 	std::vector<VkVertexInputBindingDescription> vertexInputBindingDescription;
 	std::vector<VkVertexInputAttributeDescription> vertexInputAttributeDescriptions;
@@ -130,16 +149,107 @@ class PipelineBuilder
 
 	VkDevice device;
 	VkPipelineCache cache;
+	PipelineCache* pipeline_cache = nullptr;
+};
+
+enum class PipelineStatus
+{
+	compiling,
+	ready,
+	failed
+};
+
+// Shared pipeline owned by the PipelineRegistry, which may still be compiling on a worker thread
+class PipelineHandle
+{
+	public:
+	struct Slot
+	{
+		std::atomic<PipelineStatus> status = PipelineStatus::compiling;
+		std::optional<GraphicsPipeline> pipeline;
+	};
+
+	PipelineHandle () = default;
+	PipelineHandle (std::shared_ptr<Slot> slot) : slot (slot) {}
+
+	PipelineStatus status () const;
+	bool is_ready () const { return status () == PipelineStatus::ready; }
+
+	// returns false while the pipeline isn't ready, so the caller can skip the draw or bind a fallback
+	bool bind (VkCommandBuffer cmdBuf) const;
+
+	private:
+	std::shared_ptr<Slot> slot;
+};
+
+class PipelineRegistry
+{
+	public:
+	PipelineRegistry (VkDevice device, PipelineCache& pipeline_cache, Shaders& shaders, job::ThreadPool& thread_pool);
+	~PipelineRegistry ();
+
+	PipelineRegistry (PipelineRegistry const& other) = delete;
+	PipelineRegistry& operator= (PipelineRegistry const& other) = delete;
+
+	// Pipelines are keyed on the render pass's compatibility key instead of its handle, so passes
+	// that are recreated share their pipelines and a reused handle can't alias an old pass. Call
+	// whenever a render pass is created.
+	void register_render_pass (VkRenderPass render_pass, std::string const& compatibility_key);
+
+	// Returns the pipeline for an identical builder state if there is one, otherwise creates it now.
+	// A state that failed before is tried again.
+	PipelineHandle get_pipeline (
+	    PipelineBuilder const& builder, PipelineLayout const& layout, VkRenderPass render_pass, uint32_t subpass);
+
+	// Creation happens on the job system, the builder's shader modules must come from the shader
+	// database since they are re-fetched by name. Descriptor set layouts must outlive the creation.
+	PipelineHandle get_pipeline_async (PipelineBuilder const& builder, VkRenderPass render_pass, uint32_t subpass);
+
+	size_t pipeline_count ();
+
+	// drops the pipelines no handle refers to anymore, only while the device is idle
+	void collect_unused ();
+
+	private:
+	std::string state_key (PipelineBuilder const& builder, VkRenderPass render_pass, uint32_t subpass);
+	// the slot for key, a new one when there is none or the last attempt failed. new_slot is set when
+	// the caller has to create the pipeline.
+	std::shared_ptr<PipelineHandle::Slot> find_slot (std::string const& key, bool& new_slot);
+
+	VkDevice device;
+	PipelineCache& pipeline_cache;
+	Shaders& shaders;
+	job::ThreadPool& thread_pool;
+
+	std::mutex lock;
+	std::unordered_map<std::string, std::shared_ptr<PipelineHandle::Slot>> pipelines;
+	std::unordered_map<VkRenderPass, std::string> render_pass_keys;
+
+	std::shared_ptr<job::TaskSignal> async_signal;
 };
 
 std::optional<ComputePipeline> BuildComputePipeline (
     VkDevice device, PipelineLayout const& layout, ShaderModule module, VkPipelineCache cache);
 
 
+// On disk layout of .cache/pipeline_cache, the driver blob is only handed to
+// vkCreatePipelineCache when every field matches the current device
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t header_size;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+	uint64_t data_size;
+	uint64_t data_hash;
+};
+
 class PipelineCache
 {
 	public:
-	PipelineCache (VkDevice device);
+	PipelineCache (VkDevice device, VkPhysicalDeviceProperties const& properties);
 	~PipelineCache ();
 
 	PipelineCache (PipelineCache const& other) = delete;
@@ -147,7 +257,33 @@ class PipelineCache
 
 	VkPipelineCache get () const;
 
+	// Render passes are recorded by name so the manifest survives handle changes between runs
+	void register_render_pass (std::string const& name, VkRenderPass render_pass);
+	// Forgets every registered render pass once the warmups still creating pipelines against them
+	// are done. Call before the render passes can be destroyed, then register the current ones.
+	void clear_render_passes ();
+
+	void record (PipelineBuilder const& builder, VkRenderPass render_pass, uint32_t subpass);
+
+	// Recreates every pipeline in the manifest on worker threads to fill the driver cache
+	void warmup (Shaders& shaders, job::ThreadPool& thread_pool);
+	void wait_for_warmup ();
+
 	private:
+	std::vector<std::byte> load_cache_data () const;
+	void save_cache_data () const;
+	void load_manifest ();
+	void save_manifest () const;
+
+	void warmup_pipeline (Shaders& shaders, nlohmann::json const& entry, VkRenderPass render_pass);
+
 	VkDevice device;
+	VkPhysicalDeviceProperties properties;
 	VkPipelineCache cache;
+
+	std::mutex manifest_lock;
+	nlohmann::json manifest;
+	std::unordered_map<std::string, VkRenderPass> render_passes;
+
+	std::shared_ptr<job::TaskSignal> warmup_signal;
 };
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "RenderTools.h"
 
+#include <cstring>
+#include <fstream>
+
 const char* errorString (const VkResult errorCode)
 {
 	switch (errorCode)
@@ -34,4 +37,44 @@ const char* errorString (const VkResult errorCode)
 		default:
 			return "UNKNOWN_ERROR";
 	}
-}
\ No newline at end of file
+}
+uint16_t to_half_float (float value)
+{
+	uint32_t bits;
+	std::memcpy (&bits, &value, sizeof (float));
+	uint32_t sign = (bits >> 16) & 0x8000u;
+	int32_t exponent = static_cast<int32_t> ((bits >> 23) & 0xFFu) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFFu;
+	if (exponent <= 0) return static_cast<uint16_t> (sign);
+	if (exponent >= 31) return static_cast<uint16_t> (sign | 0x7C00u);
+	// rounding may carry into the exponent, which is still the right result
+	return static_cast<uint16_t> ((sign | (static_cast<uint32_t> (exponent) << 10)) + ((mantissa + 0x1000u) >> 13));
+}
+
+uint64_t fnv1a_hash (std::byte const* data, size_t size, uint64_t hash)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= static_cast<uint64_t> (data[i]);
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+void write_file_atomic (std::filesystem::path const& path, char const* data, size_t size)
+{
+	auto temp_path = path;
+	temp_path += ".tmp";
+	{
+		std::ofstream out (temp_path, std::ios::binary | std::ios::out | std::ios::trunc);
+		out.write (data, size);
+		if (!out)
+		{
+			Log.error ("Failed to write {}", temp_path.string ());
+			return;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename (temp_path, path, ec);
+	if (ec) Log.error ("Failed to replace {}: {}", path.string (), ec.message ());
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
 #include <vulkan/vulkan.h>
 
 #include "core/Logger.h"
@@ -7,13 +11,23 @@
 /** @brief Returns an error code as a string */
 const char* errorString (const VkResult errorCode);
 
+/** @brief Rounds to the nearest half float, for uploads into 16 bit float textures. Values too
+small for a normal half flush to zero, values too large become infinity. */
+uint16_t to_half_float (float value);
+
+/** @brief 64 bit FNV-1a, pass a previous result as hash to continue it over more data */
+uint64_t fnv1a_hash (std::byte const* data, size_t size, uint64_t hash = 0xcbf29ce484222325);
+
+/** @brief Writes to a temporary file then renames it over path, so a crash mid write leaves the
+previous file intact instead of a truncated one */
+void write_file_atomic (std::filesystem::path const& path, char const* data, size_t size);
+
 #define VK_CHECK_RESULT(f)                                                                          \
 	{                                                                                               \
 		VkResult res = (f);                                                                         \
 		if (res != VK_SUCCESS)                                                                      \
 		{                                                                                           \
-			Log.error (fmt::format (                                                                \
-			    "Fatal : VkResult is {} in {} at line {}", errorString (res), __FILE__, __LINE__)); \
+			Log.error ("Fatal : VkResult is {} in {} at line {}", errorString (res), __FILE__, __LINE__); \
 			assert (res == VK_SUCCESS);                                                             \
 		}                                                                                           \
 	}
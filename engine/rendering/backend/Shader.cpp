@@ -1,5 +1,6 @@
 #include "Shader.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <filesystem>
@@ -56,8 +57,8 @@ void test_func ()
 	std::string source = glsl.compile ();
 }
 
-ShaderModule::ShaderModule (VkDevice device, ShaderType type, std::vector<uint32_t> const& code)
-: device (device), type (type)
+ShaderModule::ShaderModule (VkDevice device, ShaderType type, std::vector<uint32_t> const& code, std::string name)
+: device (device), type (type), name (name)
 {
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -66,7 +67,7 @@ ShaderModule::ShaderModule (VkDevice device, ShaderType type, std::vector<uint32
 
 	if (vkCreateShaderModule (device, &createInfo, nullptr, &module) != VK_SUCCESS)
 	{
-		Log.error (fmt::format ("Failed to create VkShaderModule for"));
+		Log.error ("Failed to create VkShaderModule for {}", name);
 	}
 }
 
@@ -76,7 +77,7 @@ ShaderModule::~ShaderModule ()
 }
 
 ShaderModule::ShaderModule (ShaderModule&& mod) noexcept
-: device (mod.device), type (mod.type), module (mod.module)
+: device (mod.device), type (mod.type), module (mod.module), name (std::move (mod.name))
 {
 	mod.module = nullptr;
 }
@@ -85,6 +86,7 @@ ShaderModule& ShaderModule::operator= (ShaderModule&& mod) noexcept
 	device = mod.device;
 	type = mod.type;
 	module = mod.module;
+	name = std::move (mod.name);
 	mod.module = nullptr;
 	return *this;
 }
@@ -118,34 +120,54 @@ ShaderModuleSet::ShaderModuleSet (){};
 ShaderModuleSet::ShaderModuleSet (ShaderModule const& vert, ShaderModule const& frag)
 : vert (vert.get ()), frag (frag.get ())
 {
+	add_name (ShaderType::vertex, vert);
+	add_name (ShaderType::fragment, frag);
 }
 
 ShaderModuleSet& ShaderModuleSet::Vertex (ShaderModule const& vert)
 {
 	this->vert = vert.get ();
+	add_name (ShaderType::vertex, vert);
 	return *this;
 }
 ShaderModuleSet& ShaderModuleSet::Fragment (ShaderModule const& frag)
 {
 	this->frag = frag.get ();
+	add_name (ShaderType::fragment, frag);
 	return *this;
 }
 ShaderModuleSet& ShaderModuleSet::Geometry (ShaderModule const& geom)
 {
 	this->geom = geom.get ();
+	add_name (ShaderType::geometry, geom);
 	return *this;
 }
 ShaderModuleSet& ShaderModuleSet::TessControl (ShaderModule const& tess_control)
 {
 	this->tess_control = tess_control.get ();
+	add_name (ShaderType::tessControl, tess_control);
 	return *this;
 }
 ShaderModuleSet& ShaderModuleSet::TessEval (ShaderModule const& tess_eval)
 {
 	this->tess_eval = tess_eval.get ();
+	add_name (ShaderType::tessEval, tess_eval);
 	return *this;
 }
 
+ShaderModuleSet& ShaderModuleSet::Add (ShaderModule const& module)
+{
+	switch (module.get_type ())
+	{
+		case (ShaderType::vertex): return Vertex (module);
+		case (ShaderType::fragment): return Fragment (module);
+		case (ShaderType::geometry): return Geometry (module);
+		case (ShaderType::tessControl): return TessControl (module);
+		case (ShaderType::tessEval): return TessEval (module);
+		default: Log.error ("Shader module type not part of a graphics pipeline"); return *this;
+	}
+}
+
 std::vector<VkPipelineShaderStageCreateInfo> ShaderModuleSet::ShaderStageCreateInfos () const
 {
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
@@ -160,6 +182,22 @@ std::vector<VkPipelineShaderStageCreateInfo> ShaderModuleSet::ShaderStageCreateI
 	return shaderStages;
 }
 
+void ShaderModuleSet::add_name (ShaderType type, ShaderModule const& module)
+{
+	stage_names.erase (std::remove_if (std::begin (stage_names),
+	                       std::end (stage_names),
+	                       [type] (auto const& stage) { return stage.first == type; }),
+	    std::end (stage_names));
+	if (module.get_name ().empty ()) has_unnamed_stage = true;
+	stage_names.emplace_back (type, module.get_name ());
+}
+
+std::vector<std::pair<ShaderType, std::string>> ShaderModuleSet::get_stage_names () const
+{
+	if (has_unnamed_stage) return {};
+	return stage_names;
+}
+
 Shaders::Shaders (Resource::Shader::Shaders& shaders, VkDevice device)
 : shaders (shaders), device (device)
 {
@@ -169,5 +207,13 @@ std::optional<ShaderModule> Shaders::GetModule (std::string name, ShaderType typ
 {
 	auto spirv_data = shaders.get_spirv_data (name, static_cast<Resource::Shader::ShaderType> (type));
 	if (spirv_data.size () == 0) return std::nullopt;
-	return ShaderModule{ device, type, spirv_data };
+	return ShaderModule{ device, type, spirv_data, name };
+}
+
+std::optional<ShaderModule> Shaders::compile_module (std::string const& name, std::string const& source, ShaderType type)
+{
+	auto spirv_data = shaders.compiler.compile_glsl_to_spirv (
+	    name, source, static_cast<Resource::Shader::ShaderType> (type), "assets/shaders/common");
+	if (!spirv_data || spirv_data->empty ()) return std::nullopt;
+	return ShaderModule{ device, type, spirv_data.value (), name };
 }
\ No newline at end of file
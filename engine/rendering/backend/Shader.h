@@ -2,6 +2,7 @@
 
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -24,7 +25,7 @@ ShaderType GetShaderStage (const std::string& stage);
 class ShaderModule
 {
 	public:
-	ShaderModule (VkDevice device, ShaderType type, std::vector<uint32_t> const& code);
+	ShaderModule (VkDevice device, ShaderType type, std::vector<uint32_t> const& code, std::string name = "");
 	~ShaderModule ();
 
 	ShaderModule (ShaderModule const& mod) = delete;
@@ -33,11 +34,14 @@ class ShaderModule
 	ShaderModule& operator= (ShaderModule&& mod) noexcept;
 
 	VkShaderModule get () const { return module; }
+	ShaderType get_type () const { return type; }
+	std::string const& get_name () const { return name; }
 
 	private:
 	VkDevice device;
 	ShaderType type;
 	VkShaderModule module = nullptr;
+	std::string name;
 };
 
 class ShaderModuleSet
@@ -51,10 +55,19 @@ class ShaderModuleSet
 	ShaderModuleSet& Geometry (ShaderModule const& geom);
 	ShaderModuleSet& TessControl (ShaderModule const& tess_control);
 	ShaderModuleSet& TessEval (ShaderModule const& tess_eval);
+	ShaderModuleSet& Add (ShaderModule const& module); // uses the module's type to pick the stage
 
 	std::vector<VkPipelineShaderStageCreateInfo> ShaderStageCreateInfos () const;
 
+	// names of the modules in the set, empty when any module wasn't created from the shader database
+	std::vector<std::pair<ShaderType, std::string>> get_stage_names () const;
+
 	private:
+	void add_name (ShaderType type, ShaderModule const& module);
+
+	std::vector<std::pair<ShaderType, std::string>> stage_names;
+	bool has_unnamed_stage = false;
+
 	VkShaderModule vert = VK_NULL_HANDLE;
 	VkShaderModule frag = VK_NULL_HANDLE;
 	VkShaderModule geom = VK_NULL_HANDLE;
@@ -72,6 +85,8 @@ class Shaders
 	Shaders (Resource::Shader::Shaders& shaders, VkDevice device);
 
 	std::optional<ShaderModule> GetModule (std::string name, ShaderType type);
+	// compiles GLSL made at runtime, includes resolve against assets/shaders/common
+	std::optional<ShaderModule> compile_module (std::string const& name, std::string const& source, ShaderType type);
 
 	private:
 	Resource::Shader::Shaders& shaders;
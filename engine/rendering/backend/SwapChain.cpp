@@ -1,8 +1,10 @@
 #include "SwapChain.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "core/Logger.h"
+#include "core/MemoryTracker.h"
 #include "core/Window.h"
 
 #include "Device.h"
@@ -10,16 +12,24 @@
 #include "rendering/Initializers.h"
 
 
-VulkanSwapChain::VulkanSwapChain (VulkanDevice& device, Window& window)
-: device (device), window (window)
+VulkanSwapChain::VulkanSwapChain (
+    VulkanDevice& device, Window* window, VkExtent2D headless_extent, uint32_t headless_layers)
+: device (device), window (window), headless_extent (headless_extent)
 {
-	CreateSwapChain ();
+	if (is_headless ())
+	{
+		layer_count = std::max (headless_layers, 1u);
+		create_headless_images ();
+	}
+	else
+		CreateSwapChain ();
 }
 
 VulkanSwapChain::~VulkanSwapChain () { DestroySwapchainResources (); }
 
 void VulkanSwapChain::recreate_swapchain ()
 {
+	if (is_headless ()) return;
 	DestroySwapchainResources ();
 
 	CreateSwapChain ();
@@ -103,18 +113,75 @@ void VulkanSwapChain::CreateSwapChain ()
 	{
 		VkImageViewCreateInfo viewInfo = initializers::image_view_create_info ();
 		viewInfo.image = swapChainImages[i];
-		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.viewType = layer_count > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = swapChainImageFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = layer_count;
+
+		VK_CHECK_RESULT (vkCreateImageView (device.device, &viewInfo, nullptr, &swapChainImageViews[i]));
+	}
+}
+
+void VulkanSwapChain::create_headless_images ()
+{
+	image_count = 2;
+	swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	swapChainExtent = headless_extent;
+
+	swapChainImages.resize (image_count);
+	swapChainImageViews.resize (image_count);
+	headless_allocations.resize (image_count);
+
+	for (uint32_t i = 0; i < image_count; i++)
+	{
+		VkImageCreateInfo imageInfo = initializers::image_create_info ();
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = swapChainImageFormat;
+		imageInfo.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = layer_count;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		VmaAllocationCreateInfo allocInfo = {};
+		allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+		VmaAllocationInfo alloc_info{};
+		VK_CHECK_RESULT (vmaCreateImage (device.get_image_optimal_allocator (),
+		    &imageInfo,
+		    &allocInfo,
+		    &swapChainImages[i],
+		    &headless_allocations[i],
+		    &alloc_info));
+		MemTracker.allocate (MemoryTag::render_target, alloc_info.size);
+
+		VkImageViewCreateInfo viewInfo = initializers::image_view_create_info ();
+		viewInfo.image = swapChainImages[i];
+		viewInfo.viewType = layer_count > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
 		viewInfo.format = swapChainImageFormat;
 		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		viewInfo.subresourceRange.baseMipLevel = 0;
 		viewInfo.subresourceRange.levelCount = 1;
 		viewInfo.subresourceRange.baseArrayLayer = 0;
-		viewInfo.subresourceRange.layerCount = 1;
+		viewInfo.subresourceRange.layerCount = layer_count;
 
 		VK_CHECK_RESULT (vkCreateImageView (device.device, &viewInfo, nullptr, &swapChainImageViews[i]));
 	}
 }
 
+uint32_t VulkanSwapChain::acquire_headless_image ()
+{
+	uint32_t index = next_headless_image;
+	next_headless_image = (next_headless_image + 1) % image_count;
+	return index;
+}
+
 void VulkanSwapChain::DestroySwapchainResources ()
 {
 
@@ -124,6 +191,15 @@ void VulkanSwapChain::DestroySwapchainResources ()
 	}
 	swapChainImageViews.clear ();
 
+	for (size_t i = 0; i < headless_allocations.size (); i++)
+	{
+		VmaAllocationInfo alloc_info{};
+		vmaGetAllocationInfo (device.get_image_optimal_allocator (), headless_allocations[i], &alloc_info);
+		MemTracker.free (MemoryTag::render_target, alloc_info.size);
+		vmaDestroyImage (device.get_image_optimal_allocator (), swapChainImages[i], headless_allocations[i]);
+	}
+	headless_allocations.clear ();
+
 	if (swapChain != nullptr) vkDestroySwapchainKHR (device.device, swapChain, nullptr);
 	swapChain = nullptr;
 }
@@ -173,7 +249,7 @@ VkExtent2D VulkanSwapChain::chooseSwapExtent ()
 	}
 	else
 	{
-		auto size = window.get_window_size ();
+		auto size = window->get_window_size ();
 
 		VkExtent2D actualExtent = { static_cast<uint32_t> (size.x), static_cast<uint32_t> (size.y) };
 
@@ -5,6 +5,8 @@
 
 #include <vulkan/vulkan.h>
 
+#include "vk_mem_alloc.h"
+
 class VulkanDevice;
 class Window;
 
@@ -18,7 +20,11 @@ struct SwapChainSupportDetails
 class VulkanSwapChain
 {
 	public:
-	VulkanSwapChain (VulkanDevice& device, Window& window);
+	// Without a window the 'swapchain' is a ring of offscreen images of headless_extent that are
+	// left in TRANSFER_SRC_OPTIMAL, nothing is presented. Headless images can have more than one
+	// layer, for multiview passes that render a view into each.
+	VulkanSwapChain (
+	    VulkanDevice& device, Window* window, VkExtent2D headless_extent = {}, uint32_t headless_layers = 1);
 	VulkanSwapChain (VulkanSwapChain const& chain) = delete;
 	VulkanSwapChain& operator= (VulkanSwapChain const& chain) = delete;
 	VulkanSwapChain (VulkanSwapChain&& chain) = delete;
@@ -35,8 +41,13 @@ class VulkanSwapChain
 	uint32_t GetChainCount () { return image_count; }
 
 	VkExtent2D GetImageExtent () { return swapChainExtent; }
+	uint32_t GetLayerCount () { return layer_count; }
 
 	VkImageView GetSwapChainImageView (int i) { return swapChainImageViews.at (i); }
+	VkImage GetSwapChainImage (int i) { return swapChainImages.at (i); }
+
+	bool is_headless () const { return window == nullptr; }
+	uint32_t acquire_headless_image ();
 
 	static SwapChainSupportDetails querySwapChainSupport (VkPhysicalDevice device, VkSurfaceKHR surface);
 
@@ -51,13 +62,18 @@ class VulkanSwapChain
 	private:
 	VulkanDevice& device;
 
-	Window& window;
+	Window* window;
+	VkExtent2D headless_extent;
+	uint32_t layer_count = 1;
+	std::vector<VmaAllocation> headless_allocations;
+	uint32_t next_headless_image = 0;
 
 	uint32_t image_count = 0;
 
 	SwapChainSupportDetails details;
 
 	void CreateSwapChain ();
+	void create_headless_images ();
 	void create_image_views ();
 
 	void DestroySwapchainResources ();
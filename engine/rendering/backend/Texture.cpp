@@ -1,12 +1,14 @@
 #include "Texture.h"
 
 #include <algorithm>
+#include <utility>
 
 #include "stb_image.h"
 
 #include "core/Logger.h"
 
 #include "AsyncTask.h"
+#include "Bindless.h"
 #include "Buffer.h"
 #include "Device.h"
 #include "RenderTools.h"
@@ -205,7 +207,7 @@ void GenerateMipMaps (VkCommandBuffer cmdBuf,
 	// all to SHADER_READ
 
 	if (finalImageLayout == VK_IMAGE_LAYOUT_UNDEFINED)
-		Log.error (fmt::format ("Final image layout Undefined!"));
+		Log.error ("Final image layout Undefined!");
 	SetImageLayout (cmdBuf, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, finalImageLayout, subresourceRange);
 }
 
@@ -492,7 +494,8 @@ VulkanTexture::VulkanTexture (VulkanDevice& device,
 VulkanTexture::VulkanTexture (VulkanDevice& device, TexCreateDetails texCreateDetails)
 {
 	data.device = &device;
-	data.layers = 1;
+	data.mipLevels = texCreateDetails.mipLevels;
+	data.layers = texCreateDetails.layers;
 	data.width = texCreateDetails.desiredWidth;
 	data.height = texCreateDetails.desiredHeight;
 
@@ -502,8 +505,8 @@ VulkanTexture::VulkanTexture (VulkanDevice& device, TexCreateDetails texCreateDe
 
 	VkImageCreateInfo imageInfo = initializers::image_create_info (VK_IMAGE_TYPE_2D,
 	    texCreateDetails.format,
-	    1,
-	    1,
+	    data.mipLevels,
+	    data.layers,
 	    VK_SAMPLE_COUNT_1_BIT,
 	    VK_IMAGE_TILING_OPTIMAL,
 	    VK_SHARING_MODE_EXCLUSIVE,
@@ -512,27 +515,40 @@ VulkanTexture::VulkanTexture (VulkanDevice& device, TexCreateDetails texCreateDe
 	    texCreateDetails.usage | VK_IMAGE_USAGE_SAMPLED_BIT);
 
 	if (is_depth_stencil) imageInfo.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (texCreateDetails.cubeMap) imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
 
 	VmaAllocationCreateInfo imageAllocCreateInfo = {};
 	imageAllocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
 	data.allocator = data.device->get_image_optimal_allocator ();
+	data.memory_tag = MemoryTag::render_target;
 	VK_CHECK_RESULT (vmaCreateImage (
 	    data.allocator, &imageInfo, &imageAllocCreateInfo, &image, &data.allocation, &data.allocationInfo));
+	MemTracker.allocate (data.memory_tag, data.allocationInfo.size);
+
 
+	bool has_stencil = texCreateDetails.format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+	                   texCreateDetails.format == VK_FORMAT_D24_UNORM_S8_UINT;
+	VkImageAspectFlags flags = VK_IMAGE_ASPECT_COLOR_BIT;
+	if (is_depth_stencil) flags = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (has_stencil) flags |= VK_IMAGE_ASPECT_STENCIL_BIT;
 
-	VkImageAspectFlags flags = is_depth_stencil ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT :
-	                                              VK_IMAGE_ASPECT_COLOR_BIT;
+	VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D;
+	if (texCreateDetails.cubeMap)
+		viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+	else if (data.layers > 1)
+		viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
 
 	imageView = VulkanTexture::create_image_view (image,
-	    VK_IMAGE_VIEW_TYPE_2D,
+	    viewType,
 	    texCreateDetails.format,
 	    flags,
 	    VkComponentMapping{ VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_B, VK_COMPONENT_SWIZZLE_A },
-	    1,
-	    1);
+	    data.mipLevels,
+	    data.layers);
 
-	VkImageSubresourceRange subresourceRange = initializers::image_subresource_range_create_info (flags);
+	VkImageSubresourceRange subresourceRange =
+	    initializers::image_subresource_range_create_info (flags, data.mipLevels, data.layers);
 
 	CommandPool pool (device.device, device.graphics_queue ());
 	CommandBuffer cmdBuf (pool);
@@ -544,7 +560,11 @@ VulkanTexture::VulkanTexture (VulkanDevice& device, TexCreateDetails texCreateDe
 
 VulkanTexture::~VulkanTexture ()
 {
-	if (image != VK_NULL_HANDLE) vmaDestroyImage (data.allocator, image, data.allocation);
+	if (image != VK_NULL_HANDLE)
+	{
+		vmaDestroyImage (data.allocator, image, data.allocation);
+		MemTracker.free (data.memory_tag, data.allocationInfo.size);
+	}
 	if (imageView != VK_NULL_HANDLE) vkDestroyImageView (data.device->device, imageView, nullptr);
 	if (sampler != VK_NULL_HANDLE) vkDestroySampler (data.device->device, sampler, nullptr);
 }
@@ -558,14 +578,11 @@ VulkanTexture::VulkanTexture (VulkanTexture&& tex) noexcept
 }
 VulkanTexture& VulkanTexture::operator= (VulkanTexture&& tex) noexcept
 {
-	image = tex.image;
-	imageView = tex.imageView;
-	sampler = tex.sampler;
-	data = tex.data;
-
-	tex.image = VK_NULL_HANDLE;
-	tex.imageView = VK_NULL_HANDLE;
-	tex.sampler = VK_NULL_HANDLE;
+	// tex destroys what this held
+	std::swap (image, tex.image);
+	std::swap (imageView, tex.imageView);
+	std::swap (sampler, tex.sampler);
+	std::swap (data, tex.data);
 	return *this;
 }
 
@@ -648,14 +665,18 @@ void VulkanTexture::init_image_2d (VkImageCreateInfo imageInfo)
 	}
 	VK_CHECK_RESULT (vmaCreateImage (
 	    data.allocator, &imageInfo, &imageAllocCreateInfo, &image, &data.allocation, &data.allocationInfo));
+	MemTracker.allocate (data.memory_tag, data.allocationInfo.size);
 }
 
-Textures::Textures (Resource::Texture::Textures& textures, VulkanDevice& device, AsyncTaskQueue& async_task_queue)
-: textures (textures), device (device), async_task_queue (async_task_queue)
+Textures::Textures (Resource::Texture::Textures& textures,
+    VulkanDevice& device,
+    AsyncTaskQueue& async_task_queue,
+    BindlessDescriptors& bindless)
+: textures (textures), device (device), async_task_queue (async_task_queue), bindless (bindless)
 {
 }
 
-Textures::~Textures () { Log.debug (fmt::format ("Textures left over {}", texture_map.size ())); }
+Textures::~Textures () { Log.debug ("Textures left over {}", texture_map.size ()); }
 
 std::function<void ()> Textures::create_finish_work (VulkanTextureID id)
 {
@@ -672,6 +693,9 @@ std::function<void ()> Textures::create_finish_work (VulkanTextureID id)
 			if (node)
 			{
 				texture_map.insert (std::move (node));
+				auto bindless_index = bindless_indices.find (id);
+				if (bindless_index != std::end (bindless_indices))
+					bindless.write_texture (bindless_index->second, texture_map.at (id)->get_resource ());
 			}
 		}
 	};
@@ -684,6 +708,7 @@ VulkanTextureID Textures::create_texture_2d (Resource::Texture::TexID texture_id
 	auto tex = std::make_unique<VulkanTexture> (device, async_task_queue, finish_work, texCreateDetails, resource);
 	std::lock_guard guard (map_lock);
 	in_progress_map[id_counter] = std::move (tex);
+	reserve_bindless_index (id_counter);
 	return id_counter++;
 }
 
@@ -715,6 +740,7 @@ VulkanTextureID Textures::create_texture_from_buffer (
 	    device, async_task_queue, finish_work, texCreateDetails, std::move (buffer));
 	std::lock_guard guard (map_lock);
 	in_progress_map[id_counter] = std::move (tex);
+	reserve_bindless_index (id_counter);
 	return id_counter++;
 }
 
@@ -741,6 +767,12 @@ VkDescriptorType Textures::get_descriptor_type (VulkanTextureID id)
 void Textures::delete_texture (VulkanTextureID id)
 {
 	std::lock_guard guard (map_lock);
+	auto bindless_index = bindless_indices.find (id);
+	if (bindless_index != std::end (bindless_indices))
+	{
+		bindless.free_texture_index (bindless_index->second);
+		bindless_indices.erase (bindless_index);
+	}
 	auto it = std::find (expired_textures.begin (), expired_textures.end (), id);
 	if (it != expired_textures.end ())
 	{
@@ -759,4 +791,17 @@ bool Textures::is_finished_transfer (VulkanTextureID id)
 {
 	std::lock_guard guard (map_lock);
 	return texture_map.count (id) == 1;
-}
\ No newline at end of file
+}
+std::optional<uint32_t> Textures::get_bindless_index (VulkanTextureID id)
+{
+	std::lock_guard guard (map_lock);
+	auto it = bindless_indices.find (id);
+	if (it == std::end (bindless_indices)) return {};
+	return it->second;
+}
+
+// expects map_lock to be held
+void Textures::reserve_bindless_index (VulkanTextureID id)
+{
+	if (bindless.is_enabled ()) bindless_indices[id] = bindless.allocate_texture_index ();
+}
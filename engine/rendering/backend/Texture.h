@@ -2,10 +2,13 @@
 
 #include <cstddef>
 #include <memory>
+#include <optional>
 #include <vulkan/vulkan.h>
 
 #include "vk_mem_alloc.h"
 
+#include "core/MemoryTracker.h"
+
 #include "resources/Texture.h"
 
 #include "AsyncTask.h"
@@ -13,6 +16,7 @@
 class VulkanDevice;
 class VulkanBuffer;
 class AsyncTaskQueue;
+class BindlessDescriptors;
 
 struct TexCreateDetails
 {
@@ -24,6 +28,10 @@ struct TexCreateDetails
 	uint32_t desiredWidth = 0;
 	uint32_t desiredHeight = 0;
 	VkImageUsageFlags usage = 0;
+	// only read by the constructor without a source, which leaves the contents to the caller
+	uint32_t mipLevels = 1;
+	uint32_t layers = 1;
+	bool cubeMap = false; // needs six layers
 
 	TexCreateDetails (){};
 	TexCreateDetails (VkFormat format,
@@ -93,6 +101,7 @@ class VulkanTexture
 		VmaAllocation allocation = VK_NULL_HANDLE;
 		VmaAllocationInfo allocationInfo;
 		VmaAllocator allocator = nullptr;
+		MemoryTag memory_tag = MemoryTag::texture;
 
 		uint32_t mipLevels;
 		uint32_t layers;
@@ -129,7 +138,10 @@ using VulkanTextureID = int32_t;
 class Textures
 {
 	public:
-	Textures (Resource::Texture::Textures& textures, VulkanDevice& device, AsyncTaskQueue& async_task_queue);
+	Textures (Resource::Texture::Textures& textures,
+	    VulkanDevice& device,
+	    AsyncTaskQueue& async_task_queue,
+	    BindlessDescriptors& bindless);
 	~Textures ();
 
 	Textures (Textures const& buf) = delete;
@@ -153,12 +165,18 @@ class Textures
 	VkDescriptorImageInfo get_resource (VulkanTextureID id);
 	VkDescriptorType get_descriptor_type (VulkanTextureID id);
 
+	// Index into the bindless texture array, only 2D textures get one and only when bindless is enabled.
+	// The index is valid immediately, the descriptor is written once the upload finishes.
+	std::optional<uint32_t> get_bindless_index (VulkanTextureID id);
+
 	private:
 	std::function<void ()> create_finish_work (VulkanTextureID id);
+	void reserve_bindless_index (VulkanTextureID id);
 
 	Resource::Texture::Textures& textures;
 	VulkanDevice& device;
 	AsyncTaskQueue& async_task_queue;
+	BindlessDescriptors& bindless;
 
 	VulkanTextureID id_counter = 0;
 	std::mutex map_lock;
@@ -166,4 +184,5 @@ class Textures
 	std::unordered_map<VulkanTextureID, std::unique_ptr<VulkanTexture>> texture_map;
 
 	std::vector<VulkanTextureID> expired_textures;
+	std::unordered_map<VulkanTextureID, uint32_t> bindless_indices;
 };
@@ -0,0 +1,286 @@
+#include "AtmosphereRenderer.h"
+
+#include <chrono>
+#include <cmath>
+
+#include "core/JobSystem.h"
+#include "core/Logger.h"
+#include "core/Profiler.h"
+
+#include "rendering/Initializers.h"
+#include "rendering/ViewCamera.h"
+
+// Matches SkyParams in sky.frag
+struct SkyPushConstants
+{
+	float sun_direction[4];
+	float sun_illuminance[4];
+	float sun_disk[4];
+};
+
+// the sun as seen from earth, in radians
+const float SunAngularRadius = 0.00465f;
+
+TexCreateDetails sky_view_details (AtmosphereSettings const& settings)
+{
+	TexCreateDetails details (VK_FORMAT_R16G16B16A16_SFLOAT,
+	    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    false,
+	    1,
+	    settings.sky_view_width,
+	    settings.sky_view_height);
+	details.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	return details;
+}
+
+// azimuth only covers half a turn, both ends clamp
+VkSampler create_sky_view_sampler (VkDevice device)
+{
+	VkSamplerCreateInfo info = initializers::sampler_create_info ();
+	info.magFilter = VK_FILTER_LINEAR;
+	info.minFilter = VK_FILTER_LINEAR;
+	info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.maxLod = 0.0f;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK_RESULT (vkCreateSampler (device, &info, nullptr, &sampler));
+	return sampler;
+}
+
+AtmosphereRenderer::AtmosphereRenderer (BackEnd& back_end,
+    job::ThreadPool& thread_pool,
+    DescriptorStack const& parent_stack,
+    uint32_t frame_count,
+    AtmosphereSettings settings)
+: back_end (back_end),
+  thread_pool (thread_pool),
+  luts (settings),
+  bindings ({ { DescriptorType::combined_image_sampler, ShaderStage::fragment, 0, 1 } }),
+  layout (back_end.device.device, bindings),
+  draw_stack (layout, parent_stack),
+  pool (back_end.device.device, layout.get (), bindings, 1),
+  set (pool.allocate ()),
+  sky_view (back_end.device, sky_view_details (settings)),
+  sky_view_sampler (back_end.device.device, create_sky_view_sampler (back_end.device.device), vkDestroySampler),
+  frame_staged (frame_count, false)
+{
+	auto bake_start = std::chrono::steady_clock::now ();
+	luts.generate (thread_pool);
+	Log.debug ("Atmosphere lookup tables baked in {:.1f} ms",
+	    std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - bake_start).count ());
+
+	VkDeviceSize sky_view_bytes = 4 * sizeof (uint16_t) * settings.sky_view_width * settings.sky_view_height;
+	for (uint32_t i = 0; i < frame_count; i++)
+		staging.emplace_back (back_end.device, staging_details (BufferType::staging, sky_view_bytes));
+
+	std::vector<VkDescriptorImageInfo> infos = {
+		{ sky_view_sampler.handle, sky_view.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+	};
+	std::vector<DescriptorUse> writes = { { 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, infos } };
+	set.update (back_end.device.device, writes);
+}
+
+void AtmosphereRenderer::create_pipeline (VkRenderPass render_pass, uint32_t subpass)
+{
+	auto vert = back_end.shaders.GetModule ("sky.vert", ShaderType::vertex);
+	auto frag = back_end.shaders.GetModule ("sky.frag", ShaderType::fragment);
+	if (!vert || !frag)
+	{
+		Log.error ("Missing sky shaders");
+		return;
+	}
+
+	// one triangle from gl_VertexIndex, no vertex input
+	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache };
+	builder.SetShaderModuleSet (ShaderModuleSet (vert.value (), frag.value ()))
+	    .AddViewport (1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f)
+	    .AddScissor (1, 1, 0, 0)
+	    .SetInputAssembly (VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false)
+	    .SetRasterizer (
+	        VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE, VK_FALSE, 1.0f, VK_FALSE)
+	    .SetMultisampling (VK_SAMPLE_COUNT_1_BIT)
+	    // the triangle sits on the cleared far plane, anything drawn before hides it
+	    .set_depth_stencil (VK_TRUE, VK_FALSE, VK_COMPARE_OP_GREATER_OR_EQUAL, VK_FALSE, VK_FALSE)
+	    .AddColorBlendingAttachment (VK_FALSE,
+	        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_SRC_COLOR,
+	        VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_ONE,
+	        VK_BLEND_FACTOR_ZERO)
+	    .AddDescriptorStack (draw_stack)
+	    .AddPushConstantRange (
+	        initializers::push_constant_range (VK_SHADER_STAGE_FRAGMENT_BIT, sizeof (SkyPushConstants), 0))
+	    .AddDynamicStates ({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
+
+	pipe_layout = builder.CreateLayout ();
+	if (!pipe_layout)
+	{
+		Log.error ("Failed to create the sky pipeline layout");
+		return;
+	}
+	// compiled on the job system, draws are skipped until it is ready
+	pipe = back_end.pipeline_registry.get_pipeline_async (builder, render_pass, subpass);
+}
+
+void AtmosphereRenderer::set_sun (cml::vec3f direction, cml::vec3f color, float illuminance)
+{
+	float length = std::sqrt (direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+	if (length > 0.f) sun_direction = cml::vec3f (direction.x / length, direction.y / length, direction.z / length);
+	sun_color = color;
+	sun_illuminance = illuminance;
+}
+
+void AtmosphereRenderer::update (uint32_t frame_index, ViewCameraData& camera)
+{
+	frame_staged.at (frame_index) = false;
+	if (!enabled) return;
+
+	PROFILE_SCOPE ("AtmosphereRenderer::update");
+	float view_height = camera.get_position ().y;
+	transmittance = luts.sun_transmittance (sun_direction, view_height);
+
+	// swaps in a bake that finished since the last frame
+	if (sky_view_bake && sky_view_job.is_done ()) swap_sky_view (frame_index);
+	if (!sky_view_job.is_done () || !luts.needs_sky_view (sun_direction, view_height)) return;
+
+	if (has_sky_view)
+		sky_view_job.start (thread_pool, [this, sun = sun_direction, view_height] { bake_sky_view (sun, view_height); });
+	else
+	{
+		// there is nothing to draw or light with yet, so the first one doesn't wait a frame
+		bake_sky_view (sun_direction, view_height);
+		swap_sky_view (frame_index);
+	}
+}
+
+void AtmosphereRenderer::bake_sky_view (cml::vec3f sun, float view_height)
+{
+	auto bake_start = std::chrono::steady_clock::now ();
+	sky_view_bake = luts.bake_sky_view (thread_pool, sun, view_height);
+	sky_view_bake_ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - bake_start).count ();
+}
+
+void AtmosphereRenderer::swap_sky_view (uint32_t frame_index)
+{
+	luts.set_sky_view (std::move (sky_view_bake.value ()));
+	sky_view_bake.reset ();
+	bake_ms = sky_view_bake_ms;
+
+	// the frame's fence has passed, so its staging buffer is free
+	auto const& texels = luts.get_sky_view ();
+	void* mapped = nullptr;
+	staging.at (frame_index).map (&mapped);
+	uint16_t* halves = static_cast<uint16_t*> (mapped);
+	for (size_t i = 0; i < texels.size (); i++)
+		halves[i] = to_half_float (texels[i]);
+	staging.at (frame_index).unmap ();
+	frame_staged.at (frame_index) = true;
+	has_sky_view = true;
+}
+
+void AtmosphereRenderer::record_uploads (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	if (!frame_staged.at (frame_index)) return;
+
+	PROFILE_SCOPE ("AtmosphereRenderer::record_uploads");
+	auto const& settings = luts.get_settings ();
+
+	// the previous frame may still sample the sky view, the barrier waits for it
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = sky_view.image;
+	barrier.subresourceRange = initializers::image_subresource_range_create_info (VK_IMAGE_ASPECT_COLOR_BIT);
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	    VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr,
+	    1,
+	    &barrier);
+
+	VkBufferImageCopy region{};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { settings.sky_view_width, settings.sky_view_height, 1 };
+	vkCmdCopyBufferToImage (
+	    cmdBuf, staging.at (frame_index).get (), sky_view.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr,
+	    1,
+	    &barrier);
+}
+
+void AtmosphereRenderer::draw (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	if (!enabled || !pipe_layout || !has_sky_view) return;
+	if (!pipe.bind (cmdBuf)) return;
+
+	float cos_disk = std::cos (SunAngularRadius);
+	float disk_solid_angle = 2.f * 3.14159265f * (1.f - cos_disk);
+	cml::vec3f illuminance (
+	    sun_color.x * sun_illuminance, sun_color.y * sun_illuminance, sun_color.z * sun_illuminance);
+
+	SkyPushConstants push{};
+	push.sun_direction[0] = sun_direction.x;
+	push.sun_direction[1] = sun_direction.y;
+	push.sun_direction[2] = sun_direction.z;
+	push.sun_direction[3] = cos_disk;
+	push.sun_illuminance[0] = illuminance.x;
+	push.sun_illuminance[1] = illuminance.y;
+	push.sun_illuminance[2] = illuminance.z;
+	push.sun_disk[0] = illuminance.x * transmittance.x / disk_solid_angle;
+	push.sun_disk[1] = illuminance.y * transmittance.y / disk_solid_angle;
+	push.sun_disk[2] = illuminance.z * transmittance.z / disk_solid_angle;
+
+	set.bind (cmdBuf, pipe_layout->get (), 2);
+	vkCmdPushConstants (cmdBuf, pipe_layout->get (), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof (SkyPushConstants), &push);
+	vkCmdDraw (cmdBuf, 3, 1, 0, 0);
+}
+
+DirectionalLight AtmosphereRenderer::get_sun_light () const
+{
+	DirectionalLight light;
+	light.direction = sun_direction;
+	light.intensity = sun_illuminance;
+	light.color =
+	    cml::vec3f (sun_color.x * transmittance.x, sun_color.y * transmittance.y, sun_color.z * transmittance.z);
+	return light;
+}
+
+AmbientProbe AtmosphereRenderer::get_ambient () const
+{
+	AmbientProbe probe = luts.get_ambient (sun_direction);
+	float scale[3] = { sun_color.x * sun_illuminance, sun_color.y * sun_illuminance, sun_color.z * sun_illuminance };
+	for (int i = 0; i < 3; i++)
+	{
+		probe.constant[i] *= scale[i];
+		probe.x[i] *= scale[i];
+		probe.y[i] *= scale[i];
+		probe.z[i] *= scale[i];
+	}
+	return probe;
+}
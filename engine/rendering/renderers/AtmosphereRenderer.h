@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "core/JobSystem.h"
+
+#include "rendering/Atmosphere.h"
+#include "rendering/backend/BackEnd.h"
+#include "rendering/backend/Buffer.h"
+#include "rendering/backend/Descriptor.h"
+#include "rendering/backend/Pipeline.h"
+#include "rendering/backend/RenderTools.h"
+#include "rendering/backend/Texture.h"
+#include "rendering/renderers/Lighting.h"
+
+class ViewCameraData;
+
+// Draws a physically based sky behind everything else from AtmosphereLUTs. The transmittance and
+// multiple scattering tables are baked on the pool when this is constructed, the sky view and the
+// ambient probe only when the sun's elevation or the camera's height moved enough. Those bakes run
+// in the background while the previous sky view stays in use, it is swapped and uploaded in the
+// first frame after the bake finished. The sun it lights the scene with, after the atmosphere dimmed it, and the probe are
+// handed to Lighting.
+class AtmosphereRenderer
+{
+	public:
+	AtmosphereRenderer (BackEnd& back_end,
+	    job::ThreadPool& thread_pool,
+	    DescriptorStack const& parent_stack,
+	    uint32_t frame_count,
+	    AtmosphereSettings settings = {});
+
+	void create_pipeline (VkRenderPass render_pass, uint32_t subpass);
+
+	// the sky view is only baked while enabled
+	void set_enabled (bool enabled) { this->enabled = enabled; }
+	bool is_enabled () const { return enabled; }
+
+	// direction is towards the sun with y up, illuminance is the sun's at the top of the atmosphere
+	void set_sun (cml::vec3f direction, cml::vec3f color, float illuminance);
+	cml::vec3f get_sun_direction () const { return sun_direction; }
+	cml::vec3f get_sun_color () const { return sun_color; }
+	float get_sun_illuminance () const { return sun_illuminance; }
+
+	// stages a finished sky view bake and starts the next one if the camera or the sun moved enough
+	void update (uint32_t frame_index, ViewCameraData& camera);
+	// copies a staged sky view, record before the render pass that draws the sky
+	void record_uploads (VkCommandBuffer cmdBuf, uint32_t frame_index);
+	// draws where nothing wrote depth, so record after the opaque geometry
+	void draw (VkCommandBuffer cmdBuf, uint32_t frame_index);
+
+	// the sun as it reaches the camera, as of the last update
+	DirectionalLight get_sun_light () const;
+	// the sky's irradiance in the same units as the sun light
+	AmbientProbe get_ambient () const;
+
+	AtmosphereLUTs const& get_luts () const { return luts; }
+	double get_bake_ms () const { return bake_ms; }
+
+	private:
+	BackEnd& back_end;
+	job::ThreadPool& thread_pool;
+	AtmosphereLUTs luts;
+	bool enabled = false;
+	bool has_sky_view = false;
+	double bake_ms = 0.0;
+
+	cml::vec3f sun_direction = cml::vec3f (0.f, 1.f, 0.f);
+	cml::vec3f sun_color = cml::vec3f (1.f, 1.f, 1.f);
+	float sun_illuminance = 10.f;
+	cml::vec3f transmittance = cml::vec3f (1.f, 1.f, 1.f); // towards the sun from the camera
+
+	std::vector<DescriptorSetLayoutBinding> bindings;
+	DescriptorLayout layout;
+	DescriptorStack draw_stack;
+	DescriptorPool pool;
+	DescriptorSet set;
+
+	VulkanTexture sky_view;
+	VulkanHandle<VkSampler, PFN_vkDestroySampler> sky_view_sampler;
+	// one per frame in flight
+	std::vector<VulkanBuffer> staging;
+	std::vector<bool> frame_staged;
+
+	std::optional<PipelineLayout> pipe_layout;
+	PipelineHandle pipe;
+
+	// written by sky_view_job, only read once it is done
+	std::optional<SkyViewBake> sky_view_bake;
+	double sky_view_bake_ms = 0.0;
+	// last, so it's finished before what it writes is destroyed
+	job::BackgroundJob sky_view_job;
+
+	void bake_sky_view (cml::vec3f sun, float view_height);
+	// hands the finished bake to luts and stages it
+	void swap_sky_view (uint32_t frame_index);
+};
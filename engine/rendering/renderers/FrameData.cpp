@@ -2,21 +2,40 @@
 
 #include "rendering/backend/Device.h"
 
-FrameData::FrameData (VulkanDevice& device)
+FrameData::FrameData (VulkanDevice& device, uint32_t frame_count)
 : device (device),
-  frame_data (device, uniform_details (sizeof (Data))),
   m_bindings ({ { DescriptorType::uniform_buffer, ShaderStage::all_graphics, 0, 1 },
       { DescriptorType::uniform_buffer, ShaderStage::all_graphics, 1, 1 } }),
   layout (device.device, m_bindings),
   descriptor_stack (layout),
-  pool (device.device, layout.get (), m_bindings, 2),
-  frame_descriptors ({ pool.allocate (), pool.allocate () })
+  pool (device.device, layout.get (), m_bindings, frame_count)
 {
+	frame_data.reserve (frame_count);
+	frame_descriptors.reserve (frame_count);
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		frame_data.emplace_back (device, uniform_details (sizeof (Data)));
+		frame_data.back ().copy_to_buffer (current_data);
+		frame_descriptors.push_back (pool.allocate ());
+		frame_descriptors.back ().update (device.device,
+		    { { 0, 1, frame_data.back ().get_descriptor_type (), { frame_data.back ().get_descriptor_info () } } });
+	}
 }
 
 void FrameData::update (double time) {}
 
-void FrameData::bind (VkCommandBuffer buffer) {}
-void FrameData::advance () {}
+void FrameData::set_cameras (RenderCameras& cameras, ViewCameraID id)
+{
+	for (size_t i = 0; i < frame_descriptors.size (); i++)
+	{
+		frame_descriptors[i].update (device.device,
+		    { { 1, 1, cameras.get_descriptor_type (), { cameras.get_descriptor_info (static_cast<int> (i), id) } } });
+	}
+}
+
+void FrameData::bind (VkCommandBuffer buffer, VkPipelineLayout layout, uint32_t frame_index)
+{
+	frame_descriptors.at (frame_index).bind (buffer, layout, 0);
+}
 
-DescriptorStack const& FrameData::get_descriptor_stack () const { return descriptor_stack; }
\ No newline at end of file
+DescriptorStack const& FrameData::get_descriptor_stack () const { return descriptor_stack; }
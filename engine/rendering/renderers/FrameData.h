@@ -5,31 +5,32 @@
 
 #include "rendering/backend/Buffer.h"
 #include "rendering/backend/Descriptor.h"
+#include "rendering/ViewCamera.h"
 
 class FrameData
 {
 	public:
-	FrameData (VulkanDevice& device);
+	FrameData (VulkanDevice& device, uint32_t frame_count);
 
 	void update (double time);
 
-	void bind (VkCommandBuffer buffer);
-	void advance ();
+	// points the camera binding of every frame's set at camera id, and the ones after it for
+	// multiview passes
+	void set_cameras (RenderCameras& cameras, ViewCameraID id);
+
+	void bind (VkCommandBuffer buffer, VkPipelineLayout layout, uint32_t frame_index);
 
 	DescriptorStack const& get_descriptor_stack () const;
 
 	private:
 	VulkanDevice& device;
-	DoubleBuffer frame_data;
+	std::vector<VulkanBuffer> frame_data; // one per frame in flight
 
-	int cur_index = 0;
 	std::vector<DescriptorSetLayoutBinding> m_bindings;
 	DescriptorLayout layout;
 	DescriptorStack descriptor_stack;
 	DescriptorPool pool;
-	std::array<DescriptorSet, 2> frame_descriptors;
-
-	VkPipelineLayout frame_layout;
+	std::vector<DescriptorSet> frame_descriptors;
 
 	struct Data
 	{
@@ -37,4 +38,4 @@ class FrameData
 		float delta_time = 0.f;
 		uint32_t frame_index = 0;
 	} current_data;
-};
\ No newline at end of file
+};
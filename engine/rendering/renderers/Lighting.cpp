@@ -1,60 +1,414 @@
 #include "Lighting.h"
 
+#include <algorithm>
+#include <cmath>
+
+#include "core/Logger.h"
+#include "core/Profiler.h"
+
+#include "rendering/Initializers.h"
+#include "rendering/ViewCamera.h"
 #include "rendering/backend/Device.h"
+#include "rendering/backend/RenderTools.h"
+#include "rendering/backend/Wrappers.h"
+
+static_assert (sizeof (DirectionalLight) == 32, "must match DirectionalLight in lighting.glsl");
+static_assert (sizeof (PointLight) == 32, "must match PointLight in lighting.glsl");
+static_assert (sizeof (SpotLight) == 64, "must match SpotLight in lighting.glsl");
+static_assert (sizeof (ClusterParams) == 48 && sizeof (LightCluster) == 16, "must match lighting.glsl");
+static_assert (sizeof (ShadowGPUData) == 304, "must match ShadowData in lighting.glsl");
+static_assert (sizeof (AmbientProbe) == 64, "must match AmbientProbe in lighting.glsl");
+static_assert (sizeof (EnvironmentGPUData) == 160, "must match EnvironmentData in lighting.glsl");
+
+// lights surfaces with albedo * 0.02, the constant ambient term the shaders used before
+const AmbientProbe DefaultAmbient = AmbientProbe::uniform (cml::vec3f (0.0628f, 0.0628f, 0.0628f));
+
+// lights and shadows the scene from above when there is neither a sun nor a directional light
+const DirectionalLight DefaultDirectionalLight{ cml::vec3f (0.3015f, 0.9045f, 0.3015f), 3.f, cml::vec3f (1.f, 0.97f, 0.9f) };
+
+// unit length, lights with no direction point straight down
+cml::vec3f light_direction (cml::vec3f direction)
+{
+	float length_sq = direction.x * direction.x + direction.y * direction.y + direction.z * direction.z;
+	if (length_sq < 1e-12f) return cml::vec3f (0.f, -1.f, 0.f);
+	return direction * (1.f / std::sqrt (length_sq));
+}
+
+BufCreateDetails light_buffer_details (VkDeviceSize size)
+{
+	return BufCreateDetails{ BufferType::storage,
+		size,
+		(VkBufferUsageFlags) (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+		VMA_MEMORY_USAGE_CPU_TO_GPU,
+		VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		1,
+		true };
+}
+
+// Compares against reversed depth, so a fragment is lit when it's at least as close to the light as
+// the stored caster. Outside the map counts as lit.
+VkSampler create_shadow_sampler (VkDevice device)
+{
+	VkSamplerCreateInfo info = initializers::sampler_create_info ();
+	info.magFilter = VK_FILTER_LINEAR;
+	info.minFilter = VK_FILTER_LINEAR;
+	info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	info.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK;
+	info.compareEnable = VK_TRUE;
+	info.compareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+	info.maxLod = 0.0f;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK_RESULT (vkCreateSampler (device, &info, nullptr, &sampler));
+	return sampler;
+}
+
+// Trilinear across the prefiltered mips, the shader picks the mip by roughness
+VkSampler create_environment_sampler (VkDevice device)
+{
+	VkSamplerCreateInfo info = initializers::sampler_create_info ();
+	info.magFilter = VK_FILTER_LINEAR;
+	info.minFilter = VK_FILTER_LINEAR;
+	info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.maxLod = VK_LOD_CLAMP_NONE;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK_RESULT (vkCreateSampler (device, &info, nullptr, &sampler));
+	return sampler;
+}
+
+TexCreateDetails environment_specular_details (uint32_t size, uint32_t mips)
+{
+	TexCreateDetails details (VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, 1, size, size);
+	details.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	details.mipLevels = mips;
+	details.layers = 6;
+	details.cubeMap = true;
+	return details;
+}
+
+TexCreateDetails environment_brdf_details (uint32_t size)
+{
+	TexCreateDetails details (VK_FORMAT_R16G16_SFLOAT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, 1, size, size);
+	details.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	return details;
+}
+
+// Copies the whole image from staging, which has to be laid out in the order of regions
+void upload_environment_image (VulkanDevice& device,
+    VulkanTexture& texture,
+    VulkanBuffer& staging,
+    std::vector<VkBufferImageCopy> const& regions,
+    VkImageSubresourceRange range)
+{
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = texture.image;
+	barrier.subresourceRange = range;
+
+	CommandPool cmd_pool (device.device, device.graphics_queue ());
+	CommandBuffer cmd_buf (cmd_pool);
+	cmd_buf.allocate ().begin ();
+	vkCmdPipelineBarrier (
+	    cmd_buf.get (), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	vkCmdCopyBufferToImage (cmd_buf.get (),
+	    staging.get (),
+	    texture.image,
+	    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	    static_cast<uint32_t> (regions.size ()),
+	    regions.data ());
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier (cmd_buf.get (),
+	    VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr,
+	    1,
+	    &barrier);
+	cmd_buf.end ().submit ().wait ();
+}
 
-Lighting::Lighting (VulkanDevice& device, Textures& textures, FrameData& frame_data)
+Lighting::Lighting (VulkanDevice& device, FrameData& frame_data, uint32_t frame_count)
 : device (device),
-  directional_gpu_data (device, uniform_array_details (MaxDirectionalLightCount, sizeof (DirectionalLight))),
-  point_gpu_data (device, uniform_array_details (MaxPointLightCount, sizeof (PointLight))),
-  spot_gpu_data (device, uniform_array_details (MaxSpotLightCount, sizeof (SpotLight))),
-  m_bindings ({ { DescriptorType::uniform_buffer, ShaderStage::all_graphics, 0, MaxDirectionalLightCount },
-      { DescriptorType::uniform_buffer, ShaderStage::all_graphics, 1, MaxPointLightCount },
-      { DescriptorType::uniform_buffer, ShaderStage::all_graphics, 2, MaxSpotLightCount } }),
+  shadow_sampler (device.device, create_shadow_sampler (device.device), vkDestroySampler),
+  environment_specular (device, environment_specular_details (1, 1)),
+  environment_brdf (device, environment_brdf_details (1)),
+  environment_sampler (device.device, create_environment_sampler (device.device), vkDestroySampler),
+  m_bindings ({ { DescriptorType::storage_buffer, ShaderStage::fragment, 0, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 1, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 2, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 3, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 4, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 5, 1 },
+      { DescriptorType::combined_image_sampler, ShaderStage::fragment, 6, ShadowGPUData::MaxCascades },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 7, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 8, 1 },
+      { DescriptorType::combined_image_sampler, ShaderStage::fragment, 9, 1 },
+      { DescriptorType::combined_image_sampler, ShaderStage::fragment, 10, 1 } }),
   layout (device.device, m_bindings),
   descriptor_stack (layout, frame_data.get_descriptor_stack ()),
-  pool (device.device, layout.get (), m_bindings, 2),
-  lighting_descriptors ({ pool.allocate (), pool.allocate () }),
+  pool (device.device, layout.get (), m_bindings, frame_count),
   pipeline_layout (device.device, descriptor_stack.get_layouts (), {})
 {
-	for (int i = 0; i < lighting_descriptors.size (); i++)
-	{
-		std::vector<VkDescriptorBufferInfo> dir_buf;
-		for (int j = 0; j < MaxDirectionalLightCount; j++)
-			dir_buf.push_back (directional_gpu_data.get_descriptor_info (i, j));
-		std::vector<VkDescriptorBufferInfo> point_buf;
-		for (int j = 0; j < MaxPointLightCount; j++)
-			point_buf.push_back (point_gpu_data.get_descriptor_info (i, j));
-		std::vector<VkDescriptorBufferInfo> spot_buf;
-		for (int j = 0; j < MaxSpotLightCount; j++)
-			spot_buf.push_back (spot_gpu_data.get_descriptor_info (i, j));
-
-		std::vector<DescriptorUse> writes_0 = {
-			{ 0, MaxDirectionalLightCount, directional_gpu_data.get_descriptor_type (), dir_buf },
-			{ 0, MaxPointLightCount, point_gpu_data.get_descriptor_type (), point_buf },
-			{ 0, MaxSpotLightCount, spot_gpu_data.get_descriptor_type (), spot_buf }
+	frame_buffers.reserve (frame_count);
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		frame_buffers.push_back (FrameBuffers{
+		    VulkanBuffer (device, light_buffer_details (sizeof (DirectionalLight) * MaxDirectionalLightCount)),
+		    VulkanBuffer (device, light_buffer_details (sizeof (PointLight) * MaxPointLightCount)),
+		    VulkanBuffer (device, light_buffer_details (sizeof (SpotLight) * MaxSpotLightCount)),
+		    VulkanBuffer (device,
+		        light_buffer_details (sizeof (ClusterParams) + sizeof (LightCluster) * LightClusterGrid::ClusterCount)),
+		    VulkanBuffer (device, light_buffer_details (sizeof (uint32_t) * LightClusterGrid::MaxIndexCount)),
+		    VulkanBuffer (device, light_buffer_details (sizeof (ShadowGPUData))),
+		    VulkanBuffer (device, light_buffer_details (sizeof (AmbientProbe))),
+		    VulkanBuffer (device, light_buffer_details (sizeof (EnvironmentGPUData))) });
+		auto& buffers = frame_buffers.back ();
+
+		lighting_descriptors.push_back (pool.allocate ());
+		std::vector<DescriptorUse> writes = {
+			{ 0, 1, buffers.directional.get_descriptor_type (), { buffers.directional.get_descriptor_info () } },
+			{ 1, 1, buffers.point.get_descriptor_type (), { buffers.point.get_descriptor_info () } },
+			{ 2, 1, buffers.spot.get_descriptor_type (), { buffers.spot.get_descriptor_info () } },
+			{ 3, 1, buffers.clusters.get_descriptor_type (), { buffers.clusters.get_descriptor_info () } },
+			{ 4, 1, buffers.indices.get_descriptor_type (), { buffers.indices.get_descriptor_info () } },
+			{ 5, 1, buffers.shadows.get_descriptor_type (), { buffers.shadows.get_descriptor_info () } },
+			{ 7, 1, buffers.ambient.get_descriptor_type (), { buffers.ambient.get_descriptor_info () } },
+			{ 8, 1, buffers.environment.get_descriptor_type (), { buffers.environment.get_descriptor_info () } }
 		};
-		lighting_descriptors[i].update (device.device, writes_0);
+		lighting_descriptors[i].update (device.device, writes);
+	}
+	write_environment_maps ();
+}
+
+void Lighting::set_directional_lights (std::vector<DirectionalLight> lights)
+{
+	if (lights.size () > MaxDirectionalLightCount) lights.resize (MaxDirectionalLightCount);
+	for (auto& light : lights)
+		light.direction = light_direction (light.direction);
+	directional_lights = std::move (lights);
+}
+
+void Lighting::set_point_lights (std::vector<PointLight> lights)
+{
+	if (lights.size () > MaxPointLightCount) lights.resize (MaxPointLightCount);
+	point_lights = std::move (lights);
+
+	point_spheres.resize (point_lights.size ());
+	for (size_t i = 0; i < point_lights.size (); i++)
+		point_spheres[i] = LightSphere{ point_lights[i].position, point_lights[i].range };
+}
+
+void Lighting::set_spot_lights (std::vector<SpotLight> lights)
+{
+	if (lights.size () > MaxSpotLightCount) lights.resize (MaxSpotLightCount);
+	// the shader and the bounds below expect unit directions
+	for (auto& light : lights)
+		light.direction = light_direction (light.direction);
+	spot_lights = std::move (lights);
+
+	// smallest sphere around the cone, wide cones are bounded by their cap instead of their apex
+	spot_spheres.resize (spot_lights.size ());
+	for (size_t i = 0; i < spot_lights.size (); i++)
+	{
+		auto& light = spot_lights[i];
+		float cos_angle = std::clamp (light.cos_outer, -1.f, 1.f);
+		float sin_angle = std::sqrt (1.f - cos_angle * cos_angle);
+		if (cos_angle < 0.f)
+			// wider than a hemisphere, reaches behind the light
+			spot_spheres[i] = LightSphere{ light.position, light.range };
+		else if (cos_angle < 0.70710678f)
+			spot_spheres[i] =
+			    LightSphere{ light.position + light.direction * (light.range * cos_angle), light.range * sin_angle };
+		else
+		{
+			float radius = light.range / (2.f * cos_angle);
+			spot_spheres[i] = LightSphere{ light.position + light.direction * radius, radius };
+		}
 	}
 }
 
+std::optional<cml::vec3f> Lighting::get_shadow_direction () const
+{
+	if (sun) return sun->direction;
+	if (directional_lights.empty ()) return DefaultDirectionalLight.direction;
+	return directional_lights.front ().direction;
+}
+
+void Lighting::set_shadow_maps (std::vector<VkImageView> const& views)
+{
+	if (views.empty ()) return;
+
+	std::vector<VkDescriptorImageInfo> infos;
+	for (uint32_t i = 0; i < ShadowGPUData::MaxCascades; i++)
+	{
+		VkDescriptorImageInfo info{};
+		info.sampler = shadow_sampler.handle;
+		info.imageView = i < views.size () ? views[i] : views.front ();
+		info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		infos.push_back (info);
+	}
+
+	for (auto& set : lighting_descriptors)
+	{
+		std::vector<DescriptorUse> writes = {
+			{ 6, ShadowGPUData::MaxCascades, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, infos }
+		};
+		set.update (device.device, writes);
+	}
+}
 
-void Lighting::update (std::vector<DirectionalLight> directional_lights,
-    std::vector<PointLight> point_lights,
-    std::vector<SpotLight> spot_lights)
+void Lighting::set_environment (IBLMaps const& maps)
 {
-	directional_gpu_data.Write ().copy_to_buffer (directional_lights);
-	point_gpu_data.Write ().copy_to_buffer (point_lights);
-	spot_gpu_data.Write ().copy_to_buffer (spot_lights);
-	directional_gpu_data.advance ();
-	point_gpu_data.advance ();
-	spot_gpu_data.advance ();
+	PROFILE_SCOPE ("Lighting::set_environment");
+	uint32_t size = maps.get_specular_size ();
+	uint32_t mips = maps.get_specular_mips ();
+	uint32_t lut_size = maps.get_settings ().brdf_lut_size;
+	if (size == 0 || mips == 0)
+	{
+		Log.error ("Lighting was given empty environment maps");
+		return;
+	}
+
+	// half floats, the specular mips back to back and the BRDF table after them
+	auto const& specular = maps.get_specular ();
+	auto const& brdf_lut = maps.get_brdf_lut ();
+	std::vector<uint16_t> halves (specular.size () + brdf_lut.size ());
+	for (size_t i = 0; i < specular.size (); i++)
+		halves[i] = to_half_float (specular[i]);
+	for (size_t i = 0; i < brdf_lut.size (); i++)
+		halves[specular.size () + i] = to_half_float (brdf_lut[i]);
+
+	VulkanBuffer staging (device, staging_details (BufferType::staging, sizeof (uint16_t) * halves.size ()));
+	staging.copy_to_buffer (halves);
+
+	// frames in flight may still sample the old maps
+	vkDeviceWaitIdle (device.device);
+	environment_specular = VulkanTexture (device, environment_specular_details (size, mips));
+	environment_brdf = VulkanTexture (device, environment_brdf_details (lut_size));
+
+	std::vector<VkBufferImageCopy> specular_regions;
+	for (uint32_t mip = 0; mip < mips; mip++)
+	{
+		uint32_t mip_size = std::max (size >> mip, 1u);
+		VkBufferImageCopy region{};
+		region.bufferOffset = sizeof (uint16_t) * maps.get_specular_offset (mip, 0);
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 6 };
+		region.imageExtent = { mip_size, mip_size, 1 };
+		specular_regions.push_back (region);
+	}
+	upload_environment_image (device,
+	    environment_specular,
+	    staging,
+	    specular_regions,
+	    initializers::image_subresource_range_create_info (VK_IMAGE_ASPECT_COLOR_BIT, mips, 6));
+
+	VkBufferImageCopy brdf_region{};
+	brdf_region.bufferOffset = sizeof (uint16_t) * specular.size ();
+	brdf_region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	brdf_region.imageExtent = { lut_size, lut_size, 1 };
+	upload_environment_image (device,
+	    environment_brdf,
+	    staging,
+	    { brdf_region },
+	    initializers::image_subresource_range_create_info (VK_IMAGE_ASPECT_COLOR_BIT));
+
+	write_environment_maps ();
+	environment.irradiance = maps.get_irradiance ();
+	environment.specular_mips = static_cast<float> (mips);
+	environment.enabled = 1;
 }
-void Lighting::bind (VkCommandBuffer buffer)
+
+void Lighting::write_environment_maps ()
 {
-	lighting_descriptors.at (cur_index).bind (buffer, pipeline_layout.get (), 1);
+	std::vector<VkDescriptorImageInfo> specular_info = {
+		{ environment_sampler.handle, environment_specular.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+	};
+	std::vector<VkDescriptorImageInfo> brdf_info = {
+		{ environment_sampler.handle, environment_brdf.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+	};
+	for (auto& set : lighting_descriptors)
+	{
+		std::vector<DescriptorUse> writes = { { 9, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, specular_info },
+			{ 10, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, brdf_info } };
+		set.update (device.device, writes);
+	}
 }
 
-void Lighting::advance () { cur_index = (cur_index + 1) % 2; }
+void Lighting::update (
+    job::ThreadPool& pool, uint32_t frame_index, ViewCameraData& camera, VkExtent2D extent, float view_offset)
+{
+	PROFILE_SCOPE ("Lighting::update");
+	// A view offset from the camera looks up the same froxel at a point moved by its offset, so
+	// growing every light by the offset keeps its fragments within the light's clusters
+	auto const* points = &point_spheres;
+	auto const* spots = &spot_spheres;
+	if (view_offset > 0.f)
+	{
+		auto inflate = [view_offset] (std::vector<LightSphere> const& spheres, std::vector<LightSphere>& inflated) {
+			inflated = spheres;
+			for (auto& sphere : inflated)
+				sphere.radius += view_offset;
+		};
+		inflate (point_spheres, inflated_point_spheres);
+		inflate (spot_spheres, inflated_spot_spheres);
+		points = &inflated_point_spheres;
+		spots = &inflated_spot_spheres;
+	}
+	cluster_grid.build (pool,
+	    camera.get_view_mat (),
+	    camera.get_proj_mat (),
+	    camera.get_clip_near (),
+	    camera.get_clip_far (),
+	    static_cast<float> (extent.width),
+	    static_cast<float> (extent.height),
+	    *points,
+	    *spots);
+
+	uploaded_directional_lights.clear ();
+	if (sun) uploaded_directional_lights.push_back (*sun);
+	for (auto const& light : directional_lights)
+		if (uploaded_directional_lights.size () < MaxDirectionalLightCount)
+			uploaded_directional_lights.push_back (light);
+	if (uploaded_directional_lights.empty ()) uploaded_directional_lights.push_back (DefaultDirectionalLight);
 
+	ClusterParams params = cluster_grid.get_params ();
+	params.directional_count = static_cast<uint32_t> (uploaded_directional_lights.size ());
+
+	auto& buffers = frame_buffers.at (frame_index);
+	buffers.directional.copy_to_buffer (uploaded_directional_lights);
+	buffers.point.copy_to_buffer (point_lights);
+	buffers.spot.copy_to_buffer (spot_lights);
+	buffers.clusters.copy_to_buffer (params);
+	buffers.clusters.copy_to_buffer (cluster_grid.get_clusters (), sizeof (ClusterParams));
+	buffers.indices.copy_to_buffer (cluster_grid.get_indices ());
+	buffers.shadows.copy_to_buffer (shadow_data);
+	buffers.ambient.copy_to_buffer (ambient ? *ambient : DefaultAmbient);
+	buffers.environment.copy_to_buffer (environment);
+}
+
+void Lighting::bind (VkCommandBuffer buffer, uint32_t frame_index)
+{
+	lighting_descriptors.at (frame_index).bind (buffer, pipeline_layout.get (), 1);
+}
 
 DescriptorStack const& Lighting::get_descriptor_stack () const { return descriptor_stack; }
@@ -1,72 +1,166 @@
 #pragma once
-#include <array>
+#include <optional>
+#include <vector>
 
 #include "cml/cml.h"
 
+#include "rendering/Atmosphere.h"
+#include "rendering/IBL.h"
+#include "rendering/LightClusters.h"
+#include "rendering/ShadowCascades.h"
 #include "rendering/backend/Buffer.h"
 #include "rendering/backend/Descriptor.h"
-#include "rendering/backend/Texture.h"
 #include "rendering/backend/Pipeline.h"
+#include "rendering/backend/Texture.h"
 
 #include "rendering/renderers/FrameData.h"
 
 class VulkanDevice;
+class ViewCameraData;
+namespace job
+{
+class ThreadPool;
+}
+
+// Light structs match their std430 counterparts in lighting.glsl
 
 struct DirectionalLight
 {
-	cml::vec3f direction;
-	cml::vec3f color;
+	cml::vec3f direction; // towards the light
 	float intensity = 0.0f;
+	cml::vec3f color;
+	float padding = 0.0f;
 };
 
 struct PointLight
 {
 	cml::vec3f position;
+	float range = 0.0f; // no contribution past this distance
 	cml::vec3f color;
-	float attenuation = 0.0f;
-	float cufOff = 0.0f;
+	float intensity = 0.0f;
 };
 
 struct SpotLight
 {
 	cml::vec3f position;
-	cml::vec3f direction;
+	float range = 0.0f;
+	cml::vec3f direction; // the way the light points
+	float cos_inner = 1.0f; // full intensity inside this cone
 	cml::vec3f color;
-	float attenuation = 0.0f;
-	float cutoff = 0.0f;
-	float outerCutOff = 0.0f;
+	float intensity = 0.0f;
+	float cos_outer = 0.0f; // no contribution outside this cone
+	float padding[3] = {};
+};
+
+// Matches EnvironmentData in lighting.glsl
+struct EnvironmentGPUData
+{
+	IrradianceSH irradiance;
+	float specular_mips = 1.0f;
+	float intensity = 1.0f;
+	uint32_t enabled = 0;
+	float padding = 0.0f;
 };
 
 const uint32_t MaxDirectionalLightCount = 4;
-const uint32_t MaxPointLightCount = 16;
-const uint32_t MaxSpotLightCount = 16;
+const uint32_t MaxPointLightCount = 4096;
+const uint32_t MaxSpotLightCount = 1024;
 
+// Lights live in storage buffers and are binned into a LightClusterGrid for the main camera each
+// frame, so fragments only shade the lights whose range reaches their cluster. The first
+// directional light casts cascaded shadows, a default one stands in while there is no sun and no
+// directional light. Every surface gets ambient light from an AmbientProbe, or from IBLMaps once
+// an environment is set.
 class Lighting
 {
 	public:
-	Lighting (VulkanDevice& device, Textures& textures, FrameData& frame_data);
+	Lighting (VulkanDevice& device, FrameData& frame_data, uint32_t frame_count);
+
+	// lights past the max counts are dropped, directions are normalized
+	void set_directional_lights (std::vector<DirectionalLight> lights);
+	void set_point_lights (std::vector<PointLight> lights);
+	void set_spot_lights (std::vector<SpotLight> lights);
+	// the sun goes ahead of the directional lights and casts the shadows, nullopt removes it
+	void set_sun (std::optional<DirectionalLight> light) { sun = light; }
+	// nullopt goes back to a dim uniform ambient
+	void set_ambient (std::optional<AmbientProbe> probe) { ambient = probe; }
+	// Uploads the maps and lights with them instead of the ambient probe. Waits for the device to
+	// idle, so call it outside of a frame.
+	void set_environment (IBLMaps const& maps);
+	// back to the ambient probe
+	void clear_environment () { environment.enabled = 0; }
+	bool has_environment () const { return environment.enabled != 0; }
+	void set_environment_intensity (float intensity) { environment.intensity = intensity; }
+	float get_environment_intensity () const { return environment.intensity; }
+
+	// towards the shadow casting light
+	std::optional<cml::vec3f> get_shadow_direction () const;
+	// written into the frame's buffers by the next update
+	void set_shadows (ShadowGPUData const& data) { shadow_data = data; }
+	// One depth view per cascade, must not be called while frames using them are in flight.
+	// Missing cascades repeat the first view.
+	void set_shadow_maps (std::vector<VkImageView> const& views);
 
-	void update (std::vector<DirectionalLight> directional_lights,
-	    std::vector<PointLight> point_lights,
-	    std::vector<SpotLight> spot_lights);
+	// Bins the lights for the camera and writes everything into the frame's buffers. Views
+	// rendered up to view_offset away from the camera, like stereo eyes, look up the same grid.
+	void update (job::ThreadPool& pool,
+	    uint32_t frame_index,
+	    ViewCameraData& camera,
+	    VkExtent2D extent,
+	    float view_offset = 0.f);
 
-	void bind (VkCommandBuffer buffer);
-	void advance ();
+	void bind (VkCommandBuffer buffer, uint32_t frame_index);
 
 	DescriptorStack const& get_descriptor_stack () const;
+	// the layout bind uses, FrameData binds set 0 with it as well
+	VkPipelineLayout get_pipeline_layout () const { return pipeline_layout.get (); }
+	LightClusterGrid const& get_cluster_grid () const { return cluster_grid; }
 
 	private:
 	VulkanDevice& device;
-	DoubleBuffer directional_gpu_data;
-	DoubleBuffer point_gpu_data;
-	DoubleBuffer spot_gpu_data;
 
-	int cur_index = 0;
+	std::optional<DirectionalLight> sun;
+	std::vector<DirectionalLight> directional_lights;
+	std::vector<DirectionalLight> uploaded_directional_lights;
+	std::optional<AmbientProbe> ambient;
+	std::vector<PointLight> point_lights;
+	std::vector<SpotLight> spot_lights;
+
+	LightClusterGrid cluster_grid;
+	std::vector<LightSphere> point_spheres;
+	std::vector<LightSphere> spot_spheres;
+	std::vector<LightSphere> inflated_point_spheres; // grown by the view offset
+	std::vector<LightSphere> inflated_spot_spheres;
+
+	ShadowGPUData shadow_data;
+	VulkanHandle<VkSampler, PFN_vkDestroySampler> shadow_sampler;
+
+	EnvironmentGPUData environment;
+	// 1x1 placeholders until an environment is set, so the descriptors are always valid
+	VulkanTexture environment_specular;
+	VulkanTexture environment_brdf;
+	VulkanHandle<VkSampler, PFN_vkDestroySampler> environment_sampler;
+
+	struct FrameBuffers
+	{
+		VulkanBuffer directional;
+		VulkanBuffer point;
+		VulkanBuffer spot;
+		VulkanBuffer clusters; // ClusterParams followed by the LightClusters
+		VulkanBuffer indices;
+		VulkanBuffer shadows; // ShadowGPUData
+		VulkanBuffer ambient; // AmbientProbe
+		VulkanBuffer environment; // EnvironmentGPUData
+	};
+	std::vector<FrameBuffers> frame_buffers;
+
 	std::vector<DescriptorSetLayoutBinding> m_bindings;
 	DescriptorLayout layout;
 	DescriptorStack descriptor_stack;
 	DescriptorPool pool;
-	std::array<DescriptorSet, 2> lighting_descriptors;
+	std::vector<DescriptorSet> lighting_descriptors;
 
 	PipelineLayout pipeline_layout;
-};
\ No newline at end of file
+
+	void write_environment_maps ();
+};
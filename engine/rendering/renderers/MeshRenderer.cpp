@@ -1,6 +1,448 @@
 #include "MeshRenderer.h"
 
+#include <algorithm>
+#include <cmath>
+
+#include "core/Logger.h"
+
+#include "rendering/Initializers.h"
 #include "rendering/backend/BackEnd.h"
 
+const uint32_t CullGroupSize = 64;
+
+const uint32_t VisibilityWordCount = MeshRenderer::MaxDrawCount / 32;
+
+struct CullPushConstants
+{
+	uint32_t draw_count;
+};
+
+BufCreateDetails draw_data_details ()
+{
+	return BufCreateDetails{ BufferType::storage,
+		sizeof (DrawData) * MeshRenderer::MaxDrawCount,
+		(VkBufferUsageFlags) (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+		VMA_MEMORY_USAGE_GPU_ONLY };
+}
+
+// big enough for the whole DrawData array, transform uploads only use the front
+BufCreateDetails draw_upload_details ()
+{
+	return BufCreateDetails{ BufferType::staging,
+		sizeof (DrawData) * MeshRenderer::MaxDrawCount,
+		(VkBufferUsageFlags) (VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
+		VMA_MEMORY_USAGE_CPU_TO_GPU,
+		VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		1,
+		true };
+}
+
+BufCreateDetails draw_command_details ()
+{
+	return BufCreateDetails{ BufferType::storage,
+		sizeof (VkDrawIndexedIndirectCommand) * MeshRenderer::MaxDrawCount,
+		(VkBufferUsageFlags) (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT),
+		VMA_MEMORY_USAGE_GPU_ONLY };
+}
+
+MeshRenderer::MeshRenderer (BackEnd& back_end, DescriptorStack const& parent_stack, uint32_t frame_count)
+: back_end (back_end),
+  cull_bindings ({ { DescriptorType::storage_buffer, ShaderStage::compute, 0, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::compute, 1, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::compute, 2, 1 } }),
+  draw_bindings ({ { DescriptorType::storage_buffer, ShaderStage::vertex, 0, 1 } }),
+  cull_layout (back_end.device.device, cull_bindings),
+  draw_layout (back_end.device.device, draw_bindings),
+  draw_stack (draw_layout, parent_stack),
+  cull_pool (back_end.device.device, cull_layout.get (), cull_bindings, frame_count),
+  draw_pool (back_end.device.device, draw_layout.get (), draw_bindings, 1),
+  draw_buffer (back_end.device, draw_data_details ()),
+  draw_set (draw_pool.allocate ()),
+  pending_transform_slots (MaxDrawCount),
+  slot_upload_stamps (MaxDrawCount, 0),
+  cull_pipe_layout (back_end.device.device,
+      { cull_layout.get () },
+      { initializers::push_constant_range (VK_SHADER_STAGE_COMPUTE_BIT, sizeof (CullPushConstants), 0) })
+{
+	std::vector<DescriptorUse> draw_writes = {
+		{ 0, 1, draw_buffer.get_descriptor_type (), { draw_buffer.get_descriptor_info () } }
+	};
+	draw_set.update (back_end.device.device, draw_writes);
+
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		command_buffers.emplace_back (back_end.device, draw_command_details ());
+		visibility_buffers.emplace_back (back_end.device, storage_mapped_details (VisibilityWordCount, sizeof (uint32_t)));
+		cull_sets.push_back (cull_pool.allocate ());
+
+		std::vector<DescriptorUse> cull_writes = {
+			{ 0, 1, draw_buffer.get_descriptor_type (), { draw_buffer.get_descriptor_info () } },
+			{ 1, 1, command_buffers[i].get_descriptor_type (), { command_buffers[i].get_descriptor_info () } },
+			{ 2, 1, visibility_buffers[i].get_descriptor_type (), { visibility_buffers[i].get_descriptor_info () } }
+		};
+		cull_sets[i].update (back_end.device.device, cull_writes);
+	}
+	for (uint32_t i = 0; i < frame_count + 1; i++)
+		upload_buffers.emplace_back (back_end.device, draw_upload_details ());
+
+	auto cull_shader = back_end.shaders.GetModule ("cull_draws.comp", ShaderType::compute);
+	if (cull_shader)
+	{
+		cull_pipe = BuildComputePipeline (back_end.device.device,
+		    cull_pipe_layout,
+		    std::move (cull_shader.value ()),
+		    back_end.pipeline_cache.get ());
+	}
+	if (!cull_pipe) Log.error ("Failed to create the draw culling pipeline");
+}
+
+void MeshRenderer::create_pipeline (VkRenderPass render_pass, uint32_t subpass)
+{
+	// with descriptor indexing each draw reads its material, otherwise every mesh is plain grey
+	draw_uses_bindless = back_end.materials.uses_bindless ();
+	auto vert = back_end.shaders.GetModule ("mesh_indirect.vert", ShaderType::vertex);
+	auto frag = back_end.shaders.GetModule (
+	    draw_uses_bindless ? "mesh_indirect_bindless.frag" : "mesh_indirect.frag", ShaderType::fragment);
+	if (!vert || !frag)
+	{
+		Log.error ("Missing indirect mesh shaders");
+		return;
+	}
+
+	using Resource::Mesh::VertexType;
+	Resource::Mesh::VertexDescription vert_desc ({ VertexType::Vert3, VertexType::Vert3, VertexType::Vert2 });
+
+	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache };
+	builder.SetShaderModuleSet (ShaderModuleSet (vert.value (), frag.value ()))
+	    .UseModelVertexLayout (VertexLayout (vert_desc))
+	    .AddViewport (1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f)
+	    .AddScissor (1, 1, 0, 0)
+	    .SetInputAssembly (VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false)
+	    .SetRasterizer (
+	        VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE, VK_FALSE, 1.0f, VK_TRUE)
+	    .SetMultisampling (VK_SAMPLE_COUNT_1_BIT)
+	    .set_depth_stencil (VK_TRUE, VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL, VK_FALSE, VK_FALSE)
+	    .AddColorBlendingAttachment (VK_FALSE,
+	        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_SRC_COLOR,
+	        VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_ONE,
+	        VK_BLEND_FACTOR_ZERO)
+	    .AddDescriptorStack (draw_stack)
+	    .AddDynamicStates ({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
+	if (draw_uses_bindless) builder.AddDescriptorLayout (back_end.bindless.get_layout ());
+
+	draw_pipe_layout = builder.CreateLayout ();
+	if (!draw_pipe_layout)
+	{
+		Log.error ("Failed to create the indirect mesh pipeline layout");
+		return;
+	}
+	draw_pipe = back_end.pipeline_registry.get_pipeline (builder, draw_pipe_layout.value (), render_pass, subpass);
+}
+
+void MeshRenderer::create_shadow_pipeline (VkRenderPass render_pass, uint32_t subpass)
+{
+	auto vert = back_end.shaders.GetModule ("shadow.vert", ShaderType::vertex);
+	if (!vert)
+	{
+		Log.error ("Missing shadow shader");
+		return;
+	}
+
+	using Resource::Mesh::VertexType;
+	Resource::Mesh::VertexDescription vert_desc ({ VertexType::Vert3, VertexType::Vert3, VertexType::Vert2 });
+
+	// no culling, thin casters would otherwise let light through from behind
+	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache };
+	builder.SetShaderModuleSet (ShaderModuleSet ().Vertex (vert.value ()))
+	    .UseModelVertexLayout (VertexLayout (vert_desc))
+	    .AddViewport (1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f)
+	    .AddScissor (1, 1, 0, 0)
+	    .SetInputAssembly (VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false)
+	    .SetRasterizer (
+	        VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE, VK_FALSE, 1.0f, VK_FALSE)
+	    .SetMultisampling (VK_SAMPLE_COUNT_1_BIT)
+	    .set_depth_stencil (VK_TRUE, VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL, VK_FALSE, VK_FALSE)
+	    .AddDescriptorStack (draw_stack)
+	    .AddPushConstantRange (initializers::push_constant_range (VK_SHADER_STAGE_VERTEX_BIT, sizeof (cml::mat4f), 0))
+	    .AddDynamicStates ({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
+
+	shadow_pipe_layout = builder.CreateLayout ();
+	if (!shadow_pipe_layout)
+	{
+		Log.error ("Failed to create the shadow pipeline layout");
+		return;
+	}
+	shadow_pipe = back_end.pipeline_registry.get_pipeline (builder, shadow_pipe_layout.value (), render_pass, subpass);
+}
+
+MeshDrawID MeshRenderer::add_mesh (ModelID model,
+    cml::mat4f const& transform,
+    cml::vec3f bounds_center,
+    float bounds_radius,
+    BindlessMaterialIndex material_index)
+{
+	if (draws.size () >= MaxDrawCount)
+		throw std::runtime_error ("MeshRenderer is out of draw slots");
+
+	DrawData data;
+	data.transform = transform;
+	data.bounds = cml::vec4f (bounds_center.x, bounds_center.y, bounds_center.z, bounds_radius);
+	data.material_index = material_index;
+
+	auto info = back_end.models.get_draw_info (model);
+	if (info)
+	{
+		data.index_count = info->index_count;
+		data.first_index = info->first_index;
+		data.vertex_offset = info->vertex_offset;
+	}
+	else
+	{
+		has_pending_models = true;
+	}
+
+	MeshDrawID id = next_id++;
+	id_to_slot[id] = static_cast<uint32_t> (draws.size ());
+	slot_to_id.push_back (id);
+	draws.push_back (data);
+	draw_models.push_back (model);
+	mark_dirty ();
+	return id;
+}
+
+void MeshRenderer::set_transform (MeshDrawID id, cml::mat4f const& transform)
+{
+	auto it = id_to_slot.find (id);
+	if (it == id_to_slot.end ()) return;
+	uint32_t slot = it->second;
+	// kept for fill_bounds and full uploads, the GPU gets the matrix from the upload buffer
+	draws[slot].transform = transform;
+
+	// past the end of the upload buffer the next cull uploads the whole array instead
+	uint32_t entry = pending_transform_count.fetch_add (1, std::memory_order_relaxed);
+	if (entry >= MaxDrawCount) return;
+	upload_buffers[upload_index].copy_to_buffer (transform, entry * sizeof (cml::mat4f));
+	pending_transform_slots[entry] = slot;
+}
+
+void MeshRenderer::remove_mesh (MeshDrawID id)
+{
+	auto it = id_to_slot.find (id);
+	if (it == id_to_slot.end ()) return;
+
+	// swap with the last draw to keep the array dense
+	uint32_t slot = it->second;
+	uint32_t last = static_cast<uint32_t> (draws.size ()) - 1;
+	if (slot != last)
+	{
+		draws[slot] = draws[last];
+		draw_models[slot] = draw_models[last];
+		slot_to_id[slot] = slot_to_id[last];
+		id_to_slot[slot_to_id[slot]] = slot;
+	}
+	draws.pop_back ();
+	draw_models.pop_back ();
+	slot_to_id.pop_back ();
+	id_to_slot.erase (it);
+	mark_dirty ();
+}
+
+void MeshRenderer::resolve_pending_models ()
+{
+	if (!has_pending_models) return;
+
+	has_pending_models = false;
+	for (size_t i = 0; i < draws.size (); i++)
+	{
+		if (draws[i].index_count != 0) continue;
+
+		auto info = back_end.models.get_draw_info (draw_models[i]);
+		if (!info)
+		{
+			has_pending_models = true;
+			continue;
+		}
+		draws[i].index_count = info->index_count;
+		draws[i].first_index = info->first_index;
+		draws[i].vertex_offset = info->vertex_offset;
+		mark_dirty ();
+	}
+}
+
+void MeshRenderer::upload_draws (VkCommandBuffer cmdBuf)
+{
+	resolve_pending_models ();
+
+	auto& upload = upload_buffers[upload_index];
+	uint32_t transform_count = pending_transform_count.exchange (0, std::memory_order_relaxed);
+	upload_index = (upload_index + 1) % static_cast<uint32_t> (upload_buffers.size ());
+
+	std::vector<VkBufferCopy> regions;
+	if (needs_full_upload || transform_count > MaxDrawCount)
+	{
+		if (!draws.empty ())
+		{
+			upload.copy_to_buffer (draws);
+			regions.push_back ({ 0, 0, sizeof (DrawData) * draws.size () });
+		}
+		needs_full_upload = false;
+	}
+	else
+	{
+		// the regions of one copy may not overlap, so only the last write of a slot is copied
+		upload_stamp++;
+		for (uint32_t entry = transform_count; entry-- > 0;)
+		{
+			uint32_t slot = pending_transform_slots[entry];
+			if (slot_upload_stamps[slot] == upload_stamp) continue;
+			slot_upload_stamps[slot] = upload_stamp;
+			regions.push_back ({ entry * sizeof (cml::mat4f), slot * sizeof (DrawData), sizeof (cml::mat4f) });
+		}
+	}
+	if (regions.empty ()) return;
+	upload.flush ();
+
+	// earlier frames may still be reading the draws, the queue runs their commands first
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = draw_buffer.get ();
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+	    VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    1,
+	    &barrier,
+	    0,
+	    nullptr);
+
+	vkCmdCopyBuffer (cmdBuf, upload.get (), draw_buffer.get (), static_cast<uint32_t> (regions.size ()), regions.data ());
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    1,
+	    &barrier,
+	    0,
+	    nullptr);
+}
+
+void MeshRenderer::cull (VkCommandBuffer cmdBuf, uint32_t frame_index, std::vector<uint32_t> const& visible_slots)
+{
+	// shadows draw from the uploaded draws even when culling isn't available
+	upload_draws (cmdBuf);
+	if (!cull_pipe || draws.empty ()) return;
+
+	visibility_mask.assign ((draws.size () + 31) / 32, 0);
+	for (uint32_t slot : visible_slots)
+		if (slot < draws.size ()) visibility_mask[slot / 32] |= 1u << (slot % 32);
+	visibility_buffers.at (frame_index).copy_to_buffer (visibility_mask);
+	visibility_buffers.at (frame_index).flush ();
+
+	CullPushConstants push{ draw_count () };
+
+	cull_pipe->bind (cmdBuf);
+	cull_sets.at (frame_index).bind (cmdBuf, cull_pipe_layout.get (), 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+	vkCmdPushConstants (
+	    cmdBuf, cull_pipe_layout.get (), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof (CullPushConstants), &push);
+	vkCmdDispatch (cmdBuf, (draw_count () + CullGroupSize - 1) / CullGroupSize, 1, 1);
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = command_buffers.at (frame_index).get ();
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    1,
+	    &barrier,
+	    0,
+	    nullptr);
+}
+
+void MeshRenderer::draw (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	if (!cull_pipe || !draw_pipe_layout || draws.empty ()) return;
+	if (!draw_pipe.bind (cmdBuf)) return;
+
+	draw_set.bind (cmdBuf, draw_pipe_layout->get (), 2);
+	if (draw_uses_bindless) back_end.bindless.bind (cmdBuf, draw_pipe_layout->get (), 3);
+	back_end.models.bind_geometry (cmdBuf);
+	vkCmdDrawIndexedIndirect (cmdBuf,
+	    command_buffers.at (frame_index).get (),
+	    0,
+	    draw_count (),
+	    sizeof (VkDrawIndexedIndirectCommand));
+}
+
+void MeshRenderer::fill_bounds (CullingBounds& bounds) const
+{
+	bounds.clear ();
+	for (auto& draw : draws)
+	{
+		float const* m = reinterpret_cast<float const*> (&draw.transform);
+		float const* b = reinterpret_cast<float const*> (&draw.bounds);
+		cml::vec3f center (m[0] * b[0] + m[4] * b[1] + m[8] * b[2] + m[12],
+		    m[1] * b[0] + m[5] * b[1] + m[9] * b[2] + m[13],
+		    m[2] * b[0] + m[6] * b[1] + m[10] * b[2] + m[14]);
+		// the largest axis scale keeps the sphere conservative under non uniform scale
+		float scale = std::sqrt (std::max ({ m[0] * m[0] + m[1] * m[1] + m[2] * m[2],
+		    m[4] * m[4] + m[5] * m[5] + m[6] * m[6],
+		    m[8] * m[8] + m[9] * m[9] + m[10] * m[10] }));
+		bounds.add_sphere (center, b[3] * scale);
+	}
+}
+
+void MeshRenderer::draw_shadow (VkCommandBuffer cmdBuf,
+    cml::mat4f const& proj_view,
+    std::vector<uint32_t> const& visible_slots,
+    uint32_t resolution)
+{
+	if (!shadow_pipe_layout || visible_slots.empty ()) return;
+	if (!shadow_pipe.bind (cmdBuf)) return;
+
+	VkViewport viewport =
+	    initializers::viewport (static_cast<float> (resolution), static_cast<float> (resolution), 0.0f, 1.0f);
+	vkCmdSetViewport (cmdBuf, 0, 1, &viewport);
+	VkRect2D scissor = initializers::rect2D (resolution, resolution, 0, 0);
+	vkCmdSetScissor (cmdBuf, 0, 1, &scissor);
+
+	draw_set.bind (cmdBuf, shadow_pipe_layout->get (), 2);
+	vkCmdPushConstants (
+	    cmdBuf, shadow_pipe_layout->get (), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof (cml::mat4f), &proj_view);
+	back_end.models.bind_geometry (cmdBuf);
 
-MeshRenderer::MeshRenderer (BackEnd& back_end) : back_end (back_end) {}
\ No newline at end of file
+	// firstInstance carries the slot, like the indirect commands written by the cull pass
+	for (uint32_t slot : visible_slots)
+	{
+		if (slot >= draws.size ()) continue;
+		auto& draw = draws[slot];
+		if (draw.index_count == 0) continue;
+		vkCmdDrawIndexed (cmdBuf, draw.index_count, 1, draw.first_index, draw.vertex_offset, slot);
+	}
+}
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "rendering/Culling.h"
 #include "rendering/backend/BackEnd.h"
 
+#include "rendering/backend/Buffer.h"
 #include "rendering/backend/Descriptor.h"
 #include "rendering/backend/Material.h"
 #include "rendering/backend/Model.h"
@@ -15,11 +24,109 @@ struct MeshData
 	MatInstanceID mat;
 };
 
+// Matches DrawData in cull_draws.comp and mesh_indirect.vert (std430)
+struct DrawData
+{
+	cml::mat4f transform;
+	cml::vec4f bounds; // object space sphere, w is the radius
+	uint32_t index_count = 0; // 0 while the model is still uploading, the cull pass skips it
+	uint32_t first_index = 0;
+	int32_t vertex_offset = 0;
+	uint32_t material_index = Materials::DefaultMaterial; // ignored without bindless
+};
+
+using MeshDrawID = uint32_t;
+
+// Draws every mesh with a single vkCmdDrawIndexedIndirect. The draws are culled on the CPU against
+// the cameras, a compute pass then turns the visible slots into one indirect command per draw,
+// hidden draws get an instanceCount of 0. Meshes must use the pos3/normal3/uv2 vertex layout and live in the
+// models GeometryBuffer.
+//
+// The DrawData array lives in a single device local buffer. Moving a draw only uploads its
+// transform: write_transform puts the matrix straight into a mapped upload buffer and cull copies
+// it into place. Adding or removing draws uploads the whole array.
 class MeshRenderer
 {
 	public:
-	MeshRenderer (BackEnd& back_end);
+	static constexpr uint32_t MaxDrawCount = 16384;
+
+	MeshRenderer (BackEnd& back_end, DescriptorStack const& parent_stack, uint32_t frame_count);
+
+	void create_pipeline (VkRenderPass render_pass, uint32_t subpass);
+	// depth only pipeline for shadow maps, the render pass needs a single depth attachment
+	void create_shadow_pipeline (VkRenderPass render_pass, uint32_t subpass);
+
+	MeshDrawID add_mesh (ModelID model,
+	    cml::mat4f const& transform,
+	    cml::vec3f bounds_center,
+	    float bounds_radius,
+	    BindlessMaterialIndex material_index = Materials::DefaultMaterial);
+	// Safe to call from several threads at once, as long as no draws are added or removed meanwhile
+	void set_transform (MeshDrawID id, cml::mat4f const& transform);
+	void remove_mesh (MeshDrawID id);
+
+	uint32_t draw_count () const { return static_cast<uint32_t> (draws.size ()); }
+
+	// Records the draw uploads and the dispatch writing the draw commands, must be called outside
+	// of a render pass and before draw_shadow. visible_slots are the slots fill_bounds culled to.
+	void cull (VkCommandBuffer cmdBuf, uint32_t frame_index, std::vector<uint32_t> const& visible_slots);
+	void draw (VkCommandBuffer cmdBuf, uint32_t frame_index);
+
+	// Fills bounds with the world space sphere of every draw, index i is draw slot i
+	void fill_bounds (CullingBounds& bounds) const;
+	// Draws the given slots depth only, for shadow maps culled on the CPU with fill_bounds
+	void draw_shadow (VkCommandBuffer cmdBuf,
+	    cml::mat4f const& proj_view,
+	    std::vector<uint32_t> const& visible_slots,
+	    uint32_t resolution);
 
 	private:
 	BackEnd& back_end;
-};
\ No newline at end of file
+
+	std::vector<DescriptorSetLayoutBinding> cull_bindings;
+	std::vector<DescriptorSetLayoutBinding> draw_bindings;
+	DescriptorLayout cull_layout;
+	DescriptorLayout draw_layout;
+	DescriptorStack draw_stack;
+	DescriptorPool cull_pool;
+	DescriptorPool draw_pool;
+
+	VulkanBuffer draw_buffer;
+	DescriptorSet draw_set;
+	// one of each per frame in flight
+	std::vector<VulkanBuffer> command_buffers;
+	std::vector<VulkanBuffer> visibility_buffers; // a bit per slot
+	std::vector<DescriptorSet> cull_sets;
+	std::vector<uint32_t> visibility_mask;
+
+	// One more upload buffer than frames in flight. set_transform runs before render_frame waits
+	// for this frame's fence, but the buffer it writes was last read frame_count + 1 frames ago,
+	// which the previous frame's fence wait already covered.
+	std::vector<VulkanBuffer> upload_buffers;
+	uint32_t upload_index = 0;
+	std::atomic_uint32_t pending_transform_count{ 0 };
+	std::vector<uint32_t> pending_transform_slots; // by upload entry
+	std::vector<uint32_t> slot_upload_stamps; // dedupes slots written more than once per upload
+	uint32_t upload_stamp = 0;
+	bool needs_full_upload = true;
+
+	PipelineLayout cull_pipe_layout;
+	std::optional<ComputePipeline> cull_pipe;
+	std::optional<PipelineLayout> draw_pipe_layout;
+	PipelineHandle draw_pipe;
+	bool draw_uses_bindless = false;
+	std::optional<PipelineLayout> shadow_pipe_layout;
+	PipelineHandle shadow_pipe;
+
+	// draws are kept dense so the cull dispatch covers exactly draw_count entries
+	std::vector<DrawData> draws;
+	std::vector<ModelID> draw_models;
+	std::vector<MeshDrawID> slot_to_id;
+	std::unordered_map<MeshDrawID, uint32_t> id_to_slot;
+	MeshDrawID next_id = 0;
+	bool has_pending_models = false;
+
+	void mark_dirty () { needs_full_upload = true; }
+	void resolve_pending_models ();
+	void upload_draws (VkCommandBuffer cmdBuf);
+};
@@ -0,0 +1,298 @@
+#include "OceanRenderer.h"
+
+#include <limits>
+
+#include "core/JobSystem.h"
+#include "core/Logger.h"
+#include "core/Profiler.h"
+
+#include "rendering/Initializers.h"
+#include "resources/Mesh.h"
+
+// Matches OceanParams in water.vert and water.frag
+struct OceanPushConstants
+{
+	float patch_sizes[4];
+	float fade_distances[4];
+	float sea_level;
+	uint32_t cascade_count;
+	float padding[2];
+};
+
+// a cascade fades out over the distance this many of its tiles cover
+const float OceanFadeTiles = 12.f;
+
+// RGBA16F texels, displacement then slope of every cascade
+const VkDeviceSize OceanTexelBytes = 4 * sizeof (uint16_t);
+
+TexCreateDetails ocean_map_details (uint32_t size)
+{
+	TexCreateDetails details (VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, 1, size, size);
+	details.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	return details;
+}
+
+VkSampler create_ocean_sampler (VkDevice device)
+{
+	VkSamplerCreateInfo info = initializers::sampler_create_info ();
+	info.magFilter = VK_FILTER_LINEAR;
+	info.minFilter = VK_FILTER_LINEAR;
+	info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	info.maxLod = 0.0f;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK_RESULT (vkCreateSampler (device, &info, nullptr, &sampler));
+	return sampler;
+}
+
+OceanRenderer::OceanRenderer (BackEnd& back_end,
+    job::ThreadPool& thread_pool,
+    DescriptorStack const& parent_stack,
+    uint32_t frame_count,
+    OceanSettings settings)
+: back_end (back_end),
+  thread_pool (thread_pool),
+  simulation (settings),
+  start_time (std::chrono::steady_clock::now ()),
+  // dense under the camera, coarser towards the horizon
+  plane_model (back_end.models.create_model (Resource::Mesh::create_water_plane_sub_div (17, 16))),
+  bindings ({ { DescriptorType::combined_image_sampler, ShaderStage::all_graphics, 0, OceanSettings::MaxCascades },
+      { DescriptorType::combined_image_sampler, ShaderStage::all_graphics, 1, OceanSettings::MaxCascades } }),
+  layout (back_end.device.device, bindings),
+  draw_stack (layout, parent_stack),
+  pool (back_end.device.device, layout.get (), bindings, 1),
+  set (pool.allocate ()),
+  map_sampler (back_end.device.device, create_ocean_sampler (back_end.device.device), vkDestroySampler),
+  frame_staged (frame_count, false)
+{
+	for (uint32_t i = 0; i < settings.cascade_count; i++)
+	{
+		displacement_maps.emplace_back (back_end.device, ocean_map_details (settings.resolution));
+		slope_maps.emplace_back (back_end.device, ocean_map_details (settings.resolution));
+	}
+
+	VkDeviceSize map_bytes = OceanTexelBytes * settings.resolution * settings.resolution;
+	for (uint32_t i = 0; i < frame_count; i++)
+		staging.emplace_back (back_end.device, staging_details (BufferType::staging, map_bytes * 2 * settings.cascade_count));
+
+	// the array bindings always have MaxCascades entries, missing cascades repeat the first
+	std::vector<VkDescriptorImageInfo> displacement_infos;
+	std::vector<VkDescriptorImageInfo> slope_infos;
+	for (uint32_t i = 0; i < OceanSettings::MaxCascades; i++)
+	{
+		uint32_t cascade = i < settings.cascade_count ? i : 0;
+		displacement_infos.push_back (
+		    { map_sampler.handle, displacement_maps[cascade].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+		slope_infos.push_back ({ map_sampler.handle, slope_maps[cascade].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+	}
+	std::vector<DescriptorUse> writes = {
+		{ 0, OceanSettings::MaxCascades, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, displacement_infos },
+		{ 1, OceanSettings::MaxCascades, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, slope_infos }
+	};
+	set.update (back_end.device.device, writes);
+}
+
+void OceanRenderer::create_pipeline (VkRenderPass render_pass, uint32_t subpass)
+{
+	auto vert = back_end.shaders.GetModule ("water.vert", ShaderType::vertex);
+	auto frag = back_end.shaders.GetModule ("water.frag", ShaderType::fragment);
+	if (!vert || !frag)
+	{
+		Log.error ("Missing water shaders");
+		return;
+	}
+
+	using Resource::Mesh::VertexType;
+	Resource::Mesh::VertexDescription vert_desc ({ VertexType::Vert3 });
+
+	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache };
+	builder.SetShaderModuleSet (ShaderModuleSet (vert.value (), frag.value ()))
+	    .UseModelVertexLayout (VertexLayout (vert_desc))
+	    .AddViewport (1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f)
+	    .AddScissor (1, 1, 0, 0)
+	    .SetInputAssembly (VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false)
+	    // steep crests can show their back faces
+	    .SetRasterizer (
+	        VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE, VK_FALSE, 1.0f, VK_FALSE)
+	    .SetMultisampling (VK_SAMPLE_COUNT_1_BIT)
+	    .set_depth_stencil (VK_TRUE, VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL, VK_FALSE, VK_FALSE)
+	    .AddColorBlendingAttachment (VK_FALSE,
+	        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_SRC_COLOR,
+	        VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_ONE,
+	        VK_BLEND_FACTOR_ZERO)
+	    .AddDescriptorStack (draw_stack)
+	    .AddPushConstantRange (initializers::push_constant_range (
+	        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, sizeof (OceanPushConstants), 0))
+	    .AddDynamicStates ({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
+
+	pipe_layout = builder.CreateLayout ();
+	if (!pipe_layout)
+	{
+		Log.error ("Failed to create the ocean pipeline layout");
+		return;
+	}
+	// compiled on the job system, draws are skipped until it is ready
+	pipe = back_end.pipeline_registry.get_pipeline_async (builder, render_pass, subpass);
+}
+
+void OceanRenderer::update (uint32_t frame_index)
+{
+	frame_staged.at (frame_index) = false;
+	if (!enabled) return;
+
+	PROFILE_SCOPE ("OceanRenderer::update");
+	float time = std::chrono::duration<float> (std::chrono::steady_clock::now () - start_time).count ();
+
+	// the frame's fence has passed, so its staging buffer is free
+	void* mapped = nullptr;
+	staging.at (frame_index).map (&mapped);
+	staging_frame = frame_index;
+	frame_staged.at (frame_index) = true;
+	simulate_job.start (thread_pool, [this, time, halves = static_cast<uint16_t*> (mapped)] { simulate (time, halves); });
+}
+
+void OceanRenderer::finish_update ()
+{
+	if (!staging_frame) return;
+
+	PROFILE_SCOPE ("OceanRenderer::finish_update");
+	simulate_job.wait ();
+	staging.at (staging_frame.value ()).unmap ();
+	staging_frame.reset ();
+}
+
+void OceanRenderer::simulate (float time, uint16_t* halves)
+{
+	auto simulate_start = std::chrono::steady_clock::now ();
+	simulation.simulate (thread_pool, time);
+	simulate_ms = std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - simulate_start).count ();
+
+	auto const& settings = simulation.get_settings ();
+	size_t texel_count = static_cast<size_t> (settings.resolution) * settings.resolution;
+	job::parallel_for (thread_pool, settings.cascade_count * settings.resolution, 16, [&] (size_t begin, size_t end) {
+		for (size_t row = begin; row < end; row++)
+		{
+			uint32_t cascade = static_cast<uint32_t> (row / settings.resolution);
+			size_t first = (row % settings.resolution) * settings.resolution;
+			auto const& texels = simulation.get_texels (cascade);
+			uint16_t* displacement = halves + (2 * cascade * texel_count + first) * 4;
+			uint16_t* slope = displacement + texel_count * 4;
+			for (size_t i = 0; i < settings.resolution; i++)
+				for (size_t c = 0; c < 4; c++)
+				{
+					displacement[i * 4 + c] = to_half_float (texels[first + i].displacement[c]);
+					slope[i * 4 + c] = to_half_float (texels[first + i].slope[c]);
+				}
+		}
+	});
+}
+
+void OceanRenderer::record_uploads (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	if (!frame_staged.at (frame_index)) return;
+
+	PROFILE_SCOPE ("OceanRenderer::record_uploads");
+	auto const& settings = simulation.get_settings ();
+	VkDeviceSize map_bytes = OceanTexelBytes * settings.resolution * settings.resolution;
+
+	std::vector<VkImage> images;
+	for (uint32_t i = 0; i < settings.cascade_count; i++)
+	{
+		images.push_back (displacement_maps[i].image);
+		images.push_back (slope_maps[i].image);
+	}
+
+	// the previous frame may still sample the maps, the barriers wait for it
+	std::vector<VkImageMemoryBarrier> barriers;
+	for (VkImage image : images)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = initializers::image_subresource_range_create_info (VK_IMAGE_ASPECT_COLOR_BIT);
+		barriers.push_back (barrier);
+	}
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	    VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr,
+	    static_cast<uint32_t> (barriers.size ()),
+	    barriers.data ());
+
+	for (size_t i = 0; i < images.size (); i++)
+	{
+		VkBufferImageCopy region{};
+		region.bufferOffset = map_bytes * i;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { settings.resolution, settings.resolution, 1 };
+		vkCmdCopyBufferToImage (
+		    cmdBuf, staging.at (frame_index).get (), images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	}
+
+	for (auto& barrier : barriers)
+	{
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr,
+	    static_cast<uint32_t> (barriers.size ()),
+	    barriers.data ());
+}
+
+void OceanRenderer::draw (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	// the maps only hold this frame's surface once it was staged
+	if (!pipe_layout || !frame_staged.at (frame_index)) return;
+
+	auto info = back_end.models.get_draw_info (plane_model);
+	if (!info) return;
+	if (!pipe.bind (cmdBuf)) return;
+
+	auto const& settings = simulation.get_settings ();
+	OceanPushConstants push{};
+	for (uint32_t i = 0; i < settings.cascade_count; i++)
+	{
+		push.patch_sizes[i] = settings.patch_sizes[i];
+		push.fade_distances[i] = settings.patch_sizes[i] * OceanFadeTiles;
+	}
+	// the largest cascade carries the swell out to the horizon
+	push.fade_distances[0] = std::numeric_limits<float>::max ();
+	push.sea_level = sea_level;
+	push.cascade_count = settings.cascade_count;
+
+	set.bind (cmdBuf, pipe_layout->get (), 2);
+	vkCmdPushConstants (cmdBuf,
+	    pipe_layout->get (),
+	    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+	    0,
+	    sizeof (OceanPushConstants),
+	    &push);
+	back_end.models.bind_geometry (cmdBuf);
+	vkCmdDrawIndexed (cmdBuf, info->index_count, 1, info->first_index, info->vertex_offset, 0);
+}
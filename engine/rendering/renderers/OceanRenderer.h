@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "core/JobSystem.h"
+
+#include "rendering/Ocean.h"
+#include "rendering/backend/BackEnd.h"
+#include "rendering/backend/Buffer.h"
+#include "rendering/backend/Descriptor.h"
+#include "rendering/backend/Model.h"
+#include "rendering/backend/Pipeline.h"
+#include "rendering/backend/RenderTools.h"
+#include "rendering/backend/Texture.h"
+
+class ViewCameraData;
+
+// Draws an endless sea surface displaced by an OceanSimulation. Every frame the cascades are
+// simulated on the thread pool, converted to half floats into the frame's staging buffer and
+// copied into one displacement and one slope map per cascade, which water.vert and water.frag
+// sample with repeat addressing. The simulation runs in the background while the rest of the
+// frame is recorded, only the submit waits for it. The mesh follows the camera and gets coarser away from it, the
+// finer cascades fade out with distance before their tiling shows.
+class OceanRenderer
+{
+	public:
+	OceanRenderer (BackEnd& back_end,
+	    job::ThreadPool& thread_pool,
+	    DescriptorStack const& parent_stack,
+	    uint32_t frame_count,
+	    OceanSettings settings = {});
+
+	void create_pipeline (VkRenderPass render_pass, uint32_t subpass);
+
+	// simulation only runs while enabled
+	void set_enabled (bool enabled) { this->enabled = enabled; }
+	bool is_enabled () const { return enabled; }
+	void set_sea_level (float height) { sea_level = height; }
+	float get_sea_level () const { return sea_level; }
+
+	// starts simulating the current time into the frame's staging buffer, call once its fence passed
+	void update (uint32_t frame_index);
+	// copies the staged maps, record before the render pass that draws the ocean
+	void record_uploads (VkCommandBuffer cmdBuf, uint32_t frame_index);
+	// waits for the simulation update started, call before submitting the frame
+	void finish_update ();
+	void draw (VkCommandBuffer cmdBuf, uint32_t frame_index);
+
+	// only between frames, update's simulation is done by then
+	OceanSimulation const& get_simulation () const { return simulation; }
+	double get_simulate_ms () const { return simulate_ms; }
+
+	private:
+	BackEnd& back_end;
+	job::ThreadPool& thread_pool;
+	OceanSimulation simulation;
+	bool enabled = false;
+	float sea_level = 0.f;
+	std::chrono::steady_clock::time_point start_time;
+	double simulate_ms = 0.0;
+
+	ModelID plane_model;
+
+	std::vector<DescriptorSetLayoutBinding> bindings;
+	DescriptorLayout layout;
+	DescriptorStack draw_stack;
+	DescriptorPool pool;
+	DescriptorSet set;
+
+	std::vector<VulkanTexture> displacement_maps;
+	std::vector<VulkanTexture> slope_maps;
+	VulkanHandle<VkSampler, PFN_vkDestroySampler> map_sampler;
+	// one per frame in flight, the maps of every cascade back to back
+	std::vector<VulkanBuffer> staging;
+	std::vector<bool> frame_staged;
+	std::optional<uint32_t> staging_frame; // mapped while the simulation writes it
+
+	std::optional<PipelineLayout> pipe_layout;
+	PipelineHandle pipe;
+
+	// last, so it's finished before the buffers it writes are destroyed
+	job::BackgroundJob simulate_job;
+
+	void simulate (float time, uint16_t* halves);
+};
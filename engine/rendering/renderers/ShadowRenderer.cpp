@@ -0,0 +1,62 @@
+#include "ShadowRenderer.h"
+
+#include "core/Profiler.h"
+
+#include "rendering/ViewCamera.h"
+
+static_assert (ShadowCascades::MaxCascades <= TerrainRenderer::MaxShadowFrustums, "every cascade needs terrain casters");
+
+ShadowRenderer::ShadowRenderer (MeshRenderer& mesh_renderer, TerrainRenderer& terrain_renderer, ShadowSettings settings)
+: mesh_renderer (mesh_renderer), terrain_renderer (terrain_renderer), cascades (settings)
+{
+}
+
+void ShadowRenderer::prepare (job::ThreadPool& pool,
+    ViewCameraData& camera,
+    std::optional<cml::vec3f> light_direction,
+    CullingBounds const& bounds)
+{
+	PROFILE_SCOPE ("ShadowRenderer::prepare");
+	enabled = light_direction.has_value ();
+	frustums.clear ();
+	if (!enabled)
+	{
+		// the maps go stale while there's no light to cast them
+		cascades.invalidate ();
+		return;
+	}
+	cascades.update (camera, light_direction.value ());
+
+	for (uint32_t i = 0; i < cascades.cascade_count (); i++)
+	{
+		if (!cascades.needs_render (i)) continue;
+		cull_index[i] = static_cast<uint32_t> (frustums.size ());
+		frustums.push_back (cascades.get_frustum (i));
+	}
+	if (frustums.empty ()) return;
+
+	culler.cull (pool, bounds, frustums);
+}
+
+bool ShadowRenderer::needs_render (uint32_t cascade) const
+{
+	return enabled && cascade < cascades.cascade_count () && cascades.needs_render (cascade);
+}
+
+void ShadowRenderer::draw (VkCommandBuffer cmdBuf, uint32_t frame_index, uint32_t cascade)
+{
+	if (!needs_render (cascade)) return;
+	terrain_renderer.draw_shadow (
+	    cmdBuf, frame_index, cull_index[cascade], cascades.get_proj_view (cascade), get_settings ().resolution);
+	mesh_renderer.draw_shadow (cmdBuf,
+	    cascades.get_proj_view (cascade),
+	    culler.get_visible (cull_index[cascade]),
+	    get_settings ().resolution);
+}
+
+ShadowGPUData ShadowRenderer::get_gpu_data () const
+{
+	ShadowGPUData data = cascades.get_gpu_data ();
+	if (!enabled) data.cascade_count = 0;
+	return data;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "rendering/Culling.h"
+#include "rendering/ShadowCascades.h"
+
+#include "rendering/renderers/MeshRenderer.h"
+#include "rendering/renderers/TerrainRenderer.h"
+
+class ViewCameraData;
+namespace job
+{
+class ThreadPool;
+}
+
+// Renders the MeshRenderer's draws and the terrain into one shadow map per cascade. Each frame the
+// cascades are fitted to the camera and culled on the CPU, cascades that keep their cached map skip
+// culling and their render pass isn't recorded.
+class ShadowRenderer
+{
+	public:
+	ShadowRenderer (MeshRenderer& mesh_renderer, TerrainRenderer& terrain_renderer, ShadowSettings settings = {});
+
+	// light_direction points towards the light, without one no cascade renders and the
+	// GPU data has a cascade count of 0. bounds are the MeshRenderer's, from fill_bounds.
+	void prepare (job::ThreadPool& pool,
+	    ViewCameraData& camera,
+	    std::optional<cml::vec3f> light_direction,
+	    CullingBounds const& bounds);
+
+	// the frustums of the cascades rendering this frame, for TerrainRenderer::update
+	std::vector<Frustum> const& get_render_frustums () const { return frustums; }
+
+	bool needs_render (uint32_t cascade) const;
+	void draw (VkCommandBuffer cmdBuf, uint32_t frame_index, uint32_t cascade);
+
+	// call when the shadow maps were recreated
+	void invalidate () { cascades.invalidate (); }
+
+	ShadowGPUData get_gpu_data () const;
+	ShadowSettings const& get_settings () const { return cascades.get_settings (); }
+
+	private:
+	MeshRenderer& mesh_renderer;
+	TerrainRenderer& terrain_renderer;
+	ShadowCascades cascades;
+	bool enabled = false;
+
+	FrustumCuller culler;
+	std::vector<Frustum> frustums;
+	// index into frustums of each cascade, only cascades that render this frame are culled
+	std::array<uint32_t, ShadowCascades::MaxCascades> cull_index;
+};
@@ -80,7 +80,7 @@ std::optional<Skybox> CreateSkybox (
 	auto vert = back_end.shaders.GetModule ("skybox.vert", ShaderType::vertex);
 	auto frag = back_end.shaders.GetModule ("skybox.frag", ShaderType::fragment);
 
-	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache.get () };
+	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache };
 	builder.SetShaderModuleSet (ShaderModuleSet (vert.value (), frag.value ()))
 	    .UseModelVertexLayout (back_end.models.get_layout (skybox_cube_model))
 	    .AddViewport (1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f)
@@ -99,7 +99,7 @@ std::optional<Skybox> CreateSkybox (
 	        VK_BLEND_FACTOR_ONE,
 	        VK_BLEND_FACTOR_ZERO)
 	    // outline.AddDescriptorLayouts (double_buffer_man.GetGlobalLayouts ());
-	    .AddDescriptorLayout (descriptor_layout.get ())
+	    .AddDescriptorLayout (descriptor_layout)
 	    .AddDynamicStates ({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
 
 	auto pipe_layout = builder.CreateLayout ();
@@ -0,0 +1,580 @@
+#include "TerrainRenderer.h"
+
+#include <cstring>
+
+#include "core/JobSystem.h"
+#include "core/Logger.h"
+#include "core/Profiler.h"
+
+#include "rendering/Initializers.h"
+#include "rendering/TerrainMaterial.h"
+#include "rendering/ViewCamera.h"
+
+static_assert (sizeof (TerrainPatch) == 32, "must match TerrainPatch in terrain.vert");
+
+// Matches TerrainParams in terrain.glsl
+struct TerrainPushConstants
+{
+	cml::mat4f shadow_proj_view;
+	cml::vec3f lod_origin;
+	float grid_resolution;
+	float origin_x;
+	float origin_z;
+	float world_size;
+	float height_scale;
+	uint32_t tile_count;
+	uint32_t tile_samples;
+};
+static_assert (sizeof (TerrainPushConstants) == 104, "must match TerrainParams in terrain.glsl");
+
+// Matches GraphParams in terrain_graph.glsl
+struct GraphPushConstants
+{
+	uint32_t tile_count;
+	uint32_t tile_samples;
+	uint32_t leaf_count;
+	float scale;
+	float height_scale;
+	float padding[3];
+};
+
+// terrain_graph.glsl stores floats so unsigned integer order matches float order
+float from_ordered_bits (uint32_t bits)
+{
+	uint32_t raw = (bits & 0x80000000u) != 0 ? bits & 0x7FFFFFFFu : ~bits;
+	float value;
+	std::memcpy (&value, &raw, sizeof (float));
+	return value;
+}
+
+// Unit grid from 0 to 1 in x and z, the indices of each quadrant are contiguous and in the order
+// TerrainQuadtree::select groups its patches
+Resource::Mesh::MeshData create_terrain_grid (uint32_t resolution)
+{
+	std::vector<float> vertices;
+	vertices.reserve ((resolution + 1) * (resolution + 1) * 8);
+	for (uint32_t x = 0; x <= resolution; x++)
+	{
+		for (uint32_t z = 0; z <= resolution; z++)
+		{
+			float u = static_cast<float> (x) / static_cast<float> (resolution);
+			float v = static_cast<float> (z) / static_cast<float> (resolution);
+			vertices.insert (std::end (vertices), { u, 0.f, v, 0.f, 1.f, 0.f, u, v });
+		}
+	}
+
+	std::vector<uint32_t> indices;
+	uint32_t half = resolution / 2;
+	for (uint32_t q = 0; q < 4; q++)
+	{
+		uint32_t start_x = (q & 1) * half;
+		uint32_t start_z = (q >> 1) * half;
+		for (uint32_t x = start_x; x < start_x + half; x++)
+		{
+			for (uint32_t z = start_z; z < start_z + half; z++)
+			{
+				uint32_t corner = x * (resolution + 1) + z;
+				indices.insert (std::end (indices),
+				    { corner, corner + 1, corner + resolution + 1, corner + 1, corner + resolution + 2, corner + resolution + 1 });
+			}
+		}
+	}
+
+	using Resource::Mesh::VertexType;
+	return Resource::Mesh::MeshData (
+	    Resource::Mesh::VertexDescription ({ VertexType::Vert3, VertexType::Vert3, VertexType::Vert2 }), vertices, indices);
+}
+
+BufCreateDetails patch_buffer_details ()
+{
+	return BufCreateDetails{ BufferType::storage,
+		sizeof (TerrainPatch) * TerrainRenderer::MaxPatchCount,
+		(VkBufferUsageFlags) (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+		VMA_MEMORY_USAGE_CPU_TO_GPU,
+		VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		1,
+		true };
+}
+
+BufCreateDetails height_buffer_details (VkDeviceSize size)
+{
+	return BufCreateDetails{ BufferType::storage,
+		size,
+		(VkBufferUsageFlags) (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+		                      VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
+		VMA_MEMORY_USAGE_GPU_ONLY };
+}
+
+BufCreateDetails readback_details (VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	return BufCreateDetails{
+		BufferType::storage, size, usage, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT, 1, true
+	};
+}
+
+// the graph shader writes it as a storage image and the fragment shader samples it, so it stays in
+// VK_IMAGE_LAYOUT_GENERAL
+TexCreateDetails splat_map_details (uint32_t size)
+{
+	TexCreateDetails details (VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_GENERAL, false, 1, size, size);
+	details.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	return details;
+}
+
+VkSampler create_splat_sampler (VkDevice device)
+{
+	VkSamplerCreateInfo info = initializers::sampler_create_info ();
+	info.magFilter = VK_FILTER_LINEAR;
+	info.minFilter = VK_FILTER_LINEAR;
+	info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.maxLod = 0.0f;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK_RESULT (vkCreateSampler (device, &info, nullptr, &sampler));
+	return sampler;
+}
+
+TerrainRenderer::TerrainRenderer (
+    BackEnd& back_end, DescriptorStack const& parent_stack, uint32_t frame_count, TerrainSettings settings)
+: back_end (back_end),
+  quadtree (settings),
+  grid_model (back_end.models.create_model (create_terrain_grid (settings.grid_resolution))),
+  quadrant_index_count (settings.grid_resolution * settings.grid_resolution / 4 * 6),
+  bindings ({ { DescriptorType::storage_buffer, ShaderStage::vertex, 0, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::vertex, 1, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 2, 1 },
+      { DescriptorType::storage_buffer, ShaderStage::fragment, 3, 1 },
+      { DescriptorType::combined_image_sampler, ShaderStage::fragment, 4, 1 },
+      { DescriptorType::combined_image_sampler, ShaderStage::fragment, 5, 1 } }),
+  layout (back_end.device.device, bindings),
+  draw_stack (layout, parent_stack),
+  pool (back_end.device.device, layout.get (), bindings, frame_count),
+  height_buffer (back_end.device, height_buffer_details (sizeof (float) * quadtree.get_heights ().size ())),
+  splat_map (back_end.device, splat_map_details (quadtree.samples_per_side ())),
+  splat_sampler (back_end.device.device, create_splat_sampler (back_end.device.device), vkDestroySampler),
+  virtual_texture (back_end, { splat_sampler.handle, splat_map.imageView, VK_IMAGE_LAYOUT_GENERAL }, frame_count),
+  frame_selections (frame_count)
+{
+	std::vector<VkDescriptorImageInfo> atlas_info = { virtual_texture.get_atlas_info () };
+	std::vector<VkDescriptorImageInfo> splat_info = {
+		{ splat_sampler.handle, splat_map.imageView, VK_IMAGE_LAYOUT_GENERAL }
+	};
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		patch_buffers.emplace_back (back_end.device, patch_buffer_details ());
+		sets.push_back (pool.allocate ());
+
+		std::vector<DescriptorUse> writes = {
+			{ 0, 1, height_buffer.get_descriptor_type (), { height_buffer.get_descriptor_info () } },
+			{ 1, 1, patch_buffers[i].get_descriptor_type (), { patch_buffers[i].get_descriptor_info () } },
+			{ 2, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { virtual_texture.get_page_table_info (i) } },
+			{ 3, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, { virtual_texture.get_feedback_info (i) } },
+			{ 4, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, atlas_info },
+			{ 5, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, splat_info }
+		};
+		sets[i].update (back_end.device.device, writes);
+	}
+}
+
+void TerrainRenderer::create_pipeline (VkRenderPass render_pass, uint32_t subpass)
+{
+	auto vert = back_end.shaders.GetModule ("terrain.vert", ShaderType::vertex);
+	auto frag = back_end.shaders.GetModule ("terrain.frag", ShaderType::fragment);
+	if (!vert || !frag)
+	{
+		Log.error ("Missing terrain shaders");
+		return;
+	}
+
+	using Resource::Mesh::VertexType;
+	Resource::Mesh::VertexDescription vert_desc ({ VertexType::Vert3, VertexType::Vert3, VertexType::Vert2 });
+
+	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache };
+	builder.SetShaderModuleSet (ShaderModuleSet (vert.value (), frag.value ()))
+	    .UseModelVertexLayout (VertexLayout (vert_desc))
+	    .AddViewport (1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f)
+	    .AddScissor (1, 1, 0, 0)
+	    .SetInputAssembly (VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false)
+	    .SetRasterizer (
+	        VK_POLYGON_MODE_FILL, VK_CULL_MODE_BACK_BIT, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE, VK_FALSE, 1.0f, VK_FALSE)
+	    .SetMultisampling (VK_SAMPLE_COUNT_1_BIT)
+	    .set_depth_stencil (VK_TRUE, VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL, VK_FALSE, VK_FALSE)
+	    .AddColorBlendingAttachment (VK_FALSE,
+	        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_SRC_COLOR,
+	        VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_ONE,
+	        VK_BLEND_FACTOR_ZERO)
+	    .AddDescriptorStack (draw_stack)
+	    .AddPushConstantRange (
+	        initializers::push_constant_range (VK_SHADER_STAGE_VERTEX_BIT, sizeof (TerrainPushConstants), 0))
+	    .AddDynamicStates ({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
+
+	pipe_layout = builder.CreateLayout ();
+	if (!pipe_layout)
+	{
+		Log.error ("Failed to create the terrain pipeline layout");
+		return;
+	}
+	pipe = back_end.pipeline_registry.get_pipeline (builder, pipe_layout.value (), render_pass, subpass);
+}
+
+void TerrainRenderer::create_shadow_pipeline (VkRenderPass render_pass, uint32_t subpass)
+{
+	auto vert = back_end.shaders.GetModule ("terrain_shadow.vert", ShaderType::vertex);
+	if (!vert)
+	{
+		Log.error ("Missing terrain shadow shader");
+		return;
+	}
+
+	using Resource::Mesh::VertexType;
+	Resource::Mesh::VertexDescription vert_desc ({ VertexType::Vert3, VertexType::Vert3, VertexType::Vert2 });
+
+	// no culling, the light sees the terrain from any side
+	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache };
+	builder.SetShaderModuleSet (ShaderModuleSet ().Vertex (vert.value ()))
+	    .UseModelVertexLayout (VertexLayout (vert_desc))
+	    .AddViewport (1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f)
+	    .AddScissor (1, 1, 0, 0)
+	    .SetInputAssembly (VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false)
+	    .SetRasterizer (
+	        VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE, VK_FALSE, 1.0f, VK_FALSE)
+	    .SetMultisampling (VK_SAMPLE_COUNT_1_BIT)
+	    .set_depth_stencil (VK_TRUE, VK_TRUE, VK_COMPARE_OP_GREATER_OR_EQUAL, VK_FALSE, VK_FALSE)
+	    .AddDescriptorStack (draw_stack)
+	    .AddPushConstantRange (
+	        initializers::push_constant_range (VK_SHADER_STAGE_VERTEX_BIT, sizeof (TerrainPushConstants), 0))
+	    .AddDynamicStates ({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
+
+	shadow_pipe_layout = builder.CreateLayout ();
+	if (!shadow_pipe_layout)
+	{
+		Log.error ("Failed to create the terrain shadow pipeline layout");
+		return;
+	}
+	shadow_pipe = back_end.pipeline_registry.get_pipeline (builder, shadow_pipe_layout.value (), render_pass, subpass);
+}
+
+void TerrainRenderer::generate (job::ThreadPool& thread_pool, TerrainHeightSource const& source)
+{
+	PROFILE_SCOPE ("TerrainRenderer::generate");
+	auto const& settings = quadtree.get_settings ();
+	uint32_t tile_count = settings.tile_count;
+	// pages are composited from the splat map about to change
+	virtual_texture.clear ();
+
+	// tiles write to separate ranges of the height array
+	job::parallel_for (thread_pool, tile_count * tile_count, 1, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t tile_x = static_cast<uint32_t> (i % tile_count);
+			uint32_t tile_z = static_cast<uint32_t> (i / tile_count);
+			auto heights = source (tile_x, tile_z, settings.tile_samples);
+			if (heights.size () != settings.tile_samples * settings.tile_samples)
+			{
+				Log.error ("Terrain tile {},{} has {} heights, expected {}",
+				    tile_x,
+				    tile_z,
+				    heights.size (),
+				    settings.tile_samples * settings.tile_samples);
+				continue;
+			}
+			quadtree.set_tile (tile_x, tile_z, heights);
+		}
+	});
+	quadtree.update_bounds ();
+	upload_heights ();
+	upload_splat_map (compute_splat_map (thread_pool, quadtree));
+	has_heights = true;
+}
+
+bool TerrainRenderer::generate_on_gpu (std::string const& graph_shader, float scale)
+{
+	PROFILE_SCOPE ("TerrainRenderer::generate_on_gpu");
+	auto module = back_end.shaders.compile_module ("terrain_graph.comp", graph_shader, ShaderType::compute);
+	if (!module)
+	{
+		Log.error ("Failed to compile the terrain graph shader");
+		return false;
+	}
+
+	std::vector<DescriptorSetLayoutBinding> graph_bindings = { { DescriptorType::storage_buffer, ShaderStage::compute, 0, 1 },
+		{ DescriptorType::storage_image, ShaderStage::compute, 1, 1 },
+		{ DescriptorType::storage_buffer, ShaderStage::compute, 2, 1 } };
+	DescriptorLayout graph_layout (back_end.device.device, graph_bindings);
+	DescriptorPool graph_pool (back_end.device.device, graph_layout.get (), graph_bindings, 1);
+	PipelineLayout graph_pipe_layout (back_end.device.device,
+	    { graph_layout.get () },
+	    { initializers::push_constant_range (VK_SHADER_STAGE_COMPUTE_BIT, sizeof (GraphPushConstants), 0) });
+	auto graph_pipe = BuildComputePipeline (
+	    back_end.device.device, graph_pipe_layout, std::move (module.value ()), back_end.pipeline_cache.get ());
+	if (!graph_pipe)
+	{
+		Log.error ("Failed to create the terrain graph pipeline");
+		return false;
+	}
+
+	// min slots start high and max slots low, so the first atomic of every leaf wins
+	uint32_t leaves = quadtree.leaf_count ();
+	std::vector<uint32_t> initial_bounds (static_cast<size_t> (leaves) * leaves * 2, 0u);
+	for (size_t i = 0; i < initial_bounds.size (); i += 2)
+		initial_bounds[i] = 0xFFFFFFFFu;
+	VulkanBuffer bounds_buffer (back_end.device,
+	    readback_details (sizeof (uint32_t) * initial_bounds.size (), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT));
+	bounds_buffer.copy_to_buffer (initial_bounds);
+
+	DescriptorSet set = graph_pool.allocate ();
+	std::vector<VkDescriptorImageInfo> splat_info = { { VK_NULL_HANDLE, splat_map.imageView, VK_IMAGE_LAYOUT_GENERAL } };
+	std::vector<DescriptorUse> writes = {
+		{ 0, 1, height_buffer.get_descriptor_type (), { height_buffer.get_descriptor_info () } },
+		{ 1, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, splat_info },
+		{ 2, 1, bounds_buffer.get_descriptor_type (), { bounds_buffer.get_descriptor_info () } }
+	};
+	set.update (back_end.device.device, writes);
+
+	auto const& settings = quadtree.get_settings ();
+	GraphPushConstants push{ settings.tile_count, settings.tile_samples, leaves, scale, settings.height_scale, {} };
+	uint32_t group_count = (quadtree.samples_per_side () + 7) / 8;
+
+	// frames in flight may still read the old heights
+	vkDeviceWaitIdle (back_end.device.device);
+	// pages are composited from the splat map about to change
+	virtual_texture.clear ();
+
+	CommandPool cmd_pool (back_end.device.device, back_end.device.graphics_queue ());
+	CommandBuffer cmd_buf (cmd_pool);
+	cmd_buf.allocate ().begin ();
+	graph_pipe->bind (cmd_buf.get ());
+	set.bind (cmd_buf.get (), graph_pipe_layout.get (), 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+	vkCmdPushConstants (
+	    cmd_buf.get (), graph_pipe_layout.get (), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof (GraphPushConstants), &push);
+	vkCmdDispatch (cmd_buf.get (), group_count, group_count, 1);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier (cmd_buf.get (),
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+	        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    0,
+	    1,
+	    &barrier,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr);
+	cmd_buf.end ().submit ().wait ();
+
+	std::vector<uint32_t> bits (initial_bounds.size ());
+	void* mapped = nullptr;
+	bounds_buffer.map (&mapped);
+	std::memcpy (bits.data (), mapped, sizeof (uint32_t) * bits.size ());
+	bounds_buffer.unmap ();
+
+	std::vector<float> leaf_bounds (bits.size ());
+	for (size_t i = 0; i < bits.size (); i++)
+		leaf_bounds[i] = from_ordered_bits (bits[i]);
+	quadtree.set_leaf_bounds (leaf_bounds);
+	has_heights = true;
+	return true;
+}
+
+std::vector<float> TerrainRenderer::read_back_heights ()
+{
+	VkDeviceSize size = sizeof (float) * quadtree.get_heights ().size ();
+	VulkanBuffer readback (back_end.device, readback_details (size, VK_BUFFER_USAGE_TRANSFER_DST_BIT));
+
+	CommandPool cmd_pool (back_end.device.device, back_end.device.graphics_queue ());
+	CommandBuffer cmd_buf (cmd_pool);
+	cmd_buf.allocate ().begin ();
+	VkBufferCopy region{ 0, 0, size };
+	vkCmdCopyBuffer (cmd_buf.get (), height_buffer.get (), readback.get (), 1, &region);
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier (
+	    cmd_buf.get (), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	cmd_buf.end ().submit ().wait ();
+
+	std::vector<float> heights (quadtree.get_heights ().size ());
+	void* mapped = nullptr;
+	readback.map (&mapped);
+	std::memcpy (heights.data (), mapped, size);
+	readback.unmap ();
+	return heights;
+}
+
+void TerrainRenderer::upload_heights ()
+{
+	auto const& heights = quadtree.get_heights ();
+	VkDeviceSize size = sizeof (float) * heights.size ();
+
+	VulkanBuffer staging (back_end.device, staging_details (BufferType::staging, size));
+	staging.copy_to_buffer (heights);
+
+	// frames in flight may still read the old heights
+	vkDeviceWaitIdle (back_end.device.device);
+
+	CommandPool cmd_pool (back_end.device.device, back_end.device.graphics_queue ());
+	CommandBuffer cmd_buf (cmd_pool);
+	cmd_buf.allocate ().begin ();
+	VkBufferCopy region{ 0, 0, size };
+	vkCmdCopyBuffer (cmd_buf.get (), staging.get (), height_buffer.get (), 1, &region);
+	cmd_buf.end ().submit ().wait ();
+}
+
+void TerrainRenderer::upload_splat_map (std::vector<uint32_t> const& splat)
+{
+	uint32_t samples = quadtree.samples_per_side ();
+	VulkanBuffer staging (back_end.device, staging_details (BufferType::staging, sizeof (uint32_t) * splat.size ()));
+	staging.copy_to_buffer (splat);
+
+	// upload_heights already waited for the frames in flight
+	CommandPool cmd_pool (back_end.device.device, back_end.device.graphics_queue ());
+	CommandBuffer cmd_buf (cmd_pool);
+	cmd_buf.allocate ().begin ();
+	VkBufferImageCopy region{};
+	region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	region.imageExtent = { samples, samples, 1 };
+	vkCmdCopyBufferToImage (cmd_buf.get (), staging.get (), splat_map.image, VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier (cmd_buf.get (),
+	    VK_PIPELINE_STAGE_TRANSFER_BIT,
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    0,
+	    1,
+	    &barrier,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr);
+	cmd_buf.end ().submit ().wait ();
+}
+
+void TerrainRenderer::update (uint32_t frame_index, ViewCameraData& camera, std::vector<Frustum> const& shadow_frustums)
+{
+	auto& selection = frame_selections.at (frame_index);
+	selection = FrameSelection{};
+	if (!has_heights) return;
+
+	PROFILE_SCOPE ("TerrainRenderer::update");
+	virtual_texture.update (frame_index);
+	selection.lod_origin = camera.get_position ();
+	stats = quadtree.select (
+	    selection.lod_origin, extract_frustum (camera.get_proj_view_mat ()), patches, selection.camera.counts);
+	if (patches.size () > MaxPatchCount)
+	{
+		Log.error ("Terrain selected {} patches, more than the {} supported", patches.size (), MaxPatchCount);
+		selection.camera.counts = {};
+		return;
+	}
+
+	// Casters are selected by their distance to the camera as well, so they morph like the surface
+	// they shadow. They go after the camera's patches, cascades that don't fit draw no terrain.
+	for (size_t i = 0; i < shadow_frustums.size () && i < selection.shadows.size (); i++)
+	{
+		auto& range = selection.shadows[i];
+		quadtree.select (selection.lod_origin, shadow_frustums[i], caster_patches, range.counts);
+		if (patches.size () + caster_patches.size () > MaxPatchCount)
+		{
+			range.counts = {};
+			continue;
+		}
+		range.first = static_cast<uint32_t> (patches.size ());
+		patches.insert (patches.end (), caster_patches.begin (), caster_patches.end ());
+	}
+	patch_buffers.at (frame_index).copy_to_buffer (patches);
+}
+
+void TerrainRenderer::record_uploads (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	if (has_heights) virtual_texture.record_composites (cmdBuf, frame_index);
+}
+
+void TerrainRenderer::record_readback (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	if (has_heights) virtual_texture.record_readback (cmdBuf, frame_index);
+}
+
+TerrainPushConstants TerrainRenderer::push_constants (uint32_t frame_index, cml::mat4f const& shadow_proj_view) const
+{
+	auto const& settings = quadtree.get_settings ();
+	return TerrainPushConstants{ shadow_proj_view,
+		frame_selections.at (frame_index).lod_origin,
+		static_cast<float> (settings.grid_resolution),
+		settings.origin_x,
+		settings.origin_z,
+		settings.world_size,
+		settings.height_scale,
+		settings.tile_count,
+		settings.tile_samples };
+}
+
+void TerrainRenderer::draw_patches (VkCommandBuffer cmdBuf, PatchRange const& range)
+{
+	auto info = back_end.models.get_draw_info (grid_model);
+	if (!info) return;
+	back_end.models.bind_geometry (cmdBuf);
+
+	// firstInstance steps through the patch buffer, which select grouped by quadrant
+	uint32_t first_instance = range.first;
+	for (uint32_t q = 0; q < 4; q++)
+	{
+		if (range.counts[q] > 0)
+			vkCmdDrawIndexed (cmdBuf,
+			    quadrant_index_count,
+			    range.counts[q],
+			    info->first_index + q * quadrant_index_count,
+			    info->vertex_offset,
+			    first_instance);
+		first_instance += range.counts[q];
+	}
+}
+
+void TerrainRenderer::draw (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	auto const& range = frame_selections.at (frame_index).camera;
+	if (!pipe_layout || range.empty ()) return;
+	if (!pipe.bind (cmdBuf)) return;
+
+	TerrainPushConstants push = push_constants (frame_index, cml::mat4f ());
+	sets.at (frame_index).bind (cmdBuf, pipe_layout->get (), 2);
+	vkCmdPushConstants (cmdBuf, pipe_layout->get (), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof (TerrainPushConstants), &push);
+	draw_patches (cmdBuf, range);
+}
+
+void TerrainRenderer::draw_shadow (VkCommandBuffer cmdBuf,
+    uint32_t frame_index,
+    uint32_t shadow_index,
+    cml::mat4f const& proj_view,
+    uint32_t resolution)
+{
+	auto const& shadows = frame_selections.at (frame_index).shadows;
+	if (!shadow_pipe_layout || shadow_index >= shadows.size () || shadows[shadow_index].empty ()) return;
+	if (!shadow_pipe.bind (cmdBuf)) return;
+
+	VkViewport viewport =
+	    initializers::viewport (static_cast<float> (resolution), static_cast<float> (resolution), 0.0f, 1.0f);
+	vkCmdSetViewport (cmdBuf, 0, 1, &viewport);
+	VkRect2D scissor = initializers::rect2D (resolution, resolution, 0, 0);
+	vkCmdSetScissor (cmdBuf, 0, 1, &scissor);
+
+	TerrainPushConstants push = push_constants (frame_index, proj_view);
+	sets.at (frame_index).bind (cmdBuf, shadow_pipe_layout->get (), 2);
+	vkCmdPushConstants (
+	    cmdBuf, shadow_pipe_layout->get (), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof (TerrainPushConstants), &push);
+	draw_patches (cmdBuf, shadows[shadow_index]);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "rendering/TerrainLOD.h"
+#include "rendering/backend/BackEnd.h"
+#include "rendering/backend/Buffer.h"
+#include "rendering/backend/Descriptor.h"
+#include "rendering/backend/Model.h"
+#include "rendering/backend/Pipeline.h"
+#include "rendering/backend/RenderTools.h"
+#include "rendering/backend/Texture.h"
+#include "rendering/renderers/TerrainVirtualTexture.h"
+
+class ViewCameraData;
+struct TerrainPushConstants;
+namespace job
+{
+class ThreadPool;
+}
+
+// Returns samples * samples unscaled heights of a tile in x major order. Called from pool threads.
+using TerrainHeightSource = std::function<std::vector<float> (uint32_t tile_x, uint32_t tile_z, uint32_t samples)>;
+
+// Draws a TerrainQuadtree with one shared grid mesh. The grid's indices are ordered by quadrant,
+// so the selected patches are drawn with one instanced draw per quadrant. Heights live in a
+// storage buffer the vertex shader samples, which also morphs the vertices between levels. Nearby
+// terrain blends its layers per pixel by the weights in a splat map, distant terrain takes its
+// material from a TerrainVirtualTexture instead. The shadow cascades draw the same morphed
+// surface from the patches selected in their frustums.
+class TerrainRenderer
+{
+	public:
+	static constexpr uint32_t MaxPatchCount = 16384; // the camera's and the shadow casters' together
+	static constexpr uint32_t MaxShadowFrustums = 4;
+
+	TerrainRenderer (
+	    BackEnd& back_end, DescriptorStack const& parent_stack, uint32_t frame_count, TerrainSettings settings = {});
+
+	void create_pipeline (VkRenderPass render_pass, uint32_t subpass);
+	// depth only, for the shadow cascades' render pass
+	void create_shadow_pipeline (VkRenderPass render_pass, uint32_t subpass);
+
+	// Fills every tile from source on the pool and uploads the heights, waits on the device
+	void generate (job::ThreadPool& pool, TerrainHeightSource const& source);
+
+	// Compiles graph_shader, a compute shader built on common/terrain_graph.glsl, and runs it once
+	// to write the heights and the splat map in GPU memory. Only the leaf height bounds come back
+	// for selection, so get_height keeps answering with the heights of the last generate call. The
+	// virtual texture composites from the splat map, so it pages the new terrain as it is.
+	// scale is the noise coordinate step between two samples. Waits on the device.
+	bool generate_on_gpu (std::string const& graph_shader, float scale = 1.f);
+	// copies the height buffer back, tile after tile like TerrainQuadtree::get_heights, waits on the device
+	std::vector<float> read_back_heights ();
+
+	// selects the patches for the camera and the casters in every shadow frustum, and writes them
+	// into the frame's buffer
+	void update (uint32_t frame_index, ViewCameraData& camera, std::vector<Frustum> const& shadow_frustums = {});
+	// the virtual texture's new pages, record before the pass that draws the terrain
+	void record_uploads (VkCommandBuffer cmdBuf, uint32_t frame_index);
+	// the virtual texture's feedback, record after the pass that draws the terrain
+	void record_readback (VkCommandBuffer cmdBuf, uint32_t frame_index);
+	void draw (VkCommandBuffer cmdBuf, uint32_t frame_index);
+	// shadow_index picks the frustum passed to update
+	void draw_shadow (VkCommandBuffer cmdBuf,
+	    uint32_t frame_index,
+	    uint32_t shadow_index,
+	    cml::mat4f const& proj_view,
+	    uint32_t resolution);
+
+	bool has_terrain () const { return has_heights; }
+	float get_height (float x, float z) const { return quadtree.get_height (x, z); }
+	TerrainQuadtree const& get_quadtree () const { return quadtree; }
+	TerrainSelectionStats const& get_stats () const { return stats; }
+	TerrainVirtualTexture const& get_virtual_texture () const { return virtual_texture; }
+	void set_virtual_texture_enabled (bool enabled) { virtual_texture.set_enabled (enabled); }
+
+	private:
+	BackEnd& back_end;
+	TerrainQuadtree quadtree;
+	bool has_heights = false;
+
+	ModelID grid_model;
+	uint32_t quadrant_index_count = 0;
+
+	std::vector<DescriptorSetLayoutBinding> bindings;
+	DescriptorLayout layout;
+	DescriptorStack draw_stack;
+	DescriptorPool pool;
+
+	VulkanBuffer height_buffer;
+	// layer weights, one texel per height sample, see TerrainMaterial.h
+	VulkanTexture splat_map;
+	VulkanHandle<VkSampler, PFN_vkDestroySampler> splat_sampler;
+	TerrainVirtualTexture virtual_texture;
+	// one of each per frame in flight
+	std::vector<VulkanBuffer> patch_buffers;
+	std::vector<DescriptorSet> sets;
+
+	// a run of the frame's patch buffer, grouped by quadrant
+	struct PatchRange
+	{
+		uint32_t first = 0;
+		std::array<uint32_t, 4> counts = {};
+		bool empty () const { return counts[0] + counts[1] + counts[2] + counts[3] == 0; }
+	};
+	struct FrameSelection
+	{
+		cml::vec3f lod_origin;
+		PatchRange camera;
+		std::array<PatchRange, MaxShadowFrustums> shadows;
+	};
+	std::vector<FrameSelection> frame_selections;
+
+	std::optional<PipelineLayout> pipe_layout;
+	PipelineHandle pipe;
+	std::optional<PipelineLayout> shadow_pipe_layout;
+	PipelineHandle shadow_pipe;
+
+	std::vector<TerrainPatch> patches;
+	std::vector<TerrainPatch> caster_patches;
+	TerrainSelectionStats stats;
+
+	void upload_heights ();
+	void upload_splat_map (std::vector<uint32_t> const& splat);
+	TerrainPushConstants push_constants (uint32_t frame_index, cml::mat4f const& shadow_proj_view) const;
+	void draw_patches (VkCommandBuffer cmdBuf, PatchRange const& range);
+};
@@ -0,0 +1,256 @@
+#include "TerrainVirtualTexture.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "core/Logger.h"
+#include "core/Profiler.h"
+
+#include "rendering/Initializers.h"
+
+static_assert (sizeof (VirtualTextureGPUHeader) == 16, "must match PageTable in terrain.frag");
+
+// Matches CompositeParams in terrain_vt_composite.comp
+struct CompositePushConstants
+{
+	uint32_t page_x;
+	uint32_t page_z;
+	uint32_t pages_per_side;
+	uint32_t slot;
+	uint32_t atlas_pages;
+	uint32_t page_texels;
+};
+
+const uint32_t CompositeGroupSize = 8;
+
+BufCreateDetails feedback_details (VkDeviceSize size)
+{
+	return BufCreateDetails{ BufferType::storage,
+		size,
+		(VkBufferUsageFlags) (VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+		VMA_MEMORY_USAGE_GPU_TO_CPU,
+		VMA_ALLOCATION_CREATE_MAPPED_BIT,
+		1,
+		true };
+}
+
+// written by the composite shader and sampled by terrain.frag, so it stays in VK_IMAGE_LAYOUT_GENERAL
+TexCreateDetails atlas_details (VirtualTextureSettings const& settings)
+{
+	uint32_t size = settings.atlas_pages * settings.page_texels;
+	TexCreateDetails details (VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_GENERAL, false, 1, size, size);
+	details.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+	return details;
+}
+
+VkSampler create_atlas_sampler (VkDevice device)
+{
+	VkSamplerCreateInfo info = initializers::sampler_create_info ();
+	info.magFilter = VK_FILTER_LINEAR;
+	info.minFilter = VK_FILTER_LINEAR;
+	info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.maxLod = 0.0f;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK_RESULT (vkCreateSampler (device, &info, nullptr, &sampler));
+	return sampler;
+}
+
+TerrainVirtualTexture::TerrainVirtualTexture (
+    BackEnd& back_end, VkDescriptorImageInfo splat_map, uint32_t frame_count, VirtualTextureSettings settings)
+: cache (settings),
+  fragment_stores (back_end.device.has_fragment_stores ()),
+  atlas (back_end.device, atlas_details (settings)),
+  atlas_sampler (back_end.device.device, create_atlas_sampler (back_end.device.device), vkDestroySampler),
+  composites (frame_count),
+  composite_bindings ({ { DescriptorType::combined_image_sampler, ShaderStage::compute, 0, 1 },
+      { DescriptorType::storage_image, ShaderStage::compute, 1, 1 } }),
+  composite_layout (back_end.device.device, composite_bindings),
+  composite_pool (back_end.device.device, composite_layout.get (), composite_bindings, 1),
+  composite_set (composite_pool.allocate ()),
+  composite_pipe_layout (back_end.device.device,
+      { composite_layout.get () },
+      { initializers::push_constant_range (VK_SHADER_STAGE_COMPUTE_BIT, sizeof (CompositePushConstants), 0) })
+{
+	VkDeviceSize table_size = sizeof (VirtualTextureGPUHeader) + sizeof (uint32_t) * cache.page_count ();
+	std::vector<uint32_t> no_requests (cache.page_count (), 0);
+	for (uint32_t i = 0; i < frame_count; i++)
+	{
+		page_tables.emplace_back (back_end.device, storage_mapped_details (1, table_size));
+		feedback.emplace_back (back_end.device, feedback_details (sizeof (uint32_t) * cache.page_count ()));
+		feedback.back ().copy_to_buffer (no_requests);
+	}
+
+	std::vector<VkDescriptorImageInfo> atlas_info = { { VK_NULL_HANDLE, atlas.imageView, VK_IMAGE_LAYOUT_GENERAL } };
+	std::vector<DescriptorUse> writes = { { 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, { splat_map } },
+		{ 1, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, atlas_info } };
+	composite_set.update (back_end.device.device, writes);
+
+	auto shader = back_end.shaders.GetModule ("terrain_vt_composite.comp", ShaderType::compute);
+	if (shader)
+	{
+		composite_pipe = BuildComputePipeline (back_end.device.device,
+		    composite_pipe_layout,
+		    std::move (shader.value ()),
+		    back_end.pipeline_cache.get ());
+	}
+	if (!composite_pipe) Log.error ("Failed to create the terrain virtual texture composite pipeline");
+}
+
+void TerrainVirtualTexture::clear ()
+{
+	cache.clear ();
+	for (auto& frame_composites : composites)
+		frame_composites.clear ();
+	stats = {};
+}
+
+void TerrainVirtualTexture::set_enabled (bool enabled)
+{
+	if (!enabled) clear ();
+	if (enabled && !fragment_stores)
+		Log.warn ("The terrain virtual texture needs fragmentStoresAndAtomics, the device doesn't have it");
+	this->enabled = enabled && fragment_stores && composite_pipe.has_value ();
+}
+
+void TerrainVirtualTexture::update (uint32_t frame_index)
+{
+	auto& frame_composites = composites.at (frame_index);
+	frame_composites.clear ();
+	auto const& settings = cache.get_settings ();
+
+	if (enabled)
+	{
+		PROFILE_SCOPE ("TerrainVirtualTexture::update");
+		// the frame's fence has passed and record_readback made its feedback visible, map invalidates
+		std::vector<uint32_t> requested (cache.page_count ());
+		void* mapped = nullptr;
+		feedback.at (frame_index).map (&mapped);
+		std::memcpy (requested.data (), mapped, sizeof (uint32_t) * requested.size ());
+		std::memset (mapped, 0, sizeof (uint32_t) * requested.size ());
+		feedback.at (frame_index).flush ();
+		feedback.at (frame_index).unmap ();
+
+		auto requests = cache.gather_requests (requested.data (), frame_counter);
+		stats.requested_pages = static_cast<uint32_t> (requests.size ());
+
+		for (uint32_t index : requests)
+		{
+			if (frame_composites.size () >= settings.max_pages_per_frame) break;
+			// every slot holds a page this frame uses, the feedback asks for it again later
+			auto slot = cache.place_page (index, frame_counter);
+			if (!slot) break;
+			frame_composites.push_back ({ cache.get_page (index), slot.value () });
+		}
+		frame_counter++;
+	}
+
+	stats.resident_pages = cache.resident_count ();
+	stats.composited_pages = static_cast<uint32_t> (frame_composites.size ());
+	stats.evicted_pages = cache.evicted_count ();
+
+	// while disabled every fragment counts as near, so it blends per pixel and writes no feedback
+	VirtualTextureGPUHeader header{ settings.level_count,
+		settings.atlas_pages,
+		settings.page_texels,
+		enabled ? settings.near_distance : std::numeric_limits<float>::max () };
+	page_tables.at (frame_index).copy_to_buffer (header);
+	page_tables.at (frame_index).copy_to_buffer (cache.get_page_table (), sizeof (VirtualTextureGPUHeader));
+}
+
+void TerrainVirtualTexture::record_composites (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	auto const& frame_composites = composites.at (frame_index);
+	if (frame_composites.empty () || !composite_pipe) return;
+
+	PROFILE_SCOPE ("TerrainVirtualTexture::record_composites");
+	// earlier frames may still sample the slots being replaced
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    0,
+	    1,
+	    &barrier,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr);
+
+	auto const& settings = cache.get_settings ();
+	uint32_t group_count = (settings.page_texels + CompositeGroupSize - 1) / CompositeGroupSize;
+	composite_pipe->bind (cmdBuf);
+	composite_set.bind (cmdBuf, composite_pipe_layout.get (), 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+	for (auto const& composite : frame_composites)
+	{
+		CompositePushConstants push{ composite.page.x,
+			composite.page.z,
+			cache.pages_per_side (composite.page.level),
+			composite.slot,
+			settings.atlas_pages,
+			settings.page_texels };
+		vkCmdPushConstants (
+		    cmdBuf, composite_pipe_layout.get (), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof (CompositePushConstants), &push);
+		vkCmdDispatch (cmdBuf, group_count, group_count, 1);
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	    0,
+	    1,
+	    &barrier,
+	    0,
+	    nullptr,
+	    0,
+	    nullptr);
+}
+
+void TerrainVirtualTexture::record_readback (VkCommandBuffer cmdBuf, uint32_t frame_index)
+{
+	if (!enabled) return;
+
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = feedback.at (frame_index).get ();
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier (cmdBuf,
+	    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	    VK_PIPELINE_STAGE_HOST_BIT,
+	    0,
+	    0,
+	    nullptr,
+	    1,
+	    &barrier,
+	    0,
+	    nullptr);
+}
+
+VkDescriptorBufferInfo TerrainVirtualTexture::get_page_table_info (uint32_t frame_index)
+{
+	return page_tables.at (frame_index).get_descriptor_info ();
+}
+
+VkDescriptorBufferInfo TerrainVirtualTexture::get_feedback_info (uint32_t frame_index)
+{
+	return feedback.at (frame_index).get_descriptor_info ();
+}
+
+VkDescriptorImageInfo TerrainVirtualTexture::get_atlas_info () const
+{
+	return { atlas_sampler.handle, atlas.imageView, VK_IMAGE_LAYOUT_GENERAL };
+}
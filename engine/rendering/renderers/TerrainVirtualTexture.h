@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "rendering/VirtualTexture.h"
+#include "rendering/backend/BackEnd.h"
+#include "rendering/backend/Buffer.h"
+#include "rendering/backend/Descriptor.h"
+#include "rendering/backend/Pipeline.h"
+#include "rendering/backend/RenderTools.h"
+#include "rendering/backend/Texture.h"
+
+// Matches the start of PageTable in terrain.frag (std430), the page table entries follow it
+struct VirtualTextureGPUHeader
+{
+	uint32_t level_count;
+	uint32_t atlas_pages;
+	uint32_t page_texels;
+	float near_distance;
+};
+
+// Runtime virtual texture over the whole terrain. The fragment shader flags the pages it wants in
+// a per frame feedback buffer, update reads it back once the frame's fence passed and places the
+// missing pages in the atlas. terrain_vt_composite.comp then blends the terrain layers into them
+// from the splat map, once per texel, before the frame's passes. Distant terrain takes one fetch
+// instead of blending its layers per pixel. The heights and the splat map stay in GPU memory, so
+// terrain generated on the GPU is paged the same way.
+//
+// Pages hold linear albedo and roughness in alpha. Off until enabled, and always on devices without
+// fragmentStoresAndAtomics, terrain.frag blends per pixel everywhere then and writes no feedback.
+class TerrainVirtualTexture
+{
+	public:
+	// splat_map is sampled by the composite shader, in VK_IMAGE_LAYOUT_GENERAL
+	TerrainVirtualTexture (BackEnd& back_end,
+	    VkDescriptorImageInfo splat_map,
+	    uint32_t frame_count,
+	    VirtualTextureSettings settings = {});
+
+	TerrainVirtualTexture (TerrainVirtualTexture const& other) = delete;
+	TerrainVirtualTexture& operator= (TerrainVirtualTexture const& other) = delete;
+
+	// Drops every page, call when the splat map changed
+	void clear ();
+	void set_enabled (bool enabled);
+	bool is_enabled () const { return enabled; }
+
+	// reads the frame's feedback and places the pages it asked for
+	void update (uint32_t frame_index);
+	// composites the placed pages into the atlas, record before the pass that samples it
+	void record_composites (VkCommandBuffer cmdBuf, uint32_t frame_index);
+	// makes the feedback the frame's passes wrote visible to update, record after them
+	void record_readback (VkCommandBuffer cmdBuf, uint32_t frame_index);
+
+	VkDescriptorBufferInfo get_page_table_info (uint32_t frame_index);
+	VkDescriptorBufferInfo get_feedback_info (uint32_t frame_index);
+	VkDescriptorImageInfo get_atlas_info () const;
+
+	VirtualTextureStats const& get_stats () const { return stats; }
+	VirtualPageCache const& get_cache () const { return cache; }
+
+	private:
+	struct PageComposite
+	{
+		VirtualPage page;
+		uint32_t slot;
+	};
+
+	VirtualPageCache cache;
+	bool enabled = false;
+	bool fragment_stores; // the feedback is written from terrain.frag
+	uint64_t frame_counter = 1;
+
+	VulkanTexture atlas;
+	VulkanHandle<VkSampler, PFN_vkDestroySampler> atlas_sampler;
+	// one of each per frame in flight
+	std::vector<VulkanBuffer> page_tables;
+	std::vector<VulkanBuffer> feedback;
+	std::vector<std::vector<PageComposite>> composites;
+
+	std::vector<DescriptorSetLayoutBinding> composite_bindings;
+	DescriptorLayout composite_layout;
+	DescriptorPool composite_pool;
+	DescriptorSet composite_set;
+	PipelineLayout composite_pipe_layout;
+	std::optional<ComputePipeline> composite_pipe;
+
+	VirtualTextureStats stats;
+};
@@ -0,0 +1,118 @@
+#include "UpscaleRenderer.h"
+
+#include "core/Logger.h"
+
+#include "rendering/Initializers.h"
+
+// Matches UpscaleParams in upscale.frag
+struct UpscalePushConstants
+{
+	float uv_scale[2];
+	float texel_size[2];
+};
+
+// linear so a tap between two texels reads both, clamped so the edges don't wrap around
+VkSampler create_upscale_sampler (VkDevice device)
+{
+	VkSamplerCreateInfo info = initializers::sampler_create_info ();
+	info.magFilter = VK_FILTER_LINEAR;
+	info.minFilter = VK_FILTER_LINEAR;
+	info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	info.maxLod = 0.0f;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK_RESULT (vkCreateSampler (device, &info, nullptr, &sampler));
+	return sampler;
+}
+
+UpscaleRenderer::UpscaleRenderer (BackEnd& back_end)
+: back_end (back_end),
+  bindings ({ { DescriptorType::combined_image_sampler, ShaderStage::fragment, 0, 1 } }),
+  layout (back_end.device.device, bindings),
+  draw_stack (layout),
+  sampler (back_end.device.device, create_upscale_sampler (back_end.device.device), vkDestroySampler),
+  source_view (back_end.device.device, VK_NULL_HANDLE, vkDestroyImageView)
+{
+}
+
+void UpscaleRenderer::create_pipeline (VkRenderPass render_pass, uint32_t subpass)
+{
+	auto vert = back_end.shaders.GetModule ("upscale.vert", ShaderType::vertex);
+	auto frag = back_end.shaders.GetModule ("upscale.frag", ShaderType::fragment);
+	if (!vert || !frag)
+	{
+		Log.error ("Missing upscale shaders");
+		return;
+	}
+
+	// one triangle from gl_VertexIndex, no vertex input
+	PipelineBuilder builder{ back_end.device.device, back_end.pipeline_cache };
+	builder.SetShaderModuleSet (ShaderModuleSet (vert.value (), frag.value ()))
+	    .AddViewport (1.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f)
+	    .AddScissor (1, 1, 0, 0)
+	    .SetInputAssembly (VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false)
+	    .SetRasterizer (
+	        VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FALSE, VK_FALSE, 1.0f, VK_FALSE)
+	    .SetMultisampling (VK_SAMPLE_COUNT_1_BIT)
+	    .set_depth_stencil (VK_FALSE, VK_FALSE, VK_COMPARE_OP_ALWAYS, VK_FALSE, VK_FALSE)
+	    .AddColorBlendingAttachment (VK_FALSE,
+	        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_SRC_COLOR,
+	        VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR,
+	        VK_BLEND_OP_ADD,
+	        VK_BLEND_FACTOR_ONE,
+	        VK_BLEND_FACTOR_ZERO)
+	    .AddDescriptorStack (draw_stack)
+	    .AddPushConstantRange (
+	        initializers::push_constant_range (VK_SHADER_STAGE_FRAGMENT_BIT, sizeof (UpscalePushConstants), 0))
+	    .AddDynamicStates ({ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR });
+
+	pipe_layout = builder.CreateLayout ();
+	if (!pipe_layout)
+	{
+		Log.error ("Failed to create the upscale pipeline layout");
+		return;
+	}
+	pipe = back_end.pipeline_registry.get_pipeline (builder, pipe_layout.value (), render_pass, subpass);
+}
+
+void UpscaleRenderer::set_source (VkImage image, VkFormat format, uint32_t layers, VkExtent2D extent)
+{
+	// the frame graph's own view is 2D for single layer attachments, the shader always reads an array
+	VkImageViewCreateInfo view_info = initializers::image_view_create_info ();
+	view_info.image = image;
+	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	view_info.format = format;
+	view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, layers };
+	VkImageView view = VK_NULL_HANDLE;
+	VK_CHECK_RESULT (vkCreateImageView (back_end.device.device, &view_info, nullptr, &view));
+	source_view = VulkanHandle<VkImageView, PFN_vkDestroyImageView> (back_end.device.device, view, vkDestroyImageView);
+	source_extent = extent;
+}
+
+void UpscaleRenderer::draw (VkCommandBuffer cmdBuf, VkExtent2D render_extent)
+{
+	if (!pipe_layout || source_view.handle == VK_NULL_HANDLE) return;
+	if (source_extent.width == 0 || source_extent.height == 0) return;
+	if (!pipe.bind (cmdBuf)) return;
+
+	UpscalePushConstants push{};
+	push.uv_scale[0] = static_cast<float> (render_extent.width) / static_cast<float> (source_extent.width);
+	push.uv_scale[1] = static_cast<float> (render_extent.height) / static_cast<float> (source_extent.height);
+	push.texel_size[0] = 1.0f / static_cast<float> (source_extent.width);
+	push.texel_size[1] = 1.0f / static_cast<float> (source_extent.height);
+
+	// a frame's set never outlives the source view it was written with
+	std::vector<VkDescriptorImageInfo> infos = {
+		{ sampler.handle, source_view.handle, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
+	};
+	std::vector<DescriptorUse> writes = { { 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, infos } };
+	back_end.transient_descriptors.allocate (layout.get (), writes).bind (cmdBuf, pipe_layout->get (), 0);
+	vkCmdPushConstants (
+	    cmdBuf, pipe_layout->get (), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof (UpscalePushConstants), &push);
+	vkCmdDraw (cmdBuf, 3, 1, 0, 0);
+}
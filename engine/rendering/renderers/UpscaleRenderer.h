@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "rendering/backend/BackEnd.h"
+#include "rendering/backend/Descriptor.h"
+#include "rendering/backend/Pipeline.h"
+#include "rendering/backend/RenderTools.h"
+
+// Stretches the scene, rendered into the top left of an attachment allocated at the output's size,
+// over the whole output with a Catmull-Rom filter. Taps are kept inside the rendered area so the
+// stale texels around it never bleed in. In multiview passes each view reads its own layer.
+class UpscaleRenderer
+{
+	public:
+	explicit UpscaleRenderer (BackEnd& back_end);
+
+	void create_pipeline (VkRenderPass render_pass, uint32_t subpass);
+
+	// the scene attachment in SHADER_READ_ONLY_OPTIMAL, set again whenever it is recreated and only
+	// while no frame uses the previous one
+	void set_source (VkImage image, VkFormat format, uint32_t layers, VkExtent2D extent);
+
+	// render_extent is the part of the source the scene was rendered into
+	void draw (VkCommandBuffer cmdBuf, VkExtent2D render_extent);
+
+	private:
+	BackEnd& back_end;
+
+	std::vector<DescriptorSetLayoutBinding> bindings;
+	DescriptorLayout layout;
+	DescriptorStack draw_stack;
+
+	VulkanHandle<VkSampler, PFN_vkDestroySampler> sampler;
+	VulkanHandle<VkImageView, PFN_vkDestroyImageView> source_view;
+	VkExtent2D source_extent{};
+
+	std::optional<PipelineLayout> pipe_layout;
+	PipelineHandle pipe;
+};
@@ -5,6 +5,8 @@
 
 #include "cml/cml.h"
 
+#include "core/MemoryTracker.h"
+
 
 namespace job
 {
@@ -33,13 +35,15 @@ class VertexDescription
 struct MeshData
 {
 	MeshData (VertexDescription desc, std::vector<float> vertexData, std::vector<uint32_t> indexData)
-	: desc (desc), vertexData (vertexData), indexData (indexData)
+	: desc (desc),
+	  vertexData (std::begin (vertexData), std::end (vertexData)),
+	  indexData (std::begin (indexData), std::end (indexData))
 	{
 	}
 
 	const VertexDescription desc;
-	std::vector<float> vertexData;
-	std::vector<uint32_t> indexData;
+	TrackedVector<float, MemoryTag::mesh_data> vertexData;
+	TrackedVector<uint32_t, MemoryTag::mesh_data> indexData;
 };
 
 struct DeInterleavedMeshData
@@ -23,7 +23,7 @@ Resources::Resources (job::ThreadPool& thread_pool)
 			std::filesystem::path asset_path (dir_name);
 			if (std::filesystem::create_directory (asset_path))
 			{
-				Log.error (fmt::format ("Failed to create directory {}", dir_name));
+				Log.error ("Failed to create directory {}", dir_name);
 			}
 		}
 	}
@@ -11,6 +11,7 @@
 
 #include "core/JobSystem.h"
 #include "core/Logger.h"
+#include "core/Profiler.h"
 namespace Resource::Shader
 {
 
@@ -150,7 +151,7 @@ ShaderType GetShaderStage (const std::string& stage)
 	{
 		return ShaderType::compute;
 	}
-	Log.error (fmt::format ("Found error shader type of {}", stage));
+	Log.error ("Found error shader type of {}", stage);
 	return ShaderType::error;
 }
 
@@ -218,12 +219,12 @@ void ShaderDatabase::load ()
 		}
 		catch (nlohmann::detail::parse_error& e)
 		{
-			Log.debug (fmt::format ("Shader Database file was bas, creating a new one: {}", e.what ()));
+			Log.debug ("Shader Database file was bas, creating a new one: {}", e.what ());
 			save ();
 		}
 		catch (std::runtime_error& e)
 		{
-			Log.debug (fmt::format ("Shader Database file was incorrect, creating a new one: {}", e.what ()));
+			Log.debug ("Shader Database file was incorrect, creating a new one: {}", e.what ());
 			save ();
 		}
 	}
@@ -291,7 +292,7 @@ std::optional<std::string> ShaderCompiler::load_file_data (const std::string& fi
 
 	if (!file.is_open ())
 	{
-		Log.error (fmt::format ("Failed to load shader: {}", filename));
+		Log.error ("Failed to load shader: {}", filename);
 		return {};
 	}
 
@@ -303,6 +304,7 @@ std::optional<std::vector<uint32_t>> const ShaderCompiler::compile_glsl_to_spirv
     ShaderType const shader_type,
     std::filesystem::path include_path)
 {
+	PROFILE_SCOPE_DYNAMIC (fmt::format ("Compile shader {}", shader_name));
 	const char* InputCString = shader_data.c_str ();
 
 	glslang::TShader Shader (static_cast<EShLanguage> (shader_type));
@@ -337,7 +339,7 @@ std::optional<std::vector<uint32_t>> const ShaderCompiler::compile_glsl_to_spirv
 
 	if (!Shader.preprocess (&Resources, DefaultVersion, ENoProfile, false, false, messages, &PreprocessedGLSL, Includer))
 	{
-		Log.error (fmt::format ("GLSL Preprocessing Failed for: {}", shader_name));
+		Log.error ("GLSL Preprocessing Failed for: {}", shader_name);
 		Log.error (Shader.getInfoLog ());
 		Log.error (Shader.getInfoDebugLog ());
 		return {};
@@ -348,7 +350,7 @@ std::optional<std::vector<uint32_t>> const ShaderCompiler::compile_glsl_to_spirv
 
 	if (!Shader.parse (&Resources, 100, false, messages))
 	{
-		Log.error (fmt::format ("GLSL Parsing Failed for: {}", shader_name));
+		Log.error ("GLSL Parsing Failed for: {}", shader_name);
 		Log.error (Shader.getInfoLog ());
 		Log.error (Shader.getInfoDebugLog ());
 		return {};
@@ -359,7 +361,7 @@ std::optional<std::vector<uint32_t>> const ShaderCompiler::compile_glsl_to_spirv
 
 	if (!Program.link (messages))
 	{
-		Log.error (fmt::format ("GLSL Linking Failed for: {}", shader_name));
+		Log.error ("GLSL Linking Failed for: {}", shader_name);
 		Log.error (Shader.getInfoLog ());
 		Log.error (Shader.getInfoDebugLog ());
 		return {};
@@ -397,8 +399,7 @@ Shaders::Shaders (job::ThreadPool& thread_pool) : thread_pool (thread_pool)
 			{
 				fs::path in_path = entry.path ();
 				add_shader (in_path.filename ().string (), in_path.string ());
-				Log.debug (fmt::format (
-				    "Compiled shader {}.{}", in_path.stem ().string (), in_path.extension ().string ()));
+				Log.debug ("Compiled shader {}.{}", in_path.stem ().string (), in_path.extension ().string ());
 			}
 		}
 	}
@@ -420,7 +421,7 @@ ShaderID Shaders::add_shader (std::string name, std::string path)
 	auto shader_chars = compiler.load_file_data (path);
 	if (!shader_chars.has_value ())
 	{
-		Log.error (fmt::format ("Couldn't find shader {}", name));
+		Log.error ("Couldn't find shader {}", name);
 	}
 	std::filesystem::path p = path;
 	ShaderType type;
@@ -10,6 +10,7 @@
 
 #include "core/JobSystem.h"
 #include "core/Logger.h"
+#include "core/Profiler.h"
 
 
 
@@ -92,7 +93,7 @@ std::optional<TexResource> from_json_TexResource (nlohmann::json j)
 	}
 	catch (nlohmann::json::exception& e)
 	{
-		Log.error (fmt::format ("failed to parse texture: {}", e.what ()));
+		Log.error ("failed to parse texture: {}", e.what ());
 		return {};
 	}
 }
@@ -120,7 +121,7 @@ void Textures::load_texture_list ()
 		catch (nlohmann::json::exception& e)
 		{
 			Log.debug ("Texture db was invalid json, creating a new one");
-			Log.debug (fmt::format ("Json error: {}", e.what ()));
+			Log.debug ("Json error: {}", e.what ());
 			save_texture_list ();
 		}
 	}
@@ -132,7 +133,7 @@ void Textures::load_texture_list ()
 
 	try
 	{
-		Log.debug (fmt::format ("Loading {} textures", texture_resources.size ()));
+		Log.debug ("Loading {} textures", texture_resources.size ());
 		int count = 0;
 
 		auto signal = std::make_shared<job::TaskSignal> ();
@@ -149,7 +150,7 @@ void Textures::load_texture_list ()
 			}
 			else
 			{
-				Log.error (fmt::format ("Tex resource is invalid"));
+				Log.error ("Tex resource is invalid");
 			}
 		}
 		id_counter = count;
@@ -158,7 +159,7 @@ void Textures::load_texture_list ()
 	}
 	catch (nlohmann::json::exception& e)
 	{
-		Log.debug (fmt::format ("Error loading texture list {}", e.what ()));
+		Log.debug ("Error loading texture list {}", e.what ());
 	}
 }
 
@@ -180,7 +181,7 @@ void Textures::save_texture_list ()
 	}
 	catch (nlohmann::json::exception& e)
 	{
-		Log.debug (fmt::format ("{}", e.what ()));
+		Log.debug ("{}", e.what ());
 	}
 	outFile.close ();
 }
@@ -188,8 +189,9 @@ void Textures::save_texture_list ()
 void Textures::load_texture_from_file (TexID id)
 {
 	auto& texRes = get_tex_resource_by_id (id);
+	PROFILE_SCOPE_DYNAMIC (fmt::format ("Load texture {}", texRes.name));
 
-	std::vector<std::byte> texData; // = std::vector<std::byte> (texRes.description.pixelCount * 4);
+	TrackedVector<std::byte, MemoryTag::texture_data> texData; // = std::vector<std::byte> (texRes.description.pixelCount * 4);
 
 	// int desiredChannels = texRes.dataDescription.channels;
 	std::vector<stbi_uc*> pixels_array (texRes.paths.size ());
@@ -206,7 +208,7 @@ void Textures::load_texture_from_file (TexID id)
 		    4);
 		if (pixels_array.at (i) == nullptr)
 		{
-			Log.error (fmt::format ("Image {} failed to load!", path.string ()));
+			Log.error ("Image {} failed to load!", path.string ());
 		}
 	}
 
@@ -226,7 +228,7 @@ void Textures::load_texture_from_file (TexID id)
 		stbi_image_free (pixels_array.at (i));
 	}
 
-	Log.debug (fmt::format ("Tex {}", id));
+	Log.debug ("Tex {}", id);
 
 	std::lock_guard lg (resource_lock);
 	texRes.data = std::move (texData);
@@ -10,6 +10,8 @@
 #include <unordered_map>
 #include <vector>
 
+#include "core/MemoryTracker.h"
+
 namespace job
 {
 class ThreadPool;
@@ -76,7 +78,7 @@ class TexResource
 	TextureType tex_type;
 	std::vector<std::string> paths;
 	std::vector<Dimensions> dims;
-	std::vector<std::byte> data;
+	TrackedVector<std::byte, MemoryTag::texture_data> data;
 };
 
 class Textures
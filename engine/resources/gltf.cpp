@@ -1,12 +1,15 @@
 #include "gltf.h"
 
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
 #include <nlohmann/json.hpp>
 
 #include "core/Logger.h"
+#include "core/Profiler.h"
 
 using namespace nlohmann;
 
@@ -223,7 +226,7 @@ void from_json (json const& j, Accessor& p)
 {
 	get_optional (j, "name", p.name);
 	get_optional (j, "bufferView", p.bufferView);
-	j.at ("byteOffset").get_to (p.byteOffset);
+	get_optional (j, "byteOffset", p.byteOffset);
 	j.at ("componentType").get_to (p.componentType);
 	get_optional (j, "normalized", p.normalized);
 	j.at ("count").get_to (p.count);
@@ -442,6 +445,7 @@ void from_json (json const& j, RawGLTF& p)
 
 std::optional<RawGLTF> parse_gltf_file (std::string name)
 {
+	PROFILE_SCOPE_DYNAMIC (fmt::format ("Parse gltf {}", name));
 
 	std::ifstream i (name);
 	json j;
@@ -453,9 +457,174 @@ std::optional<RawGLTF> parse_gltf_file (std::string name)
 	}
 	catch (json::exception& e)
 	{
-		Log.debug (fmt::format ("Couldn't open gltf: {}", e.what ()));
+		Log.debug ("Couldn't open gltf: {}", e.what ());
+		return {};
+	}
+}
+
+namespace
+{
+uint32_t component_count (AccessorType type)
+{
+	switch (type)
+	{
+		case AccessorType::scalar: return 1;
+		case AccessorType::vec2: return 2;
+		case AccessorType::vec3: return 3;
+		case AccessorType::vec4: return 4;
+		case AccessorType::mat2: return 4;
+		case AccessorType::mat3: return 9;
+		case AccessorType::mat4: return 16;
+		default: return 0;
+	}
+}
+
+uint32_t component_size (ComponentType type)
+{
+	switch (type)
+	{
+		case ComponentType::byte:
+		case ComponentType::unsigned_byte: return 1;
+		case ComponentType::short16:
+		case ComponentType::unsigned_short: return 2;
+		default: return 4;
+	}
+}
+
+// first element of the accessor and the distance between elements, nullptr if it doesn't fit its view
+uint8_t const* accessor_data (RawGLTF const& gltf,
+    std::vector<std::vector<uint8_t>> const& buffers,
+    Accessor const& accessor,
+    size_t& stride)
+{
+	if (!accessor.bufferView || *accessor.bufferView >= gltf.bufferViews.size () || accessor.count == 0)
+		return nullptr;
+	auto& view = gltf.bufferViews[*accessor.bufferView];
+	if (view.buffer >= buffers.size ()) return nullptr;
+
+	size_t element_size = component_count (accessor.accessorType) * component_size (accessor.componentType);
+	stride = view.byteStride != 0 ? view.byteStride : element_size;
+	size_t begin = static_cast<size_t> (view.byteOffset) + accessor.byteOffset;
+	size_t end = begin + stride * (accessor.count - 1) + element_size;
+	if (element_size == 0 || end > static_cast<size_t> (view.byteOffset) + view.byteLength ||
+	    end > buffers[view.buffer].size ())
+		return nullptr;
+	return buffers[view.buffer].data () + begin;
+}
+
+// writes the accessor's floats into every vertex_stride'th float of out, starting at out_offset
+bool read_floats (RawGLTF const& gltf,
+    std::vector<std::vector<uint8_t>> const& buffers,
+    uint32_t accessor_index,
+    AccessorType type,
+    uint32_t vertex_count,
+    std::vector<float>& out,
+    size_t vertex_stride,
+    size_t out_offset)
+{
+	if (accessor_index >= gltf.accessors.size ()) return false;
+	auto& accessor = gltf.accessors[accessor_index];
+	if (accessor.accessorType != type || accessor.componentType != ComponentType::float32 ||
+	    accessor.count != vertex_count)
+		return false;
+
+	size_t stride = 0;
+	uint8_t const* data = accessor_data (gltf, buffers, accessor, stride);
+	if (data == nullptr) return false;
+
+	size_t size = component_count (type) * sizeof (float);
+	for (uint32_t i = 0; i < vertex_count; i++)
+		std::memcpy (&out[i * vertex_stride + out_offset], data + i * stride, size);
+	return true;
+}
+} // namespace
+
+std::optional<std::vector<std::vector<uint8_t>>> load_buffers (RawGLTF const& gltf, std::filesystem::path const& base_dir)
+{
+	std::vector<std::vector<uint8_t>> buffers;
+	for (auto& buffer : gltf.buffers)
+	{
+		if (buffer.uri.empty () || buffer.uri.rfind ("data:", 0) == 0)
+		{
+			Log.error ("gltf buffer {} isn't an external file", buffer.name);
+			return {};
+		}
+		std::ifstream file (base_dir / buffer.uri, std::ios::binary);
+		std::vector<uint8_t> data (buffer.byteLength);
+		if (!file.read (reinterpret_cast<char*> (data.data ()), static_cast<std::streamsize> (data.size ())))
+		{
+			Log.error ("Couldn't read gltf buffer {}", (base_dir / buffer.uri).string ());
+			return {};
+		}
+		buffers.push_back (std::move (data));
+	}
+	return buffers;
+}
+
+std::optional<Resource::Mesh::MeshData> load_mesh (
+    RawGLTF const& gltf, std::vector<std::vector<uint8_t>> const& buffers, uint32_t mesh)
+{
+	if (mesh >= gltf.meshes.size ()) return {};
+	auto& primitives = gltf.meshes[mesh].primitives;
+	auto primitive = std::find_if (primitives.begin (), primitives.end (), [] (Primitive const& p) {
+		return p.mode == PrimitiveMode::TRIANGLES && p.attributes.POSITION.has_value ();
+	});
+	if (primitive == primitives.end ()) return {};
+
+	auto& attributes = primitive->attributes;
+	if (*attributes.POSITION >= gltf.accessors.size ()) return {};
+	uint32_t vertex_count = gltf.accessors[*attributes.POSITION].count;
+
+	const size_t vertex_stride = 8;
+	std::vector<float> vertices (vertex_count * vertex_stride, 0.f);
+	if (!read_floats (gltf, buffers, *attributes.POSITION, AccessorType::vec3, vertex_count, vertices, vertex_stride, 0))
 		return {};
+	if (attributes.NORMAL)
+		read_floats (gltf, buffers, *attributes.NORMAL, AccessorType::vec3, vertex_count, vertices, vertex_stride, 3);
+	if (attributes.TEXCOORD_0)
+		read_floats (gltf, buffers, *attributes.TEXCOORD_0, AccessorType::vec2, vertex_count, vertices, vertex_stride, 6);
+
+	std::vector<uint32_t> indices;
+	if (!primitive->indices)
+	{
+		indices.resize (vertex_count);
+		for (uint32_t i = 0; i < vertex_count; i++)
+			indices[i] = i;
 	}
+	else
+	{
+		if (*primitive->indices >= gltf.accessors.size ()) return {};
+		auto& accessor = gltf.accessors[*primitive->indices];
+		size_t stride = 0;
+		uint8_t const* data = accessor_data (gltf, buffers, accessor, stride);
+		if (data == nullptr || accessor.accessorType != AccessorType::scalar) return {};
+
+		indices.resize (accessor.count);
+		for (uint32_t i = 0; i < accessor.count; i++)
+		{
+			uint8_t const* element = data + i * stride;
+			switch (accessor.componentType)
+			{
+				case ComponentType::unsigned_byte: indices[i] = *element; break;
+				case ComponentType::unsigned_short:
+				{
+					uint16_t index;
+					std::memcpy (&index, element, sizeof (index));
+					indices[i] = index;
+					break;
+				}
+				case ComponentType::unsigned_int: std::memcpy (&indices[i], element, sizeof (uint32_t)); break;
+				default: return {};
+			}
+			if (indices[i] >= vertex_count) return {};
+		}
+	}
+
+	using Resource::Mesh::VertexType;
+	return Resource::Mesh::MeshData (
+	    Resource::Mesh::VertexDescription ({ VertexType::Vert3, VertexType::Vert3, VertexType::Vert2 }),
+	    std::move (vertices),
+	    std::move (indices));
 }
 
 } // namespace gltf
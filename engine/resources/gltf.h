@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <filesystem>
 #include <optional>
 #include <string>
 #include <variant>
@@ -217,8 +219,8 @@ struct Attributes
 struct Primitive
 {
 	Attributes attributes;
-	uint32_t indices = 0;
-	uint32_t material = 0;
+	std::optional<uint32_t> indices = std::nullopt;
+	std::optional<uint32_t> material = std::nullopt;
 	PrimitiveMode mode = PrimitiveMode::TRIANGLES;
 	std::vector<Target> morphTargets;
 };
@@ -381,4 +383,13 @@ struct RawGLTF
 
 std::optional<RawGLTF> parse_gltf_file (std::string name);
 
+// Reads every buffer from its .bin file next to the gltf, embedded data uris aren't supported
+std::optional<std::vector<std::vector<uint8_t>>> load_buffers (RawGLTF const& gltf, std::filesystem::path const& base_dir);
+
+// Interleaves the mesh's first triangle list primitive into the pos3/normal3/uv2 layout. Missing
+// normals and uvs are zero, returns nullopt without float positions or when an accessor points
+// outside of its buffer.
+std::optional<Resource::Mesh::MeshData> load_mesh (
+    RawGLTF const& gltf, std::vector<std::vector<uint8_t>> const& buffers, uint32_t mesh);
+
 } // namespace gltf
\ No newline at end of file
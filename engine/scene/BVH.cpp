@@ -0,0 +1,361 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+#include "core/JobSystem.h"
+#include "core/Profiler.h"
+
+namespace
+{
+const uint32_t SAHBinCount = 16;
+const float TraversalCost = 1.f; // relative to testing one primitive
+// subtrees smaller than this are built on one thread
+const uint32_t ParallelBuildThreshold = 4096;
+
+float axis_value (cml::vec3f v, uint32_t axis) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; }
+
+enum class Containment
+{
+	outside,
+	intersecting,
+	inside
+};
+
+Containment test_box (Frustum const& frustum, cml::vec3f min, cml::vec3f max)
+{
+	cml::vec3f c = (min + max) * 0.5f;
+	cml::vec3f e = (max - min) * 0.5f;
+	Containment result = Containment::inside;
+	for (auto& p : frustum.planes)
+	{
+		float dist = c.x * p.x + c.y * p.y + c.z * p.z + p.w;
+		float reach = e.x * std::abs (p.x) + e.y * std::abs (p.y) + e.z * std::abs (p.z);
+		if (dist < -reach) return Containment::outside;
+		if (dist < reach) result = Containment::intersecting;
+	}
+	return result;
+}
+
+// Narrows [t_near, t_far] to where the ray is between min and max on one axis. A zero direction
+// component has an infinite inverse, the ray then stays inside the slab for every t or for none,
+// which has to be decided from the origin since 0 * inf would make the distances NaN.
+bool clip_slab (float origin, float inv_dir, float min, float max, float& t_near, float& t_far)
+{
+	if (std::isinf (inv_dir)) return origin >= min && origin <= max;
+	float t0 = (min - origin) * inv_dir;
+	float t1 = (max - origin) * inv_dir;
+	t_near = std::max (t_near, std::min (t0, t1));
+	t_far = std::min (t_far, std::max (t0, t1));
+	return t_near <= t_far;
+}
+
+// slab test, returns the entry distance
+std::optional<float> ray_box (cml::vec3f origin, cml::vec3f inv_dir, cml::vec3f min, cml::vec3f max, float max_t)
+{
+	float t_near = 0.f;
+	float t_far = max_t;
+	if (!clip_slab (origin.x, inv_dir.x, min.x, max.x, t_near, t_far) ||
+	    !clip_slab (origin.y, inv_dir.y, min.y, max.y, t_near, t_far) ||
+	    !clip_slab (origin.z, inv_dir.z, min.z, max.z, t_near, t_far))
+		return std::nullopt;
+	return t_near;
+}
+} // namespace
+
+// AABB
+
+void AABB::grow (cml::vec3f p)
+{
+	min = cml::min (min, p);
+	max = cml::max (max, p);
+}
+
+void AABB::grow (AABB const& other)
+{
+	min = cml::min (min, other.min);
+	max = cml::max (max, other.max);
+}
+
+float AABB::surface_area () const
+{
+	if (is_empty ()) return 0.f;
+	cml::vec3f d = max - min;
+	return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// BVH
+
+std::optional<BVH::Split> BVH::find_split (uint32_t first, uint32_t count, AABB const& node_box) const
+{
+	AABB centroid_box;
+	for (uint32_t i = first; i < first + count; i++)
+		centroid_box.grow (centers[indices[i]]);
+
+	std::optional<Split> best;
+	for (uint32_t axis = 0; axis < 3; axis++)
+	{
+		float lo = axis_value (centroid_box.min, axis);
+		float hi = axis_value (centroid_box.max, axis);
+		if (hi <= lo) continue;
+
+		std::array<AABB, SAHBinCount> bin_boxes;
+		std::array<uint32_t, SAHBinCount> bin_counts{};
+		float scale = static_cast<float> (SAHBinCount) / (hi - lo);
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			uint32_t prim = indices[i];
+			auto bin = std::min (static_cast<uint32_t> ((axis_value (centers[prim], axis) - lo) * scale), SAHBinCount - 1);
+			bin_boxes[bin].grow (boxes[prim]);
+			bin_counts[bin]++;
+		}
+
+		// sweep from the right to get the area and count on that side of every plane
+		std::array<float, SAHBinCount> right_area;
+		std::array<uint32_t, SAHBinCount> right_count;
+		AABB right_box;
+		uint32_t right_total = 0;
+		for (uint32_t b = SAHBinCount - 1; b > 0; b--)
+		{
+			right_box.grow (bin_boxes[b]);
+			right_total += bin_counts[b];
+			right_area[b] = right_box.surface_area ();
+			right_count[b] = right_total;
+		}
+
+		AABB left_box;
+		uint32_t left_total = 0;
+		for (uint32_t b = 1; b < SAHBinCount; b++)
+		{
+			left_box.grow (bin_boxes[b - 1]);
+			left_total += bin_counts[b - 1];
+			if (left_total == 0 || right_count[b] == 0) continue;
+			float cost = left_box.surface_area () * left_total + right_area[b] * right_count[b];
+			if (!best || cost < best->cost) best = Split{ axis, lo + static_cast<float> (b) / scale, cost };
+		}
+	}
+	if (best) best->cost = TraversalCost + best->cost / node_box.surface_area ();
+	return best;
+}
+
+uint32_t BVH::partition (uint32_t first, uint32_t count, AABB const& node_box)
+{
+	if (count <= 1) return first;
+
+	auto begin = indices.begin () + first;
+	auto end = begin + count;
+	auto split = find_split (first, count, node_box);
+	if (split)
+	{
+		if (count <= MaxLeafSize && split->cost >= static_cast<float> (count)) return first;
+		auto mid = std::partition (begin, end, [&] (uint32_t prim) {
+			return axis_value (centers[prim], split->axis) < split->position;
+		});
+		if (mid != begin && mid != end) return static_cast<uint32_t> (mid - indices.begin ());
+	}
+	if (count <= MaxLeafSize) return first;
+
+	// all centers coincide (or float rounding put them on one side), halve the range instead
+	uint32_t half = count / 2;
+	cml::vec3f extent = node_box.max - node_box.min;
+	uint32_t axis = extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2;
+	std::nth_element (begin, begin + half, end, [&] (uint32_t a, uint32_t b) {
+		return axis_value (centers[a], axis) < axis_value (centers[b], axis);
+	});
+	return first + half;
+}
+
+uint32_t BVH::build_serial (uint32_t first, uint32_t count, std::vector<Node>& out)
+{
+	uint32_t index = static_cast<uint32_t> (out.size ());
+	AABB box;
+	for (uint32_t i = first; i < first + count; i++)
+		box.grow (boxes[indices[i]]);
+	out.push_back (Node{ box.min, first, box.max, count });
+
+	uint32_t mid = partition (first, count, box);
+	if (mid == first) return index;
+
+	build_serial (first, mid - first, out);
+	uint32_t right = build_serial (mid, first + count - mid, out);
+	out[index].right = right;
+	return index;
+}
+
+std::vector<BVH::Node> BVH::build_parallel (job::ThreadPool& pool, uint32_t first, uint32_t count)
+{
+	std::vector<Node> out;
+	if (count < ParallelBuildThreshold)
+	{
+		build_serial (first, count, out);
+		return out;
+	}
+
+	AABB box;
+	for (uint32_t i = first; i < first + count; i++)
+		box.grow (boxes[indices[i]]);
+	out.push_back (Node{ box.min, first, box.max, count });
+
+	uint32_t mid = partition (first, count, box);
+	if (mid == first) return out;
+
+	// the halves own disjoint index ranges, so they can be built at the same time
+	std::array<std::vector<Node>, 2> children;
+	job::parallel_for (pool, 2, 1, [&] (size_t begin, size_t end) {
+		for (size_t c = begin; c < end; c++)
+			children[c] = c == 0 ? build_parallel (pool, first, mid - first) : build_parallel (pool, mid, first + count - mid);
+	});
+
+	// child subtrees index relative to their own arrays
+	out.reserve (1 + children[0].size () + children[1].size ());
+	for (auto& child : children)
+	{
+		uint32_t offset = static_cast<uint32_t> (out.size ());
+		if (&child == &children[1]) out[0].right = offset;
+		for (auto node : child)
+		{
+			if (node.right != 0) node.right += offset;
+			out.push_back (node);
+		}
+	}
+	return out;
+}
+
+void BVH::build (job::ThreadPool& pool, std::vector<AABB> const& new_boxes)
+{
+	PROFILE_SCOPE ("BVH::build");
+	boxes = new_boxes;
+	centers.resize (boxes.size ());
+	indices.resize (boxes.size ());
+	for (uint32_t i = 0; i < boxes.size (); i++)
+	{
+		centers[i] = boxes[i].center ();
+		indices[i] = i;
+	}
+	nodes.clear ();
+	if (boxes.empty ()) return;
+
+	nodes = build_parallel (pool, 0, static_cast<uint32_t> (boxes.size ()));
+}
+
+void BVH::refit (std::vector<AABB> const& new_boxes)
+{
+	PROFILE_SCOPE ("BVH::refit");
+	if (new_boxes.size () != boxes.size ()) throw std::runtime_error ("BVH refit needs the same primitives as the build");
+	boxes = new_boxes;
+	for (uint32_t i = 0; i < boxes.size (); i++)
+		centers[i] = boxes[i].center ();
+
+	// children are stored after their parent, so walking backwards visits them first
+	for (size_t n = nodes.size (); n-- > 0;)
+	{
+		auto& node = nodes[n];
+		AABB box;
+		if (node.right == 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+				box.grow (boxes[indices[i]]);
+		}
+		else
+		{
+			box.grow (AABB{ nodes[n + 1].min, nodes[n + 1].max });
+			box.grow (AABB{ nodes[node.right].min, nodes[node.right].max });
+		}
+		node.min = box.min;
+		node.max = box.max;
+	}
+}
+
+void BVH::cull (Frustum const& frustum, std::vector<uint32_t>& out) const
+{
+	if (nodes.empty ()) return;
+
+	std::vector<uint32_t> stack;
+	stack.reserve (64);
+	stack.push_back (0);
+	while (!stack.empty ())
+	{
+		uint32_t index = stack.back ();
+		stack.pop_back ();
+		auto& node = nodes[index];
+
+		auto containment = test_box (frustum, node.min, node.max);
+		if (containment == Containment::outside) continue;
+		if (containment == Containment::inside)
+		{
+			out.insert (out.end (), indices.begin () + node.first, indices.begin () + node.first + node.count);
+			continue;
+		}
+		if (node.right == 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				auto& box = boxes[indices[i]];
+				if (test_box (frustum, box.min, box.max) != Containment::outside) out.push_back (indices[i]);
+			}
+			continue;
+		}
+		stack.push_back (node.right);
+		stack.push_back (index + 1);
+	}
+}
+
+std::optional<RayHit> BVH::raycast (cml::vec3f origin, cml::vec3f dir, float max_t, PrimitiveRayTest const& test) const
+{
+	if (nodes.empty ()) return std::nullopt;
+
+	// zero components become infinite, ray_box handles them
+	cml::vec3f inv_dir (1.f / dir.x, 1.f / dir.y, 1.f / dir.z);
+	std::optional<RayHit> best;
+	float best_t = max_t;
+
+	std::vector<uint32_t> stack;
+	stack.reserve (64);
+	stack.push_back (0);
+	while (!stack.empty ())
+	{
+		uint32_t index = stack.back ();
+		stack.pop_back ();
+		auto& node = nodes[index];
+		if (!ray_box (origin, inv_dir, node.min, node.max, best_t)) continue;
+
+		if (node.right == 0)
+		{
+			for (uint32_t i = node.first; i < node.first + node.count; i++)
+			{
+				uint32_t prim = indices[i];
+				auto t = test ? test (prim, origin, dir, best_t) :
+				                ray_box (origin, inv_dir, boxes[prim].min, boxes[prim].max, best_t);
+				if (t && *t <= best_t)
+				{
+					best_t = *t;
+					best = RayHit{ prim, *t };
+				}
+			}
+			continue;
+		}
+
+		// visit the nearer child first so best_t shrinks sooner
+		uint32_t near = index + 1;
+		uint32_t far = node.right;
+		auto near_t = ray_box (origin, inv_dir, nodes[near].min, nodes[near].max, best_t);
+		auto far_t = ray_box (origin, inv_dir, nodes[far].min, nodes[far].max, best_t);
+		if (near_t && far_t && *far_t < *near_t) std::swap (near, far);
+		stack.push_back (far);
+		stack.push_back (near);
+	}
+	return best;
+}
+
+std::optional<float> BVH::height_at (float x, float z, PrimitiveRayTest const& test) const
+{
+	if (nodes.empty ()) return std::nullopt;
+
+	auto& root = nodes[0];
+	cml::vec3f origin (x, root.max.y + 1.f, z);
+	auto hit = raycast (origin, cml::vec3f (0.f, -1.f, 0.f), root.max.y - root.min.y + 2.f, test);
+	if (!hit) return std::nullopt;
+	return origin.y - hit->t;
+}
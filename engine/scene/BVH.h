@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "rendering/Culling.h"
+
+namespace job
+{
+class ThreadPool;
+}
+
+struct AABB
+{
+	cml::vec3f min = cml::vec3f (INFINITY, INFINITY, INFINITY);
+	cml::vec3f max = cml::vec3f (-INFINITY, -INFINITY, -INFINITY);
+
+	void grow (cml::vec3f p);
+	void grow (AABB const& other);
+	cml::vec3f center () const { return (min + max) * 0.5f; }
+	float surface_area () const;
+	bool is_empty () const { return min.x > max.x; }
+};
+
+struct RayHit
+{
+	uint32_t index; // primitive
+	float t;
+};
+
+// Exact intersection against a primitive whose box was hit, returns the distance along the ray
+// or nullopt for a miss. Without one, hits are reported against the boxes.
+using PrimitiveRayTest =
+    std::function<std::optional<float> (uint32_t index, cml::vec3f origin, cml::vec3f dir, float max_t)>;
+
+// Bounding volume hierarchy over a set of primitive boxes, built top down with binned SAH splits.
+// Nodes are flattened depth first into one array: a node's left child directly follows it and each
+// node's primitives are a contiguous range of the index array, so a node found fully inside a
+// frustum adds its whole range without visiting its children.
+//
+// The topology is meant for mostly static content. Objects that move a little can be refit, which
+// keeps the tree but recomputes the node boxes, quality degrades as they move further away.
+class BVH
+{
+	public:
+	static constexpr uint32_t MaxLeafSize = 4;
+
+	void build (job::ThreadPool& pool, std::vector<AABB> const& boxes);
+	// boxes must be in the same order and count as the last build
+	void refit (std::vector<AABB> const& boxes);
+
+	// appends the indices of every primitive intersecting the frustum, in no particular order
+	void cull (Frustum const& frustum, std::vector<uint32_t>& out) const;
+
+	std::optional<RayHit> raycast (
+	    cml::vec3f origin, cml::vec3f dir, float max_t = INFINITY, PrimitiveRayTest const& test = {}) const;
+
+	// highest surface below the top of the tree at (x, z), for ground queries
+	std::optional<float> height_at (float x, float z, PrimitiveRayTest const& test = {}) const;
+
+	size_t node_count () const { return nodes.size (); }
+	size_t primitive_count () const { return boxes.size (); }
+	AABB bounds () const { return nodes.empty () ? AABB{} : AABB{ nodes[0].min, nodes[0].max }; }
+
+	private:
+	struct Node
+	{
+		cml::vec3f min;
+		uint32_t first; // into indices
+		cml::vec3f max;
+		uint32_t count;
+		uint32_t right = 0; // 0 for leaves, the root is never a right child
+	};
+	std::vector<Node> nodes;
+	std::vector<uint32_t> indices;
+	std::vector<AABB> boxes;
+	std::vector<cml::vec3f> centers;
+
+	struct Split
+	{
+		uint32_t axis;
+		float position;
+		float cost;
+	};
+	std::optional<Split> find_split (uint32_t first, uint32_t count, AABB const& node_box) const;
+	uint32_t partition (uint32_t first, uint32_t count, AABB const& node_box);
+	// appends the subtree for [first, first + count) to out, returns its root
+	uint32_t build_serial (uint32_t first, uint32_t count, std::vector<Node>& out);
+	std::vector<Node> build_parallel (job::ThreadPool& pool, uint32_t first, uint32_t count);
+};
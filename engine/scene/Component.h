@@ -1,8 +1,56 @@
 #pragma once
 
-#include <map>
-#include <vector>
+#include <cstdint>
 
-#include "resources/Resource.h"
+#include "cml/cml.h"
 
-#include "Transform.h"
+// Components are plain data, the ECS moves them between chunks with memcpy
+
+struct Transform
+{
+	cml::vec3f position = cml::vec3f (0, 0, 0);
+	cml::quatf rotation = cml::quatf (1, 0, 0, 0);
+	cml::vec3f scale = cml::vec3f (1, 1, 1);
+};
+
+struct MeshRendererComponent
+{
+	int model = -1; // ModelID
+	uint32_t material_index = 0;
+	uint32_t draw_id = UINT32_MAX; // MeshDrawID once registered with the MeshRenderer
+};
+
+enum class LightType : uint32_t
+{
+	point,
+	spot,
+	directional
+};
+
+// placed at the entity's Transform, directional lights ignore the position
+struct LightComponent
+{
+	LightType type = LightType::point;
+	cml::vec3f color = cml::vec3f (1, 1, 1);
+	float intensity = 1.f;
+	float range = 10.f; // point and spot lights
+	cml::vec3f direction = cml::vec3f (0, -1, 0); // the way spot and directional lights point
+	float inner_angle = 0.3f; // spot cone half angles in radians, full intensity inside the inner one
+	float outer_angle = 0.5f;
+};
+
+// circles center in the xz plane, at the height of center
+struct Orbit
+{
+	cml::vec3f center = cml::vec3f (0, 0, 0);
+	float radius = 1.f;
+	float speed = 1.f; // radians per second
+	float angle = 0.f;
+};
+
+// object space bounding sphere
+struct Bounds
+{
+	cml::vec3f center = cml::vec3f (0, 0, 0);
+	float radius = 0.f;
+};
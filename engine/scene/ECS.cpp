@@ -0,0 +1,202 @@
+#include "ECS.h"
+
+#include <mutex>
+#include <stdexcept>
+
+namespace ecs
+{
+namespace
+{
+std::mutex registry_lock;
+std::vector<ComponentInfo>& component_registry ()
+{
+	// reserved up front so references handed out stay valid
+	static std::vector<ComponentInfo> registry = [] {
+		std::vector<ComponentInfo> r;
+		r.reserve (MaxComponentTypes);
+		return r;
+	}();
+	return registry;
+}
+
+size_t align_up (size_t value, size_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+} // namespace
+
+namespace detail
+{
+ComponentTypeID register_component (ComponentInfo info)
+{
+	std::lock_guard lg (registry_lock);
+	auto& registry = component_registry ();
+	if (registry.size () >= MaxComponentTypes) throw std::runtime_error ("Too many ECS component types");
+	registry.push_back (info);
+	return static_cast<ComponentTypeID> (registry.size () - 1);
+}
+} // namespace detail
+
+ComponentInfo const& component_info (ComponentTypeID id)
+{
+	std::lock_guard lg (registry_lock);
+	return component_registry ().at (id);
+}
+
+// Archetype
+
+Archetype::Archetype (ComponentMask mask) : mask (mask)
+{
+	offsets.fill (UINT32_MAX);
+	sizes.fill (0);
+	size_t row_size = sizeof (Entity);
+	for (ComponentTypeID id = 0; id < MaxComponentTypes; id++)
+	{
+		if (!mask.test (id)) continue;
+		types.push_back (id);
+		sizes[id] = static_cast<uint32_t> (component_info (id).size);
+		row_size += sizes[id];
+	}
+
+	// columns are laid out back to back, shrink the capacity until the alignment padding fits
+	uint32_t capacity = static_cast<uint32_t> (ChunkSize / row_size);
+	while (capacity > 0)
+	{
+		size_t offset = sizeof (Entity) * capacity;
+		for (auto id : types)
+		{
+			auto& info = component_info (id);
+			offset = align_up (offset, info.alignment);
+			offsets[id] = static_cast<uint32_t> (offset);
+			offset += info.size * capacity;
+		}
+		if (offset <= ChunkSize) break;
+		capacity--;
+	}
+	if (capacity == 0) throw std::runtime_error ("ECS archetype row doesn't fit in a chunk");
+	chunk_capacity = capacity;
+}
+
+Archetype::Slot Archetype::allocate_row (Entity entity)
+{
+	if (chunks.empty () || chunks.back ()->count == chunk_capacity) chunks.push_back (std::make_unique<Chunk> ());
+
+	auto& chunk = *chunks.back ();
+	Slot slot{ static_cast<uint32_t> (chunks.size () - 1), chunk.count };
+	entities (chunk)[slot.row] = entity;
+	chunk.count++;
+	entity_count++;
+	return slot;
+}
+
+Entity Archetype::remove_row (Slot slot)
+{
+	auto& chunk = *chunks[slot.chunk];
+	auto& last_chunk = *chunks.back ();
+	uint32_t last_row = last_chunk.count - 1;
+
+	Entity moved;
+	bool is_last = &chunk == &last_chunk && slot.row == last_row;
+	if (!is_last)
+	{
+		moved = entities (last_chunk)[last_row];
+		entities (chunk)[slot.row] = moved;
+		for (auto id : types)
+		{
+			size_t size = sizes[id];
+			std::memcpy (static_cast<std::byte*> (column (chunk, id)) + size * slot.row,
+			    static_cast<std::byte*> (column (last_chunk, id)) + size * last_row,
+			    size);
+		}
+	}
+
+	last_chunk.count--;
+	entity_count--;
+	if (last_chunk.count == 0) chunks.pop_back ();
+	return moved;
+}
+
+// World
+
+Archetype& World::get_archetype (ComponentMask mask)
+{
+	auto it = archetypes.find (mask);
+	if (it != archetypes.end ()) return *it->second;
+
+	auto archetype = std::make_unique<Archetype> (mask);
+	archetype_list.push_back (archetype.get ());
+	return *archetypes.emplace (mask, std::move (archetype)).first->second;
+}
+
+Entity World::allocate_entity (Archetype& archetype)
+{
+	uint32_t index;
+	if (!free_indices.empty ())
+	{
+		index = free_indices.back ();
+		free_indices.pop_back ();
+	}
+	else
+	{
+		index = static_cast<uint32_t> (records.size ());
+		records.emplace_back ();
+	}
+
+	Entity entity{ index, records[index].generation };
+	records[index].archetype = &archetype;
+	records[index].slot = archetype.allocate_row (entity);
+	alive_count++;
+	return entity;
+}
+
+bool World::is_alive (Entity entity) const
+{
+	return entity.index < records.size () && records[entity.index].archetype != nullptr &&
+	       records[entity.index].generation == entity.generation;
+}
+
+void World::destroy (Entity entity)
+{
+	if (!is_alive (entity)) return;
+
+	auto& record = records[entity.index];
+	auto slot = record.slot;
+	Entity moved = record.archetype->remove_row (slot);
+	fix_moved (moved, slot);
+
+	record.archetype = nullptr;
+	record.generation++;
+	free_indices.push_back (entity.index);
+	alive_count--;
+}
+
+void World::move_entity (Entity entity, Archetype& target)
+{
+	auto& record = records.at (entity.index);
+	Archetype& source = *record.archetype;
+	auto old_slot = record.slot;
+	auto new_slot = target.allocate_row (entity);
+
+	// copy the components both archetypes share, anything new is left for the caller to set
+	auto& src_chunk = source.get_chunk (old_slot.chunk);
+	auto& dst_chunk = target.get_chunk (new_slot.chunk);
+	for (auto id : target.get_types ())
+	{
+		if (!source.get_mask ().test (id)) continue;
+		size_t size = target.component_size (id);
+		std::memcpy (static_cast<std::byte*> (target.column (dst_chunk, id)) + size * new_slot.row,
+		    static_cast<std::byte*> (source.column (src_chunk, id)) + size * old_slot.row,
+		    size);
+	}
+
+	Entity moved = source.remove_row (old_slot);
+	fix_moved (moved, old_slot);
+
+	record.archetype = &target;
+	record.slot = new_slot;
+}
+
+void World::fix_moved (Entity moved, Archetype::Slot slot)
+{
+	if (moved.index == UINT32_MAX) return;
+	records[moved.index].slot = slot;
+}
+
+} // namespace ecs
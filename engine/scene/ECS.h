@@ -0,0 +1,237 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "core/JobSystem.h"
+
+// Archetype based entity component storage. Entities with the same set of components share an
+// archetype, which stores them in fixed size chunks with one contiguous array per component (SoA).
+// Queries walk the matching chunks directly, so iteration touches only the columns it asks for.
+//
+// Components must be trivially copyable. Pointers into chunks are invalidated by any structural
+// change (create, destroy, add, remove), which must not happen while systems run in parallel.
+namespace ecs
+{
+constexpr size_t MaxComponentTypes = 64;
+constexpr size_t ChunkSize = 16 * 1024;
+
+using ComponentTypeID = uint32_t;
+using ComponentMask = std::bitset<MaxComponentTypes>;
+
+struct Entity
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool operator== (Entity const& other) const { return index == other.index && generation == other.generation; }
+	bool operator!= (Entity const& other) const { return !(*this == other); }
+};
+
+struct ComponentInfo
+{
+	size_t size;
+	size_t alignment;
+	char const* name;
+};
+
+namespace detail
+{
+ComponentTypeID register_component (ComponentInfo info);
+} // namespace detail
+
+ComponentInfo const& component_info (ComponentTypeID id);
+
+template <typename T> ComponentTypeID component_id ()
+{
+	static_assert (std::is_trivially_copyable_v<T>, "components are moved between chunks with memcpy");
+	static const ComponentTypeID id = detail::register_component ({ sizeof (T), alignof (T), typeid (T).name () });
+	return id;
+}
+
+template <typename... Ts> ComponentMask component_mask ()
+{
+	ComponentMask mask;
+	(mask.set (component_id<Ts> ()), ...);
+	return mask;
+}
+
+struct Chunk
+{
+	alignas (64) std::array<std::byte, ChunkSize> data;
+	uint32_t count = 0;
+};
+
+class Archetype
+{
+	public:
+	explicit Archetype (ComponentMask mask);
+
+	ComponentMask const& get_mask () const { return mask; }
+	uint32_t get_chunk_capacity () const { return chunk_capacity; }
+	size_t get_entity_count () const { return entity_count; }
+	std::vector<ComponentTypeID> const& get_types () const { return types; }
+	size_t component_size (ComponentTypeID id) const { return sizes[id]; }
+
+	size_t chunk_count () const { return chunks.size (); }
+	Chunk& get_chunk (size_t index) { return *chunks[index]; }
+
+	Entity* entities (Chunk& chunk) { return reinterpret_cast<Entity*> (chunk.data.data ()); }
+	void* column (Chunk& chunk, ComponentTypeID id) { return chunk.data.data () + offsets[id]; }
+	template <typename T> T* column (Chunk& chunk) { return static_cast<T*> (column (chunk, component_id<T> ())); }
+
+	struct Slot
+	{
+		uint32_t chunk;
+		uint32_t row;
+	};
+
+	// appends an uninitialized row
+	Slot allocate_row (Entity entity);
+	// fills the hole with the last row, returns the entity that moved or an invalid one
+	Entity remove_row (Slot slot);
+
+	private:
+	ComponentMask mask;
+	std::vector<ComponentTypeID> types;
+	std::array<uint32_t, MaxComponentTypes> offsets;
+	std::array<uint32_t, MaxComponentTypes> sizes;
+	uint32_t chunk_capacity = 0;
+	size_t entity_count = 0;
+	std::vector<std::unique_ptr<Chunk>> chunks; // all full except the last
+};
+
+class World
+{
+	public:
+	World () = default;
+	World (World const&) = delete;
+	World& operator= (World const&) = delete;
+
+	template <typename... Ts> Entity create (Ts const&... components)
+	{
+		Entity entity = allocate_entity (get_archetype (component_mask<Ts...> ()));
+		(set_component (entity, components), ...);
+		return entity;
+	}
+	void destroy (Entity entity);
+	bool is_alive (Entity entity) const;
+
+	// add and remove do nothing for entities that were destroyed
+	template <typename T> void add (Entity entity, T const& component)
+	{
+		if (!is_alive (entity)) return;
+		auto& record = records[entity.index];
+		ComponentMask mask = record.archetype->get_mask ();
+		if (!mask.test (component_id<T> ()))
+		{
+			mask.set (component_id<T> ());
+			move_entity (entity, get_archetype (mask));
+		}
+		set_component (entity, component);
+	}
+	template <typename T> void remove (Entity entity)
+	{
+		if (!is_alive (entity)) return;
+		ComponentMask mask = records[entity.index].archetype->get_mask ();
+		if (!mask.test (component_id<T> ())) return;
+		mask.reset (component_id<T> ());
+		move_entity (entity, get_archetype (mask));
+	}
+
+	template <typename T> bool has (Entity entity) const
+	{
+		return is_alive (entity) && records[entity.index].archetype->get_mask ().test (component_id<T> ());
+	}
+	template <typename T> T* get (Entity entity)
+	{
+		if (!has<T> (entity)) return nullptr;
+		auto& record = records[entity.index];
+		auto& chunk = record.archetype->get_chunk (record.slot.chunk);
+		return record.archetype->column<T> (chunk) + record.slot.row;
+	}
+
+	size_t entity_count () const { return alive_count; }
+
+	// fn (size_t count, Entity const* entities, Ts*... columns) once per chunk holding all of Ts
+	template <typename... Ts, typename F> void each_chunk (F&& fn)
+	{
+		ComponentMask query = component_mask<Ts...> ();
+		for (auto archetype : archetype_list)
+		{
+			if ((archetype->get_mask () & query) != query) continue;
+			for (size_t c = 0; c < archetype->chunk_count (); c++)
+			{
+				auto& chunk = archetype->get_chunk (c);
+				fn (static_cast<size_t> (chunk.count), archetype->entities (chunk), archetype->column<Ts> (chunk)...);
+			}
+		}
+	}
+
+	// fn (Entity, Ts&...) for every entity holding all of Ts
+	template <typename... Ts, typename F> void each (F&& fn)
+	{
+		each_chunk<Ts...> ([&] (size_t count, Entity const* entities, Ts*... columns) {
+			for (size_t i = 0; i < count; i++)
+				fn (entities[i], columns[i]...);
+		});
+	}
+
+	// each_chunk with chunks spread over the pool, fn must only touch its own chunk
+	template <typename... Ts, typename F> void par_each_chunk (job::ThreadPool& pool, F&& fn)
+	{
+		struct ChunkRef
+		{
+			Archetype* archetype;
+			Chunk* chunk;
+		};
+		std::vector<ChunkRef> work;
+		ComponentMask query = component_mask<Ts...> ();
+		for (auto archetype : archetype_list)
+		{
+			if ((archetype->get_mask () & query) != query) continue;
+			for (size_t c = 0; c < archetype->chunk_count (); c++)
+				work.push_back ({ archetype, &archetype->get_chunk (c) });
+		}
+		job::parallel_for (pool, work.size (), 4, [&] (size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				Archetype* archetype = work[i].archetype;
+				Chunk& chunk = *work[i].chunk;
+				fn (static_cast<size_t> (chunk.count), archetype->entities (chunk), archetype->column<Ts> (chunk)...);
+			}
+		});
+	}
+
+	private:
+	struct EntityRecord
+	{
+		Archetype* archetype = nullptr;
+		Archetype::Slot slot;
+		uint32_t generation = 0;
+	};
+	std::vector<EntityRecord> records;
+	std::vector<uint32_t> free_indices;
+	size_t alive_count = 0;
+
+	std::unordered_map<ComponentMask, std::unique_ptr<Archetype>> archetypes;
+	std::vector<Archetype*> archetype_list;
+
+	Archetype& get_archetype (ComponentMask mask);
+	Entity allocate_entity (Archetype& archetype);
+	void move_entity (Entity entity, Archetype& target);
+	void fix_moved (Entity moved, Archetype::Slot slot);
+
+	template <typename T> void set_component (Entity entity, T const& component) { *get<T> (entity) = component; }
+};
+
+} // namespace ecs
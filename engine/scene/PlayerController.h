@@ -40,6 +40,7 @@ class PlayerController
 	void update (float deltaTime);
 	cml::vec3f position ();
 	cml::quatf rotation ();
+	void set_position (cml::vec3f position) { m_position = position; }
 
 	private:
 	enum class MovementAxis
@@ -69,3 +70,5 @@ class PlayerController
 	// Calculates the front vector from the Camera's (updated) Euler Angles
 	void update_camera_vectors ();
 };
+
+cml::quatf to_quaternion (float yaw, float pitch, float roll); // yaw (Z), pitch (Y), roll (X)
@@ -1,5 +1,8 @@
 #include "Scene.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "core/JobSystem.h"
 #include "core/Time.h"
 #include "core/Input.h"
@@ -9,6 +12,7 @@
 #include "cml/cml.h"
 
 #include "core/Logger.h"
+#include "core/Profiler.h"
 
 Scene::Scene (job::ThreadPool& thread_pool,
     Time& time,
@@ -24,17 +28,255 @@ Scene::Scene (job::ThreadPool& thread_pool,
 {
 	main_camera =
 	    renderer.render_cameras.create (CameraType::perspective, cml::vec3f::zero, cml::quatf::identity);
+	create_material_spheres ();
+	create_orbiting_lights ();
+	load_gltf_scenes ();
+
+	systems.add_system ("orbit",
+	    {},
+	    ecs::SystemScheduler::access<Transform, Orbit> (),
+	    [this] (ecs::World& w, job::ThreadPool& pool) {
+		    float dt = static_cast<float> (time.delta_time ());
+		    w.par_each_chunk<Transform, Orbit> (
+		        pool, [dt] (size_t count, ecs::Entity const*, Transform* transforms, Orbit* orbits) {
+			        for (size_t i = 0; i < count; i++)
+			        {
+				        auto& orbit = orbits[i];
+				        orbit.angle = std::fmod (orbit.angle + orbit.speed * dt, 6.2831853f);
+				        transforms[i].position = orbit.center +
+				            cml::vec3f (std::cos (orbit.angle), 0.f, std::sin (orbit.angle)) * orbit.radius;
+			        }
+		        });
+	    });
+}
+
+Scene::~Scene ()
+{
+	world.each<MeshRendererComponent> ([&] (ecs::Entity, MeshRendererComponent& mesh) {
+		renderer.mesh_renderer.remove_mesh (mesh.draw_id);
+		renderer.get_materials ().destroy_bindless_material (mesh.material_index);
+	});
+	if (sphere_model != -1) renderer.get_models ().free_model (sphere_model);
+	for (auto model : gltf_models)
+		renderer.get_models ().free_model (model);
+}
+
+void Scene::create_material_spheres ()
+{
+	using Resource::Material::DataMember;
+	const int sphere_count = 8;
+
+	sphere_model = renderer.get_models ().create_model (Resource::Mesh::create_sphere ());
+	for (int i = 0; i < sphere_count; i++)
+	{
+		float t = static_cast<float> (i) / static_cast<float> (sphere_count - 1);
+		// falls back to the default material without bindless
+		auto material = renderer.get_materials ().create_bindless_material (
+		    { DataMember{ cml::vec3f (0.9f, 0.6f, 0.3f) }, DataMember{ 1.f - t * 0.9f }, DataMember{ t } }, {});
+
+		Transform transform;
+		transform.position = cml::vec3f (static_cast<float> (i) * 2.5f - 8.75f, 2.f, -6.f);
+		Bounds bounds{ cml::vec3f::zero, 1.f };
+
+		MeshRendererComponent mesh;
+		mesh.model = sphere_model;
+		mesh.material_index = material.value_or (Materials::DefaultMaterial);
+		mesh.draw_id = renderer.mesh_renderer.add_mesh (
+		    sphere_model, cml::mat4f (), bounds.center, bounds.radius, mesh.material_index);
+
+		// the hierarchy writes the transform on the first update
+		auto node = transforms.add_node (NoParent, transform.position);
+		transforms.bind_draw (node, mesh.draw_id);
+
+		world.create (transform, bounds, mesh);
+	}
+}
+
+void Scene::create_orbiting_lights ()
+{
+	const cml::vec3f colors[] = { cml::vec3f (1.f, 0.4f, 0.3f), cml::vec3f (0.3f, 1.f, 0.4f), cml::vec3f (0.3f, 0.5f, 1.f) };
+	for (int i = 0; i < 3; i++)
+	{
+		Orbit orbit;
+		orbit.center = cml::vec3f (0.f, 4.f, -6.f);
+		orbit.radius = 6.f;
+		orbit.speed = 0.5f;
+		orbit.angle = static_cast<float> (i) * 2.0943951f; // a third of a turn apart
+
+		LightComponent light;
+		light.color = colors[i];
+		light.intensity = 20.f;
+		light.range = 12.f;
+
+		world.create (Transform{}, orbit, light);
+	}
+}
+
+void Scene::load_gltf_scenes ()
+{
+	std::error_code ec;
+	for (auto& entry : std::filesystem::directory_iterator ("assets/gltf", ec))
+		if (entry.is_regular_file () && entry.path ().extension () == ".gltf") load_gltf (entry.path ());
+}
+
+namespace
+{
+Bounds bounds_of (Resource::Mesh::MeshData const& mesh)
+{
+	cml::vec3f min (1e30f, 1e30f, 1e30f);
+	cml::vec3f max (-1e30f, -1e30f, -1e30f);
+	for (size_t i = 0; i + 2 < mesh.vertexData.size (); i += 8)
+	{
+		cml::vec3f pos (mesh.vertexData[i], mesh.vertexData[i + 1], mesh.vertexData[i + 2]);
+		min = cml::vec3f (std::min (min.x, pos.x), std::min (min.y, pos.y), std::min (min.z, pos.z));
+		max = cml::vec3f (std::max (max.x, pos.x), std::max (max.y, pos.y), std::max (max.z, pos.z));
+	}
+	cml::vec3f extent = max - min;
+	return Bounds{ (min + max) * 0.5f, 0.5f * std::sqrt (extent.x * extent.x + extent.y * extent.y + extent.z * extent.z) };
+}
+} // namespace
+
+void Scene::load_gltf (std::filesystem::path const& path)
+{
+	using Resource::Material::DataMember;
+
+	auto gltf = gltf::parse_gltf_file (path.string ());
+	if (!gltf || gltf->scenes.empty ()) return;
+	auto buffers = gltf::load_buffers (*gltf, path.parent_path ());
+	if (!buffers) return;
+
+	// one model per mesh, shared by every node that draws it
+	std::vector<ModelID> models (gltf->meshes.size (), -1);
+	std::vector<Bounds> bounds (gltf->meshes.size ());
+	for (uint32_t m = 0; m < gltf->meshes.size (); m++)
+	{
+		auto mesh = gltf::load_mesh (*gltf, *buffers, m);
+		if (!mesh)
+		{
+			Log.warn ("Skipping mesh {} of {}, it has no float triangle list", m, path.string ());
+			continue;
+		}
+		bounds[m] = bounds_of (*mesh);
+		models[m] = renderer.get_models ().create_model (*mesh);
+		gltf_models.push_back (models[m]);
+	}
+
+	uint32_t scene = gltf->display_scene >= 0 ? static_cast<uint32_t> (gltf->display_scene) : 0;
+	auto nodes = transforms.add_gltf_scene (*gltf, scene);
+	for (size_t n = 0; n < gltf->nodes.size (); n++)
+	{
+		auto& node = gltf->nodes[n];
+		if (nodes[n] == NoParent || !node.mesh || *node.mesh >= models.size () || models[*node.mesh] == -1)
+			continue;
+
+		// load_mesh reads the first triangle list, so does the material
+		auto& primitives = gltf->meshes[*node.mesh].primitives;
+		auto primitive = std::find_if (primitives.begin (), primitives.end (), [] (gltf::Primitive const& p) {
+			return p.mode == gltf::PrimitiveMode::TRIANGLES;
+		});
+		gltf::PBRMetallicRoughness pbr;
+		if (primitive != primitives.end () && primitive->material && *primitive->material < gltf->materials.size ())
+			pbr = gltf->materials[*primitive->material].pbrMetallicRoughness.value_or (pbr);
+
+		MeshRendererComponent mesh;
+		mesh.model = models[*node.mesh];
+		cml::vec3f albedo (pbr.baseColorFactor.x, pbr.baseColorFactor.y, pbr.baseColorFactor.z);
+		auto material = renderer.get_materials ().create_bindless_material (
+		    { DataMember{ albedo }, DataMember{ pbr.roughnessFactor }, DataMember{ pbr.metallicFactor } }, {});
+		mesh.material_index = material.value_or (Materials::DefaultMaterial);
+		auto& sphere = bounds[*node.mesh];
+		mesh.draw_id = renderer.mesh_renderer.add_mesh (
+		    mesh.model, cml::mat4f (), sphere.center, sphere.radius, mesh.material_index);
+		transforms.bind_draw (nodes[n], mesh.draw_id);
+
+		world.create (Transform{}, sphere, mesh);
+	}
+	Log.debug ("Loaded {} with {} nodes", path.string (), gltf->nodes.size ());
+}
+
+std::optional<float> Scene::ground_height (float x, float z)
+{
+	PROFILE_SCOPE ("Scene::ground_height");
+	renderer.mesh_renderer.fill_bounds (ground_bounds);
+	size_t count = ground_bounds.size ();
+	bool rebuild = count != ground_boxes.size ();
+	ground_boxes.resize (count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		cml::vec3f center = ground_bounds.get_center (i);
+		cml::vec3f extent = ground_bounds.get_extent (i);
+		ground_boxes[i] = AABB{ center - extent, center + extent };
+	}
+	if (rebuild)
+		ground_bvh.build (thread_pool, ground_boxes);
+	else if (count > 0)
+		ground_bvh.refit (ground_boxes);
+
+	std::optional<float> height = ground_bvh.height_at (x, z);
+	if (renderer.terrain_renderer.has_terrain ())
+	{
+		float terrain = renderer.terrain_renderer.get_height (x, z);
+		height = height ? std::max (*height, terrain) : terrain;
+	}
+	return height;
 }
 
 void Scene::update ()
 {
+	PROFILE_SCOPE ("Scene::update");
 	double deltaTime = time.delta_time ();
 
 	player.update (static_cast<float> (deltaTime));
+	if (walk_on_ground)
+	{
+		cml::vec3f pos = player.position ();
+		auto ground = ground_height (pos.x, pos.z);
+		if (ground && pos.y < *ground + eye_height) player.set_position (cml::vec3f (pos.x, *ground + eye_height, pos.z));
+	}
 	auto cam = renderer.render_cameras.get_camera_data (main_camera);
 	cam.set_position (player.position ());
 	cam.set_rotation (player.rotation ());
 	renderer.render_cameras.set_camera_data (main_camera, cam);
+
+	systems.run (world, thread_pool);
+	transforms.update (thread_pool, &renderer.mesh_renderer);
+
+	std::vector<DirectionalLight> directional_lights;
+	std::vector<PointLight> point_lights;
+	std::vector<SpotLight> spot_lights;
+	world.each<Transform, LightComponent> ([&] (ecs::Entity, Transform& transform, LightComponent& light) {
+		switch (light.type)
+		{
+			case LightType::point:
+				point_lights.push_back (PointLight{ transform.position, light.range, light.color, light.intensity });
+				break;
+			case LightType::spot:
+			{
+				SpotLight spot;
+				spot.position = transform.position;
+				spot.range = light.range;
+				spot.direction = light.direction;
+				spot.cos_inner = std::cos (light.inner_angle);
+				spot.cos_outer = std::cos (std::max (light.outer_angle, light.inner_angle));
+				spot.color = light.color;
+				spot.intensity = light.intensity;
+				spot_lights.push_back (spot);
+				break;
+			}
+			case LightType::directional:
+			{
+				DirectionalLight directional;
+				directional.direction = light.direction * -1.f; // towards the light
+				directional.intensity = light.intensity;
+				directional.color = light.color;
+				directional_lights.push_back (directional);
+				break;
+			}
+		}
+	});
+	renderer.lighting.set_directional_lights (std::move (directional_lights));
+	renderer.lighting.set_point_lights (std::move (point_lights));
+	renderer.lighting.set_spot_lights (std::move (spot_lights));
 }
 
 // Scene::Scene (job::ThreadPool& thread_pool,
@@ -1,8 +1,19 @@
 #pragma once
 
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "rendering/Culling.h"
 #include "rendering/ViewCamera.h"
 
+#include "BVH.h"
+
+#include "Component.h"
+#include "ECS.h"
 #include "PlayerController.h"
+#include "SystemScheduler.h"
+#include "TransformHierarchy.h"
 
 namespace job
 {
@@ -27,6 +38,10 @@ class Scene
 	    Input::InputDirector const& input,
 	    Resource::Resources& resourceMan,
 	    VulkanRenderer& renderer);
+	~Scene ();
+
+	Scene (Scene const& other) = delete;
+	Scene& operator= (Scene const& other) = delete;
 
 	void update ();
 
@@ -37,10 +52,34 @@ class Scene
 	Resource::Resources& resources;
 	VulkanRenderer& renderer;
 
+	// a row of sphere entities going from rough dielectric to smooth metal, lit by orbiting lights
+	ModelID sphere_model = -1;
+	void create_material_spheres ();
+	void create_orbiting_lights ();
+
+	// instantiates the default scene of every .gltf in assets/gltf, the transform hierarchy places its meshes
+	std::vector<ModelID> gltf_models;
+	void load_gltf_scenes ();
+	void load_gltf (std::filesystem::path const& path);
+
+	// the mesh draws' boxes, refit every frame and rebuilt when draws come or go
+	CullingBounds ground_bounds;
+	std::vector<AABB> ground_boxes;
+	BVH ground_bvh;
+	// highest of the terrain and the mesh boxes below (x, z)
+	std::optional<float> ground_height (float x, float z);
+
 	public:
 	PlayerController player;
+	// keeps the player's eyes above the terrain and the meshes instead of flying
+	bool walk_on_ground = false;
+	float eye_height = 1.8f;
 
 	ViewCameraID main_camera;
+
+	ecs::World world;
+	ecs::SystemScheduler systems;
+	TransformHierarchy transforms;
 };
 
 
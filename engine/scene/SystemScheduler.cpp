@@ -0,0 +1,68 @@
+#include "SystemScheduler.h"
+
+#include <algorithm>
+
+#include "core/Profiler.h"
+
+namespace ecs
+{
+void SystemScheduler::add_system (std::string name, ComponentMask reads, ComponentMask writes, SystemFunc fn)
+{
+	char const* profile_name = Prof.intern (name);
+	systems.push_back (System{ std::move (name), profile_name, reads, writes, std::move (fn) });
+	stages_dirty = true;
+}
+
+bool SystemScheduler::conflicts (System const& a, System const& b)
+{
+	return (a.writes & (b.reads | b.writes)).any () || (b.writes & a.reads).any ();
+}
+
+void SystemScheduler::build_stages ()
+{
+	stages.clear ();
+	std::vector<size_t> system_stage (systems.size ());
+	for (size_t i = 0; i < systems.size (); i++)
+	{
+		// a system has to run after every earlier system it conflicts with
+		size_t stage = 0;
+		for (size_t j = 0; j < i; j++)
+		{
+			if (conflicts (systems[i], systems[j])) stage = std::max (stage, system_stage[j] + 1);
+		}
+		system_stage[i] = stage;
+		if (stages.size () <= stage) stages.resize (stage + 1);
+		stages[stage].push_back (i);
+	}
+	stages_dirty = false;
+}
+
+std::vector<std::vector<size_t>> const& SystemScheduler::get_stages ()
+{
+	if (stages_dirty) build_stages ();
+	return stages;
+}
+
+void SystemScheduler::run_system (System& system, World& world, job::ThreadPool& pool)
+{
+	ProfileScope scope (system.profile_name);
+	system.fn (world, pool);
+}
+
+void SystemScheduler::run (World& world, job::ThreadPool& pool)
+{
+	PROFILE_SCOPE ("SystemScheduler::run");
+	for (auto& stage : get_stages ())
+	{
+		if (stage.size () == 1)
+		{
+			run_system (systems[stage[0]], world, pool);
+			continue;
+		}
+		job::parallel_for (pool, stage.size (), 1, [&] (size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+				run_system (systems[stage[i]], world, pool);
+		});
+	}
+}
+} // namespace ecs
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ECS.h"
+
+namespace ecs
+{
+// Runs systems in registration order, except that systems whose declared component access doesn't
+// conflict are grouped into the same stage and run in parallel on the thread pool. Two systems
+// conflict when either writes a component the other reads or writes.
+//
+// Systems may only touch the components they declare and must not create or destroy entities.
+class SystemScheduler
+{
+	public:
+	using SystemFunc = std::function<void (World& world, job::ThreadPool& pool)>;
+
+	void add_system (std::string name, ComponentMask reads, ComponentMask writes, SystemFunc fn);
+
+	template <typename... Ts> static ComponentMask access () { return component_mask<Ts...> (); }
+
+	void run (World& world, job::ThreadPool& pool);
+
+	// indices into the registration order, rebuilt lazily after add_system
+	std::vector<std::vector<size_t>> const& get_stages ();
+
+	private:
+	struct System
+	{
+		std::string name;
+		char const* profile_name;
+		ComponentMask reads;
+		ComponentMask writes;
+		SystemFunc fn;
+	};
+	std::vector<System> systems;
+	std::vector<std::vector<size_t>> stages;
+	bool stages_dirty = false;
+
+	static bool conflicts (System const& a, System const& b);
+	void build_stages ();
+	void run_system (System& system, World& world, job::ThreadPool& pool);
+};
+} // namespace ecs
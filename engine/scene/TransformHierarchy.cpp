@@ -0,0 +1,240 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define TRANSFORM_USE_SSE 1
+#include <xmmintrin.h>
+#endif
+
+#include "core/JobSystem.h"
+#include "core/Profiler.h"
+
+static_assert (sizeof (cml::mat4f) == 16 * sizeof (float), "matrices are treated as 16 column major floats");
+
+namespace
+{
+// out = a * b, all column major. out may not alias a or b.
+void mul_mat4 (float const* a, float const* b, float* out)
+{
+#if defined(TRANSFORM_USE_SSE)
+	__m128 a0 = _mm_loadu_ps (a + 0);
+	__m128 a1 = _mm_loadu_ps (a + 4);
+	__m128 a2 = _mm_loadu_ps (a + 8);
+	__m128 a3 = _mm_loadu_ps (a + 12);
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 r = _mm_mul_ps (a0, _mm_set1_ps (b[c * 4 + 0]));
+		r = _mm_add_ps (r, _mm_mul_ps (a1, _mm_set1_ps (b[c * 4 + 1])));
+		r = _mm_add_ps (r, _mm_mul_ps (a2, _mm_set1_ps (b[c * 4 + 2])));
+		r = _mm_add_ps (r, _mm_mul_ps (a3, _mm_set1_ps (b[c * 4 + 3])));
+		_mm_storeu_ps (out + c * 4, r);
+	}
+#else
+	for (int c = 0; c < 4; c++)
+		for (int r = 0; r < 4; r++)
+			out[c * 4 + r] = a[0 * 4 + r] * b[c * 4 + 0] + a[1 * 4 + r] * b[c * 4 + 1] +
+			                 a[2 * 4 + r] * b[c * 4 + 2] + a[3 * 4 + r] * b[c * 4 + 3];
+#endif
+}
+
+float const* floats (cml::mat4f const& m) { return reinterpret_cast<float const*> (&m); }
+float* floats (cml::mat4f& m) { return reinterpret_cast<float*> (&m); }
+
+// translation * rotation * scale
+cml::mat4f compose_trs (cml::vec3f t, cml::quatf q, cml::vec3f s)
+{
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	cml::mat4f m;
+	float* f = floats (m);
+	f[0] = (1.f - 2.f * (yy + zz)) * s.x;
+	f[1] = (2.f * (xy + wz)) * s.x;
+	f[2] = (2.f * (xz - wy)) * s.x;
+	f[3] = 0.f;
+	f[4] = (2.f * (xy - wz)) * s.y;
+	f[5] = (1.f - 2.f * (xx + zz)) * s.y;
+	f[6] = (2.f * (yz + wx)) * s.y;
+	f[7] = 0.f;
+	f[8] = (2.f * (xz + wy)) * s.z;
+	f[9] = (2.f * (yz - wx)) * s.z;
+	f[10] = (1.f - 2.f * (xx + yy)) * s.z;
+	f[11] = 0.f;
+	f[12] = t.x;
+	f[13] = t.y;
+	f[14] = t.z;
+	f[15] = 1.f;
+	return m;
+}
+
+// levels smaller than this run on the calling thread
+const size_t ParallelLevelThreshold = 1024;
+const size_t NodeGrainSize = 256;
+} // namespace
+
+TransformID TransformHierarchy::add_node (TransformID parent_id, cml::vec3f position, cml::quatf rotation, cml::vec3f scale)
+{
+	TransformID id = static_cast<TransformID> (index_of.size ());
+	uint32_t index = static_cast<uint32_t> (parent.size ());
+	uint32_t parent_index = parent_id == NoParent ? NoParent : index_of.at (parent_id);
+	uint32_t depth = parent_id == NoParent ? 0 : depth_of[parent_id] + 1;
+
+	// appending keeps the depth order as long as nothing shallower than the last node is added
+	if (!id_of.empty () && depth < depth_of[id_of.back ()]) needs_sort = true;
+
+	parent.push_back (parent_index);
+	local.push_back (compose_trs (position, rotation, scale));
+	world.push_back (local.back ());
+	dirty.push_back (1);
+	changed.push_back (0);
+	draw.push_back (UINT32_MAX);
+	id_of.push_back (id);
+	index_of.push_back (index);
+	depth_of.push_back (depth);
+
+	if (!needs_sort)
+	{
+		if (level_begin.size () <= depth + 1) level_begin.resize (depth + 2, index);
+		level_begin[depth + 1] = index + 1;
+	}
+	any_dirty = true;
+	return id;
+}
+
+std::vector<TransformID> TransformHierarchy::add_gltf_scene (gltf::RawGLTF const& gltf, uint32_t scene, TransformID root_parent)
+{
+	std::vector<TransformID> ids (gltf.nodes.size (), NoParent);
+	if (scene >= gltf.scenes.size ()) return ids;
+
+	// breadth first, so adding nodes in visit order keeps the arrays sorted
+	std::vector<std::pair<uint32_t, TransformID>> queue;
+	for (auto node : gltf.scenes[scene].nodes)
+		queue.push_back ({ node, root_parent });
+
+	for (size_t head = 0; head < queue.size (); head++)
+	{
+		auto [node_index, parent_id] = queue[head];
+		if (node_index >= gltf.nodes.size () || ids[node_index] != NoParent) continue;
+
+		auto& node = gltf.nodes[node_index];
+		TransformID id = add_node (parent_id);
+		if (auto trs = std::get_if<gltf::TRS> (&node.transform))
+			set_local (id, trs->translation, trs->rotation, trs->scale);
+		else
+			set_local (id, std::get<cml::mat4f> (node.transform));
+		ids[node_index] = id;
+
+		for (auto child : node.children)
+			queue.push_back ({ child, id });
+	}
+	return ids;
+}
+
+void TransformHierarchy::set_local (TransformID id, cml::vec3f position, cml::quatf rotation, cml::vec3f scale)
+{
+	set_local (id, compose_trs (position, rotation, scale));
+}
+
+void TransformHierarchy::set_local (TransformID id, cml::mat4f const& matrix)
+{
+	uint32_t index = index_of.at (id);
+	local[index] = matrix;
+	dirty[index] = 1;
+	any_dirty = true;
+}
+
+void TransformHierarchy::bind_draw (TransformID id, MeshDrawID draw_id)
+{
+	uint32_t index = index_of.at (id);
+	draw[index] = draw_id;
+	dirty[index] = 1;
+	any_dirty = true;
+}
+
+void TransformHierarchy::sort_by_depth ()
+{
+	PROFILE_SCOPE ("TransformHierarchy::sort_by_depth");
+	size_t count = parent.size ();
+
+	// counting sort on depth, stable so siblings keep their insertion order
+	uint32_t max_depth = 0;
+	for (size_t i = 0; i < count; i++)
+		max_depth = std::max (max_depth, depth_of[id_of[i]]);
+	level_begin.assign (max_depth + 2, 0);
+	for (size_t i = 0; i < count; i++)
+		level_begin[depth_of[id_of[i]] + 1]++;
+	for (size_t d = 1; d < level_begin.size (); d++)
+		level_begin[d] += level_begin[d - 1];
+
+	std::vector<uint32_t> new_index (count);
+	std::vector<uint32_t> cursor (level_begin.begin (), level_begin.end () - 1);
+	for (size_t i = 0; i < count; i++)
+		new_index[i] = cursor[depth_of[id_of[i]]]++;
+
+	auto permute = [&] (auto& values) {
+		std::remove_reference_t<decltype (values)> sorted (values.size ());
+		for (size_t i = 0; i < count; i++)
+			sorted[new_index[i]] = values[i];
+		values.swap (sorted);
+	};
+	permute (local);
+	permute (world);
+	permute (dirty);
+	permute (changed);
+	permute (draw);
+	permute (id_of);
+	permute (parent);
+	for (auto& p : parent)
+		if (p != NoParent) p = new_index[p];
+	for (size_t i = 0; i < count; i++)
+		index_of[id_of[i]] = static_cast<uint32_t> (i);
+
+	needs_sort = false;
+}
+
+void TransformHierarchy::update (job::ThreadPool& pool, MeshRenderer* mesh_renderer)
+{
+	PROFILE_SCOPE ("TransformHierarchy::update");
+	if (needs_sort) sort_by_depth ();
+	if (!any_dirty)
+	{
+		std::fill (changed.begin (), changed.end (), 0);
+		return;
+	}
+
+	auto update_range = [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			uint32_t p = parent[i];
+			changed[i] = dirty[i] || (p != NoParent && changed[p]);
+			dirty[i] = 0;
+			if (!changed[i]) continue;
+
+			if (p == NoParent)
+				world[i] = local[i];
+			else
+				mul_mat4 (floats (world[p]), floats (local[i]), floats (world[i]));
+
+			if (mesh_renderer != nullptr && draw[i] != UINT32_MAX) mesh_renderer->set_transform (draw[i], world[i]);
+		}
+	};
+
+	for (size_t d = 0; d + 1 < level_begin.size (); d++)
+	{
+		size_t begin = level_begin[d];
+		size_t end = level_begin[d + 1];
+		if (end - begin < ParallelLevelThreshold)
+		{
+			update_range (begin, end);
+			continue;
+		}
+		job::parallel_for (pool, end - begin, NodeGrainSize, [&] (size_t range_begin, size_t range_end) {
+			update_range (begin + range_begin, begin + range_end);
+		});
+	}
+
+	any_dirty = false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "rendering/renderers/MeshRenderer.h"
+
+#include "resources/gltf.h"
+
+namespace job
+{
+class ThreadPool;
+}
+
+using TransformID = uint32_t;
+constexpr TransformID NoParent = UINT32_MAX;
+
+// Parent/child transforms kept in SoA arrays sorted by depth, so every parent comes before its
+// children and all nodes of one depth form a contiguous range. update () walks the levels in
+// order and processes each level in parallel: nodes of the same depth only read their parent's
+// world matrix, which the previous level already finished.
+//
+// Only nodes that changed since the last update, and their descendants, are recomputed. Nodes
+// bound to a mesh draw hand their world matrix to MeshRenderer::set_transform, which writes it
+// straight into the mapped buffer the GPU draw data is updated from.
+class TransformHierarchy
+{
+	public:
+	TransformID add_node (TransformID parent_id = NoParent,
+	    cml::vec3f position = cml::vec3f::zero,
+	    cml::quatf rotation = cml::quatf::identity,
+	    cml::vec3f scale = cml::vec3f::one);
+
+	// adds every node reachable from the scene's roots, returns the ids indexed by glTF node index
+	std::vector<TransformID> add_gltf_scene (gltf::RawGLTF const& gltf, uint32_t scene, TransformID root_parent = NoParent);
+
+	void set_local (TransformID id, cml::vec3f position, cml::quatf rotation, cml::vec3f scale);
+	void set_local (TransformID id, cml::mat4f const& matrix);
+
+	// MeshDrawID to receive the node's world matrix, or UINT32_MAX to unbind
+	void bind_draw (TransformID id, MeshDrawID draw);
+
+	cml::mat4f const& get_world (TransformID id) const { return world[index_of[id]]; }
+	bool changed_last_update (TransformID id) const { return changed[index_of[id]] != 0; }
+	size_t node_count () const { return parent.size (); }
+
+	void update (job::ThreadPool& pool, MeshRenderer* mesh_renderer = nullptr);
+
+	private:
+	// per node, in depth order
+	std::vector<uint32_t> parent; // index, not id
+	std::vector<cml::mat4f> local;
+	std::vector<cml::mat4f> world;
+	std::vector<uint8_t> dirty; // local changed
+	std::vector<uint8_t> changed; // world recomputed in the last update
+	std::vector<MeshDrawID> draw;
+	std::vector<TransformID> id_of;
+
+	std::vector<uint32_t> index_of; // by id
+	std::vector<uint32_t> depth_of; // by id, only used while resorting
+	std::vector<uint32_t> level_begin; // level d covers [level_begin[d], level_begin[d + 1])
+	bool needs_sort = false;
+	bool any_dirty = false;
+
+	void sort_by_depth ();
+};
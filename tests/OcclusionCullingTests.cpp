@@ -0,0 +1,161 @@
+#include <cstdio>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "core/JobSystem.h"
+#include "rendering/Culling.h"
+#include "rendering/OcclusionCulling.h"
+#include "rendering/ViewCamera.h"
+
+namespace
+{
+int failures = 0;
+
+#define CHECK(condition)                                                               \
+	do                                                                                 \
+	{                                                                                  \
+		if (!(condition))                                                              \
+		{                                                                              \
+			std::printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++;                                                                \
+		}                                                                              \
+	} while (false)
+
+const cml::vec3f Forward = cml::vec3f::forward;
+const cml::vec3f Up = cml::vec3f::up;
+const cml::vec3f Right = cml::normalize (cml::cross (Forward, Up));
+
+// the same camera the renderer culls with, at eye, looking along forward
+cml::mat4f camera_proj_view (cml::vec3f eye)
+{
+	ViewCameraData camera;
+	camera.Setup (CameraType::perspective, eye, cml::quatf (1, 0, 0, 0));
+	camera.set_fov (1.f);
+	camera.set_aspect_ratio (320.f / 192.f);
+	camera.set_clip_near (0.1f);
+	camera.set_clip_far (1000.f);
+	return camera.get_proj_view_mat ();
+}
+
+// a square facing the camera
+void add_wall (OcclusionCuller& occlusion, cml::vec3f center, float half_size)
+{
+	cml::vec3f r = Right * half_size;
+	cml::vec3f u = Up * half_size;
+	std::vector<cml::vec3f> positions = { center - r - u, center + r - u, center + r + u, center - r + u };
+	std::vector<uint32_t> indices = { 0, 1, 2, 0, 2, 3 };
+	occlusion.add_occluder (positions, indices);
+}
+
+bool box_visible (OcclusionCuller const& occlusion, cml::vec3f center, float half_size)
+{
+	cml::vec3f extent (half_size, half_size, half_size);
+	return occlusion.is_visible (center - extent, center + extent);
+}
+
+void wall_hides_what_is_behind_it (job::ThreadPool& pool)
+{
+	OcclusionCuller occlusion;
+	occlusion.begin_frame (camera_proj_view (cml::vec3f (0, 0, 0)));
+	add_wall (occlusion, Forward * 10.f, 5.f);
+	occlusion.render (pool);
+
+	CHECK (!box_visible (occlusion, Forward * 20.f, 1.f));
+	CHECK (box_visible (occlusion, Forward * 5.f, 1.f));
+	// behind the wall's plane but past its edge
+	CHECK (box_visible (occlusion, Forward * 20.f + Right * 14.f, 1.f));
+	// big enough to stick out on every side
+	CHECK (box_visible (occlusion, Forward * 20.f, 15.f));
+}
+
+void nothing_is_hidden_without_occluders (job::ThreadPool& pool)
+{
+	OcclusionCuller occlusion;
+	occlusion.begin_frame (camera_proj_view (cml::vec3f (0, 0, 0)));
+	occlusion.render (pool);
+
+	CHECK (box_visible (occlusion, Forward * 20.f, 1.f));
+	CHECK (box_visible (occlusion, Forward * 500.f, 1.f));
+	for (float depth : occlusion.get_depth ())
+		CHECK (depth == 0.f);
+}
+
+void triangles_crossing_the_near_plane_are_clipped (job::ThreadPool& pool)
+{
+	OcclusionCuller occlusion;
+	occlusion.begin_frame (camera_proj_view (cml::vec3f (0, 0, 0)));
+	// a floor reaching from behind the camera to far in front of it
+	cml::vec3f floor = Up * -2.f;
+	std::vector<cml::vec3f> positions = {
+		floor + Forward * -20.f - Right * 100.f, floor + Forward * -20.f + Right * 100.f, floor + Forward * 200.f
+	};
+	occlusion.add_occluder (positions, { 0, 1, 2 });
+	occlusion.render (pool);
+
+	CHECK (!box_visible (occlusion, Forward * 10.f - Up * 5.f, 1.f));
+	CHECK (box_visible (occlusion, Forward * 10.f, 1.f));
+}
+
+void rendering_is_deterministic (job::ThreadPool& pool)
+{
+	auto render = [&] () {
+		OcclusionCuller occlusion;
+		occlusion.begin_frame (camera_proj_view (cml::vec3f (0, 0, 0)));
+		for (int i = 0; i < 32; i++)
+			add_wall (occlusion, Forward * (5.f + i) + Right * (i % 7 - 3.f) * 2.f + Up * (i % 5 - 2.f), 1.5f);
+		occlusion.render (pool);
+		return occlusion.get_depth ();
+	};
+	CHECK (render () == render ());
+}
+
+void filter_keeps_the_order (job::ThreadPool& pool)
+{
+	OcclusionCuller occlusion;
+	occlusion.begin_frame (camera_proj_view (cml::vec3f (0, 0, 0)));
+	add_wall (occlusion, Forward * 10.f, 5.f);
+	occlusion.render (pool);
+
+	CullingBounds bounds;
+	cml::vec3f extent (1.f, 1.f, 1.f);
+	cml::vec3f front = Forward * 5.f;
+	cml::vec3f hidden = Forward * 20.f;
+	cml::vec3f beside = Forward * 20.f + Right * 14.f;
+	bounds.add_aabb (front - extent, front + extent);
+	bounds.add_aabb (hidden - extent, hidden + extent);
+	bounds.add_aabb (beside - extent, beside + extent);
+
+	std::vector<uint32_t> indices = { 2, 1, 0, 1 };
+	occlusion.filter (pool, bounds, indices);
+	CHECK ((indices == std::vector<uint32_t>{ 2, 0 }));
+}
+
+void heightfield_hides_what_is_below_it (job::ThreadPool& pool)
+{
+	OcclusionCuller occlusion;
+	occlusion.begin_frame (camera_proj_view (cml::vec3f (0, 2, 0)));
+	uint32_t resolution = 9;
+	std::vector<float> heights (resolution * resolution, 0.f);
+	occlusion.add_heightfield_occluder (heights, resolution, cml::vec3f (-100.f, 0.f, -100.f), 200.f);
+	occlusion.render (pool);
+
+	CHECK (!box_visible (occlusion, Forward * 20.f - Up * 4.f, 1.f));
+	CHECK (box_visible (occlusion, Forward * 20.f + Up * 1.f, 1.f));
+}
+} // namespace
+
+int main ()
+{
+	job::ThreadPool pool;
+
+	wall_hides_what_is_behind_it (pool);
+	nothing_is_hidden_without_occluders (pool);
+	triangles_crossing_the_near_plane_are_clipped (pool);
+	rendering_is_deterministic (pool);
+	filter_keeps_the_order (pool);
+	heightfield_hides_what_is_below_it (pool);
+
+	if (failures == 0) std::printf ("all occlusion culling checks passed\n");
+	return failures;
+}
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "cml/cml.h"
+
+#include "core/JobSystem.h"
+#include "rendering/Renderer.h"
+#include "resources/Resource.h"
+
+#include "GraphCodegen.h"
+#include "InternalGraph.h"
+
+namespace
+{
+int failures = 0;
+
+#define CHECK(condition)                                                               \
+	do                                                                                 \
+	{                                                                                  \
+		if (!(condition))                                                              \
+		{                                                                              \
+			std::printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++;                                                                \
+		}                                                                              \
+	} while (false)
+
+// ctest reads this as skipped, for machines without a Vulkan device
+constexpr int SkipReturnCode = 77;
+
+// the graph shader and GraphUser only differ by float rounding in the noise
+constexpr double MaxError = 1e-3;
+constexpr double MeanError = 1e-4;
+
+// VulkanDevice can't fail gracefully, so look for a device before building the renderer
+bool has_vulkan_device ()
+{
+	VkApplicationInfo app_info{};
+	app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	app_info.apiVersion = VK_API_VERSION_1_1;
+	VkInstanceCreateInfo create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	create_info.pApplicationInfo = &app_info;
+
+	VkInstance instance = VK_NULL_HANDLE;
+	if (vkCreateInstance (&create_info, nullptr, &instance) != VK_SUCCESS) return false;
+	uint32_t device_count = 0;
+	vkEnumeratePhysicalDevices (instance, &device_count, nullptr);
+	vkDestroyInstance (instance, nullptr);
+	return device_count > 0;
+}
+
+// fractal simplex noise, scaled up, with a constant added
+InternalGraph::GraphPrototype seeded_graph (int seed)
+{
+	using namespace InternalGraph;
+	GraphPrototype graph;
+	NodeID output = graph.AddNode (NodeType::Output);
+	NodeID noise = graph.AddNode (NodeType::SimplexNoise);
+	NodeID height = graph.AddNode (NodeType::ConstantFloat);
+	NodeID multiply = graph.AddNode (NodeType::Multiplication);
+	NodeID offset = graph.AddNode (NodeType::ConstantFloat);
+	NodeID add = graph.AddNode (NodeType::Addition);
+
+	auto& noise_node = graph.GetNodeByID (noise);
+	noise_node.SetLinkValue (0, seed);
+	noise_node.SetLinkValue (1, 0.01f); // frequency
+	noise_node.SetLinkValue (2, 4);     // octaves
+	noise_node.SetLinkValue (3, 0.5f);  // gain
+	noise_node.SetLinkValue (4, 0);     // FBM
+
+	graph.GetNodeByID (height).SetLinkValue (0, 40.f);
+	graph.GetNodeByID (offset).SetLinkValue (0, 10.f);
+	graph.GetNodeByID (multiply).SetLinkInput (0, noise);
+	graph.GetNodeByID (multiply).SetLinkInput (1, height);
+	graph.GetNodeByID (add).SetLinkInput (0, multiply);
+	graph.GetNodeByID (add).SetLinkInput (1, offset);
+	graph.GetNodeByID (output).SetLinkInput (0, add);
+	return graph;
+}
+
+void gpu_heights_match_graph_user (job::ThreadPool& pool, TerrainRenderer& terrain)
+{
+	auto graph = seeded_graph (1337);
+	auto shader = InternalGraph::generate_compute_shader (graph);
+	CHECK (shader.has_value ());
+	if (!shader) return;
+	bool generated = terrain.generate_on_gpu (shader.value ());
+	CHECK (generated);
+	if (!generated) return;
+	auto gpu_heights = terrain.read_back_heights ();
+
+	// tiles are laid out like TerrainQuadtree::get_heights, neighbours share their edge samples
+	auto const& settings = terrain.get_quadtree ().get_settings ();
+	uint32_t tile_size = settings.tile_samples * settings.tile_samples;
+	uint32_t tile_count = settings.tile_count * settings.tile_count;
+	CHECK (gpu_heights.size () == static_cast<size_t> (tile_size) * tile_count);
+	if (gpu_heights.size () != static_cast<size_t> (tile_size) * tile_count) return;
+
+	std::vector<double> tile_max (tile_count, 0.0);
+	std::vector<double> tile_sum (tile_count, 0.0);
+	int32_t step = static_cast<int32_t> (settings.tile_samples - 1);
+	job::parallel_for (pool, tile_count, 1, [&] (size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			InternalGraph::GraphUser user (graph,
+			    1337,
+			    static_cast<int> (settings.tile_samples),
+			    cml::vec2<int32_t> (static_cast<int32_t> (i % settings.tile_count) * step,
+			        static_cast<int32_t> (i / settings.tile_count) * step),
+			    1.0f,
+			    1.0f);
+			auto& cpu_heights = user.get_heightMap ();
+			for (uint32_t s = 0; s < tile_size; s++)
+			{
+				double error = std::abs (static_cast<double> (cpu_heights[s]) - gpu_heights[i * tile_size + s]);
+				tile_max[i] = std::max (tile_max[i], error);
+				tile_sum[i] += error;
+			}
+		}
+	});
+
+	double max_error = *std::max_element (std::begin (tile_max), std::end (tile_max));
+	double sum = 0.0;
+	for (double tile : tile_sum)
+		sum += tile;
+	double mean_error = sum / (static_cast<double> (tile_size) * tile_count);
+	std::printf ("terrain graph GPU against CPU: max error %.6f, mean error %.6f\n", max_error, mean_error);
+	CHECK (max_error < MaxError);
+	CHECK (mean_error < MeanError);
+}
+} // namespace
+
+int main ()
+{
+	if (!has_vulkan_device ())
+	{
+		std::printf ("no Vulkan device, skipping the terrain graph GPU checks\n");
+		return SkipReturnCode;
+	}
+
+	job::ThreadPool pool;
+	Resource::Resources resources (pool);
+	VulkanRenderer renderer (false, pool, VkExtent2D{ 320, 192 }, resources);
+
+	gpu_heights_match_graph_user (pool, renderer.terrain_renderer);
+
+	if (failures == 0) std::printf ("all terrain graph GPU checks passed\n");
+	return failures;
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "cml/cml.h"
+
+#include "rendering/Culling.h"
+#include "rendering/TerrainLOD.h"
+#include "rendering/ViewCamera.h"
+
+namespace
+{
+int failures = 0;
+
+#define CHECK(condition)                                                               \
+	do                                                                                 \
+	{                                                                                  \
+		if (!(condition))                                                              \
+		{                                                                              \
+			std::printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			failures++;                                                                \
+		}                                                                              \
+	} while (false)
+
+const cml::vec3f Forward = cml::vec3f::forward;
+
+// small enough to select in no time, 16 lod 0 nodes of 64 m along each side
+TerrainSettings test_settings ()
+{
+	TerrainSettings settings;
+	settings.origin_x = -512.f;
+	settings.origin_z = -512.f;
+	settings.world_size = 1024.f;
+	settings.height_scale = 100.f;
+	settings.lod_count = 5;
+	settings.lod_0_range = 160.f;
+	settings.tile_count = 2;
+	settings.tile_samples = 33;
+	return settings;
+}
+
+void fill_hills (TerrainQuadtree& terrain)
+{
+	auto const& settings = terrain.get_settings ();
+	uint32_t samples = settings.tile_samples;
+	uint32_t step = samples - 1;
+	for (uint32_t tile_z = 0; tile_z < settings.tile_count; tile_z++)
+		for (uint32_t tile_x = 0; tile_x < settings.tile_count; tile_x++)
+		{
+			std::vector<float> heights;
+			for (uint32_t x = 0; x < samples; x++)
+				for (uint32_t z = 0; z < samples; z++)
+				{
+					float gx = static_cast<float> (tile_x * step + x);
+					float gz = static_cast<float> (tile_z * step + z);
+					heights.push_back (0.5f + 0.4f * std::sin (gx * 0.2f) * std::cos (gz * 0.15f));
+				}
+			terrain.set_tile (tile_x, tile_z, heights);
+		}
+	terrain.update_bounds ();
+}
+
+// planes far enough out to keep every node
+Frustum everything ()
+{
+	Frustum frustum;
+	frustum.planes = { cml::vec4f (1, 0, 0, 1e6f),
+		cml::vec4f (-1, 0, 0, 1e6f),
+		cml::vec4f (0, 1, 0, 1e6f),
+		cml::vec4f (0, -1, 0, 1e6f),
+		cml::vec4f (0, 0, 1, 1e6f),
+		cml::vec4f (0, 0, -1, 1e6f) };
+	return frustum;
+}
+
+struct Rect
+{
+	float min_x, min_z, max_x, max_z;
+};
+
+// the part of the patch's node that quadrant q draws
+Rect quadrant_rect (TerrainPatch const& patch, uint32_t q)
+{
+	float half = patch.offset_size.z * 0.5f;
+	float x = patch.offset_size.x + static_cast<float> (q & 1) * half;
+	float z = patch.offset_size.y + static_cast<float> (q >> 1) * half;
+	return Rect{ x, z, x + half, z + half };
+}
+
+// to a rect on the flat y = 0 ground
+float distance (Rect const& rect, cml::vec3f point)
+{
+	float dx = std::max ({ rect.min_x - point.x, 0.f, point.x - rect.max_x });
+	float dz = std::max ({ rect.min_z - point.z, 0.f, point.z - rect.max_z });
+	return std::sqrt (dx * dx + point.y * point.y + dz * dz);
+}
+
+// calls fn with every selected patch and the quadrant it draws
+template <typename Fn>
+void for_each_quadrant (std::vector<TerrainPatch> const& patches, std::array<uint32_t, 4> const& quadrant_counts, Fn fn)
+{
+	size_t index = 0;
+	for (uint32_t q = 0; q < 4; q++)
+		for (uint32_t i = 0; i < quadrant_counts[q]; i++)
+			fn (patches[index++], q);
+}
+
+void settings_are_validated ()
+{
+	auto throws = [] (TerrainSettings settings) {
+		try
+		{
+			TerrainQuadtree terrain (settings);
+		}
+		catch (std::runtime_error const&)
+		{
+			return true;
+		}
+		return false;
+	};
+
+	CHECK (!throws (test_settings ()));
+	TerrainSettings short_range = test_settings ();
+	short_range.lod_0_range = 100.f; // lod 0 nodes are 64 m
+	CHECK (throws (short_range));
+	TerrainSettings odd_grid = test_settings ();
+	odd_grid.grid_resolution = 31;
+	CHECK (throws (odd_grid));
+
+	TerrainQuadtree terrain (test_settings ());
+	bool threw = false;
+	try
+	{
+		terrain.set_leaf_bounds ({ 0.f, 1.f });
+	}
+	catch (std::runtime_error const&)
+	{
+		threw = true;
+	}
+	CHECK (threw);
+}
+
+void selection_covers_the_terrain_once ()
+{
+	TerrainQuadtree terrain (test_settings ());
+	fill_hills (terrain);
+	auto const& settings = terrain.get_settings ();
+
+	std::vector<TerrainPatch> patches;
+	std::array<uint32_t, 4> quadrant_counts;
+	auto stats = terrain.select (cml::vec3f (10.f, 60.f, -30.f), everything (), patches, quadrant_counts);
+
+	CHECK (stats.patch_count == patches.size ());
+	CHECK (quadrant_counts[0] + quadrant_counts[1] + quadrant_counts[2] + quadrant_counts[3] == patches.size ());
+	CHECK (stats.culled_nodes == 0);
+
+	// every lod 0 quadrant's center has to be drawn by exactly one patch
+	uint32_t cells = 2 * (1u << (settings.lod_count - 1));
+	float cell_size = settings.world_size / static_cast<float> (cells);
+	std::vector<uint32_t> coverage (cells * cells, 0);
+	for_each_quadrant (patches, quadrant_counts, [&] (TerrainPatch const& patch, uint32_t q) {
+		Rect rect = quadrant_rect (patch, q);
+		for (uint32_t z = 0; z < cells; z++)
+			for (uint32_t x = 0; x < cells; x++)
+			{
+				float cx = settings.origin_x + (static_cast<float> (x) + 0.5f) * cell_size;
+				float cz = settings.origin_z + (static_cast<float> (z) + 0.5f) * cell_size;
+				if (cx > rect.min_x && cx < rect.max_x && cz > rect.min_z && cz < rect.max_z) coverage[z * cells + x]++;
+			}
+	});
+	bool covered_once = true;
+	for (uint32_t count : coverage)
+		covered_once = covered_once && count == 1;
+	CHECK (covered_once);
+}
+
+void levels_follow_the_ranges ()
+{
+	TerrainQuadtree terrain (test_settings ()); // flat, so the node boxes are the rects on the ground
+	auto const& settings = terrain.get_settings ();
+	cml::vec3f camera (10.f, 5.f, -30.f);
+
+	std::vector<TerrainPatch> patches;
+	std::array<uint32_t, 4> quadrant_counts;
+	terrain.select (camera, everything (), patches, quadrant_counts);
+
+	bool finest_under_camera = false;
+	for_each_quadrant (patches, quadrant_counts, [&] (TerrainPatch const& patch, uint32_t q) {
+		auto lod = static_cast<uint32_t> (patch.offset_size.w);
+		Rect rect = quadrant_rect (patch, q);
+		// a quadrant within the finer level's range would have been split
+		if (lod > 0) CHECK (distance (rect, camera) > terrain.get_range (lod - 1));
+		// and its node was only visited because it was within its own range
+		Rect node{ patch.offset_size.x,
+			patch.offset_size.y,
+			patch.offset_size.x + patch.offset_size.z,
+			patch.offset_size.y + patch.offset_size.z };
+		if (lod + 1 < settings.lod_count) CHECK (distance (node, camera) <= terrain.get_range (lod));
+		CHECK (patch.offset_size.z == terrain.get_node_size (lod));
+		// morphing to the next level ends where this level's range does
+		CHECK (patch.morph.x < patch.morph.y);
+		CHECK (patch.morph.y == terrain.get_range (lod));
+
+		if (lod == 0 && camera.x >= rect.min_x && camera.x <= rect.max_x && camera.z >= rect.min_z && camera.z <= rect.max_z)
+			finest_under_camera = true;
+	});
+	CHECK (finest_under_camera);
+}
+
+void frustum_culls_nodes_behind_the_camera ()
+{
+	TerrainQuadtree terrain (test_settings ());
+	cml::vec3f eye (0.f, 20.f, 0.f);
+
+	ViewCameraData camera;
+	camera.Setup (CameraType::perspective, eye, cml::quatf (1, 0, 0, 0));
+	camera.set_fov (1.f);
+	camera.set_aspect_ratio (16.f / 9.f);
+	camera.set_clip_near (0.1f);
+	camera.set_clip_far (2000.f);
+
+	std::vector<TerrainPatch> patches;
+	std::array<uint32_t, 4> quadrant_counts;
+	auto all = terrain.select (eye, everything (), patches, quadrant_counts);
+	auto stats = terrain.select (eye, extract_frustum (camera.get_proj_view_mat ()), patches, quadrant_counts);
+
+	CHECK (stats.culled_nodes > 0);
+	CHECK (stats.patch_count < all.patch_count);
+	CHECK (stats.patch_count > 0);
+	for_each_quadrant (patches, quadrant_counts, [&] (TerrainPatch const& patch, uint32_t q) {
+		Rect rect = quadrant_rect (patch, q);
+		// some corner of the quadrant has to be in front of the camera
+		bool in_front = false;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			float x = (c & 1) ? rect.max_x : rect.min_x;
+			float z = (c >> 1) ? rect.max_z : rect.min_z;
+			in_front = in_front || (x - eye.x) * Forward.x + (z - eye.z) * Forward.z >= 0.f;
+		}
+		CHECK (in_front);
+	});
+}
+
+void occluder_stays_below_the_terrain ()
+{
+	TerrainQuadtree terrain (test_settings ());
+	fill_hills (terrain);
+	auto const& settings = terrain.get_settings ();
+
+	uint32_t max_nodes = 4;
+	auto corners = terrain.get_occluder_heights (max_nodes);
+	auto per_side = static_cast<uint32_t> (std::lround (std::sqrt (static_cast<double> (corners.size ()))));
+	CHECK (per_side * per_side == corners.size ());
+	CHECK (per_side - 1 <= max_nodes);
+
+	// bilinear between the corners, like the rasterized heightfield
+	float spacing = settings.world_size / static_cast<float> (per_side - 1);
+	bool below = true;
+	for (uint32_t z = 0; z <= 200; z++)
+		for (uint32_t x = 0; x <= 200; x++)
+		{
+			float fx = static_cast<float> (x) / 200.f * static_cast<float> (per_side - 1);
+			float fz = static_cast<float> (z) / 200.f * static_cast<float> (per_side - 1);
+			uint32_t x0 = std::min (static_cast<uint32_t> (fx), per_side - 2);
+			uint32_t z0 = std::min (static_cast<uint32_t> (fz), per_side - 2);
+			float tx = fx - static_cast<float> (x0);
+			float tz = fz - static_cast<float> (z0);
+			float h0 = corners[z0 * per_side + x0] * (1.f - tx) + corners[z0 * per_side + x0 + 1] * tx;
+			float h1 = corners[(z0 + 1) * per_side + x0] * (1.f - tx) + corners[(z0 + 1) * per_side + x0 + 1] * tx;
+			float occluder = h0 * (1.f - tz) + h1 * tz;
+
+			float height = terrain.get_height (settings.origin_x + fx * spacing, settings.origin_z + fz * spacing);
+			below = below && occluder <= height + 1e-3f;
+		}
+	CHECK (below);
+}
+} // namespace
+
+int main ()
+{
+	settings_are_validated ();
+	selection_covers_the_terrain_once ();
+	levels_follow_the_ranges ();
+	frustum_culls_nodes_behind_the_camera ();
+	occluder_stays_below_the_terrain ();
+
+	if (failures == 0) std::printf ("all terrain lod checks passed\n");
+	return failures;
+}